@@ -0,0 +1,461 @@
+/*
+ *  autofind_benchmark.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Times the detection stage of Star::AutoFind on sample frames: the direct
+ * PSF convolution and peak search AutoFind used before StarDetector, and
+ * StarDetector with its scratch buffers allocated for each frame and reused
+ * from one frame to the next, as AutoFind does.
+ *
+ *   phd2_autofind_benchmark [-r REPEATS] [-t THREADS] FILE.fit...
+ *
+ * The frames are 8 or 16 bit FITS images, for example simimage.fit,
+ * savetest.fit and savetest2.fit from the source tree. StarDetector is timed
+ * with 1, 2, 4, ... bands of rows up to THREADS; the baseline runs on one
+ * thread, as it did.
+ */
+
+#include "image_kernels.h"
+#include "star_detect.h"
+
+#include <chrono>
+#include <math.h>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+struct Frame
+{
+    int width;
+    int height;
+    std::vector<unsigned short> px;
+};
+
+static bool CardValue(const char *card, const char *key, long *val)
+{
+    size_t const len = strlen(key);
+    if (strncmp(card, key, len) != 0 || (card[len] != ' ' && card[len] != '='))
+        return false;
+    const char *eq = (const char *) memchr(card, '=', 80);
+    if (!eq)
+        return false;
+    *val = strtol(eq + 1, NULL, 10);
+    return true;
+}
+
+// reads the primary image of a FITS file, 2 dimensional with 8 or 16 bit
+// integer pixels
+static bool ReadFits(const char *path, Frame *frame)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+
+    long bitpix = 0, naxis = 0, naxis1 = 0, naxis2 = 0, bzero = 0;
+    bool end = false;
+    char block[2880];
+
+    while (!end && fread(block, sizeof(block), 1, fp) == 1)
+    {
+        for (const char *card = block; card < block + sizeof(block); card += 80)
+        {
+            if (strncmp(card, "END ", 4) == 0)
+            {
+                end = true;
+                break;
+            }
+            CardValue(card, "BITPIX", &bitpix) || CardValue(card, "NAXIS", &naxis) ||
+                CardValue(card, "NAXIS1", &naxis1) || CardValue(card, "NAXIS2", &naxis2) ||
+                CardValue(card, "BZERO", &bzero);
+        }
+    }
+
+    if (!end || naxis != 2 || naxis1 < 1 || naxis2 < 1 || (bitpix != 8 && bitpix != 16))
+    {
+        fprintf(stderr, "%s: not a 2 dimensional 8 or 16 bit FITS image\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    frame->width = (int) naxis1;
+    frame->height = (int) naxis2;
+    size_t const npix = (size_t) naxis1 * naxis2;
+    size_t const bytes = npix * (bitpix / 8);
+    std::vector<unsigned char> data(bytes);
+    bool const ok = fread(&data[0], bytes, 1, fp) == 1;
+    fclose(fp);
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s: truncated image data\n", path);
+        return false;
+    }
+
+    frame->px.resize(npix);
+    for (size_t i = 0; i < npix; i++)
+    {
+        long v;
+        if (bitpix == 8)
+            v = data[i];
+        else
+            v = (short) ((data[2 * i] << 8) | data[2 * i + 1]);  // big-endian, signed
+        v += bzero;
+        frame->px[i] = (unsigned short) (v < 0 ? 0 : v > 65535 ? 65535 : v);
+    }
+
+    return true;
+}
+
+// the same split as RunRowBands, on std::threads
+static void RunBands(RowBandJob& job, int nbands, int y0, int y1)
+{
+    std::vector<std::thread> threads;
+    int rows = y1 - y0;
+
+    for (int i = 1; i < nbands; i++)
+    {
+        int by0 = y0 + rows * i / nbands;
+        int by1 = y0 + rows * (i + 1) / nbands;
+        threads.push_back(std::thread(&RowBandJob::Run, &job, i, by0, by1));
+    }
+
+    job.Run(0, y0, y0 + rows / nbands);
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+static const double Threshold = 0.1;  // as in AutoFind
+
+// the previous AutoFind detection, allocating its images on each call
+
+static void BaselineStats(double *mean, double *stdev, const std::vector<float>& img, int width,
+                          int left, int top, int w, int h)
+{
+    double sum = 0.0;
+    double a = 0.0;
+    double q = 0.0;
+    double k = 1.0;
+    double km1 = 0.0;
+
+    const float *p0 = &img[top * width + left];
+    for (int y = 0; y < h; y++)
+    {
+        const float *end = p0 + w;
+        for (const float *p = p0; p < end; p++)
+        {
+            double const x = (double) *p;
+            sum += x;
+            double const a0 = a;
+            a += (x - a) / k;
+            q += (x - a0) * (x - a);
+            km1 = k;
+            k += 1.0;
+        }
+        p0 += width;
+    }
+
+    *mean = sum / km1;
+    *stdev = sqrt(q / km1);
+}
+
+static void BaselinePsfConv(std::vector<float>& dst, const std::vector<float>& src, int width, int height)
+{
+    //                       A      B1     B2    C1     C2    C3     D1     D2     D3
+    const double PSF[] = { 0.906, 0.584, 0.365, .117, .049, -0.05, -.064, -.074, -.094 };
+
+    dst.assign(width * height, 0.f);
+
+    int psf_size = 4;
+
+    for (int y = psf_size; y < height - psf_size; y++)
+    {
+        for (int x = psf_size; x < width - psf_size; x++)
+        {
+            float A, B1, B2, C1, C2, C3, D1, D2, D3;
+
+#define PX(dx, dy) src[width * (y + (dy)) + x + (dx)]
+            A =  PX(+0, +0);
+            B1 = PX(+0, -1) + PX(+0, +1) + PX(+1, +0) + PX(-1, +0);
+            B2 = PX(-1, -1) + PX(+1, -1) + PX(-1, +1) + PX(+1, +1);
+            C1 = PX(+0, -2) + PX(-2, +0) + PX(+2, +0) + PX(+0, +2);
+            C2 = PX(-1, -2) + PX(+1, -2) + PX(-2, -1) + PX(+2, -1) + PX(-2, +1) + PX(+2, +1) + PX(-1, +2) + PX(+1, +2);
+            C3 = PX(-2, -2) + PX(+2, -2) + PX(-2, +2) + PX(+2, +2);
+            D1 = PX(+0, -3) + PX(-3, +0) + PX(+3, +0) + PX(+0, +3);
+            D2 = PX(-1, -3) + PX(+1, -3) + PX(-3, -1) + PX(+3, -1) + PX(-3, +1) + PX(+3, +1) + PX(-1, +3) + PX(+1, +3);
+            D3 = PX(-4, -2) + PX(-3, -2) + PX(+3, -2) + PX(+4, -2) + PX(-4, -1) + PX(+4, -1) + PX(-4, +0) + PX(+4, +0) + PX(-4, +1) + PX(+4, +1) + PX(-4, +2) + PX(-3, +2) + PX(+3, +2) + PX(+4, +2);
+#undef PX
+            int i;
+            const float *uptr;
+
+            uptr = &src[width * (y - 4) + (x - 4)];
+            for (i = 0; i < 9; i++)
+                D3 += *uptr++;
+
+            uptr = &src[width * (y - 3) + (x - 4)];
+            for (i = 0; i < 3; i++)
+                D3 += *uptr++;
+            uptr += 3;
+            for (i = 0; i < 3; i++)
+                D3 += *uptr++;
+
+            uptr = &src[width * (y + 3) + (x - 4)];
+            for (i = 0; i < 3; i++)
+                D3 += *uptr++;
+            uptr += 3;
+            for (i = 0; i < 3; i++)
+                D3 += *uptr++;
+
+            uptr = &src[width * (y + 4) + (x - 4)];
+            for (i = 0; i < 9; i++)
+                D3 += *uptr++;
+
+            double mean = (A + B1 + B2 + C1 + C2 + C3 + D1 + D2 + D3) / 81.0;
+            double PSF_fit = PSF[0] * (A - mean) + PSF[1] * (B1 - 4.0 * mean) + PSF[2] * (B2 - 4.0 * mean) +
+                PSF[3] * (C1 - 4.0 * mean) + PSF[4] * (C2 - 8.0 * mean) + PSF[5] * (C3 - 4.0 * mean) +
+                PSF[6] * (D1 - 4.0 * mean) + PSF[7] * (D2 - 8.0 * mean) + PSF[8] * (D3 - 44.0 * mean);
+
+            dst[width * y + x] = (float) PSF_fit;
+        }
+    }
+}
+
+static void BaselineDetect(const Frame& frame, std::vector<Peak> *peaks)
+{
+    int const width = frame.width;
+    int const height = frame.height;
+
+    std::vector<unsigned short> smoothed(width * height);
+    Median3Rect(&smoothed[0], &frame.px[0], width, 0, 0, width, height, BestKernels());
+
+    std::vector<float> src(smoothed.begin(), smoothed.end());
+    std::vector<float> conv;
+    BaselinePsfConv(conv, src, width, height);
+
+    enum { CONV_RADIUS = 4 };
+    int const left = CONV_RADIUS;
+    int const top = CONV_RADIUS;
+    int const right = width - 1 - CONV_RADIUS;
+    int const bottom = height - 1 - CONV_RADIUS;
+
+    double global_mean, global_stdev;
+    BaselineStats(&global_mean, &global_stdev, conv, width, left, top, right - left + 1, bottom - top + 1);
+
+    peaks->clear();
+
+    int srch = 4;
+    for (int y = top + srch; y <= bottom - srch; y++)
+    {
+        for (int x = left + srch; x <= right - srch; x++)
+        {
+            float val = conv[width * y + x];
+            bool ismax = false;
+            if (val > 0.0)
+            {
+                ismax = true;
+                for (int j = -srch; j <= srch; j++)
+                {
+                    for (int i = -srch; i <= srch; i++)
+                    {
+                        if (i == 0 && j == 0)
+                            continue;
+                        if (conv[width * (y + j) + (x + i)] > val)
+                        {
+                            ismax = false;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (!ismax)
+                continue;
+
+            const int local = 7;
+            int lx0 = std::max(x - local, left);
+            int lx1 = std::min(x + local, right);
+            int ly0 = std::max(y - local, top);
+            int ly1 = std::min(y + local, bottom);
+            double local_mean, local_stdev;
+            BaselineStats(&local_mean, &local_stdev, conv, width, lx0, ly0, lx1 - lx0 + 1, ly1 - ly0 + 1);
+
+            double h = (val - local_mean) / global_stdev;
+            if (h < Threshold)
+                continue;
+
+            peaks->push_back(Peak(x, y, h));
+        }
+    }
+}
+
+// microseconds per frame
+static double TimeBaseline(const Frame& frame, int repeats, std::vector<Peak> *peaks)
+{
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+        BaselineDetect(frame, peaks);
+    std::chrono::duration<double, std::micro> const elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeats;
+}
+
+// the TOP_N brightest peaks kept by AutoFind
+static std::vector<Peak> Brightest(const std::vector<Peak>& peaks)
+{
+    enum { TOP_N = 100 };
+    std::set<Peak> stars;
+    for (std::vector<Peak>::const_iterator it = peaks.begin(); it != peaks.end(); ++it)
+    {
+        stars.insert(*it);
+        if (stars.size() > TOP_N)
+            stars.erase(stars.begin());
+    }
+    return std::vector<Peak>(stars.begin(), stars.end());
+}
+
+static bool SamePeaks(const std::vector<Peak>& a, const std::vector<Peak>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].x != b[i].x || a[i].y != b[i].y || fabs(a[i].val - b[i].val) > 1e-3 * fabs(a[i].val))
+            return false;
+    }
+    return true;
+}
+
+// microseconds per frame
+static double Time(const Frame& frame, int nbands, int repeats, bool reuse, std::vector<Peak> *peaks)
+{
+    double mean, stdev;
+    StarDetector shared;
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+    {
+        if (reuse)
+            shared.Detect(&frame.px[0], frame.width, frame.height, Threshold, nbands, RunBands, peaks, &mean, &stdev);
+        else
+        {
+            StarDetector detector;
+            detector.Detect(&frame.px[0], frame.width, frame.height, Threshold, nbands, RunBands, peaks, &mean, &stdev);
+        }
+    }
+    std::chrono::duration<double, std::micro> const elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeats;
+}
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-r REPEATS] [-t THREADS] FILE.fit...\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int repeats = 50;
+    int maxThreads = (int) std::thread::hardware_concurrency();
+    if (maxThreads < 1)
+        maxThreads = 1;
+
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi += 2)
+    {
+        if (argi + 1 >= argc || strlen(argv[argi]) != 2)
+        {
+            Usage(argv[0]);
+            return 2;
+        }
+        int const val = atoi(argv[argi + 1]);
+        switch (argv[argi][1])
+        {
+        case 'r': repeats = val; break;
+        case 't': maxThreads = val; break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (argi >= argc || repeats < 1 || maxThreads < 1)
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    int const firstFile = argi;
+    std::vector<Frame> frames(argc - firstFile);
+    for (; argi < argc; argi++)
+    {
+        if (!ReadFits(argv[argi], &frames[argi - firstFile]))
+            return 1;
+    }
+
+    printf("%d repeats\n", repeats);
+    printf("%-24s %11s %7s %7s %14s %14s %14s\n", "", "size", "bands", "peaks", "baseline (us)", "alloc (us)", "reuse (us)");
+
+    for (argi = firstFile; argi < argc; argi++)
+    {
+        const Frame& frame = frames[argi - firstFile];
+
+        char size[32];
+        sprintf(size, "%dx%d", frame.width, frame.height);
+
+        std::vector<Peak> basePeaks;
+        double const baseline = TimeBaseline(frame, repeats, &basePeaks);
+        std::vector<Peak> const baseBrightest = Brightest(basePeaks);
+
+        for (int nbands = 1; ; nbands = std::min(nbands * 2, maxThreads))
+        {
+            std::vector<Peak> peaks;
+            double const alloc = Time(frame, nbands, repeats, false, &peaks);
+            double const reuse = Time(frame, nbands, repeats, true, &peaks);
+            printf("%-24s %11s %7d %7u %14.1f %14.1f %14.1f\n", argv[argi], size, nbands, (unsigned int) peaks.size(),
+                   baseline, alloc, reuse);
+
+            // the filter sums are reordered, so the peak values may differ
+            // in the last bits, but the stars AutoFind keeps must be the same
+            if (!SamePeaks(Brightest(peaks), baseBrightest))
+                printf("%-24s the brightest peaks differ from the baseline\n", argv[argi]);
+
+            if (nbands == maxThreads)
+                break;
+        }
+    }
+
+    return 0;
+}
@@ -320,8 +320,7 @@ bool Camera_Atik16Class::Capture(int duration, usImage& img, int options, const
 
     if (useSubframe)
     {
-        img.Subframe = subframe;
-        img.Clear();
+        img.InitSubframe(subframe);
         const unsigned short *buf = (unsigned short *) ArtemisImageBuffer(Cam_Handle);
 
         for (int y = 0; y < subframe.height; y++)
@@ -49,8 +49,14 @@
 #include "image_math.h"
 #include "cam_INDI.h"
 
+enum { DECODE_LOG_INTERVAL = 100 };
+
 Camera_INDIClass::Camera_INDIClass()
 {
+    m_blobFrame = NULL;
+    m_blobIsFits = false;
+    m_decodeCount = 0;
+    m_decodeTotalUs = m_decodeMaxUs = 0;
     ClearStatus();
     // load the values from the current profile
     INDIhost = pConfig->Profile.GetString("/indi/INDIhost", _T("localhost"));
@@ -69,6 +75,7 @@ Camera_INDIClass::Camera_INDIClass()
 Camera_INDIClass::~Camera_INDIClass()
 {
     disconnectServer();
+    usImagePool::Release(m_blobFrame);
 }
 
 void Camera_INDIClass::ClearStatus()
@@ -172,15 +179,76 @@ void  Camera_INDIClass::newBLOB(IBLOB *bp)
     // this is normally the image from the camera
     //printf("Got camera blob %s \n",bp->name);
     if (expose_prop) {
-        if (bp->name == INDICameraBlobName) {
-            cam_bp = bp;
-            modal = false;
+        if (bp->name != INDICameraBlobName)
+            return;
+    }
+    else if (!video_prop) {
+        return;
+    }
+
+    // The BLOB buffer is reused by the INDI client for the next BLOB, so the
+    // image is decoded right away, in a single pass, into a frame that Capture
+    // picks up. Only the handoff of the frame is done under the lock.
+    wxSize fullSize;
+    wxRect subframe;
+    { // lock scope
+        wxCriticalSectionLocker lck(m_blobLock);
+        fullSize = m_blobFullSize;
+        subframe = m_blobSubframe;
+    } // lock scope
+
+    wxStopWatch swatch;
+    usImage *frame = usImagePool::Acquire();
+    wxString error;
+    bool isFits = strcmp(bp->format, ".fits") == 0;
+    bool err;
+
+    if (isFits) {
+        err = DecodeFITS(*frame, bp, fullSize, subframe, &error);
+    }
+    else if (strcmp(bp->format, ".stream") == 0) {
+        if (!frame_prop || !frame_width || !frame_height) {
+            error = _("No CCD_FRAME property, failed to determine image dimensions");
+            err = true;
         }
+        else
+            err = DecodeStream(*frame, bp, frame_width->value, frame_height->value, &error);
+    }
+    else {
+        error = _("Unknown image format: ") + wxString::FromAscii(bp->format);
+        err = true;
     }
-    else if (video_prop){
-        cam_bp = bp;
-        // TODO : cumulate the frames received during exposure
+
+    if (err) {
+        usImagePool::Release(frame);
+        frame = NULL;
+    }
+    else {
+        long long us = swatch.TimeInMicro().GetValue();
+        m_decodeTotalUs += us;
+        m_decodeMaxUs = wxMax(m_decodeMaxUs, us);
+        if (++m_decodeCount == DECODE_LOG_INTERVAL) {
+            Debug.Write(wxString::Format("INDI: decoded %u BLOBs of %dx%d, mean %.2f ms, max %.2f ms\n",
+                m_decodeCount, frame->Size.GetWidth(), frame->Size.GetHeight(),
+                m_decodeTotalUs / 1000.0 / m_decodeCount, m_decodeMaxUs / 1000.0));
+            m_decodeCount = 0;
+            m_decodeTotalUs = m_decodeMaxUs = 0;
+        }
     }
+
+    usImage *stale;
+    { // lock scope
+        wxCriticalSectionLocker lck(m_blobLock);
+        stale = m_blobFrame;    // not picked up, e.g. an earlier video frame
+        m_blobFrame = frame;
+        m_blobIsFits = isFits;
+        m_blobError = error;
+    } // lock scope
+
+    usImagePool::Release(stale);
+
+    if (expose_prop)
+        modal = false;
 }
 
 void Camera_INDIClass::newProperty(INDI::Property *property)
@@ -418,124 +486,267 @@ void  Camera_INDIClass::SetCCDdevice()
     }
 }
 
-bool Camera_INDIClass::ReadFITS(usImage& img, bool takeSubframe, const wxRect& subframe)
+// The keywords of a primary FITS header needed to decode its image
+struct FitsImageInfo
 {
-    int xsize, ysize;
-    fitsfile *fptr;  // FITS file pointer
-    int status = 0;  // CFITSIO status value MUST be initialized to zero!
-    int hdutype, naxis;
-    int nhdus=0;
-    long fits_size[2];
-    long fpixel[3] = {1,1,1};
-    size_t bsize = static_cast<size_t>(cam_bp->bloblen);
-
-    // load blob to CFITSIO
-    if (fits_open_memfile(&fptr,
-            "",
-            READONLY,
-            &(cam_bp->blob),
-            &bsize,
-            0,
-            NULL,
-            &status) )
+    int bitpix;
+    int naxis;
+    long naxis1;
+    long naxis2;
+    double bzero;
+    double bscale;
+    size_t dataOffset;
+};
+
+// Reads the primary header of a FITS file in memory, returns false if the
+// header has no END card
+static bool ParseFitsHeader(const char *buf, size_t len, FitsImageInfo *info)
+{
+    enum { CARD = 80, BLOCK = 2880 };
+
+    info->bitpix = 0;
+    info->naxis = 0;
+    info->naxis1 = info->naxis2 = 0;
+    info->bzero = 0.0;
+    info->bscale = 1.0;
+
+    for (size_t ofs = 0; ofs + CARD <= len; ofs += CARD)
     {
-        pFrame->Alert(_("Unsupported type or read error loading FITS file"));
-        return true;
+        const char *card = buf + ofs;
+        if (strncmp(card, "END     ", 8) == 0)
+        {
+            info->dataOffset = (ofs / BLOCK + 1) * BLOCK;
+            return true;
+        }
+        if (card[8] != '=')
+            continue;
+
+        char value[CARD - 9];
+        memcpy(value, card + 10, CARD - 10);
+        value[CARD - 10] = 0;
+
+        if (strncmp(card, "BITPIX  ", 8) == 0)
+            info->bitpix = atoi(value);
+        else if (strncmp(card, "NAXIS   ", 8) == 0)
+            info->naxis = atoi(value);
+        else if (strncmp(card, "NAXIS1  ", 8) == 0)
+            info->naxis1 = atol(value);
+        else if (strncmp(card, "NAXIS2  ", 8) == 0)
+            info->naxis2 = atol(value);
+        else if (strncmp(card, "BZERO   ", 8) == 0)
+            info->bzero = strtod(value, NULL);
+        else if (strncmp(card, "BSCALE  ", 8) == 0)
+            info->bscale = strtod(value, NULL);
     }
-    if (fits_get_hdu_type(fptr, &hdutype, &status) || hdutype != IMAGE_HDU) {
-        pFrame->Alert(_("FITS file is not of an image"));
-        PHD_fits_close_file(fptr);
-        return true;
+
+    return false;
+}
+
+inline static unsigned short ScalePixel(double v)
+{
+    return v <= 0.0 ? 0 : v >= 65535.0 ? 65535 : (unsigned short)(v + 0.5);
+}
+
+// Converts the big-endian pixels of an 8 or 16-bit FITS image into the dst
+// area of the frame
+static void DecodeFitsPixels(usImage& frame, const wxRect& dst, const unsigned char *src, const FitsImageInfo& info)
+{
+    int const width = dst.GetWidth();
+
+    for (int y = 0; y < dst.GetHeight(); y++)
+    {
+        unsigned short *d = &frame.Pixel(dst.GetLeft(), dst.GetTop() + y);
+
+        if (info.bitpix == 8)
+        {
+            if (info.bscale == 1.0 && info.bzero == 0.0)
+            {
+                for (int x = 0; x < width; x++)
+                    *d++ = *src++;
+            }
+            else
+            {
+                for (int x = 0; x < width; x++)
+                    *d++ = ScalePixel(*src++ * info.bscale + info.bzero);
+            }
+        }
+        else if (info.bscale == 1.0 && info.bzero == 32768.0)
+        {
+            // unsigned 16-bit, stored offset by 32768 as signed
+            for (int x = 0; x < width; x++, src += 2)
+                *d++ = (unsigned short)((src[0] << 8) | src[1]) ^ 0x8000;
+        }
+        else
+        {
+            for (int x = 0; x < width; x++, src += 2)
+                *d++ = ScalePixel((short)((src[0] << 8) | src[1]) * info.bscale + info.bzero);
+        }
     }
+}
 
-    // Get HDUs and size
-    fits_get_img_dim(fptr, &naxis, &status);
-    fits_get_img_size(fptr, 2, fits_size, &status);
-    xsize = (int) fits_size[0];
-    ysize = (int) fits_size[1];
-    fits_get_num_hdus(fptr,&nhdus,&status);
-    if ((nhdus != 1) || (naxis != 2)) {
-        pFrame->Alert(_("Unsupported type or read error loading FITS file"));
-        PHD_fits_close_file(fptr);
-        return true;
+// Decodes a FITS BLOB into the frame. A BLOB of the size of the subframe goes
+// into a frame of the full size, at the subframe.
+static bool DecodeFITS(usImage& frame, const IBLOB *bp, const wxSize& fullSize, const wxRect& subframe, wxString *error)
+{
+    const char *buf = static_cast<const char *>(bp->blob);
+    size_t const len = static_cast<size_t>(bp->bloblen);
+
+    // plain 8 and 16-bit images are converted directly, anything else is left
+    // to CFITSIO
+    FitsImageInfo info;
+    bool direct = ParseFitsHeader(buf, len, &info) && info.naxis == 2 &&
+        (info.bitpix == 8 || info.bitpix == 16) &&
+        info.dataOffset + (size_t) info.naxis1 * info.naxis2 * (info.bitpix / 8) <= len;
+
+    fitsfile *fptr = NULL;
+    int status = 0;  // CFITSIO status value MUST be initialized to zero!
+    int xsize, ysize;
+
+    if (direct)
+    {
+        xsize = (int) info.naxis1;
+        ysize = (int) info.naxis2;
     }
-    if (takeSubframe) {
-        if (img.Init(FullSize)) {
-            pFrame->Alert(_("Memory allocation error"));
-            PHD_fits_close_file(fptr);
+    else
+    {
+        void *mem = bp->blob;
+        size_t memsize = len;
+        int hdutype, naxis;
+        int nhdus = 0;
+        long fits_size[2];
+
+        if (fits_open_memfile(&fptr, "", READONLY, &mem, &memsize, 0, NULL, &status))
+        {
+            *error = _("Unsupported type or read error loading FITS file");
             return true;
         }
-        img.Clear();
-        img.Subframe = subframe;
-        unsigned short *rawdata = new unsigned short[xsize*ysize];
-        if (fits_read_pix(fptr, TUSHORT, fpixel, xsize*ysize, NULL, rawdata, NULL, &status) ) {
-            pFrame->Alert(_("Error reading data"));
+        if (fits_get_hdu_type(fptr, &hdutype, &status) || hdutype != IMAGE_HDU)
+        {
+            *error = _("FITS file is not of an image");
             PHD_fits_close_file(fptr);
             return true;
         }
-        int i = 0;
-        for (int y = 0; y < subframe.height; y++)
+        fits_get_img_dim(fptr, &naxis, &status);
+        fits_get_img_size(fptr, 2, fits_size, &status);
+        fits_get_num_hdus(fptr, &nhdus, &status);
+        if ((nhdus != 1) || (naxis != 2))
         {
-            unsigned short *dataptr = img.ImageData + (y + subframe.y) * img.Size.GetWidth() + subframe.x;
-            memcpy(dataptr, &rawdata[i], subframe.width * sizeof(unsigned short));
-            i += subframe.width;
-        }
-        delete[] rawdata;
-    }
-    else {
-        if (img.Init(xsize,ysize)) {
-            pFrame->Alert(_("Memory allocation error"));
+            *error = _("Unsupported type or read error loading FITS file");
             PHD_fits_close_file(fptr);
             return true;
         }
-        // Read image
-        if (fits_read_pix(fptr, TUSHORT, fpixel, xsize*ysize, NULL, img.ImageData, NULL, &status) ) {
-            pFrame->Alert(_("Error reading data"));
+        xsize = (int) fits_size[0];
+        ysize = (int) fits_size[1];
+    }
+
+    wxRect dst(0, 0, xsize, ysize);
+    bool allocErr;
+    if (!subframe.IsEmpty() && subframe.GetSize() == dst.GetSize() && wxRect(fullSize).Contains(subframe))
+    {
+        allocErr = frame.Init(fullSize);
+        if (!allocErr)
+            frame.InitSubframe(subframe);
+        dst = subframe;
+    }
+    else
+        allocErr = frame.Init(xsize, ysize);
+
+    if (allocErr)
+    {
+        *error = _("Memory allocation error");
+        if (fptr)
             PHD_fits_close_file(fptr);
-            return true;
-        }
+        return true;
     }
 
+    if (direct)
+    {
+        DecodeFitsPixels(frame, dst, reinterpret_cast<const unsigned char *>(buf) + info.dataOffset, info);
+        return false;
+    }
+
+    // read the rows straight into place
+    for (int y = 0; y < ysize && !status; y++)
+    {
+        long fpixel[3] = { 1, y + 1, 1 };
+        fits_read_pix(fptr, TUSHORT, fpixel, xsize, NULL, &frame.Pixel(dst.GetLeft(), dst.GetTop() + y), NULL, &status);
+    }
     PHD_fits_close_file(fptr);
+
+    if (status)
+    {
+        *error = _("Error reading data");
+        return true;
+    }
+
     return false;
 }
 
-bool Camera_INDIClass::ReadStream(usImage& img)
+// Decodes a raw 8 or 16-bit (little-endian) video frame BLOB into the frame
+static bool DecodeStream(usImage& frame, const IBLOB *bp, int xsize, int ysize, wxString *error)
 {
-    int xsize, ysize;
-    unsigned char *inptr;
-    unsigned short *outptr;
+    size_t const npixels = (size_t) xsize * ysize;
+    size_t const len = static_cast<size_t>(bp->bloblen);
 
-    if (! frame_prop) {
-        pFrame->Alert(_("No CCD_FRAME property, failed to determine image dimensions"));
+    if (npixels == 0 || len < npixels)
+    {
+        *error = _("CCD stream: frame size does not match the image dimensions");
         return true;
     }
 
-    if (! (frame_width)) {
-        pFrame->Alert(_("No WIDTH value, failed to determine image dimensions"));
+    if (frame.Init(xsize, ysize))
+    {
+        *error = _("CCD stream: memory allocation error");
         return true;
     }
-    xsize = frame_width->value;
 
-    if (! (frame_height)) {
-        pFrame->Alert(_("No HEIGHT value, failed to determine image dimensions"));
-        return true;
-    }
-    ysize = frame_height->value;
+    const unsigned char *src = static_cast<const unsigned char *>(bp->blob);
+    unsigned short *dst = frame.ImageData;
+    unsigned short *end = dst + npixels;
 
-    // allocate image
-    if (img.Init(xsize,ysize)) {
-        pFrame->Alert(_("CCD stream: memory allocation error"));
-        return true;
+    if (len >= 2 * npixels)
+    {
+        for (; dst < end; src += 2)
+            *dst++ = src[0] | (src[1] << 8);
+    }
+    else
+    {
+        while (dst < end)
+            *dst++ = *src++;
     }
-    // copy image
-    outptr = img.ImageData;
-    inptr = (unsigned char *) cam_bp->blob;
-    for (int i = 0; i < xsize * ysize; i++)
-        *outptr ++ = *inptr++;
+
     return false;
 }
 
+// Tells newBLOB where the pixels of the next BLOB go and drops any frame
+// decoded before the exposure started
+void Camera_INDIClass::ExpectBLOB(const wxRect& subframe)
+{
+    usImage *stale;
+
+    { // lock scope
+        wxCriticalSectionLocker lck(m_blobLock);
+        m_blobFullSize = FullSize;
+        m_blobSubframe = subframe;
+        stale = m_blobFrame;
+        m_blobFrame = NULL;
+        m_blobError.clear();
+    } // lock scope
+
+    usImagePool::Release(stale);
+}
+
+// Returns the frame decoded from the latest BLOB, or NULL with the reason
+usImage *Camera_INDIClass::TakeBLOBFrame(bool *isFits, wxString *error)
+{
+    wxCriticalSectionLocker lck(m_blobLock);
+    usImage *frame = m_blobFrame;
+    m_blobFrame = NULL;
+    *isFits = m_blobIsFits;
+    *error = m_blobError;
+    return frame;
+}
+
 bool Camera_INDIClass::Capture(int duration, usImage& img, int options, const wxRect& subframeArg)
 {
   if (Connected) {
@@ -577,12 +788,16 @@ bool Camera_INDIClass::Capture(int duration, usImage& img, int options, const wx
           }
           //printf("Exposing for %d(ms)\n", duration);
 
+          ExpectBLOB(takeSubframe ? subframe : wxRect());
+
+          // armed before the exposure starts, a short exposure's blob can
+          // arrive before sendNewNumber returns
+          modal = true;  // will be reset when the image blob is received
+
           // set the exposure time, this immediately start the exposure
           expose_prop->np->value = (double)duration/1000;
           sendNewNumber(expose_prop);
 
-          modal = true;  // will be reset when the image blob is received
-
           unsigned long loopwait = duration > 100 ? 10 : 1;
 
           CameraWatchdog watchdog(duration, GetTimeoutMs());
@@ -601,6 +816,7 @@ bool Camera_INDIClass::Capture(int duration, usImage& img, int options, const wx
       // for video camera without exposure time setting
       else if (video_prop){
           takeSubframe = false;
+          ExpectBLOB(wxRect());
           //printf("Enabling video capture\n");
           ISwitch *v_on = IUFindSwitch(video_prop,"ON");
           ISwitch *v_off = IUFindSwitch(video_prop,"OFF");
@@ -623,29 +839,38 @@ bool Camera_INDIClass::Capture(int duration, usImage& img, int options, const wx
 
       //printf("Exposure end\n");
 
-      if (strcmp(cam_bp->format, ".fits") == 0) {
-         //printf("Processing fits file\n");
+      bool isFits;
+      wxString error;
+      usImage *frame = TakeBLOBFrame(&isFits, &error);
+      if (!frame) {
+         pFrame->Alert(error.IsEmpty() ? _("No image was received from the camera") : error);
+         return true;
+      }
+
+      // take the decoded pixels, handing our buffer back to the pool along
+      // with the subframe that tells which of its pixels were written
+      wxRect prevSubframe = img.Subframe;
+      if (img.Init(frame->Size)) {
+         pFrame->Alert(_("Memory allocation error"));
+         usImagePool::Release(frame);
+         return true;
+      }
+      img.SwapImageData(*frame);
+      img.Subframe = frame->Subframe;
+      frame->Subframe = prevSubframe;
+      usImagePool::Release(frame);
+
+      if (isFits) {
          // for CCD camera
-         if ( ! ReadFITS(img,takeSubframe,subframe) ) {
-            if (options & CAPTURE_SUBTRACT_DARK) {
-               //printf("Subtracting dark\n");
-               SubtractDark(img);
-            }
-            if (options & CAPTURE_RECON) {
-                if (PixSizeX != PixSizeY) SquarePixels(img, PixSizeX, PixSizeY);
-            }
-            return false;
-         } else {
-            return true;
+         if (options & CAPTURE_SUBTRACT_DARK) {
+            //printf("Subtracting dark\n");
+            SubtractDark(img);
+         }
+         if (options & CAPTURE_RECON) {
+             if (PixSizeX != PixSizeY) SquarePixels(img, PixSizeX, PixSizeY);
          }
-      } else if (strcmp(cam_bp->format, ".stream") == 0) {
-         //printf("Processing stream file\n");
-         // for video camera
-         return ReadStream(img);
-      } else {
-         pFrame->Alert(_("Unknown image format: ") + wxString::FromAscii(cam_bp->format));
-         return true;
       }
+      return false;
 
   }
   else {
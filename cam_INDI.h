@@ -69,7 +69,6 @@ private:
     INumber               *pulseE_prop;
     INumber               *pulseW_prop;
     IndiGui  *gui ;
-    IBLOB    *cam_bp;
     bool     has_blob;
     bool     modal;
     bool     ready;
@@ -87,13 +86,23 @@ private:
     wxString INDICameraBlobName;
     wxString INDICameraPort;
     wxRect   m_roi;
+    // BLOBs are decoded in newBLOB, on the INDI client thread, and picked up by Capture
+    wxCriticalSection m_blobLock;
+    usImage *m_blobFrame;       // frame decoded from the latest BLOB, not yet captured
+    bool     m_blobIsFits;
+    wxString m_blobError;       // why the latest BLOB could not be decoded
+    wxSize   m_blobFullSize;    // geometry of the frame Capture is waiting for
+    wxRect   m_blobSubframe;
+    unsigned int m_decodeCount; // BLOB decode times, logged every DECODE_LOG_INTERVAL BLOBs
+    long long m_decodeTotalUs;
+    long long m_decodeMaxUs;
     void     SetCCDdevice();
     void     ClearStatus(); 
     void     CheckState();
     void     CameraDialog();
     void     CameraSetup();
-    bool     ReadFITS(usImage& img, bool takeSubframe, const wxRect& subframe);
-    bool     ReadStream(usImage& img);
+    void     ExpectBLOB(const wxRect& subframe);
+    usImage *TakeBLOBFrame(bool *isFits, wxString *error);
     
 protected:
     virtual void newDevice(INDI::BaseDevice *dp);
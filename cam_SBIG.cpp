@@ -505,7 +505,7 @@ bool Camera_SBIGClass::Capture(int duration, usImage& img, int options, const wx
 
     if (TakeSubframe)
     {
-        img.Subframe = subframe;
+        img.InitSubframe(subframe);
 
         // dump the lines above the one we want
         dlp.lineLength = subframe.y;
@@ -516,8 +516,6 @@ bool Camera_SBIGClass::Capture(int duration, usImage& img, int options, const wx
         rlp.pixelStart  = subframe.x;
         rlp.pixelLength = subframe.width;
 
-        img.Clear();
-
         for (int y = 0; y < subframe.height; y++)
         {
             unsigned short *dataptr = img.ImageData + subframe.x + (y + subframe.y) * FullSize.GetWidth();
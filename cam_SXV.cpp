@@ -433,8 +433,7 @@ static bool InitImgInterlacedInterp(usImage& img, const wxSize& FullSize, bool s
 
     if (subframe)
     {
-        img.Subframe = frame;
-        img.Clear();
+        img.InitSubframe(frame);
     }
 
     const unsigned short *raw = tmp.ImageData;
@@ -492,8 +491,7 @@ static bool InitImgInterlacedSquare(usImage& img, const wxSize& FullSize, bool s
 
     if (subframe)
     {
-        img.Subframe = frame;
-        img.Clear();
+        img.InitSubframe(frame);
     }
 
     const unsigned short *raw = tmp.ImageData;
@@ -545,8 +543,7 @@ static bool InitImgProgressive(usImage& img, unsigned int xofs, unsigned int yof
     if (subframe)
     {
         const unsigned short *src = raw;
-        img.Subframe = wxRect(xofs, yofs, xsize, ysize);
-        img.Clear();
+        img.InitSubframe(wxRect(xofs, yofs, xsize, ysize));
         for (unsigned int y = 0; y < ysize; y++)
         {
             unsigned short *dst = img.ImageData + (yofs + y) * FullSize.GetWidth() + xofs;
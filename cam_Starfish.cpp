@@ -171,7 +171,6 @@ bool Camera_StarfishClass::Capture(int duration, usImage& img, int options, cons
         xpos = 0;
         ypos = 0;
     }
-    img.Clear();
 
     // set ROI if something has changed
     if (lastSubFrame != subframe)
@@ -219,6 +218,7 @@ bool Camera_StarfishClass::Capture(int duration, usImage& img, int options, cons
     if (usingSubFrames)
     {
         rval = fcUsb_cmd_getRawFrame(CamNum, (unsigned short)ysize, (unsigned short)xsize, subImage.ImageData);
+        img.InitSubframe(subframe);
         // Transfer the subframe to the corresponding location in the full-size frame
         for (int y = 0; y < ysize; y++)
         {
@@ -226,7 +226,6 @@ bool Camera_StarfishClass::Capture(int duration, usImage& img, int options, cons
             unsigned short *pDest = img.ImageData + (ypos + y) * FullSize.GetWidth() + xpos;
             memcpy(pDest, pSrc, xsize * sizeof(unsigned short));
         }
-        img.Subframe = subframe;
     }
     else
     {
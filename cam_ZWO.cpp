@@ -546,10 +546,8 @@ bool Camera_ZWO::Capture(int duration, usImage& img, int options, const wxRect&
 
     if (useSubframe)
     {
-        img.Subframe = subframe;
-
-        // Clear out the image
-        img.Clear();
+        // Clear out the rest of the image
+        img.InitSubframe(subframe);
 
         for (int y = 0; y < subframe.height; y++)
         {
@@ -296,10 +296,8 @@ static bool ASCOM_Image(IDispatch *cam, usImage& Image, bool takeSubframe, const
 
     if (takeSubframe)
     {
-        Image.Subframe = subframe;
-
-        // Clear out the image
-        Image.Clear();
+        // Clear out the rest of the image
+        Image.InitSubframe(subframe);
 
         int i = 0;
         for (int y = 0; y < subframe.height; y++)
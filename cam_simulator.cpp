@@ -607,7 +607,6 @@ bool SimCamState::ReadNextImage(usImage& img, const wxRect& subframe)
         return true;
     }
 
-    unsigned short *buf = new unsigned short[img.NPixels];
     bool useSubframe = !subframe.IsEmpty();
     wxRect frame;
     if (useSubframe)
@@ -615,6 +614,8 @@ bool SimCamState::ReadNextImage(usImage& img, const wxRect& subframe)
     else
         frame = wxRect(0, 0, xsize, ysize);
 
+    unsigned short *buf = new unsigned short[frame.width * frame.height];
+
     long inc[] = { 1, 1 };
     long fpixel[] = { frame.GetLeft() + 1, frame.GetTop() + 1 };
     long lpixel[] = { frame.GetRight() + 1, frame.GetBottom() + 1 };
@@ -627,10 +628,8 @@ bool SimCamState::ReadNextImage(usImage& img, const wxRect& subframe)
 
     if (useSubframe)
     {
-        img.Subframe = subframe;
-
-        // Clear out the image
-        img.Clear();
+        // Clear out the rest of the image
+        img.InitSubframe(subframe);
 
         int i = 0;
         for (int y = 0; y < subframe.height; y++)
@@ -1217,15 +1216,12 @@ bool Camera_SimClass::Capture(int duration, usImage& img, int options, const wxR
     }
 
     if (usingSubframe)
-        img.Clear();
+        img.InitSubframe(subframe);
 
     fill_noise(img, subframe, exptime, gain, offset);
 
     sim->FillImage(img, subframe, exptime, gain, offset);
 
-    if (usingSubframe)
-        img.Subframe = subframe;
-
     if (options & CAPTURE_SUBTRACT_DARK) SubtractDark(img);
 
 #endif // SIMMODE == 1
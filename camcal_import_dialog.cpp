@@ -223,6 +223,7 @@ void CamCalImportDialog::OnOk(wxCommandEvent& evt)
         destName = MyFrame::DarkLibFileName(m_thisProfileId);
         if (wxCopyFile(sourceName, destName, true))
         {
+            DarkLibCache::Remove(destName);
             Debug.Write(wxString::Format("Dark library imported from profile %d to profile %d\n", m_sourceDarksProfileId, m_thisProfileId));
             if (!bpmLoaded)
             {
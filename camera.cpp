@@ -208,6 +208,9 @@ GuideCamera::GuideCamera(void)
     Binning = pConfig->Profile.GetInt("/camera/binning", 1);
     CurrentDarkFrame = NULL;
     CurrentDefectMap = NULL;
+    m_darkLibCache = NULL;
+    m_scaledDark = NULL;
+    m_scaledDarkFrame = NULL;
 }
 
 GuideCamera::~GuideCamera(void)
@@ -758,7 +761,9 @@ void CameraConfigDialogPane::LayoutControls(GuideCamera *pCamera, BrainCtrlIdMap
     pTopline->Add(GetSizerCtrl(CtrlMap, AD_szNoiseReduction));
     pTopline->Add(GetSizerCtrl(CtrlMap, AD_szTimeLapse), wxSizerFlags(0).Border(wxLEFT, 110).Expand());
     pGenGroup->Add(pTopline, def_flags);
+    pGenGroup->Add(GetSizerCtrl(CtrlMap, AD_szSoftwareBinning), def_flags);
     pGenGroup->Add(GetSizerCtrl(CtrlMap, AD_szAutoExposure), def_flags);
+    pGenGroup->Add(GetSingleCtrl(CtrlMap, AD_cbPipelinedCapture), def_flags);
     pGenGroup->Layout();
 
     // Specific controls
@@ -1160,6 +1165,17 @@ void GuideCamera::AddDark(usImage *dark)
     { // lock scope
         wxCriticalSectionLocker lck(DarkFrameLock);
 
+        // an added dark frame supersedes the dark frame model
+        if (m_scaledDark)
+        {
+            if (CurrentDarkFrame == m_scaledDarkFrame)
+                CurrentDarkFrame = NULL;
+            delete m_scaledDarkFrame;
+            m_scaledDarkFrame = NULL;
+            delete m_scaledDark;
+            m_scaledDark = NULL;
+        }
+
         // free the prior dark with this exposure duration
         ExposureImgMap::iterator pos = Darks.find(expdur);
         if (pos != Darks.end())
@@ -1175,6 +1191,63 @@ void GuideCamera::AddDark(usImage *dark)
     Darks[expdur] = dark;
 }
 
+// Replaces the dark frames with views of the frames of a mapped dark library.
+// The camera takes ownership of the cache.
+void GuideCamera::SetDarkLibCache(DarkLibCache *cache)
+{
+    ClearDarks();
+
+    wxCriticalSectionLocker lck(DarkFrameLock);
+
+    m_darkLibCache = cache;
+
+    for (size_t i = 0; i < cache->FrameCount(); i++)
+    {
+        int const expdur = cache->FrameExposure(i);
+
+        usImage *dark = new usImage();
+        dark->AttachData(cache->FrameData(i), cache->FrameSize());
+        dark->ImgExpDur = expdur;
+
+        ExposureImgMap::iterator pos = Darks.find(expdur);
+        if (pos != Darks.end())
+            delete pos->second;
+        Darks[expdur] = dark;
+    }
+}
+
+// Replaces the dark frames with a dark frame model. The camera takes ownership
+// of the model.
+void GuideCamera::SetScaledDark(ScaledDark *model)
+{
+    ClearDarks();
+
+    wxCriticalSectionLocker lck(DarkFrameLock);
+
+    m_scaledDark = model;
+    m_scaledDarkFrame = new usImage();
+}
+
+// Makes the dark frame for the exposure from the dark frame model unless the
+// current one already matches. Called with DarkFrameLock held.
+void GuideCamera::MakeScaledDark(int exposureDuration)
+{
+    if (m_scaledDarkFrame->ImageData && m_scaledDarkFrame->ImgExpDur == exposureDuration)
+    {
+        CurrentDarkFrame = m_scaledDarkFrame;
+        return;
+    }
+
+    if (m_scaledDark->MakeDark(*m_scaledDarkFrame, exposureDuration))
+    {
+        Debug.Write(wxString::Format("failed to make a dark frame for exposure = %d\n", exposureDuration));
+        CurrentDarkFrame = NULL;
+        return;
+    }
+
+    CurrentDarkFrame = m_scaledDarkFrame;
+}
+
 void GuideCamera::SelectDark(int exposureDuration)
 {
     // select the dark frame with the smallest exposure >= the requested exposure.
@@ -1182,6 +1255,14 @@ void GuideCamera::SelectDark(int exposureDuration)
 
     wxCriticalSectionLocker lck(DarkFrameLock);
 
+    if (m_scaledDark)
+    {
+        MakeScaledDark(exposureDuration);
+        return;
+    }
+
+    usImage *prev = CurrentDarkFrame;
+
     CurrentDarkFrame = 0;
     for (ExposureImgMap::const_iterator it = Darks.begin(); it != Darks.end(); ++it)
     {
@@ -1189,6 +1270,15 @@ void GuideCamera::SelectDark(int exposureDuration)
         if (it->first >= exposureDuration)
             break;
     }
+
+    // with a mapped dark library only the selected dark needs to stay resident
+    if (m_darkLibCache && CurrentDarkFrame != prev)
+    {
+        if (prev)
+            m_darkLibCache->Evict(*prev);
+        if (CurrentDarkFrame)
+            m_darkLibCache->WillNeed(*CurrentDarkFrame);
+    }
 }
 
 void GuideCamera::GetDarklibProperties(int *pNumDarks, double *pMinExp, double *pMaxExp)
@@ -1200,6 +1290,14 @@ void GuideCamera::GetDarklibProperties(int *pNumDarks, double *pMinExp, double *
     { // lock scope
         wxCriticalSectionLocker lck(DarkFrameLock);
 
+        if (m_scaledDark)
+        {
+            // the model covers the exposure range it was fitted to
+            ct = m_scaledDark->DarkCount();
+            minExp = m_scaledDark->MinExposure();
+            maxExp = m_scaledDark->MaxExposure();
+        }
+
         for (auto it = Darks.begin(); it != Darks.end(); ++it)
         {
             if (it->first < minExp)
@@ -1244,6 +1342,15 @@ void GuideCamera::ClearDarks()
         Darks.erase(it);
     }
     CurrentDarkFrame = NULL;
+
+    delete m_scaledDarkFrame;
+    m_scaledDarkFrame = NULL;
+    delete m_scaledDark;
+    m_scaledDark = NULL;
+
+    // the dark frames were views of the cache, unmap it last
+    delete m_darkLibCache;
+    m_darkLibCache = NULL;
 }
 
 void GuideCamera::SubtractDark(usImage& img)
@@ -1258,6 +1365,15 @@ void GuideCamera::SubtractDark(usImage& img)
     {
         RemoveDefects(img, *CurrentDefectMap);
     }
+    else if (m_scaledDark)
+    {
+        // follow the exposure of the frame, which may differ from the selected
+        // exposure, e.g. with auto exposure
+        if (img.ImgExpDur > 0 && img.ImgExpDur != m_scaledDarkFrame->ImgExpDur)
+            MakeScaledDark(img.ImgExpDur);
+        if (CurrentDarkFrame)
+            Subtract(img, *CurrentDarkFrame);
+    }
     else if (CurrentDarkFrame)
     {
         Subtract(img, *CurrentDarkFrame);
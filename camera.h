@@ -37,6 +37,8 @@
 
 typedef std::map<int, usImage *> ExposureImgMap; // map exposure to image
 class DefectMap;
+class DarkLibCache;
+class ScaledDark;
 
 enum PropDlgType
 {
@@ -102,6 +104,11 @@ class GuideCamera :  public wxMessageBoxProxy, public OnboardST4
     friend class CameraConfigDialogCtrlSet;
 
     double          m_pixelSize;
+    DarkLibCache   *m_darkLibCache; // backing store of the dark frames when the dark library is mapped
+    ScaledDark     *m_scaledDark;   // dark frame model, used instead of the per-exposure darks when present
+    usImage        *m_scaledDarkFrame; // dark frame made from the model for the current exposure
+
+    void            MakeScaledDark(int exposureDuration);
 
 protected:
     bool            m_hasGuideOutput;
@@ -175,6 +182,9 @@ public:
 
     virtual wxString GetSettingsSummary();
     void            AddDark(usImage *dark);
+    void            SetDarkLibCache(DarkLibCache *cache);
+    void            SetScaledDark(ScaledDark *model);
+    const ScaledDark *GetScaledDark() const { return m_scaledDark; }
     void            SelectDark(int exposureDuration);
     void            SetDefectMap(DefectMap *newMap);
     void            ClearDefectMap(void);
@@ -146,4 +146,126 @@ T& circular_buffer<T>::operator[](unsigned int n) const
     return m_ary[(m_tail + n) % m_capacity];
 }
 
+/*
+ * Aggregates of the entries of a circular_buffer, kept in a segment tree so
+ * that the aggregate of any run of consecutive entries is available in
+ * O(log n) instead of walking the entries.
+ *
+ * Entries are pushed and indexed like in circular_buffer: index 0 is the
+ * oldest entry. T must be default constructible to the aggregate of an empty
+ * run, and provide an associative operator+ combining the aggregates of two
+ * consecutive runs, the older one on the left.
+ */
+template<typename T>
+class circular_aggregate
+{
+    T *m_tree;                  // m_tree[m_leaves + slot] is the aggregate of the entry at slot
+    unsigned int m_leaves;      // power of 2 >= m_capacity
+    unsigned int m_tail;
+    unsigned int m_size;
+    unsigned int m_capacity;
+
+    T range(unsigned int begin, unsigned int end) const;
+
+public:
+    circular_aggregate();
+    ~circular_aggregate();
+    void resize(unsigned int capacity);
+    void push_front(const T& t);
+    void pop_back(unsigned int n = 1);
+    void clear();
+    unsigned int size() const { return m_size; }
+    T query(unsigned int begin, unsigned int end) const;
+};
+
+template<typename T>
+circular_aggregate<T>::circular_aggregate()
+    : m_tree(0),
+    m_leaves(0),
+    m_tail(0),
+    m_size(0),
+    m_capacity(0)
+{
+}
+
+template<typename T>
+circular_aggregate<T>::~circular_aggregate()
+{
+    delete [] m_tree;
+}
+
+template<typename T>
+void circular_aggregate<T>::resize(unsigned int capacity)
+{
+    assert(capacity > 0);
+    assert(m_tree == 0);
+    m_leaves = 1;
+    while (m_leaves < capacity)
+        m_leaves <<= 1;
+    m_tree = new T[2 * m_leaves];
+    m_capacity = capacity;
+}
+
+template<typename T>
+void circular_aggregate<T>::clear()
+{
+    for (unsigned int i = 0; i < 2 * m_leaves; i++)
+        m_tree[i] = T();
+    m_tail = m_size = 0;
+}
+
+template<typename T>
+void circular_aggregate<T>::push_front(const T& t)
+{
+    unsigned int slot = (m_tail + m_size) % m_capacity;
+    if (m_size == m_capacity)
+        m_tail = (m_tail + 1) % m_capacity;
+    else
+        ++m_size;
+
+    unsigned int i = m_leaves + slot;
+    m_tree[i] = t;
+    for (i >>= 1; i > 0; i >>= 1)
+        m_tree[i] = m_tree[2 * i] + m_tree[2 * i + 1];
+}
+
+template<typename T>
+void circular_aggregate<T>::pop_back(unsigned int n)
+{
+    // the slots left behind are never queried and are overwritten by the
+    // next pushes
+    assert(m_size >= n);
+    m_tail = (m_tail + n) % m_capacity;
+    m_size -= n;
+}
+
+// aggregate of the slots [begin, end)
+template<typename T>
+T circular_aggregate<T>::range(unsigned int begin, unsigned int end) const
+{
+    T left, right;
+    for (begin += m_leaves, end += m_leaves; begin < end; begin >>= 1, end >>= 1)
+    {
+        if (begin & 1)
+            left = left + m_tree[begin++];
+        if (end & 1)
+            right = m_tree[--end] + right;
+    }
+    return left + right;
+}
+
+// aggregate of the entries [begin, end)
+template<typename T>
+T circular_aggregate<T>::query(unsigned int begin, unsigned int end) const
+{
+    assert(begin <= end && end <= m_size);
+    if (begin == end)
+        return T();
+    unsigned int first = (m_tail + begin) % m_capacity;
+    unsigned int last = (m_tail + end - 1) % m_capacity;
+    if (first <= last)
+        return range(first, last + 1);
+    return range(first, m_capacity) + range(0, last + 1);
+}
+
 #endif
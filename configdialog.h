@@ -48,9 +48,11 @@ enum BRAIN_CTRL_IDS
     AD_GLOBAL_TAB_BOUNDARY,        //-----end of global tab controls
     AD_cbUseSubFrames,
     AD_szNoiseReduction,
+    AD_szSoftwareBinning,
     AD_szAutoExposure,
     AD_szCameraTimeout,
     AD_szTimeLapse,
+    AD_cbPipelinedCapture,
     AD_szPixelSize,
     AD_szGain,
     AD_szDelay,
@@ -63,6 +65,7 @@ enum BRAIN_CTRL_IDS
     AD_cbAutoRestoreCal,
     AD_cbFastRecenter,
     AD_szStarTracking,
+    AD_szMultiStar,
     AD_cbClearCalibration,
     AD_cbEnableGuiding,
     AD_szCalibrationDuration,
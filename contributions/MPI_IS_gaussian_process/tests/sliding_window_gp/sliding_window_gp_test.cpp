@@ -0,0 +1,177 @@
+// Copyright (c) 2015 Max Planck Society
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include "sliding_window_gp.h"
+
+namespace {
+
+double signal(double t) {
+  return 0.5 * std::sin(2 * M_PI * t / 480.0) + 0.001 * t;
+}
+
+/*
+ * Reference prediction, computed by factoring the full Gram matrix of the
+ * given datapoints.
+ */
+double batchPrediction(const SlidingWindowGP::Hyperparameters& hyper,
+                       const Eigen::VectorXd& t, const Eigen::VectorXd& y,
+                       double t_star) {
+  int n = t.size();
+  Eigen::MatrixXd gram(n, n);
+  Eigen::VectorXd k(n);
+
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      double d = t[i] - t[j];
+      double s = std::sin(M_PI * d / hyper.period);
+      gram(i, j) = hyper.signal_variance *
+                   std::exp(-0.5 * d * d / (hyper.length_scale * hyper.length_scale)) +
+                   hyper.periodic_variance *
+                   std::exp(-2.0 * s * s / (hyper.periodic_length_scale * hyper.periodic_length_scale));
+    }
+    gram(i, i) += hyper.noise_variance;
+
+    double d = t[i] - t_star;
+    double s = std::sin(M_PI * d / hyper.period);
+    k[i] = hyper.signal_variance *
+           std::exp(-0.5 * d * d / (hyper.length_scale * hyper.length_scale)) +
+           hyper.periodic_variance *
+           std::exp(-2.0 * s * s / (hyper.periodic_length_scale * hyper.periodic_length_scale));
+  }
+
+  double mean = y.mean();
+  Eigen::VectorXd centered = y.array() - mean;
+  return mean + k.dot(gram.llt().solve(centered));
+}
+
+}  // namespace
+
+TEST(SlidingWindowGPTest, emptyPredictionTest) {
+  SlidingWindowGP gp(10);
+  EXPECT_EQ(gp.size(), 0);
+  EXPECT_EQ(gp.predict(3.0), 0.0);
+}
+
+TEST(SlidingWindowGPTest, matchesBatchBeforeWindowIsFullTest) {
+  int max_size = 50;
+  SlidingWindowGP gp(max_size);
+  Eigen::VectorXd t(30), y(30);
+
+  for (int i = 0; i < 30; ++i) {
+    t[i] = 3.0 * i;
+    y[i] = signal(t[i]);
+    gp.append(t[i], y[i]);
+  }
+
+  EXPECT_EQ(gp.size(), 30);
+  EXPECT_NEAR(gp.predict(91.5),
+              batchPrediction(gp.getHyperparameters(), t, y, 91.5), 1e-8);
+}
+
+TEST(SlidingWindowGPTest, matchesBatchAfterSlidingTest) {
+  int max_size = 40;
+  SlidingWindowGP gp(max_size);
+
+  for (int i = 0; i < 5 * max_size; ++i) {
+    gp.append(2.0 * i, signal(2.0 * i));
+  }
+
+  EXPECT_EQ(gp.size(), max_size);
+
+  // the window holds the last max_size datapoints
+  Eigen::VectorXd t(max_size), y(max_size);
+  for (int i = 0; i < max_size; ++i) {
+    t[i] = 2.0 * (4 * max_size + i);
+    y[i] = signal(t[i]);
+  }
+
+  for (double t_star = 380.0; t_star < 420.0; t_star += 7.0) {
+    EXPECT_NEAR(gp.predict(t_star),
+                batchPrediction(gp.getHyperparameters(), t, y, t_star), 1e-6);
+  }
+}
+
+TEST(SlidingWindowGPTest, setHyperparametersRefactorsTest) {
+  int max_size = 20;
+  SlidingWindowGP gp(max_size);
+  Eigen::VectorXd t(max_size), y(max_size);
+
+  for (int i = 0; i < max_size; ++i) {
+    t[i] = 10.0 * i;
+    y[i] = signal(t[i]);
+    gp.append(t[i], y[i]);
+  }
+
+  SlidingWindowGP::Hyperparameters hyper;
+  hyper.length_scale = 100.0;
+  hyper.noise_variance = 0.01;
+  gp.setHyperparameters(hyper);
+
+  EXPECT_NEAR(gp.predict(205.0), batchPrediction(hyper, t, y, 205.0), 1e-8);
+
+  // and the incremental updates still match afterwards
+  gp.append(200.0, signal(200.0));
+  for (int i = 0; i < max_size - 1; ++i) {
+    t[i] = t[i + 1];
+    y[i] = y[i + 1];
+  }
+  t[max_size - 1] = 200.0;
+  y[max_size - 1] = signal(200.0);
+  EXPECT_NEAR(gp.predict(205.0), batchPrediction(hyper, t, y, 205.0), 1e-8);
+}
+
+TEST(SlidingWindowGPTest, clearTest) {
+  SlidingWindowGP gp(10);
+  for (int i = 0; i < 15; ++i) {
+    gp.append(i, i);
+  }
+  gp.clear();
+  EXPECT_EQ(gp.size(), 0);
+  EXPECT_EQ(gp.predict(1.0), 0.0);
+
+  gp.append(1.0, 2.0);
+  EXPECT_EQ(gp.size(), 1);
+  EXPECT_NEAR(gp.predict(1.0), 2.0, 1e-12);
+}
+
+/*
+ * Reports the latency of one guiding step (append + predict) as the window
+ * grows. The window is filled first, so that every timed step also removes
+ * the oldest datapoint.
+ */
+TEST(SlidingWindowGPTest, stepLatencyBenchmark) {
+  const int window_sizes[] = { 50, 100, 200, 400, 800 };
+  const int steps = 200;
+
+  for (int w = 0; w < 5; ++w) {
+    int max_size = window_sizes[w];
+    SlidingWindowGP gp(max_size);
+
+    double t = 0.0;
+    for (int i = 0; i < max_size; ++i, t += 2.0) {
+      gp.append(t, signal(t));
+    }
+
+    double sink = 0.0;
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < steps; ++i, t += 2.0) {
+      gp.append(t, signal(t));
+      sink += gp.predict(t + 1.0);
+    }
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::high_resolution_clock::now() - start;
+
+    EXPECT_FALSE(std::isnan(sink));
+    std::cout << "[ BENCHMARK] window " << max_size << ": "
+              << elapsed.count() / steps << " us per step" << std::endl;
+  }
+}
+
+int main(int argc, char ** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,177 @@
+// Copyright (c) 2015 Max Planck Society
+
+#include "sliding_window_gp.h"
+#include "math_tools.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// smallest value allowed on the diagonal of the Cholesky factor, guards
+// against loss of positive definiteness through rounding errors
+const double kMinimalPivot = 1e-9;
+}  // namespace
+
+SlidingWindowGP::Hyperparameters::Hyperparameters()
+: signal_variance(1.0),
+length_scale(500.0),
+periodic_variance(1.0),
+periodic_length_scale(2.0),
+period(480.0),
+noise_variance(0.1) {}
+
+SlidingWindowGP::SlidingWindowGP(int max_size, const Hyperparameters& hyper)
+: max_size_(max_size),
+size_(0),
+hyper_(hyper),
+timestamps_(Eigen::VectorXd::Zero(max_size)),
+values_(Eigen::VectorXd::Zero(max_size)),
+cholesky_(Eigen::MatrixXd::Zero(max_size, max_size)),
+weights_(Eigen::VectorXd::Zero(max_size)),
+scratch_(Eigen::VectorXd::Zero(max_size)),
+prediction_scratch_(Eigen::VectorXd::Zero(max_size)),
+mean_(0.0) {}
+
+double SlidingWindowGP::priorVariance() const {
+  return hyper_.signal_variance + hyper_.periodic_variance +
+         hyper_.noise_variance;
+}
+
+void SlidingWindowGP::covariance(int n, double timestamp,
+                                 Eigen::VectorXd& result) const {
+  /*
+   * Same kernel as in setHyperparameters(), but evaluated directly for a
+   * single location: going through squareDistance() here would allocate
+   * several temporaries on each call.
+   */
+  const double se_factor = -0.5 / (hyper_.length_scale * hyper_.length_scale);
+  const double p_factor =
+      -2.0 / (hyper_.periodic_length_scale * hyper_.periodic_length_scale);
+  const double p_freq = M_PI / hyper_.period;
+
+  for (int i = 0; i < n; ++i) {
+    double d = timestamps_[i] - timestamp;
+    double s = std::sin(p_freq * d);
+    result[i] = hyper_.signal_variance * std::exp(se_factor * d * d) +
+                hyper_.periodic_variance * std::exp(p_factor * s * s);
+  }
+}
+
+void SlidingWindowGP::append(double timestamp, double value) {
+  if (size_ == max_size_) {
+    removeOldest();
+  }
+
+  const int n = size_;
+
+  // new row of the factor: l = L^-1 k, d = sqrt(k** - l'l)
+  if (n > 0) {
+    covariance(n, timestamp, scratch_);
+    cholesky_.topLeftCorner(n, n).triangularView<Eigen::Lower>()
+        .solveInPlace(scratch_.head(n));
+    cholesky_.row(n).head(n) = scratch_.head(n).transpose();
+  }
+  double pivot = priorVariance() - scratch_.head(n).squaredNorm();
+  cholesky_(n, n) = std::sqrt(std::max(pivot, kMinimalPivot));
+
+  timestamps_[n] = timestamp;
+  values_[n] = value;
+  ++size_;
+
+  updateWeights();
+}
+
+void SlidingWindowGP::removeOldest() {
+  const int n = size_ - 1;
+
+  /*
+   * With L = [l11 0; l21 L22], the factor of the Gram matrix without the
+   * first datapoint is the factor of L22 L22' + l21 l21', obtained from L22
+   * by a rank-1 update.
+   */
+  scratch_.head(n) = cholesky_.col(0).segment(1, n);
+
+  // Shift the remaining factor to the top left corner. Reading (i+1, j+1)
+  // after writing (i, j) in column-major order never reads a written entry.
+  for (int j = 0; j < n; ++j) {
+    for (int i = j; i < n; ++i) {
+      cholesky_(i, j) = cholesky_(i + 1, j + 1);
+    }
+  }
+  cholesky_.row(n).setZero();
+  cholesky_.col(n).setZero();
+
+  for (int k = 0; k < n; ++k) {
+    double lkk = cholesky_(k, k);
+    double r = std::sqrt(lkk * lkk + scratch_[k] * scratch_[k]);
+    double c = r / lkk;
+    double s = scratch_[k] / lkk;
+    cholesky_(k, k) = r;
+    for (int i = k + 1; i < n; ++i) {
+      cholesky_(i, k) = (cholesky_(i, k) + s * scratch_[i]) / c;
+      scratch_[i] = c * scratch_[i] - s * cholesky_(i, k);
+    }
+  }
+
+  for (int i = 0; i < n; ++i) {
+    timestamps_[i] = timestamps_[i + 1];
+    values_[i] = values_[i + 1];
+  }
+  size_ = n;
+}
+
+void SlidingWindowGP::updateWeights() {
+  const int n = size_;
+  mean_ = values_.head(n).mean();
+  weights_.head(n) = values_.head(n).array() - mean_;
+  cholesky_.topLeftCorner(n, n).triangularView<Eigen::Lower>()
+      .solveInPlace(weights_.head(n));
+  cholesky_.topLeftCorner(n, n).triangularView<Eigen::Lower>().transpose()
+      .solveInPlace(weights_.head(n));
+}
+
+double SlidingWindowGP::predict(double timestamp) const {
+  if (size_ == 0) {
+    return 0.0;
+  }
+
+  covariance(size_, timestamp, prediction_scratch_);
+  return mean_ + prediction_scratch_.head(size_).dot(weights_.head(size_));
+}
+
+void SlidingWindowGP::clear() {
+  size_ = 0;
+  mean_ = 0.0;
+  cholesky_.setZero();
+  weights_.setZero();
+}
+
+void SlidingWindowGP::setHyperparameters(const Hyperparameters& hyper) {
+  hyper_ = hyper;
+
+  const int n = size_;
+  if (n == 0) {
+    return;
+  }
+
+  Eigen::MatrixXd t = timestamps_.head(n).transpose();
+  Eigen::MatrixXd sq_dist = math_tools::squareDistance(t);
+  Eigen::MatrixXd dist = sq_dist.array().max(0.0).sqrt();
+
+  const double se_factor = -0.5 / (hyper_.length_scale * hyper_.length_scale);
+  const double p_factor =
+      -2.0 / (hyper_.periodic_length_scale * hyper_.periodic_length_scale);
+
+  Eigen::ArrayXXd se = (se_factor * sq_dist.array()).exp();
+  Eigen::ArrayXXd periodic =
+      (p_factor * (M_PI / hyper_.period * dist.array()).sin().square()).exp();
+
+  Eigen::MatrixXd gram = (hyper_.signal_variance * se +
+                          hyper_.periodic_variance * periodic).matrix();
+  gram.diagonal().array() += hyper_.noise_variance;
+
+  cholesky_.setZero();
+  cholesky_.topLeftCorner(n, n) = gram.llt().matrixL();
+
+  updateWeights();
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2015 Max Planck Society
+
+/*!@file
+ *
+ * @brief
+ * The file holds the SlidingWindowGP class, a Gaussian process regressor
+ * over a window of the most recent datapoints.
+ *
+ */
+
+#ifndef PHD_SLIDING_WINDOW_GP
+#define PHD_SLIDING_WINDOW_GP
+
+#include <Eigen/Dense>
+
+/*!
+ * The SlidingWindowGP class performs one-dimensional Gaussian process
+ * regression on the last @code max_size @endcode datapoints.
+ *
+ * The covariance function is the sum of a squared exponential kernel (for
+ * the slowly varying part of the signal) and a periodic kernel (for the
+ * periodic error of the mount gears).
+ *
+ * Instead of refactoring the full Gram matrix each time a datapoint is
+ * appended, the Cholesky factor is extended by one row, and when the window
+ * is full, the oldest datapoint is removed by a rank-1 update of the
+ * remaining factor. Both operations are O(n^2), as is the computation of the
+ * weight vector. A prediction is then O(n).
+ *
+ * Usage:
+ * @code
+ *  SlidingWindowGP gp(100);
+ *  for (int i = 0; i < 200; ++i) {
+ *    gp.append(i, std::sin(0.1 * i));
+ *  }
+ *  double next = gp.predict(200);
+ * @endcode
+ */
+class SlidingWindowGP {
+ public:
+  /*!
+   * The hyperparameters of the covariance function. Time is expected in the
+   * same unit as the timestamps passed to append().
+   */
+  struct Hyperparameters {
+    double signal_variance;          //!< variance of the squared exponential
+    double length_scale;             //!< length scale of the squared exponential
+    double periodic_variance;        //!< variance of the periodic kernel
+    double periodic_length_scale;    //!< (unitless) length scale of the periodic kernel
+    double period;                   //!< period of the periodic kernel
+    double noise_variance;           //!< variance of the measurement noise
+
+    Hyperparameters();
+  };
+
+  /*!
+   * Constructor of the SlidingWindowGP class. All the storage is allocated
+   * here, so that appending and predicting do not resize any matrix.
+   *
+   * @param max_size The maximum number of datapoints kept in the window.
+   * @param hyper The hyperparameters of the covariance function.
+   */
+  explicit SlidingWindowGP(int max_size,
+                           const Hyperparameters& hyper = Hyperparameters());
+
+  ~SlidingWindowGP() {}
+
+  /*!
+   * Appends a datapoint, removing the oldest one first if the window is
+   * full.
+   *
+   * @param timestamp The location of the datapoint
+   * @param value The (noisy) observation at that location
+   */
+  void append(double timestamp, double value);
+
+  /*!
+   * Returns the posterior mean at the given location. Returns 0 if no
+   * datapoint has been appended so far. Uses a workspace of the class, so
+   * concurrent calls on the same object are not allowed.
+   */
+  double predict(double timestamp) const;
+
+  /*!
+   * Removes all datapoints from the window.
+   */
+  void clear();
+
+  /*!
+   * Changes the hyperparameters. The Cholesky factor of the current window
+   * is recomputed from scratch, which is O(n^3).
+   */
+  void setHyperparameters(const Hyperparameters& hyper);
+
+  const Hyperparameters& getHyperparameters() const { return hyper_; }
+
+  //! Returns the number of datapoints currently in the window
+  int size() const { return size_; }
+
+  //! Returns the maximum number of datapoints in the window
+  int maxSize() const { return max_size_; }
+
+ private:
+  /*!
+   * Fills the first @code n @endcode entries of @code result @endcode with the
+   * covariances between the @code n @endcode first stored timestamps and
+   * @code timestamp @endcode.
+   */
+  void covariance(int n, double timestamp, Eigen::VectorXd& result) const;
+
+  //! Prior variance of a noisy datapoint
+  double priorVariance() const;
+
+  //! Removes the oldest datapoint and downdates the Cholesky factor
+  void removeOldest();
+
+  //! Recomputes the weights from the Cholesky factor and the values
+  void updateWeights();
+
+  int max_size_;
+  int size_;
+  Hyperparameters hyper_;
+
+  Eigen::VectorXd timestamps_;
+  Eigen::VectorXd values_;
+  Eigen::MatrixXd cholesky_;   // lower triangular factor of the Gram matrix
+  Eigen::VectorXd weights_;    // (K + noise)^-1 * (values - mean)
+  Eigen::VectorXd scratch_;
+  mutable Eigen::VectorXd prediction_scratch_;  // covariances to the predicted location
+  double mean_;
+};
+
+#endif  // PHD_SLIDING_WINDOW_GP
@@ -0,0 +1,332 @@
+/*
+ *  dark_builder.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+#include "dark_builder.h"
+
+wxDEFINE_EVENT(DARK_BUILDER_EVENT, wxThreadEvent);
+
+DarkStacker::DarkStacker(void)
+    : m_count(0),
+      m_bpp(0)
+{
+}
+
+class DarkStackJob : public RowBandJob
+{
+    const unsigned short *m_src;
+    unsigned int *m_sum;
+    unsigned short *m_hi1;
+    unsigned short *m_hi2;
+    unsigned short *m_lo;
+    int m_width;
+
+public:
+    DarkStackJob(const usImage& frame, unsigned int *sum, unsigned short *hi1, unsigned short *hi2, unsigned short *lo)
+        : m_src(frame.ImageData), m_sum(sum), m_hi1(hi1), m_hi2(hi2), m_lo(lo),
+          m_width(frame.Size.GetWidth()) { }
+
+    void Run(int band, int y0, int y1)
+    {
+        for (int i = y0 * m_width; i < y1 * m_width; i++)
+        {
+            unsigned short v = m_src[i];
+            m_sum[i] += v;
+            if (v > m_hi1[i])
+            {
+                m_hi2[i] = m_hi1[i];
+                m_hi1[i] = v;
+            }
+            else if (v > m_hi2[i])
+                m_hi2[i] = v;
+            if (v < m_lo[i])
+                m_lo[i] = v;
+        }
+    }
+};
+
+bool DarkStacker::Add(const usImage& frame)
+{
+    if (!frame.ImageData)
+        return true;
+
+    if (m_count == 0)
+    {
+        m_size = frame.Size;
+        m_bpp = frame.BitsPerPixel;
+        size_t n = frame.NPixels;
+        m_sum.assign(n, 0);
+        m_hi1.assign(n, 0);
+        m_hi2.assign(n, 0);
+        m_lo.assign(n, 65535);
+    }
+    else if (frame.Size != m_size)
+    {
+        Debug.Write(wxString::Format("DarkStacker: frame size %dx%d does not match %dx%d\n",
+            frame.Size.GetWidth(), frame.Size.GetHeight(), m_size.GetWidth(), m_size.GetHeight()));
+        return true;
+    }
+
+    // the sum of 65536 frames would not fit
+    if (m_count >= 65536)
+        return true;
+
+    DarkStackJob job(frame, &m_sum[0], &m_hi1[0], &m_hi2[0], &m_lo[0]);
+    RunRowBands(job, RowBandCount(m_size.GetHeight()), 0, m_size.GetHeight());
+
+    ++m_count;
+    return false;
+}
+
+bool DarkStacker::GetMaster(usImage& master) const
+{
+    if (m_count == 0)
+        return true;
+
+    if (master.Init(m_size))
+        return true;
+
+    int const trimHigh = TrimHigh(m_count);
+    int const trimLow = TrimLow(m_count);
+    unsigned int const n = m_count - trimHigh - trimLow;
+
+    unsigned short *dst = master.ImageData;
+    for (int i = 0; i < master.NPixels; i++)
+    {
+        unsigned int sum = m_sum[i];
+        if (trimHigh > 0)
+            sum -= m_hi1[i];
+        if (trimHigh > 1)
+            sum -= m_hi2[i];
+        if (trimLow > 0)
+            sum -= m_lo[i];
+        dst[i] = (unsigned short)((sum + n / 2) / n);
+    }
+
+    master.BitsPerPixel = m_bpp;
+    master.ImgStackCnt = m_count;
+
+    return false;
+}
+
+DarkBuilder::DarkBuilder(wxEvtHandler *client, const std::vector<int>& exposures, int frameCount)
+    : wxThread(wxTHREAD_JOINABLE),
+      m_client(client),
+      m_exposures(exposures),
+      m_frameCount(frameCount),
+      m_interrupt(0)
+{
+}
+
+void DarkBuilder::Progress(const wxString& status, int done)
+{
+    wxThreadEvent *event = new wxThreadEvent(DARK_BUILDER_EVENT, DARK_BUILDER_PROGRESS);
+    event->SetString(status);
+    event->SetInt(done);
+    wxQueueEvent(m_client, event);
+}
+
+// Cameras that cannot capture off the main thread are asked to capture there,
+// like the worker thread does for guide frames
+static bool CaptureDark(int expTime, usImage& img)
+{
+    if (pCamera->HasNonGuiCapture())
+        return GuideCamera::Capture(pCamera, expTime, img, CAPTURE_DARK);
+
+    wxSemaphore semaphore;
+
+    EXPOSE_REQUEST req;
+    req.pImage = &img;
+    req.exposureDuration = expTime;
+    req.options = CAPTURE_DARK;
+    req.subframe = wxRect(0, 0, 0, 0);
+    req.error = false;
+    req.pSemaphore = &semaphore;
+
+    wxCommandEvent evt(REQUEST_EXPOSURE_EVENT, wxID_ANY);
+    evt.SetClientData(&req);
+    wxQueueEvent(pFrame, evt.Clone());
+
+    semaphore.Wait();
+
+    return req.error;
+}
+
+// Adds a frame to the stack while the next frame is captured
+class DarkStackThread : public wxThread
+{
+    DarkStacker& m_stacker;
+    const usImage& m_frame;
+    bool m_started;
+    bool m_err;
+
+public:
+    DarkStackThread(DarkStacker& stacker, const usImage& frame)
+        : wxThread(wxTHREAD_JOINABLE), m_stacker(stacker), m_frame(frame), m_started(false), m_err(true) { }
+    ExitCode Entry() { Stack(); return 0; }
+    void Stack(void) { m_err = m_stacker.Add(m_frame); }
+    void Start(void);
+    bool Finish(void);
+};
+
+void DarkStackThread::Start(void)
+{
+    m_started = Create() == wxTHREAD_NO_ERROR && Run() == wxTHREAD_NO_ERROR;
+    if (!m_started)
+        Stack();
+}
+
+// returns true on error
+bool DarkStackThread::Finish(void)
+{
+    if (m_started)
+        Wait();
+    return m_err;
+}
+
+static DarkStackThread *StartStacking(DarkStacker& stacker, const usImage& frame)
+{
+    DarkStackThread *thread = new DarkStackThread(stacker, frame);
+    thread->Start();
+    return thread;
+}
+
+// returns true on error
+static bool FinishStacking(DarkStackThread *thread)
+{
+    bool err = thread->Finish();
+    delete thread;
+    return err;
+}
+
+// returns true on error
+bool DarkBuilder::BuildMaster(int expTime, int *done)
+{
+    wxString preamble;
+    if (expTime >= 1000)
+        preamble = wxString::Format(_("Building master dark at %.1f sec:"), (double) expTime / 1000.0);
+    else
+        preamble = wxString::Format(_("Building master dark at %d mSec:"), expTime);
+
+    DarkStacker stacker;
+    usImage frames[2];
+    DarkStackThread *stacking = NULL;
+    bool err = false;
+
+    for (int j = 0; j < m_frameCount && !Cancelled(); j++)
+    {
+        usImage& frame = frames[j & 1];
+
+        Progress(preamble + " " + wxString::Format(_("Taking dark frame %d/%d"), j + 1, m_frameCount), *done);
+
+        Debug.Write(wxString::Format("Capture dark frame %d/%d exp=%d\n", j + 1, m_frameCount, expTime));
+        if (CaptureDark(expTime, frame))
+        {
+            // an interrupted exposure is not a failure
+            if (Cancelled())
+                break;
+            Progress(preamble + " " + wxString::Format(_("%.1f s dark FAILED"), (double) expTime / 1000.0), *done);
+            err = true;
+            break;
+        }
+
+        *done += expTime;
+
+        int mn = 65535, mx = 0;
+        PixelMinMax(frame.ImageData, frame.NPixels, &mn, &mx);
+        Debug.Write(wxString::Format("dark frame stats: bpp %u min %d max %d\n", frame.BitsPerPixel, mn, mx));
+
+        // the previous frame must be in the stack before its buffer is reused
+        if (stacking && FinishStacking(stacking))
+        {
+            stacking = NULL;
+            err = true;
+            break;
+        }
+        stacking = StartStacking(stacker, frame);
+    }
+
+    if (stacking && FinishStacking(stacking))
+        err = true;
+
+    if (err || Cancelled())
+        return err;
+
+    usImage *master = new usImage();
+    if (stacker.GetMaster(*master))
+    {
+        delete master;
+        return true;
+    }
+    master->ImgExpDur = expTime;
+
+    Debug.Write(wxString::Format("Master dark %d ms built from %d frames, dropping %d high and %d low values per pixel\n",
+        expTime, stacker.Count(), DarkStacker::TrimHigh(stacker.Count()), DarkStacker::TrimLow(stacker.Count())));
+
+    Progress(preamble + " " + _("Dark frames complete"), *done);
+
+    wxThreadEvent *event = new wxThreadEvent(DARK_BUILDER_EVENT, DARK_BUILDER_MASTER);
+    event->SetPayload<usImage *>(master);
+    wxQueueEvent(m_client, event);
+
+    return false;
+}
+
+wxThread::ExitCode DarkBuilder::Entry()
+{
+    DarkBuilderResult result = DARK_BUILDER_OK;
+    int done = 0;
+
+    // let Cancel() interrupt the exposures taken on this thread
+    WorkerThread::SetInterruptFlags(&m_interrupt);
+
+    for (std::vector<int>::const_iterator it = m_exposures.begin(); it != m_exposures.end() && !Cancelled(); ++it)
+    {
+        if (BuildMaster(*it, &done))
+        {
+            result = DARK_BUILDER_FAILED;
+            break;
+        }
+    }
+
+    WorkerThread::SetInterruptFlags(NULL);
+
+    if (result == DARK_BUILDER_OK && Cancelled())
+        result = DARK_BUILDER_CANCELLED;
+
+    wxThreadEvent *event = new wxThreadEvent(DARK_BUILDER_EVENT, DARK_BUILDER_DONE);
+    event->SetInt(result);
+    wxQueueEvent(m_client, event);
+
+    return 0;
+}
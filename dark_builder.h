@@ -0,0 +1,110 @@
+/*
+ *  dark_builder.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DARK_BUILDER_H_INCLUDED
+#define DARK_BUILDER_H_INCLUDED
+
+/*
+ * Combines dark frames into a master dark one frame at a time. Each pixel
+ * keeps a running sum together with its two highest and its lowest values,
+ * and the master is the mean with those extremes left out, so a cosmic ray
+ * hit or a glitch in a single frame does not leak into the master. Memory
+ * use does not depend on the number of frames.
+ */
+class DarkStacker
+{
+    wxSize                      m_size;
+    int                         m_count;
+    wxByte                      m_bpp;
+    std::vector<unsigned int>   m_sum;
+    std::vector<unsigned short> m_hi1;
+    std::vector<unsigned short> m_hi2;
+    std::vector<unsigned short> m_lo;
+
+public:
+    DarkStacker(void);
+
+    int Count(void) const { return m_count; }
+
+    // returns true on error
+    bool Add(const usImage& frame);
+    bool GetMaster(usImage& master) const;
+
+    // how many of the highest and lowest values of each pixel are dropped
+    static int TrimHigh(int frames) { return frames >= 8 ? 2 : frames >= 3 ? 1 : 0; }
+    static int TrimLow(int frames) { return frames >= 3 ? 1 : 0; }
+};
+
+wxDECLARE_EVENT(DARK_BUILDER_EVENT, wxThreadEvent);
+
+// event ids of DARK_BUILDER_EVENT
+enum DarkBuilderEventId
+{
+    DARK_BUILDER_PROGRESS,      // GetString(): status, GetInt(): exposure time completed so far
+    DARK_BUILDER_MASTER,        // GetPayload<usImage *>(): a master dark, owned by the receiver
+    DARK_BUILDER_DONE,          // GetInt(): a DarkBuilderResult
+};
+
+enum DarkBuilderResult
+{
+    DARK_BUILDER_OK,
+    DARK_BUILDER_FAILED,
+    DARK_BUILDER_CANCELLED,
+};
+
+/*
+ * Builds a master dark for each of a list of exposure durations on a
+ * background thread. The next frame is captured while the previous one is
+ * added to the stack, and progress and the finished masters are sent to the
+ * client as DARK_BUILDER_EVENTs. DARK_BUILDER_DONE is always the last event.
+ */
+class DarkBuilder : public wxThread
+{
+    wxEvtHandler       *m_client;
+    std::vector<int>    m_exposures;
+    int                 m_frameCount;
+    volatile unsigned int m_interrupt;  // WorkerThread interrupt bits, seen by the camera while capturing
+
+    void Progress(const wxString& status, int done);
+    bool BuildMaster(int expTime, int *done);
+
+public:
+    DarkBuilder(wxEvtHandler *client, const std::vector<int>& exposures, int frameCount);
+
+    // also stops an exposure in progress on cameras that support it
+    void Cancel(void) { m_interrupt |= WorkerThread::INT_STOP; }
+    bool Cancelled(void) const { return m_interrupt != 0; }
+    ExitCode Entry();
+};
+
+#endif // DARK_BUILDER_H_INCLUDED
@@ -0,0 +1,417 @@
+/*
+ *  darklib_cache.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+
+#include <wx/filename.h>
+
+#ifdef __WINDOWS__
+# include <psapi.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+#ifdef __APPLE__
+# include <mach/mach.h>
+#endif
+
+static const char CACHE_MAGIC[8] = { 'P', 'H', 'D', '2', 'D', 'A', 'R', 'K' };
+static const wxUint32 CACHE_VERSION = 1;
+
+// frames are aligned to this many bytes in the file, a multiple of the page
+// size (and of the allocation granularity on Windows)
+static const wxFileOffset FRAME_ALIGN = 64 * 1024;
+
+// The file layout is the header, the frames, then the index of the frames.
+// All values are in native byte order, the cache is never moved to another
+// machine.
+struct CacheHeader
+{
+    char        magic[8];
+    wxUint32    version;
+    wxUint32    width;
+    wxUint32    height;
+    wxUint32    count;
+    wxInt64     srcSize;        // size and modification time of the FITS
+    wxInt64     srcTime;        // file the cache was built from
+    wxUint64    indexOffset;
+};
+
+struct CacheEntry
+{
+    wxInt32     expDur;
+    wxUint32    reserved;
+    wxUint64    offset;
+};
+
+static bool GetSourceStamp(const wxString& darkLibName, wxInt64 *size, wxInt64 *mtime)
+{
+    wxFileName fn(darkLibName);
+    wxULongLong sz = fn.GetSize();
+    wxDateTime tm = fn.GetModificationTime();
+    if (sz == wxInvalidSize || !tm.IsValid())
+        return false;
+    *size = (wxInt64) sz.GetValue();
+    *mtime = tm.GetValue().GetValue(); // milliseconds
+    return true;
+}
+
+static wxFileOffset AlignUp(wxFileOffset ofs)
+{
+    return (ofs + FRAME_ALIGN - 1) / FRAME_ALIGN * FRAME_ALIGN;
+}
+
+wxString DarkLibCache::CacheFileName(const wxString& darkLibName)
+{
+    wxFileName fn(darkLibName);
+    fn.SetExt("cache");
+    return fn.GetFullPath();
+}
+
+void DarkLibCache::Remove(const wxString& darkLibName)
+{
+    wxString fname = CacheFileName(darkLibName);
+    if (wxFileExists(fname))
+    {
+        Debug.Write(wxString::Format("Removing dark library cache file: %s\n", fname));
+        wxRemoveFile(fname);
+    }
+}
+
+DarkLibCache::DarkLibCache(const wxString& fileName)
+    :
+    m_fileName(fileName),
+    m_base(0),
+    m_length(0),
+#ifdef __WINDOWS__
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(0)
+#else
+    m_fd(-1)
+#endif
+{
+}
+
+DarkLibCache::~DarkLibCache(void)
+{
+#ifdef __WINDOWS__
+    if (m_base)
+        UnmapViewOfFile(m_base);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+#else
+    if (m_base)
+        munmap(m_base, m_length);
+    if (m_fd != -1)
+        close(m_fd);
+#endif
+}
+
+bool DarkLibCache::Map(void)
+{
+    // returns true on error
+
+#ifdef __WINDOWS__
+    m_file = CreateFileW(m_fileName.wc_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return true;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart < (LONGLONG) sizeof(CacheHeader) ||
+        (ULONGLONG) size.QuadPart > (size_t) -1)
+    {
+        return true;
+    }
+    m_length = (size_t) size.QuadPart;
+
+    m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_mapping)
+        return true;
+
+    m_base = (unsigned char *) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_base)
+        return true;
+#else
+    m_fd = open(m_fileName.fn_str(), O_RDONLY);
+    if (m_fd == -1)
+        return true;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size < (off_t) sizeof(CacheHeader) ||
+        (unsigned long long) st.st_size > (size_t) -1)
+    {
+        return true;
+    }
+    m_length = (size_t) st.st_size;
+
+    void *p = mmap(NULL, m_length, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (p == MAP_FAILED)
+        return true;
+    m_base = (unsigned char *) p;
+
+    // the frames are read in whole, but only one of them at a time
+    madvise(m_base, m_length, MADV_RANDOM);
+#endif
+
+    return false;
+}
+
+DarkLibCache *DarkLibCache::Open(const wxString& darkLibName)
+{
+    wxString fname = CacheFileName(darkLibName);
+    if (!wxFileExists(fname))
+        return NULL;
+
+    DarkLibCache *cache = new DarkLibCache(fname);
+
+    try
+    {
+        wxInt64 srcSize, srcTime;
+        if (!GetSourceStamp(darkLibName, &srcSize, &srcTime))
+            throw ERROR_INFO("cannot stat dark library file");
+
+        if (cache->Map())
+            throw ERROR_INFO("cannot map dark library cache");
+
+        const CacheHeader *hdr = (const CacheHeader *) cache->m_base;
+        if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || hdr->version != CACHE_VERSION)
+            throw ERROR_INFO("not a dark library cache");
+
+        if (hdr->srcSize != srcSize || hdr->srcTime != srcTime)
+            throw ERROR_INFO("dark library cache is out of date");
+
+        size_t frameBytes = (size_t) hdr->width * hdr->height * sizeof(unsigned short);
+        if (hdr->width == 0 || hdr->height == 0 || hdr->count == 0 ||
+            hdr->indexOffset > cache->m_length ||
+            (cache->m_length - hdr->indexOffset) / sizeof(CacheEntry) < hdr->count)
+        {
+            throw ERROR_INFO("corrupt dark library cache header");
+        }
+
+        cache->m_frameSize = wxSize(hdr->width, hdr->height);
+
+        const CacheEntry *entry = (const CacheEntry *) (cache->m_base + hdr->indexOffset);
+        for (unsigned int i = 0; i < hdr->count; i++, entry++)
+        {
+            if (entry->offset % FRAME_ALIGN != 0 || entry->offset > cache->m_length ||
+                cache->m_length - entry->offset < frameBytes)
+            {
+                throw ERROR_INFO("corrupt dark library cache index");
+            }
+
+            Frame frame;
+            frame.expDur = entry->expDur;
+            // the mapping is read-only; dark frames are never written to
+            frame.pixels = (unsigned short *) (cache->m_base + entry->offset);
+            cache->m_frames.push_back(frame);
+        }
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        delete cache;
+        cache = NULL;
+    }
+
+    return cache;
+}
+
+static bool FrameRange(const unsigned char *base, size_t length, const usImage& img, unsigned char **start, size_t *len)
+{
+    const unsigned char *p = (const unsigned char *) img.ImageData;
+    size_t bytes = img.NPixels * sizeof(unsigned short);
+    if (!p || p < base || p + bytes > base + length)
+        return false;
+    *start = const_cast<unsigned char *>(p);
+    *len = bytes;
+    return true;
+}
+
+void DarkLibCache::WillNeed(const usImage& img) const
+{
+    unsigned char *start;
+    size_t len;
+    if (!FrameRange(m_base, m_length, img, &start, &len))
+        return;
+
+#ifdef __WINDOWS__
+    // nothing to do, the frame faults in on first use
+#else
+    madvise(start, len, MADV_WILLNEED);
+#endif
+}
+
+void DarkLibCache::Evict(const usImage& img) const
+{
+    unsigned char *start;
+    size_t len;
+    if (!FrameRange(m_base, m_length, img, &start, &len))
+        return;
+
+#ifdef __WINDOWS__
+    // unlocking pages that are not locked removes them from the working set
+    VirtualUnlock(start, len);
+#else
+    // the pages are clean, they are simply read from the file again if needed
+    madvise(start, len, MADV_DONTNEED);
+#endif
+}
+
+DarkLibCacheWriter::DarkLibCacheWriter(const wxString& darkLibName)
+    :
+    m_darkLibName(darkLibName),
+    m_tmpName(DarkLibCache::CacheFileName(darkLibName) + ".tmp"),
+    m_ok(false)
+{
+    wxLogNull logNull;
+    if (m_file.Create(m_tmpName, true))
+    {
+        // the header is written by Commit()
+        CacheHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        m_ok = m_file.Write(&hdr, sizeof(hdr)) == sizeof(hdr);
+    }
+}
+
+DarkLibCacheWriter::~DarkLibCacheWriter(void)
+{
+    if (m_file.IsOpened())
+    {
+        m_file.Close();
+        wxRemoveFile(m_tmpName);
+    }
+}
+
+void DarkLibCacheWriter::Add(const usImage& dark)
+{
+    if (!m_ok)
+        return;
+
+    if (m_index.empty())
+        m_frameSize = dark.Size;
+    else if (dark.Size != m_frameSize)
+    {
+        m_ok = false;
+        return;
+    }
+
+    wxFileOffset ofs = AlignUp(m_file.Length());
+    size_t bytes = dark.NPixels * sizeof(unsigned short);
+
+    if (m_file.Seek(ofs) != ofs || m_file.Write(dark.ImageData, bytes) != bytes)
+    {
+        m_ok = false;
+        return;
+    }
+
+    m_index.push_back(std::make_pair(dark.ImgExpDur, ofs));
+}
+
+bool DarkLibCacheWriter::Commit(void)
+{
+    // returns true on error
+
+    if (!m_ok || m_index.empty())
+        return true;
+
+    CacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    hdr.version = CACHE_VERSION;
+    hdr.width = m_frameSize.GetWidth();
+    hdr.height = m_frameSize.GetHeight();
+    hdr.count = m_index.size();
+    if (!GetSourceStamp(m_darkLibName, &hdr.srcSize, &hdr.srcTime))
+        return true;
+
+    // pad the last frame to the alignment so that its pages lie entirely in the file
+    hdr.indexOffset = AlignUp(m_file.Length());
+    if (m_file.Seek(hdr.indexOffset) != (wxFileOffset) hdr.indexOffset)
+        return true;
+
+    for (auto it = m_index.begin(); it != m_index.end(); ++it)
+    {
+        CacheEntry entry;
+        entry.expDur = it->first;
+        entry.reserved = 0;
+        entry.offset = it->second;
+        if (m_file.Write(&entry, sizeof(entry)) != sizeof(entry))
+            return true;
+    }
+
+    if (m_file.Seek(0) != 0 || m_file.Write(&hdr, sizeof(hdr)) != sizeof(hdr))
+        return true;
+
+    if (!m_file.Flush() || !m_file.Close())
+        return true;
+
+    if (!wxRenameFile(m_tmpName, DarkLibCache::CacheFileName(m_darkLibName), true))
+    {
+        wxRemoveFile(m_tmpName);
+        return true;
+    }
+
+    return false;
+}
+
+double GetResidentMemoryMB(void)
+{
+#if defined(__WINDOWS__)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return (double) pmc.WorkingSetSize / (1024. * 1024.);
+    return -1.0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS)
+        return (double) info.resident_size / (1024. * 1024.);
+    return -1.0;
+#else
+    double rss = -1.0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        unsigned long size, resident;
+        if (fscanf(fp, "%lu %lu", &size, &resident) == 2)
+            rss = (double) resident * sysconf(_SC_PAGESIZE) / (1024. * 1024.);
+        fclose(fp);
+    }
+    return rss;
+#endif
+}
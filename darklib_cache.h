@@ -0,0 +1,119 @@
+/*
+ *  darklib_cache.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DARKLIB_CACHE_H_INCLUDED
+#define DARKLIB_CACHE_H_INCLUDED
+
+/*
+ * The dark library cache is an uncompressed copy of the dark library FITS
+ * file, stored next to it, that can be memory-mapped. Each dark frame starts
+ * on a page boundary, so the frames are paged in from the file only when they
+ * are used and can be dropped from the working set independently.
+ *
+ * The cache records the size and modification time of the FITS file it was
+ * built from and is rebuilt when they no longer match.
+ */
+class DarkLibCache
+{
+    wxString        m_fileName;
+    wxSize          m_frameSize;
+    unsigned char  *m_base;
+    size_t          m_length;
+#ifdef __WINDOWS__
+    void           *m_file;
+    void           *m_mapping;
+#else
+    int             m_fd;
+#endif
+
+    struct Frame
+    {
+        int             expDur;
+        unsigned short *pixels;
+    };
+    std::vector<Frame> m_frames;
+
+    DarkLibCache(const wxString& fileName);
+    bool Map(void);
+
+public:
+    ~DarkLibCache(void);
+
+    // maps the cache of the given dark library file, returns NULL if there is
+    // no up-to-date cache
+    static DarkLibCache *Open(const wxString& darkLibName);
+    static wxString CacheFileName(const wxString& darkLibName);
+    static void Remove(const wxString& darkLibName);
+
+    const wxSize& FrameSize(void) const { return m_frameSize; }
+    size_t FrameCount(void) const { return m_frames.size(); }
+    int FrameExposure(size_t idx) const { return m_frames[idx].expDur; }
+    unsigned short *FrameData(size_t idx) const { return m_frames[idx].pixels; }
+
+    // hints for the pager: read a frame ahead of its use, or drop it from the
+    // working set. Images that are not views of the cache are ignored.
+    void WillNeed(const usImage& img) const;
+    void Evict(const usImage& img) const;
+};
+
+/*
+ * Writes a dark library cache one frame at a time, so that building the cache
+ * needs memory for a single frame only. The cache only replaces an existing
+ * one when Commit() succeeds.
+ */
+class DarkLibCacheWriter
+{
+    wxString        m_darkLibName;
+    wxString        m_tmpName;
+    wxFile          m_file;
+    wxSize          m_frameSize;
+    std::vector<std::pair<int, wxFileOffset> > m_index;
+    bool            m_ok;
+
+public:
+    DarkLibCacheWriter(const wxString& darkLibName);
+    ~DarkLibCacheWriter(void);
+
+    bool IsOk(void) const { return m_ok; }
+
+    // a failure is remembered and reported by Commit()
+    void Add(const usImage& dark);
+
+    // returns true on error
+    bool Commit(void);
+};
+
+// the resident set size of the process in MB, or -1 if it cannot be determined
+extern double GetResidentMemoryMB(void);
+
+#endif // DARKLIB_CACHE_H_INCLUDED
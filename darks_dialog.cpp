@@ -35,13 +35,14 @@
 
 #include "phd.h"
 #include "darks_dialog.h"
+#include "dark_builder.h"
 #include "wx/valnum.h"
-#include <sstream>
 
 static const int DefMinExpTime = 1;
 static const int DefMaxExpTime = 10;
 static const int DefDarkCount = 5;
 static const bool DefCreateDarks = true;
+static const bool DefScaledDark = false;
 static const int DefDMExpTime = 15;
 static const int DefDMCount = 25;
 
@@ -167,10 +168,16 @@ DarksDialog::DarksDialog(wxWindow *parent, bool darkLib) :
             m_rbNewDarkLib->SetValue(true);
         }
 
+        m_cbScaledDark = new wxCheckBox(this, wxID_ANY, _("Build a scaled dark model"));
+        m_cbScaledDark->SetToolTip(_("Take darks at the shortest, middle and longest exposure times only and fit a model of bias and dark current "
+            "to them. Darks for any exposure time are then computed from the model. The model replaces the existing dark library."));
+        m_cbScaledDark->SetValue(pConfig->Profile.GetBoolean("/camera/darks_scaled_model", DefScaledDark));
+
         hSizer->Add(m_rbModifyDarkLib, wxSizerFlags().Border(wxALL, 10));
         hSizer->Add(m_rbNewDarkLib, wxSizerFlags().Border(wxALL, 10));
         pBuildOptions->Add(pInfo, wxSizerFlags().Border(wxALL, 10).Border(wxLEFT, 25));
         pBuildOptions->Add(hSizer, wxSizerFlags().Border(wxALL, 10));
+        pBuildOptions->Add(m_cbScaledDark, wxSizerFlags().Border(wxALL, 10));
         pvSizer->Add(pBuildOptions, wxSizerFlags().Expand());
     }
     else
@@ -237,12 +244,22 @@ DarksDialog::DarksDialog(wxWindow *parent, bool darkLib) :
     SetAutoLayout(true);
     SetSizerAndFit (pvSizer);
 
+    Bind(DARK_BUILDER_EVENT, &DarksDialog::OnBuilderEvent, this);
+    Bind(wxEVT_CLOSE_WINDOW, &DarksDialog::OnClose, this);
+
     m_cancelling = false;
     m_started = false;
+    m_builder = NULL;
 }
 
 void DarksDialog::OnStart(wxCommandEvent& evt)
 {
+    if (buildDarkLib && m_cbScaledDark->GetValue() && m_pDarkMinExpTime->GetSelection() >= m_pDarkMaxExpTime->GetSelection())
+    {
+        wxMessageBox(_("The scaled dark model needs a range of exposure times - choose a max exposure time longer than the min exposure time"));
+        return;
+    }
+
     SaveProfileInfo();
 
     m_pStartBtn->Enable(false);
@@ -250,7 +267,6 @@ void DarksDialog::OnStart(wxCommandEvent& evt)
     m_pStopBtn->SetLabel(_("Stop"));
     m_pStopBtn->Refresh();
     m_started = true;
-    wxYield();
 
     if (!pCamera->HasShutter)
         wxMessageBox(_("Cover guide scope"));
@@ -258,61 +274,133 @@ void DarksDialog::OnStart(wxCommandEvent& evt)
 
     m_pProgress->SetValue(0);
 
-    wxString wrapupMsg;
-
-    bool err = false;
+    std::vector<int> exposures;
+    int frameCount;
 
     if (buildDarkLib)
     {
-        int darkFrameCount = m_pDarkCount->GetValue();
+        frameCount = m_pDarkCount->GetValue();
         int minExpInx = m_pDarkMinExpTime->GetSelection();
         int maxExpInx = m_pDarkMaxExpTime->GetSelection();
 
         std::vector<int> exposureDurations;
         GetExposureDurations(&exposureDurations);
 
-        int tot_dur = 0;
-        for (int i = minExpInx; i <= maxExpInx; i++)
-            tot_dur += exposureDurations[i] * darkFrameCount;
+        if (m_cbScaledDark->GetValue())
+        {
+            // the model is fitted to the ends and the middle of the range
+            exposures.push_back(exposureDurations[minExpInx]);
+            int midExpInx = (minExpInx + maxExpInx) / 2;
+            if (midExpInx != minExpInx)
+                exposures.push_back(exposureDurations[midExpInx]);
+            exposures.push_back(exposureDurations[maxExpInx]);
+        }
+        else
+        {
+            for (int i = minExpInx; i <= maxExpInx; i++)
+                exposures.push_back(exposureDurations[i]);
+        }
+    }
+    else
+    {
+        // Start by computing master dark frame with longish exposure times
+        ShowStatus(_("Taking darks to compute defect map: "),  false);
+
+        frameCount = m_pNumDefExposures->GetValue();
+        exposures.push_back(m_pDefectExpTime->GetValue() * 1000);
+    }
+
+    int tot_dur = 0;
+    for (std::vector<int>::const_iterator it = exposures.begin(); it != exposures.end(); ++it)
+        tot_dur += *it * frameCount;
+    m_pProgress->SetRange(tot_dur);
+
+    pCamera->InitCapture();
 
-        m_pProgress->SetRange(tot_dur);
-        if (m_rbNewDarkLib->GetValue())           // User rebuilding from scratch
-            pCamera->ClearDarks();
+    // all of the exposures are taken on a background thread, so the dialog
+    // stays responsive while the darks are built
+    m_builder = new DarkBuilder(this, exposures, frameCount);
+    if (m_builder->Create() != wxTHREAD_NO_ERROR || m_builder->Run() != wxTHREAD_NO_ERROR)
+    {
+        delete m_builder;
+        m_builder = NULL;
+        Debug.AddLine("Dark builder thread could not be started");
+        BuildComplete(DARK_BUILDER_FAILED);
+    }
+}
+
+void DarksDialog::OnBuilderEvent(wxThreadEvent& evt)
+{
+    switch (evt.GetId())
+    {
+    case DARK_BUILDER_PROGRESS:
+        ShowStatus(evt.GetString(), false);
+        m_pProgress->SetValue(std::min(evt.GetInt(), m_pProgress->GetRange()));
+        break;
 
-        for (int inx = minExpInx; inx <= maxExpInx; inx++)
+    case DARK_BUILDER_MASTER:
+        m_masters.push_back(evt.GetPayload<usImage *>());
+        break;
+
+    case DARK_BUILDER_DONE:
+        if (m_builder)
         {
-            int darkExpTime = exposureDurations[inx];
-            if (darkExpTime >= 1000)
-                ShowStatus (wxString::Format(_("Building master dark at %.1f sec:"), (double)darkExpTime / 1000.0), false);
-            else
-                ShowStatus (wxString::Format(_("Building master dark at %d mSec:"), darkExpTime), false);
-            usImage *newDark = new usImage();
-            err = CreateMasterDarkFrame(*newDark, exposureDurations[inx], darkFrameCount);
-            wxYield();
-            if (m_cancelling || err)
-            {
-                delete newDark;
-                break;
-            }
-            else
-            {
-                pCamera->AddDark(newDark);
-            }
+            m_builder->Wait();
+            delete m_builder;
+            m_builder = NULL;
         }
+        BuildComplete(evt.GetInt());
+        break;
+    }
+}
+
+// Puts the finished master darks to use once all of them have been built
+void DarksDialog::BuildComplete(int result)
+{
+    wxString wrapupMsg;
+
+    bool err = result == DARK_BUILDER_FAILED;
+    if (result == DARK_BUILDER_CANCELLED)
+        m_cancelling = true;
 
+    if (err)
+        pCamera->ShutterClosed = false;
+
+    if (buildDarkLib)
+    {
         if (m_cancelling || err)
         {
+            // the camera's dark library is only changed once all of the darks are built
             ShowStatus(m_cancelling ? _("Operation cancelled - no changes have been made") : _("Operation failed - no changes have been made"), false);
-            if (pFrame->DarkLibExists(pConfig->GetCurrentProfileId(), false))
+        }
+        else if (m_cbScaledDark->GetValue())
+        {
+            std::vector<const usImage *> darks(m_masters.begin(), m_masters.end());
+            ScaledDark *model = ScaledDark::Fit(darks);
+            if (model)
             {
-                if (pFrame->LoadDarkHandler(true))
-                    Debug.AddLine("Dark library abort, dark library restored.");
-                else
-                    Debug.AddLine("Dark library abort, dark library still invalid.");
+                pCamera->SetScaledDark(model);
+                pFrame->SaveDarkLibrary(m_pNotes->GetValue());
+                pFrame->LoadDarkHandler(true);
+                wrapupMsg = _("scaled dark model built");
+                Debug.AddLine(wxString::Format("Dark library - scaled dark model fitted to %d master darks.", (int) darks.size()));
+                ShowStatus(wrapupMsg, false);
+            }
+            else
+            {
+                err = true;
+                pCamera->ShutterClosed = false;
+                ShowStatus(_("Operation failed - no changes have been made"), false);
             }
         }
         else
         {
+            if (m_rbNewDarkLib->GetValue())           // User rebuilding from scratch
+                pCamera->ClearDarks();
+            for (std::vector<usImage *>::iterator it = m_masters.begin(); it != m_masters.end(); ++it)
+                pCamera->AddDark(*it);
+            m_masters.clear();
+
             pFrame->SaveDarkLibrary(m_pNotes->GetValue());
             pFrame->LoadDarkHandler(true);          // Put it to use, including selection of matching dark frame
             wrapupMsg = _("dark library built");
@@ -325,24 +413,19 @@ void DarksDialog::OnStart(wxCommandEvent& evt)
     }
     else
     {
-        // Start by computing master dark frame with longish exposure times
-        ShowStatus(_("Taking darks to compute defect map: "),  false);
-
-        int defectFrameCount = m_pNumDefExposures->GetValue();
-        int defectExpTime = m_pDefectExpTime->GetValue() * 1000;
-
-        m_pProgress->SetRange(defectFrameCount * defectExpTime);
-        m_pProgress->SetValue(0);
-
-        DefectMapDarks darks;
-        err = CreateMasterDarkFrame(darks.masterDark, defectExpTime, defectFrameCount);
-
         if (m_cancelling)
         {
             ShowStatus(_("Operation cancelled"), false);
         }
-        else if (!err)
+        else if (!err && !m_masters.empty())
         {
+            DefectMapDarks darks;
+            const usImage& master = *m_masters[0];
+            darks.masterDark.CopyFrom(master);
+            darks.masterDark.ImgExpDur = master.ImgExpDur;
+            darks.masterDark.ImgStackCnt = master.ImgStackCnt;
+            darks.masterDark.BitsPerPixel = master.BitsPerPixel;
+
             // Our role here is to build the dark-related files needed for defect map building
             ShowStatus(_("Analyzing master dark..."), false);
 
@@ -360,6 +443,8 @@ void DarksDialog::OnStart(wxCommandEvent& evt)
         }
     }
 
+    DeleteMasters();
+
     m_pStartBtn->Enable(true);
     m_pResetBtn->Enable(true);
     pFrame->SetDarkMenuState();         // Hard to know where we are at this point
@@ -373,6 +458,7 @@ void DarksDialog::OnStart(wxCommandEvent& evt)
     }
     else
     {
+        m_started = false;
         // Put up a message showing results and maybe notice to uncover the scope; then close the dialog
         pCamera->ShutterClosed = false; // Lights
         if (!pCamera->HasShutter)
@@ -382,18 +468,42 @@ void DarksDialog::OnStart(wxCommandEvent& evt)
     }
 }
 
+void DarksDialog::DeleteMasters(void)
+{
+    for (std::vector<usImage *>::iterator it = m_masters.begin(); it != m_masters.end(); ++it)
+        delete *it;
+    m_masters.clear();
+}
+
 // Event handler for dual mode cancel/stop button
 void DarksDialog::OnStop(wxCommandEvent& evt)
 {
     if (m_started)
     {
         m_cancelling = true;
+        if (m_builder)
+            m_builder->Cancel();
         ShowStatus(_("Cancelling..."), false);
     }
     else
         wxDialog::Close();
 }
 
+// the dialog cannot go away while the darks are being taken
+void DarksDialog::OnClose(wxCloseEvent& evt)
+{
+    if (m_started && evt.CanVeto())
+    {
+        m_cancelling = true;
+        if (m_builder)
+            m_builder->Cancel();
+        ShowStatus(_("Cancelling..."), false);
+        evt.Veto();
+        return;
+    }
+    evt.Skip();
+}
+
 void DarksDialog::OnReset(wxCommandEvent& evt)
 {
     if (buildDarkLib)
@@ -401,6 +511,7 @@ void DarksDialog::OnReset(wxCommandEvent& evt)
         m_pDarkMinExpTime->SetValue(MinExposureDefault());
         m_pDarkMaxExpTime->SetValue(MaxExposureDefault());
         m_pDarkCount->SetValue(DefDarkCount);
+        m_cbScaledDark->SetValue(DefScaledDark);
     }
     else
     {
@@ -430,6 +541,7 @@ void DarksDialog::SaveProfileInfo()
         pConfig->Profile.SetString("/camera/darks_min_exptime", m_pDarkMinExpTime->GetValue());
         pConfig->Profile.SetString("/camera/darks_max_exptime", m_pDarkMaxExpTime->GetValue());
         pConfig->Profile.SetInt("/camera/darks_num_frames", m_pDarkCount->GetValue());
+        pConfig->Profile.SetBoolean("/camera/darks_scaled_model", m_cbScaledDark->GetValue());
     }
     else
     {
@@ -439,119 +551,13 @@ void DarksDialog::SaveProfileInfo()
     pConfig->Profile.SetString("/camera/darks_note", m_pNotes->GetValue());
 }
 
-struct Histogram
-{
-    unsigned long val[256];
-    unsigned int median;
-    double mean;
-
-    Histogram(const usImage& img)
-    {
-        memset(&val[0], 0, sizeof(val));
-        mean = 0.0;
-        for (int i = 0; i < img.NPixels; i++)
-        {
-            unsigned short v = img.ImageData[i];
-            mean += v;
-            v >>= (img.BitsPerPixel - 8);
-            if (v > 255)
-                v = 255;  // should never happen if BitsPerPixel is valid
-            ++val[v];
-        }
-        mean /= img.NPixels;
-        // median (approx)
-        unsigned long sum = 0;
-        int i;
-        for (i = 0; i < 256; i++)
-        {
-            sum += val[i];
-            if (sum > img.NPixels / 2)
-                break;
-        }
-        median = i << (img.BitsPerPixel - 8);
-    }
-
-    void Dump()
-    {
-        Debug.Write(wxString::Format("mean = %.f  median(approx) = %u\n", mean, median));
-        int i = 0;
-        for (int l = 0; l < 4; l++)
-        {
-            std::ostringstream os;
-            os << "histo[" << (l * 64) << ".." << ((l + 1) * 64 - 1) << "]";
-            for (int j = 0; j < 64; j++, i++)
-                os << ' ' << val[i];
-            os << "\n";
-            Debug.Write(os.str());
-        }
-    }
-};
-
-bool DarksDialog::CreateMasterDarkFrame(usImage& darkFrame, int expTime, int frameCount)
+DarksDialog::~DarksDialog(void)
 {
-    bool err = false;
-
-    pCamera->InitCapture();
-    darkFrame.ImgExpDur = expTime;
-    darkFrame.ImgStackCnt = frameCount;
-
-    unsigned int *avgimg = 0;
-
-    for (int j = 1; j <= frameCount; j++)
+    if (m_builder)
     {
-        wxYield();
-        if (m_cancelling)
-            break;
-        ShowStatus(wxString::Format(_("Taking dark frame %d/%d"), j, frameCount), true);
-
-        Debug.Write(wxString::Format("Capture dark frame %d/%d exp=%d\n", j, frameCount, expTime));
-        err = GuideCamera::Capture(pCamera, expTime, darkFrame, CAPTURE_DARK);
-        if (err)
-        {
-            ShowStatus(wxString::Format(_("%.1f s dark FAILED"), (double)expTime / 1000.0), true);
-            pCamera->ShutterClosed = false;
-            break;
-        }
-
-        m_pProgress->SetValue(m_pProgress->GetValue() + expTime);
-        wxYield();
-
-        darkFrame.CalcStats();
-        Debug.Write(wxString::Format("dark frame stats: bpp %u min %u max %u filtmin %u filtmax %u\n",
-            darkFrame.BitsPerPixel, darkFrame.Min, darkFrame.Max, darkFrame.FiltMin, darkFrame.FiltMax));
-        Histogram h(darkFrame);
-        h.Dump();
-        wxYield();
-
-        if (!avgimg)
-        {
-            avgimg = new unsigned int[darkFrame.NPixels];
-            memset(avgimg, 0, darkFrame.NPixels * sizeof(*avgimg));
-        }
-
-        unsigned int *iptr = avgimg;
-        const unsigned short *usptr = darkFrame.ImageData;
-        for (int i = 0; i < darkFrame.NPixels; i++)
-            *iptr++ += *usptr++;
+        m_builder->Cancel();
+        m_builder->Wait();
+        delete m_builder;
     }
-
-    if (!m_cancelling && !err)
-    {
-        ShowStatus(_("Dark frames complete"), true);
-        const unsigned int *iptr = avgimg;
-        unsigned short *usptr = darkFrame.ImageData;
-        for (int i = 0; i < darkFrame.NPixels; i++)
-            *usptr++ = (unsigned short)(*iptr++ / frameCount);
-    }
-
-    m_pProgress->SetValue(m_pProgress->GetValue() + expTime);
-    wxYield();
-
-    delete[] avgimg;
-
-    return err;
-}
-
-DarksDialog::~DarksDialog(void)
-{
+    DeleteMasters();
 }
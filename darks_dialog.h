@@ -36,6 +36,8 @@
 #ifndef DarksDialog_h_included
 #define DarksDialog_h_included
 
+class DarkBuilder;
+
 class DarksDialog : public wxDialog
 {
 private:
@@ -49,6 +51,7 @@ private:
     wxSpinCtrl *m_pNumDefExposures;
     wxRadioButton *m_rbModifyDarkLib;
     wxRadioButton *m_rbNewDarkLib;
+    wxCheckBox *m_cbScaledDark;
     wxTextCtrl *m_pNotes;
     wxGauge *m_pProgress;
     wxButton *m_pStartBtn;
@@ -56,12 +59,17 @@ private:
     wxStatusBar *m_pStatusBar;
     wxButton *m_pStopBtn;
     wxArrayString m_expStrings;
+    DarkBuilder *m_builder;
+    std::vector<usImage *> m_masters;
     void OnStart(wxCommandEvent& evt);
     void OnStop(wxCommandEvent& evt);
     void OnReset(wxCommandEvent& evt);
+    void OnClose(wxCloseEvent& evt);
+    void OnBuilderEvent(wxThreadEvent& evt);
+    void BuildComplete(int result);
+    void DeleteMasters(void);
     void SaveProfileInfo();
     void ShowStatus(const wxString msg, bool appending);
-    bool CreateMasterDarkFrame(usImage& dark, int expTime, int frameCount);
 
 public:
     DarksDialog(wxWindow *parent, bool darkLibrary);
@@ -35,13 +35,184 @@
 
 #include "phd.h"
 
+#include <atomic>
+#include <chrono>
+
 #define ALWAYS_FLUSH_DEBUGLOG
 const int RetentionPeriod = 30;
 
+static long long MonotonicTicks(void)
+{
+    // microseconds
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * A bounded multi-producer, single-consumer queue of log messages.
+ *
+ * A message occupies one or more consecutive fixed-size slots. A producer
+ * reserves all the slots of its message with a single compare-and-swap of the
+ * head position, so messages from different threads are never interleaved,
+ * and publishes the message by storing the first slot's sequence number. The
+ * consumer frees slots in order, so when the last slot needed is free, all
+ * the slots before it are free as well.
+ */
+class DebugLogRing
+{
+public:
+    enum
+    {
+        SLOT_COUNT = 4096,          // a power of 2
+        SLOT_BYTES = 120,
+        MAX_SLOTS = 64,             // longer messages are truncated
+        WAKE_INTERVAL = SLOT_COUNT / 4,
+    };
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        long long ticks;
+        unsigned long threadId;
+        unsigned int len;
+        unsigned int nslots;
+        char data[SLOT_BYTES];
+    };
+
+    Slot m_slots[SLOT_COUNT];
+    std::atomic<size_t> m_head;
+    size_t m_tail;                  // only used by the consumer
+    std::atomic<unsigned int> m_dropped;
+
+public:
+    DebugLogRing(void);
+
+    // returns true when the consumer should be woken up
+    bool Push(const char *msg, size_t len, long long ticks, unsigned long threadId);
+
+    // appends the next message to buf, returns false if there is none
+    bool Pop(std::string& buf, long long *ticks, unsigned long *threadId);
+
+    unsigned int TakeDropped(void) { return m_dropped.exchange(0); }
+};
+
+DebugLogRing::DebugLogRing(void)
+    : m_head(0), m_tail(0), m_dropped(0)
+{
+    for (size_t i = 0; i < SLOT_COUNT; i++)
+        m_slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+bool DebugLogRing::Push(const char *msg, size_t len, long long ticks, unsigned long threadId)
+{
+    if (len > MAX_SLOTS * SLOT_BYTES)
+        len = MAX_SLOTS * SLOT_BYTES;
+    size_t nslots = len ? (len + SLOT_BYTES - 1) / SLOT_BYTES : 1;
+
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    while (true)
+    {
+        size_t last = pos + nslots - 1;
+        size_t seq = m_slots[last & (SLOT_COUNT - 1)].seq.load(std::memory_order_acquire);
+        ptrdiff_t dif = (ptrdiff_t) (seq - last);
+        if (dif == 0)
+        {
+            if (m_head.compare_exchange_weak(pos, pos + nslots, std::memory_order_relaxed))
+                break;
+        }
+        else if (dif < 0)
+        {
+            // full: drop the message rather than wait for the writer
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        else
+            pos = m_head.load(std::memory_order_relaxed);
+    }
+
+    Slot& first = m_slots[pos & (SLOT_COUNT - 1)];
+    first.ticks = ticks;
+    first.threadId = threadId;
+    first.len = (unsigned int) len;
+    first.nslots = (unsigned int) nslots;
+
+    for (size_t i = 0; i < nslots; i++)
+    {
+        size_t n = i == nslots - 1 ? len - i * SLOT_BYTES : SLOT_BYTES;
+        memcpy(m_slots[(pos + i) & (SLOT_COUNT - 1)].data, msg + i * SLOT_BYTES, n);
+    }
+
+    // the message becomes visible to the consumer with its first slot
+    for (size_t i = nslots - 1; i > 0; i--)
+        m_slots[(pos + i) & (SLOT_COUNT - 1)].seq.store(pos + i + 1, std::memory_order_release);
+    first.seq.store(pos + 1, std::memory_order_release);
+
+    // wake the writer each time another quarter of the ring has been filled
+    return pos / WAKE_INTERVAL != (pos + nslots) / WAKE_INTERVAL;
+}
+
+bool DebugLogRing::Pop(std::string& buf, long long *ticks, unsigned long *threadId)
+{
+    size_t pos = m_tail;
+    Slot& first = m_slots[pos & (SLOT_COUNT - 1)];
+    if (first.seq.load(std::memory_order_acquire) != pos + 1)
+        return false;
+
+    *ticks = first.ticks;
+    *threadId = first.threadId;
+    size_t len = first.len;
+    size_t nslots = first.nslots;
+
+    for (size_t i = 0; i < nslots; i++)
+    {
+        size_t n = i == nslots - 1 ? len - i * SLOT_BYTES : SLOT_BYTES;
+        buf.append(m_slots[(pos + i) & (SLOT_COUNT - 1)].data, n);
+    }
+
+    for (size_t i = 0; i < nslots; i++)
+        m_slots[(pos + i) & (SLOT_COUNT - 1)].seq.store(pos + i + SLOT_COUNT, std::memory_order_release);
+
+    m_tail = pos + nslots;
+    return true;
+}
+
+class DebugLogWriter : public wxThread
+{
+    DebugLog *m_log;
+    wxSemaphore m_wake;
+    std::atomic<bool> m_stop;
+
+public:
+    DebugLogWriter(DebugLog *log) : wxThread(wxTHREAD_JOINABLE), m_log(log), m_stop(false) { }
+    void Wake(void) { m_wake.Post(); }
+    void Stop(void) { m_stop = true; m_wake.Post(); }
+    ExitCode Entry(void);
+};
+
+wxThread::ExitCode DebugLogWriter::Entry(void)
+{
+    while (!m_stop)
+    {
+        // write in batches: a few times a second, or as soon as the ring
+        // starts filling up
+        m_wake.WaitTimeout(100);
+
+        wxMutexLocker lock(m_log->m_fileMutex);
+        m_log->Drain();
+    }
+
+    return 0;
+}
+
 void DebugLog::InitVars(void)
 {
     m_bEnabled = false;
-    m_lastWriteTime = wxDateTime::UNow();
+    m_ring = new DebugLogRing();
+    m_writer = NULL;
+    m_baseTime = wxDateTime::UNow();
+    m_baseTicks = MonotonicTicks();
+    m_lastWriteTicks = m_baseTicks;
 }
 
 DebugLog::DebugLog(void)
@@ -57,8 +228,14 @@ DebugLog::DebugLog(const wxString& name, bool bEnabled = true)
 
 DebugLog::~DebugLog(void)
 {
+    StopWriter();
+    {
+        wxMutexLocker lock(m_fileMutex);
+        Drain();
+    }
     wxFFile::Flush();
     wxFFile::Close();
+    delete m_ring;
 }
 
 bool DebugLog::Enable(bool bEnabled)
@@ -70,12 +247,42 @@ bool DebugLog::Enable(bool bEnabled)
     return prevState;
 }
 
+void DebugLog::StartWriter(void)
+{
+    if (m_writer)
+        return;
+
+    DebugLogWriter *writer = new DebugLogWriter(this);
+    if (writer->Create() != wxTHREAD_NO_ERROR || writer->Run() != wxTHREAD_NO_ERROR)
+    {
+        // messages are written synchronously without the writer thread
+        delete writer;
+        return;
+    }
+    m_writer = writer;
+}
+
+// Stops the writer thread after it has written all pending messages. Messages
+// written afterwards are written synchronously. Called when the application
+// exits, after the other threads have stopped.
+void DebugLog::StopWriter(void)
+{
+    if (m_writer)
+    {
+        m_writer->Stop();
+        m_writer->Wait();
+        delete m_writer;
+        m_writer = NULL;
+    }
+}
+
 bool DebugLog::Init(const wxString& name, bool bEnable, bool bForceOpen)
 {
-    wxCriticalSectionLocker lock(m_criticalSection);
+    wxMutexLocker lock(m_fileMutex);
 
     if (m_bEnabled)
     {
+        Drain();
         wxFFile::Flush();
         wxFFile::Close();
 
@@ -96,6 +303,9 @@ bool DebugLog::Init(const wxString& name, bool bEnable, bool bForceOpen)
 
     m_bEnabled = bEnable;
 
+    if (m_bEnabled)
+        StartWriter();
+
     return m_bEnabled;
 }
 
@@ -137,41 +347,94 @@ wxString DebugLog::AddBytes(const wxString& str, const unsigned char *pBytes, un
     return Write(Line + "\n");
 }
 
+// Formats and writes the messages in the ring
+void DebugLog::Drain(void)
+{
+    long long ticks;
+    unsigned long threadId;
+
+    m_batch.clear();
+    m_msg.clear();
+
+    while (m_ring->Pop(m_msg, &ticks, &threadId))
+    {
+        long long deltaMs = (ticks - m_lastWriteTicks) / 1000;
+        m_lastWriteTicks = ticks;
+        wxDateTime when = m_baseTime + wxTimeSpan::Milliseconds((ticks - m_baseTicks) / 1000);
+
+        wxString prefix = wxString::Format("%s %lld.%03lld %lu ", when.Format("%H:%M:%S.%l"),
+                                           deltaMs / 1000, deltaMs % 1000, threadId);
+        m_batch.append(prefix.ToAscii());
+        m_batch.append(m_msg);
+
+#if defined(__WINDOWS__) && defined(_DEBUG)
+        OutputDebugStringA((prefix + wxString::FromUTF8(m_msg.c_str())).ToAscii());
+#endif
+        m_msg.clear();
+    }
+
+    unsigned int dropped = m_ring->TakeDropped();
+    if (dropped)
+    {
+        wxString msg = wxString::Format("%s debug log buffer overflow, %u messages dropped\n",
+                                        wxDateTime::UNow().Format("%H:%M:%S.%l"), dropped);
+        m_batch.append(msg.ToAscii());
+    }
+
+    if (m_batch.empty() || !IsOpened())
+        return;
+
+    wxFFile::Write(m_batch.data(), m_batch.size());
+#if defined(ALWAYS_FLUSH_DEBUGLOG)
+    wxFFile::Flush();
+#endif
+}
+
+// Writes all the messages logged so far
 bool DebugLog::Flush(void)
 {
     bool bReturn = true;
 
     if (m_bEnabled)
     {
-        wxCriticalSectionLocker lock(m_criticalSection);
+        wxMutexLocker lock(m_fileMutex);
 
+        Drain();
         bReturn = wxFFile::Flush();
     }
 
     return bReturn;
 }
 
+// Flush() for fatal exception handlers: gives up rather than deadlock if the
+// crashing thread was writing to the log
+void DebugLog::EmergencyFlush(void)
+{
+    if (m_bEnabled && m_fileMutex.TryLock() == wxMUTEX_NO_ERROR)
+    {
+        Drain();
+        wxFFile::Flush();
+        m_fileMutex.Unlock();
+    }
+}
+
 wxString DebugLog::Write(const wxString& str)
 {
     if (m_bEnabled)
     {
-        wxCriticalSectionLocker lock(m_criticalSection);
+        const wxScopedCharBuffer utf8 = str.utf8_str();
 
-        wxDateTime now = wxDateTime::UNow();
-        wxTimeSpan deltaTime = now - m_lastWriteTime;
-        m_lastWriteTime = now;
-        wxString outputLine = wxString::Format("%s %s %lu %s", now.Format("%H:%M:%S.%l"),
-                                                              deltaTime.Format("%S.%l"),
-                                                              (unsigned long) wxThread::GetCurrentId(),
-                                                              str);
-
-        wxFFile::Write(outputLine);
-#if defined(ALWAYS_FLUSH_DEBUGLOG)
-        wxFFile::Flush();
-#endif
-#if defined(__WINDOWS__) && defined(_DEBUG)
-        OutputDebugString(outputLine.c_str());
-#endif
+        bool wake = m_ring->Push(utf8.data(), utf8.length(), MonotonicTicks(),
+                                 (unsigned long) wxThread::GetCurrentId());
+
+        if (!m_writer)
+        {
+            // no writer thread (yet), write synchronously
+            wxMutexLocker lock(m_fileMutex);
+            Drain();
+        }
+        else if (wake)
+            m_writer->Wake();
     }
 
     return str;
@@ -38,15 +38,34 @@
 
 #include "logger.h"
 
+class DebugLogRing;
+class DebugLogWriter;
+
+/*
+ * Write() only copies the message and a timestamp into a lock-free ring
+ * buffer. The messages are formatted and written to the file in batches by a
+ * writer thread, or by whichever thread calls Flush(). When the ring is full,
+ * messages are dropped and a count of the dropped messages is logged instead.
+ */
 class DebugLog : public wxFFile, public Logger
 {
 private:
     bool m_bEnabled;
-    wxCriticalSection m_criticalSection;
-    wxDateTime m_lastWriteTime;
+    wxMutex m_fileMutex;            // held while draining the ring to the file
+    DebugLogRing *m_ring;
+    DebugLogWriter *m_writer;
+    wxDateTime m_baseTime;          // wall clock time at the m_baseTicks timestamp
+    long long m_baseTicks;
+    long long m_lastWriteTicks;
     wxString m_pPathName;
+    std::string m_batch;
+    std::string m_msg;
 
     void InitVars(void);
+    void Drain(void);               // called with m_fileMutex held
+    void StartWriter(void);
+
+    friend class DebugLogWriter;
 
 public:
     DebugLog(void);
@@ -60,6 +79,8 @@ public:
     wxString AddBytes(const wxString& str, const unsigned char *pBytes, unsigned count);
     wxString Write(const wxString& str);
     bool Flush(void);
+    void EmergencyFlush(void);
+    void StopWriter(void);
 
     bool ChangeDirLog(const wxString& newdir);
     void RemoveOldFiles();
@@ -0,0 +1,200 @@
+/*
+ *  defect_benchmark.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Times the correction of defective pixels on a full frame and on a guide
+ * subframe, walking either the plain list of defects, as RemoveDefects did
+ * before the defect map had a row index, or the row index.
+ *
+ *   phd2_defect_benchmark [-w WIDTH] [-h HEIGHT] [-n DEFECTS] [-s SUBFRAME_SIZE] [-r REPEATS]
+ *
+ * The defects are placed at random on a synthetic frame. Both walks fix the
+ * defects with DefectFixer, so the difference is the cost of finding the
+ * defects to fix.
+ */
+
+#include "image_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+struct Defect
+{
+    int x;
+    int y;
+    bool operator<(const Defect& rhs) const { return y < rhs.y || (y == rhs.y && x < rhs.x); }
+};
+
+struct Rect
+{
+    int x0, y0, x1, y1;     // inclusive
+    bool Contains(const Defect& d) const { return d.x >= x0 && d.x <= x1 && d.y >= y0 && d.y <= y1; }
+};
+
+// the same layout as DefectMap's index: the columns of the defects on row y
+// are cols[rowStart[y]] up to cols[rowStart[y + 1]], sorted
+struct RowIndex
+{
+    std::vector<int> rowStart;
+    std::vector<int> cols;
+
+    void Build(std::vector<Defect> defects, int height)
+    {
+        std::sort(defects.begin(), defects.end());
+        rowStart.assign(height + 1, 0);
+        cols.clear();
+        cols.reserve(defects.size());
+        for (size_t i = 0; i < defects.size(); i++)
+        {
+            ++rowStart[defects[i].y + 1];
+            cols.push_back(defects[i].x);
+        }
+        for (int y = 0; y < height; y++)
+            rowStart[y + 1] += rowStart[y];
+    }
+};
+
+typedef void (*FixFn)(DefectFixer& fixer, const std::vector<Defect>& defects, const RowIndex& index, const Rect& area);
+
+static void FixList(DefectFixer& fixer, const std::vector<Defect>& defects, const RowIndex&, const Rect& area)
+{
+    for (std::vector<Defect>::const_iterator it = defects.begin(); it != defects.end(); ++it)
+    {
+        if (area.Contains(*it))
+            fixer.Fix(it->x, it->y);
+    }
+}
+
+static void FixIndexed(DefectFixer& fixer, const std::vector<Defect>&, const RowIndex& index, const Rect& area)
+{
+    const int *cols = index.cols.empty() ? NULL : &index.cols[0];
+    for (int y = area.y0; y <= area.y1; y++)
+        fixer.FixRow(y, cols + index.rowStart[y], cols + index.rowStart[y + 1], area.x0, area.x1);
+}
+
+// microseconds per frame
+static double Time(FixFn fn, DefectFixer& fixer, const std::vector<Defect>& defects, const RowIndex& index,
+                   const Rect& area, int repeats)
+{
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+        fn(fixer, defects, index, area);
+    std::chrono::duration<double, std::micro> const elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeats;
+}
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-w WIDTH] [-h HEIGHT] [-n DEFECTS] [-s SUBFRAME_SIZE] [-r REPEATS]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 3000;
+    int height = 2000;
+    int count = 30000;
+    int subSize = 100;
+    int repeats = 200;
+
+    for (int argi = 1; argi < argc; argi += 2)
+    {
+        if (argi + 1 >= argc || argv[argi][0] != '-' || strlen(argv[argi]) != 2)
+        {
+            Usage(argv[0]);
+            return 2;
+        }
+        int const val = atoi(argv[argi + 1]);
+        switch (argv[argi][1])
+        {
+        case 'w': width = val; break;
+        case 'h': height = val; break;
+        case 'n': count = val; break;
+        case 's': subSize = val; break;
+        case 'r': repeats = val; break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (width < 2 || height < 2 || count < 0 || subSize < 1 || subSize > width || subSize > height || repeats < 1)
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    srand(1);
+
+    std::vector<unsigned short> frame(width * height);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = (unsigned short)(1000 + rand() % 100);
+
+    std::vector<Defect> defects(count);
+    for (int i = 0; i < count; i++)
+    {
+        defects[i].x = rand() % width;
+        defects[i].y = rand() % height;
+    }
+
+    RowIndex index;
+    index.Build(defects, height);
+
+    DefectFixer fixer(&frame[0], width, height);
+
+    Rect full = { 0, 0, width - 1, height - 1 };
+    Rect sub;
+    sub.x0 = (width - subSize) / 2;
+    sub.y0 = (height - subSize) / 2;
+    sub.x1 = sub.x0 + subSize - 1;
+    sub.y1 = sub.y0 + subSize - 1;
+
+    printf("%dx%d frame, %d defects, %dx%d subframe, %d repeats\n", width, height, count, subSize, subSize, repeats);
+    printf("%-10s %14s %14s\n", "", "list (us)", "index (us)");
+
+    double const listFull = Time(FixList, fixer, defects, index, full, repeats);
+    double const indexFull = Time(FixIndexed, fixer, defects, index, full, repeats);
+    printf("%-10s %14.1f %14.1f\n", "full frame", listFull, indexFull);
+
+    // the subframe is fixed far more often than a full frame is, so repeat it more
+    int const subRepeats = repeats * 10;
+    double const listSub = Time(FixList, fixer, defects, index, sub, subRepeats);
+    double const indexSub = Time(FixIndexed, fixer, defects, index, sub, subRepeats);
+    printf("%-10s %14.1f %14.1f\n", "subframe", listSub, indexSub);
+
+    return 0;
+}
@@ -33,10 +33,13 @@
  */
 
 #include "phd.h"
+#include "guiding_assistant.h"
+#include "guide_stats.h"
 
 #include <wx/sstream.h>
 #include <wx/sckstrm.h>
 #include <sstream>
+#include <deque>
 
 EventServer EvtServer;
 
@@ -223,6 +226,22 @@ static JAry& operator<<(JAry& a, JObj& j)
     return a << j.str();
 }
 
+static JObj& operator<<(JObj& j, const LatencyStats::Summary& summary)
+{
+    j << NV("Frames", (int) summary.frames);
+
+    for (int i = 0; i < LatencyStats::INTERVAL_COUNT; i++)
+    {
+        JObj stage;
+        stage << NV("p50", summary.p50[i], 3)
+              << NV("p95", summary.p95[i], 3)
+              << NV("p99", summary.p99[i], 3);
+        j << NV(LatencyStats::IntervalName((LatencyStats::Interval) i), stage);
+    }
+
+    return j;
+}
+
 struct Ev : public JObj
 {
     Ev(const wxString& event)
@@ -322,25 +341,43 @@ static Ev ev_settle_done(const wxString& errorMsg)
     return ev;
 }
 
-struct ClientReadBuf
+enum
+{
+    // requests larger than this are rejected
+    MAX_REQUEST_SIZE = 4 * 1024 * 1024,
+
+    // GuideStep events queued for a client beyond this count replace the
+    // oldest queued GuideStep event
+    MAX_QUEUED_GUIDE_STEPS = 64,
+
+    // a client that falls this far behind is disconnected
+    MAX_QUEUED_BYTES = 4 * 1024 * 1024,
+};
+
+struct OutboundMsg
 {
-    enum { SIZE = 1024 };
-    char buf[SIZE];
-    char *dest;
+    std::string data;
+    bool droppable;
 
-    ClientReadBuf() { reset(); }
-    size_t avail() const { return &buf[SIZE] - dest; }
-    void reset() { dest = &buf[0]; }
+    OutboundMsg(const wxCharBuffer& buf, bool droppable_) : data(buf.data(), buf.length()), droppable(droppable_) { }
 };
 
 struct ClientData
 {
     wxSocketClient *cli;
     int refcnt;
-    ClientReadBuf rdbuf;
-    wxMutex wrlock;
-
-    ClientData(wxSocketClient *cli_) : cli(cli_), refcnt(1) { }
+    JsonStream rdbuf;
+
+    // outbound queue, written to the socket on the main thread as fast as
+    // the socket accepts it (see flush_client)
+    std::deque<OutboundMsg> outq;
+    size_t outBytes;
+    size_t outPos;              // bytes of the message at the head already written
+    unsigned int queuedSteps;
+    unsigned int droppedSteps;
+    bool overflow;
+
+    ClientData(wxSocketClient *cli_) : cli(cli_), refcnt(1), outBytes(0), outPos(0), queuedSteps(0), droppedSteps(0), overflow(false) { }
     void AddRef() { ++refcnt; }
     void RemoveRef()
     {
@@ -360,20 +397,103 @@ struct ClientDataGuard
     ClientData *operator->() const { return cd; }
 };
 
-inline static wxMutex *client_wrlock(wxSocketClient *cli)
+// Writes as much of the client's outbound queue as the socket accepts without
+// blocking. The sockets belong to the main thread, like their input and
+// connection events. When the socket is full the rest of the queue waits for
+// its wxSOCKET_OUTPUT event.
+static void flush_client(ClientData *cd)
 {
-    return &((ClientData *) cli->GetClientData())->wrlock;
+    assert(wxThread::IsMain());
+
+    while (!cd->outq.empty())
+    {
+        const OutboundMsg& msg = cd->outq.front();
+        size_t const len = msg.data.size() - cd->outPos;
+
+        cd->cli->Write(msg.data.data() + cd->outPos, len);
+        size_t const n = cd->cli->LastWriteCount();
+
+        if (n < len)
+        {
+            cd->outPos += n;
+            if (cd->cli->Error() && cd->cli->LastError() != wxSOCKET_WOULDBLOCK)
+            {
+                // the client is going away; the socket lost event will clean up
+                cd->outq.clear();
+                cd->outBytes = cd->outPos = 0;
+                cd->queuedSteps = 0;
+                return;
+            }
+            if (n > 0 && !cd->cli->Error())
+            {
+                // short write, try again until the socket reports it would block
+                continue;
+            }
+            return;
+        }
+
+        cd->outBytes -= msg.data.size();
+        if (msg.droppable)
+            --cd->queuedSteps;
+        cd->outPos = 0;
+        cd->outq.pop_front();
+    }
+
+    if (cd->droppedSteps)
+    {
+        Debug.Write(wxString::Format("evsrv: cli %p slow, dropped %u GuideStep events\n", cd->cli, cd->droppedSteps));
+        cd->droppedSteps = 0;
+    }
 }
 
-static void send_buf(wxSocketClient *client, const wxCharBuffer& buf)
+// Queues a message for the client and writes what the socket accepts. This
+// never blocks on the socket, so a slow client cannot stall the main thread.
+// GuideStep events are marked droppable: when too many are queued for a
+// client the oldest one is discarded.
+static void send_buf(wxSocketClient *client, const wxCharBuffer& buf, bool droppable = false)
 {
-    wxMutexLocker lock(*client_wrlock(client));
-    client->Write(buf.data(), buf.length());
-    if (client->LastWriteCount() != buf.length())
+    ClientData *cd = (ClientData *) client->GetClientData();
+
+    if (cd->overflow)
+        return;
+
+    if (droppable && cd->queuedSteps >= MAX_QUEUED_GUIDE_STEPS)
+    {
+        // the head of the queue may be partially written already
+        std::deque<OutboundMsg>::iterator it = cd->outq.begin();
+        if (cd->outPos > 0)
+            ++it;
+        for (; it != cd->outq.end(); ++it)
+        {
+            if (it->droppable)
+            {
+                cd->outBytes -= it->data.size();
+                cd->outq.erase(it);
+                --cd->queuedSteps;
+                ++cd->droppedSteps;
+                break;
+            }
+        }
+    }
+
+    cd->outq.push_back(OutboundMsg(buf, droppable));
+    cd->outBytes += buf.length();
+    if (droppable)
+        ++cd->queuedSteps;
+
+    if (cd->outBytes > MAX_QUEUED_BYTES)
     {
-        Debug.Write(wxString::Format("evsrv: cli %p short write %u/%u\n",
-            client, client->LastWriteCount(), (unsigned int) buf.length()));
+        Debug.Write(wxString::Format("evsrv: cli %p not reading, %u bytes queued, disconnecting\n",
+            client, (unsigned int) cd->outBytes));
+        cd->overflow = true;
+        cd->outq.clear();
+        cd->outBytes = cd->outPos = 0;
+        cd->queuedSteps = 0;
+        EvtServer.CallAfter(&EventServer::DropClient, client);
+        return;
     }
+
+    flush_client(cd);
 }
 
 static void do_notify1(wxSocketClient *client, const JAry& ary)
@@ -386,14 +506,14 @@ static void do_notify1(wxSocketClient *client, const JObj& j)
     send_buf(client, (JObj(j).str() + "\r\n").ToUTF8());
 }
 
-static void do_notify(const EventServer::CliSockSet& cli, const JObj& jj)
+static void do_notify(const EventServer::CliSockSet& cli, const JObj& jj, bool droppable = false)
 {
     wxCharBuffer buf = (JObj(jj).str() + "\r\n").ToUTF8();
 
     for (EventServer::CliSockSet::const_iterator it = cli.begin();
         it != cli.end(); ++it)
     {
-        send_buf(*it, buf);
+        send_buf(*it, buf, droppable);
     }
 }
 
@@ -467,20 +587,6 @@ static void drain_input(wxSocketInputStream& sis)
     }
 }
 
-static bool find_eol(char *p, size_t len)
-{
-    const char *end = p + len;
-    for (; p < end; p++)
-    {
-        if (*p == '\r' || *p == '\n')
-        {
-            *p = 0;
-            return true;
-        }
-    }
-    return false;
-}
-
 enum {
     JSONRPC_PARSE_ERROR = -32700,
     JSONRPC_INVALID_REQUEST = -32600,
@@ -1191,6 +1297,69 @@ static void get_search_region(JObj& response, const json_value *params)
     response << jrpc_result(pFrame->pGuider->GetSearchRegion());
 }
 
+static void get_latency_stats(JObj& response, const json_value *params)
+{
+    LatencyStats::Summary summary;
+    LatencyStats::GetSummary(&summary);
+
+    JObj rslt;
+    rslt << summary;
+    response << jrpc_result(rslt);
+}
+
+static void get_guiding_assistant_stats(JObj& response, const json_value *params)
+{
+    Params p("window", params);
+    const json_value *val = p.param("window");
+    double window = 0.0;
+    if (val && (!float_param(val, &window) || window <= 0.0))
+    {
+        response << jrpc_error(JSONRPC_INVALID_PARAMS, "expected window param > 0");
+        return;
+    }
+
+    const GuideStats *stats = GuidingAssistant::GetStats();
+    if (!stats)
+    {
+        response << jrpc_error(1, "no guiding assistant measurements");
+        return;
+    }
+
+    GuideStats::Summary summary;
+    stats->GetSummary(&summary);
+
+    JObj rslt;
+    rslt << NV("count", (int) summary.count)
+        << NV("span", summary.span, 1)
+        << NV("ra_rms", summary.rms[GuideStats::RA], 3)
+        << NV("dec_rms", summary.rms[GuideStats::DEC], 3)
+        << NV("ra_peak", summary.peak[GuideStats::RA], 3)
+        << NV("dec_peak", summary.peak[GuideStats::DEC], 3)
+        << NV("ra_peak_peak", summary.peakPeak[GuideStats::RA], 3)
+        << NV("ra_drift_rate", summary.driftRate[GuideStats::RA], 4)
+        << NV("dec_drift_rate", summary.driftRate[GuideStats::DEC], 4)
+        << NV("ra_max_drift_rate", summary.maxDriftRateRA, 4);
+
+    if (window > 0.0)
+    {
+        rslt << NV("ra_window_rms", stats->WindowedRms(GuideStats::RA, window), 3)
+            << NV("dec_window_rms", stats->WindowedRms(GuideStats::DEC, window), 3);
+    }
+
+    std::vector<GuideStats::PeriodicComponent> pe;
+    stats->GetPeriodicComponents(&pe, 5);
+    JAry ary;
+    for (unsigned int i = 0; i < pe.size(); i++)
+    {
+        JObj c;
+        c << NV("period", pe[i].period, 1) << NV("amplitude", pe[i].amplitude, 3);
+        ary << c;
+    }
+    rslt << NV("ra_periodic", ary);
+
+    response << jrpc_result(rslt);
+}
+
 struct B64Encode
 {
     static const char *const E;
@@ -1271,8 +1440,8 @@ static void get_star_image(JObj& response, const json_value *params)
 
     int const halfw = wxMin((reqsize - 1) / 2, 31);
     int const fullw = 2 * halfw + 1;
-    int const sx = (int) rint(star.X);
-    int const sy = (int) rint(star.Y);
+    int const sx = (int) rint(img->FrameCoord(star.X));
+    int const sy = (int) rint(img->FrameCoord(star.Y));
     wxRect rect(sx - halfw, sy - halfw, fullw, fullw);
     if (img->Subframe.IsEmpty())
         rect.Intersect(wxRect(img->Size));
@@ -1289,7 +1458,7 @@ static void get_star_image(JObj& response, const json_value *params)
         enc.append(p, rect.GetWidth() * sizeof(unsigned short));
     }
 
-    PHD_Point pos(star);
+    PHD_Point pos(img->FrameCoord(star.X), img->FrameCoord(star.Y));
     pos.X -= rect.GetLeft();
     pos.Y -= rect.GetTop();
 
@@ -1537,6 +1706,8 @@ static bool handle_request(const wxSocketClient *cli, JObj& response, const json
         { "get_star_image", &get_star_image, },
         { "get_use_subframes", &get_use_subframes, },
         { "get_search_region", &get_search_region, },
+        { "get_latency_stats", &get_latency_stats, },
+        { "get_guiding_assistant_stats", &get_guiding_assistant_stats, },
         { "shutdown", &shutdown, },
     };
 
@@ -1626,14 +1797,25 @@ static void handle_cli_input(wxSocketClient *cli, JsonParser& parser)
 
     ClientDataGuard clidata(cli);
 
-    ClientReadBuf *rdbuf = &clidata->rdbuf;
+    JsonStream *rdbuf = &clidata->rdbuf;
 
     wxSocketInputStream sis(*cli);
-    size_t avail = rdbuf->avail();
 
     while (sis.CanRead())
     {
-        if (avail == 0)
+        char buf[4096];
+        size_t n = sis.Read(buf, sizeof(buf)).LastRead();
+        if (n == 0)
+            break;
+
+        rdbuf->Append(buf, n);
+
+        // handle every complete request received so far; the client may
+        // pipeline requests without waiting for the responses
+        while (char *input = rdbuf->Next())
+            handle_cli_input_complete(cli, input, parser);
+
+        if (rdbuf->Pending() > MAX_REQUEST_SIZE)
         {
             drain_input(sis);
 
@@ -1641,23 +1823,9 @@ static void handle_cli_input(wxSocketClient *cli, JsonParser& parser)
             response << jrpc_error(JSONRPC_INTERNAL_ERROR, "too big") << jrpc_id(0);
             do_notify1(cli, response);
 
-            rdbuf->reset();
-            break;
-        }
-        size_t n = sis.Read(rdbuf->dest, avail).LastRead();
-        if (n == 0)
-            break;
-
-        if (find_eol(rdbuf->dest, n))
-        {
-            drain_input(sis);
-            handle_cli_input_complete(cli, &rdbuf->buf[0], parser);
-            rdbuf->reset();
+            rdbuf->Reset();
             break;
         }
-
-        rdbuf->dest += n;
-        avail -= n;
     }
 }
 
@@ -1732,7 +1900,7 @@ void EventServer::OnEventServerEvent(wxSocketEvent& event)
     Debug.Write(wxString::Format("evsrv: cli %p connect\n", client));
 
     client->SetEventHandler(*this, EVENT_SERVER_CLIENT_ID);
-    client->SetNotify(wxSOCKET_LOST_FLAG | wxSOCKET_INPUT_FLAG);
+    client->SetNotify(wxSOCKET_LOST_FLAG | wxSOCKET_INPUT_FLAG | wxSOCKET_OUTPUT_FLAG);
     client->SetFlags(wxSOCKET_NOWAIT);
     client->Notify(true);
     client->SetClientData(new ClientData(client));
@@ -1760,12 +1928,28 @@ void EventServer::OnEventServerClientEvent(wxSocketEvent& event)
     {
         handle_cli_input(cli, m_parser);
     }
+    else if (event.GetSocketEvent() == wxSOCKET_OUTPUT)
+    {
+        // the socket can take more of the outbound queue
+        flush_client((ClientData *) cli->GetClientData());
+    }
     else
     {
         Debug.Write(wxString::Format("unexpected client socket event %d\n", event.GetSocketEvent()));
     }
 }
 
+void EventServer::DropClient(wxSocketClient *cli)
+{
+    // the client may have disconnected already
+    if (m_eventServerClients.erase(cli) == 0)
+        return;
+
+    Debug.Write(wxString::Format("evsrv: cli %p dropped\n", cli));
+
+    destroy_client(cli);
+}
+
 void EventServer::NotifyStartCalibration(Mount *mount)
 {
     SIMPLE_NOTIFY_EV(ev_start_calibration(mount));
@@ -1911,7 +2095,7 @@ void EventServer::NotifyGuideStep(const GuideStepInfo& step)
     if (step.decLimited)
         ev << NV("DecLimited", true);
 
-    do_notify(m_eventServerClients, ev);
+    do_notify(m_eventServerClients, ev, true);
 }
 
 void EventServer::NotifyGuidingDithered(double dx, double dy)
@@ -1970,6 +2154,20 @@ void EventServer::NotifySettleDone(const wxString& errorMsg)
     do_notify(m_eventServerClients, ev);
 }
 
+void EventServer::NotifyLatencyStats(void)
+{
+    if (m_eventServerClients.empty())
+        return;
+
+    LatencyStats::Summary summary;
+    LatencyStats::GetSummary(&summary);
+
+    Ev ev("LatencyStats");
+    ev << summary;
+
+    do_notify(m_eventServerClients, ev);
+}
+
 void EventServer::NotifyAlert(const wxString& msg, int type)
 {
     if (m_eventServerClients.empty())
@@ -75,6 +75,10 @@ public:
     void NotifySettling(double distance, double time, double settleTime);
     void NotifySettleDone(const wxString& errorMsg);
     void NotifyAlert(const wxString& msg, int type);
+    void NotifyLatencyStats(void);
+
+    // disconnects a client that does not keep up with its outbound queue
+    void DropClient(wxSocketClient *cli);
 
 private:
     void OnEventServerEvent(wxSocketEvent& evt);
@@ -0,0 +1,526 @@
+/*
+ *  frame_server.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+
+#include <wx/sckstrm.h>
+#include <chrono>
+
+FrameServer FrameSrv;
+
+BEGIN_EVENT_TABLE(FrameServer, wxEvtHandler)
+    EVT_SOCKET(FRAME_SERVER_ID, FrameServer::OnServerEvent)
+    EVT_SOCKET(FRAME_SERVER_CLIENT_ID, FrameServer::OnClientEvent)
+END_EVENT_TABLE()
+
+enum
+{
+    FRAME_MAGIC = 0x46444850,   // "PHDF" in little-endian byte order
+    FRAME_HEADER_SIZE = 32,
+
+    // pixel rows are encoded in chunks of about this size while the socket
+    // accepts data
+    CHUNK_SIZE = 64 * 1024,
+
+    // subscription requests larger than this are rejected
+    MAX_REQUEST_SIZE = 4096,
+};
+
+// A processed frame, copied once and shared read-only by all the clients
+// that are sent this frame
+struct FrameSnapshot
+{
+    unsigned int frame;
+    wxSize size;
+    int sensorBinning;          // sensor pixels per frame pixel
+    int blevel;
+    int wlevel;
+    float starX;
+    float starY;
+    std::vector<unsigned short> pixels;
+};
+
+struct FrameClient
+{
+    wxSocketClient *cli;
+    JsonStream rdbuf;
+
+    // the subscription
+    bool subscribed;
+    wxRect roi;                 // empty for the full frame
+    int binning;
+    bool stretch;
+    double maxRate;             // frames per second, 0 for no limit
+    long long lastFrameMs;
+
+    // the frame being sent and the next one to send
+    std::shared_ptr<const FrameSnapshot> sending;
+    std::shared_ptr<const FrameSnapshot> pending;
+    wxRect sendRect;
+    int sendBinning;
+    bool sendStretch;
+    int nextRow;
+    std::vector<unsigned char> chunk;
+    size_t chunkPos;
+
+    FrameClient(wxSocketClient *cli_)
+        : cli(cli_), subscribed(false), binning(1), stretch(false), maxRate(0.0), lastFrameMs(0),
+        sendBinning(1), sendStretch(false), nextRow(0), chunkPos(0)
+    {
+    }
+};
+
+static long long now_ms(void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void put16(unsigned char *& p, unsigned int val)
+{
+    *p++ = val & 0xff;
+    *p++ = (val >> 8) & 0xff;
+}
+
+static void put32(unsigned char *& p, unsigned int val)
+{
+    put16(p, val & 0xffff);
+    put16(p, val >> 16);
+}
+
+static void putf32(unsigned char *& p, float val)
+{
+    unsigned int bits;
+    memcpy(&bits, &val, sizeof(bits));
+    put32(p, bits);
+}
+
+// Starts sending the pending frame: clips the region of interest and writes
+// the header into the chunk buffer.
+static void start_frame(FrameClient *fc)
+{
+    fc->sending = fc->pending;
+    fc->pending.reset();
+
+    const FrameSnapshot& snap = *fc->sending;
+
+    wxRect rect(snap.size);
+    if (!fc->roi.IsEmpty())
+        rect.Intersect(fc->roi);
+
+    fc->sendBinning = fc->binning;
+    fc->sendStretch = fc->stretch;
+
+    if (fc->sendBinning == 2)
+    {
+        rect.width &= ~1;
+        rect.height &= ~1;
+    }
+    fc->sendRect = rect;
+    fc->nextRow = 0;
+
+    int const width = rect.width / fc->sendBinning;
+    int const height = rect.height / fc->sendBinning;
+    int const bpp = fc->sendStretch ? 1 : 2;
+
+    fc->chunk.resize(FRAME_HEADER_SIZE);
+    fc->chunkPos = 0;
+
+    unsigned char *p = &fc->chunk[0];
+    put32(p, FRAME_MAGIC);
+    put32(p, width * height * bpp);
+    put32(p, snap.frame);
+    put16(p, width);
+    put16(p, height);
+    put16(p, rect.x);
+    put16(p, rect.y);
+    *p++ = fc->sendBinning;
+    *p++ = bpp;
+    put16(p, snap.sensorBinning);
+    putf32(p, snap.starX);
+    putf32(p, snap.starY);
+}
+
+// Encodes the next rows of the frame being sent into the chunk buffer.
+static void encode_rows(FrameClient *fc)
+{
+    const FrameSnapshot& snap = *fc->sending;
+    const wxRect& rect = fc->sendRect;
+    int const bin = fc->sendBinning;
+    int const width = rect.width / bin;
+    int const height = rect.height / bin;
+    int const bpp = fc->sendStretch ? 1 : 2;
+    int const rows = wxMax(1, wxMin(height - fc->nextRow, CHUNK_SIZE / wxMax(1, width * bpp)));
+
+    int const blevel = snap.blevel;
+    int const range = wxMax(1, snap.wlevel - snap.blevel);
+
+    fc->chunk.resize(rows * width * bpp);
+    fc->chunkPos = 0;
+
+    unsigned char *p = &fc->chunk[0];
+    for (int row = fc->nextRow; row < fc->nextRow + rows; row++)
+    {
+        int const y = rect.y + row * bin;
+        const unsigned short *src = &snap.pixels[y * snap.size.x + rect.x];
+        const unsigned short *src2 = src + snap.size.x;
+
+        for (int x = 0; x < width; x++)
+        {
+            unsigned int val;
+            if (bin == 2)
+                val = (src[2 * x] + src[2 * x + 1] + src2[2 * x] + src2[2 * x + 1]) >> 2;
+            else
+                val = src[x];
+
+            if (bpp == 1)
+            {
+                int v = (int) (((long long) val - blevel) * 255 / range);
+                *p++ = (unsigned char) (v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+            else
+                put16(p, val);
+        }
+    }
+
+    fc->nextRow += rows;
+}
+
+// Writes as much of the client's stream as the socket accepts without
+// blocking. The sockets belong to the main thread, like their input and
+// connection events. When the socket is full the rest of the frame waits for
+// its wxSOCKET_OUTPUT event.
+static void pump_client(FrameClient *fc)
+{
+    assert(wxThread::IsMain());
+
+    while (true)
+    {
+        if (fc->chunkPos < fc->chunk.size())
+        {
+            size_t const len = fc->chunk.size() - fc->chunkPos;
+            fc->cli->Write(&fc->chunk[fc->chunkPos], len);
+            size_t const n = fc->cli->LastWriteCount();
+            fc->chunkPos += n;
+
+            if (n < len)
+            {
+                if (fc->cli->Error() && fc->cli->LastError() != wxSOCKET_WOULDBLOCK)
+                {
+                    // the client is going away; the socket lost event will clean up
+                    fc->sending.reset();
+                    fc->pending.reset();
+                    fc->chunk.clear();
+                    fc->chunkPos = 0;
+                    return;
+                }
+                if (n > 0 && !fc->cli->Error())
+                {
+                    // short write, try again until the socket reports it would block
+                    continue;
+                }
+                return;
+            }
+        }
+        else if (fc->sending && fc->nextRow < fc->sendRect.height / fc->sendBinning)
+            encode_rows(fc);
+        else if (fc->pending)
+        {
+            start_frame(fc);
+        }
+        else
+        {
+            fc->sending.reset();
+            return;
+        }
+    }
+}
+
+// true if the client should be sent a frame now
+static bool frame_due(const FrameClient *fc, long long now)
+{
+    if (!fc->subscribed || fc->sending || fc->pending)
+        return false;
+
+    return fc->maxRate <= 0.0 || now - fc->lastFrameMs >= (long long) (1000.0 / fc->maxRate);
+}
+
+FrameServer::FrameServer()
+    : m_serverSocket(NULL)
+{
+}
+
+FrameServer::~FrameServer()
+{
+}
+
+bool FrameServer::FrameServerStart(unsigned int instanceId)
+{
+    if (m_serverSocket)
+    {
+        Debug.AddLine("attempt to start frame server when it is already started?");
+        return false;
+    }
+
+    unsigned int port = 4500 + instanceId - 1;
+    wxIPV4address addr;
+    addr.Service(port);
+    m_serverSocket = new wxSocketServer(addr);
+
+    if (!m_serverSocket->Ok())
+    {
+        Debug.Write(wxString::Format("Frame server failed to start - Could not listen at port %u\n", port));
+        delete m_serverSocket;
+        m_serverSocket = NULL;
+        return true;
+    }
+
+    m_serverSocket->SetEventHandler(*this, FRAME_SERVER_ID);
+    m_serverSocket->SetNotify(wxSOCKET_CONNECTION_FLAG);
+    m_serverSocket->Notify(true);
+
+    Debug.Write(wxString::Format("frame server started, listening on port %u\n", port));
+
+    return false;
+}
+
+void FrameServer::FrameServerStop()
+{
+    if (!m_serverSocket)
+        return;
+
+    while (!m_clients.empty())
+        DestroyClient(*m_clients.begin());
+
+    delete m_serverSocket;
+    m_serverSocket = NULL;
+
+    Debug.AddLine("frame server stopped");
+}
+
+void FrameServer::DestroyClient(wxSocketClient *cli)
+{
+    FrameClient *fc = (FrameClient *) cli->GetClientData();
+    m_clients.erase(cli);
+    delete fc;
+    cli->Destroy();
+}
+
+void FrameServer::OnServerEvent(wxSocketEvent& event)
+{
+    wxSocketServer *server = static_cast<wxSocketServer *>(event.GetSocket());
+
+    if (event.GetSocketEvent() != wxSOCKET_CONNECTION)
+        return;
+
+    wxSocketClient *client = static_cast<wxSocketClient *>(server->Accept(false));
+
+    if (!client)
+        return;
+
+    Debug.Write(wxString::Format("frmsrv: cli %p connect\n", client));
+
+    client->SetEventHandler(*this, FRAME_SERVER_CLIENT_ID);
+    client->SetNotify(wxSOCKET_LOST_FLAG | wxSOCKET_INPUT_FLAG | wxSOCKET_OUTPUT_FLAG);
+    client->SetFlags(wxSOCKET_NOWAIT);
+    client->Notify(true);
+
+    client->SetClientData(new FrameClient(client));
+    m_clients.insert(client);
+}
+
+// Applies a subscription request.
+static bool subscribe(FrameClient *fc, const json_value *req, wxString *error)
+{
+    if (req->type != JSON_OBJECT)
+    {
+        *error = "expected an object";
+        return false;
+    }
+
+    bool subscribed = true;
+    wxRect roi;
+    int binning = 1;
+    bool stretch = false;
+    double maxRate = 0.0;
+
+    json_for_each (t, req)
+    {
+        if (strcmp(t->name, "subscribe") == 0 && (t->type == JSON_BOOL || t->type == JSON_INT))
+            subscribed = t->int_value != 0;
+        else if (strcmp(t->name, "stretch") == 0 && (t->type == JSON_BOOL || t->type == JSON_INT))
+            stretch = t->int_value != 0;
+        else if (strcmp(t->name, "binning") == 0 && t->type == JSON_INT && (t->int_value == 1 || t->int_value == 2))
+            binning = t->int_value;
+        else if (strcmp(t->name, "max_rate") == 0 && (t->type == JSON_INT || t->type == JSON_FLOAT))
+            maxRate = t->type == JSON_INT ? t->int_value : t->float_value;
+        else if (strcmp(t->name, "roi") == 0 && t->type == JSON_ARRAY)
+        {
+            int v[4];
+            int n = 0;
+            json_for_each (e, t)
+            {
+                if (n == 4 || e->type != JSON_INT)
+                {
+                    *error = "invalid roi";
+                    return false;
+                }
+                v[n++] = e->int_value;
+            }
+            if (n != 4 || v[2] <= 0 || v[3] <= 0)
+            {
+                *error = "invalid roi";
+                return false;
+            }
+            roi = wxRect(v[0], v[1], v[2], v[3]);
+        }
+        else
+        {
+            *error = wxString::Format("invalid parameter %s", t->name);
+            return false;
+        }
+    }
+
+    fc->subscribed = subscribed;
+    fc->roi = roi;
+    fc->binning = binning;
+    fc->stretch = stretch;
+    fc->maxRate = maxRate;
+
+    if (!subscribed)
+        fc->pending.reset();
+
+    return true;
+}
+
+void FrameServer::OnClientEvent(wxSocketEvent& event)
+{
+    wxSocketClient *cli = static_cast<wxSocketClient *>(event.GetSocket());
+
+    if (event.GetSocketEvent() == wxSOCKET_LOST)
+    {
+        Debug.Write(wxString::Format("frmsrv: cli %p disconnect\n", cli));
+        DestroyClient(cli);
+        return;
+    }
+
+    FrameClient *fc = (FrameClient *) cli->GetClientData();
+
+    if (event.GetSocketEvent() == wxSOCKET_OUTPUT)
+    {
+        // the socket can take more of the frame being sent
+        pump_client(fc);
+        return;
+    }
+
+    if (event.GetSocketEvent() != wxSOCKET_INPUT)
+        return;
+
+    wxSocketInputStream sis(*cli);
+    JsonParser parser;
+
+    while (sis.CanRead())
+    {
+        char buf[1024];
+        size_t n = sis.Read(buf, sizeof(buf)).LastRead();
+        if (n == 0)
+            break;
+
+        fc->rdbuf.Append(buf, n);
+
+        while (char *input = fc->rdbuf.Next())
+        {
+            Debug.Write(wxString::Format("frmsrv: cli %p request: %s\n", cli, input));
+
+            wxString error;
+            if (!parser.Parse(input))
+                error = parser.ErrorDesc();
+            else
+                subscribe(fc, parser.Root(), &error);
+
+            if (!error.IsEmpty())
+                Debug.Write(wxString::Format("frmsrv: cli %p invalid request: %s\n", cli, error));
+        }
+
+        if (fc->rdbuf.Pending() > MAX_REQUEST_SIZE)
+        {
+            Debug.Write(wxString::Format("frmsrv: cli %p request too big\n", cli));
+            fc->rdbuf.Reset();
+        }
+    }
+}
+
+void FrameServer::NotifyFrame(const usImage *img, const PHD_Point& star)
+{
+    if (m_clients.empty() || !img->ImageData)
+        return;
+
+    long long const now = now_ms();
+
+    // only copy the frame if some client is ready to take it
+    bool due = false;
+    for (CliSockSet::const_iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+    {
+        if (frame_due((FrameClient *) (*it)->GetClientData(), now))
+        {
+            due = true;
+            break;
+        }
+    }
+    if (!due)
+        return;
+
+    std::shared_ptr<FrameSnapshot> snap = std::make_shared<FrameSnapshot>();
+    snap->frame = pFrame->m_frameCounter;
+    snap->size = img->Size;
+    snap->sensorBinning = img->BinFactor;
+    snap->blevel = img->FiltMin;
+    snap->wlevel = img->FiltMax;
+    // the star position is in sensor pixels, the pixels sent are frame pixels
+    snap->starX = star.IsValid() ? (float) img->FrameCoord(star.X) : NAN;
+    snap->starY = star.IsValid() ? (float) img->FrameCoord(star.Y) : NAN;
+    snap->pixels.assign(img->ImageData, img->ImageData + img->NPixels);
+
+    std::shared_ptr<const FrameSnapshot> shared(snap);
+
+    for (CliSockSet::const_iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+    {
+        FrameClient *fc = (FrameClient *) (*it)->GetClientData();
+        if (frame_due(fc, now))
+        {
+            fc->pending = shared;
+            fc->lastFrameMs = now;
+            pump_client(fc);
+        }
+    }
+}
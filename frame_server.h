@@ -0,0 +1,105 @@
+/*
+ *  frame_server.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef FRAME_SERVER_INCLUDED
+#define FRAME_SERVER_INCLUDED
+
+#include <memory>
+#include <set>
+
+struct FrameSnapshot;
+
+/*
+ * Streams the processed guide frames to remote clients over a TCP port of its
+ * own (4500 + instance - 1), next to the JSON-RPC event server.
+ *
+ * A client sends newline-terminated JSON objects to subscribe and to choose
+ * how frames are encoded:
+ *
+ *   {"subscribe": true, "roi": [x, y, width, height], "binning": 2, "stretch": true, "max_rate": 5}
+ *
+ * All keys are optional: the defaults are the full frame, no binning, 16-bit
+ * pixels and no rate limit. "stretch" maps the display black and white levels
+ * to 8-bit pixels. {"subscribe": false} stops the stream.
+ *
+ * The roi, and the roi and star position in the frame header, are in pixels
+ * of the guide frame as processed, before the binning requested by the
+ * client. When the camera frames are binned in software, these frame pixels
+ * span several sensor pixels: the header gives the sensor binning, and a
+ * frame coordinate f maps to the sensor coordinate
+ * f * sensor_binning + (sensor_binning - 1) / 2.
+ *
+ * Each frame is sent as a 32-byte little-endian header followed by the pixel
+ * rows:
+ *
+ *   u32 magic "PHDF", u32 payload bytes, u32 frame number,
+ *   u16 width, u16 height, u16 roi x, u16 roi y,
+ *   u8 binning, u8 bytes per pixel, u16 sensor binning,
+ *   f32 star x, f32 star y (frame coordinates, NaN when no star)
+ *
+ * A frame is copied once into a read-only snapshot shared by all clients, and
+ * each client's encoding is produced from it a few rows at a time while its
+ * socket accepts data. A client that is still receiving a frame, or whose
+ * rate limit has not elapsed, skips the frames in between.
+ */
+class FrameServer : public wxEvtHandler
+{
+public:
+    typedef std::set<wxSocketClient *> CliSockSet;
+
+private:
+    wxSocketServer *m_serverSocket;
+    CliSockSet m_clients;
+
+public:
+    FrameServer();
+    ~FrameServer(void);
+
+    bool FrameServerStart(unsigned int instanceId);
+    void FrameServerStop();
+
+    // called on the main thread for each processed frame; the frames are
+    // written on the main thread too, as far as each socket accepts them
+    void NotifyFrame(const usImage *img, const PHD_Point& star);
+
+private:
+    void OnServerEvent(wxSocketEvent& evt);
+    void OnClientEvent(wxSocketEvent& evt);
+    void DestroyClient(wxSocketClient *cli);
+
+    wxDECLARE_EVENT_TABLE();
+};
+
+extern FrameServer FrameSrv;
+
+#endif
@@ -760,21 +760,59 @@ GraphLogClientWindow::~GraphLogClientWindow(void)
     delete [] m_line2;
 }
 
-static void reset_trend_accums(TrendLineAccum accums[4])
+HistoryAggregate::HistoryAggregate()
+    : raPeak(0.0), decPeak(0.0), maxDur(0), maxStarMass(0.0), maxStarSNR(0.0),
+    raSameSides(0), raLimited(0), decLimited(0)
 {
     for (int i = 0; i < 4; i++)
     {
-        accums[i].sum_xy = 0.0;
-        accums[i].sum_y = 0.0;
-        accums[i].sum_y2 = 0.0;
+        trend[i].sum_y = 0.0;
+        trend[i].sum_xy = 0.0;
+        trend[i].sum_y2 = 0.0;
     }
 }
 
+HistoryAggregate::HistoryAggregate(const S_HISTORY& h, unsigned int seq, bool raSameSide)
+    : raPeak(fabs(h.ra)), decPeak(fabs(h.dec)), maxDur(wxMax(abs(h.raDur), abs(h.decDur))),
+    maxStarMass(h.starMass), maxStarSNR(h.starSNR),
+    raSameSides(raSameSide ? 1 : 0), raLimited(h.raLimited ? 1 : 0), decLimited(h.decLimited ? 1 : 0)
+{
+    const double vals[4] = { h.dx, h.dy, h.ra, h.dec };
+    for (int i = 0; i < 4; i++)
+    {
+        trend[i].sum_y = vals[i];
+        trend[i].sum_xy = seq * vals[i];
+        trend[i].sum_y2 = vals[i] * vals[i];
+    }
+}
+
+HistoryAggregate HistoryAggregate::operator+(const HistoryAggregate& rhs) const
+{
+    HistoryAggregate r;
+    for (int i = 0; i < 4; i++)
+    {
+        r.trend[i].sum_y = trend[i].sum_y + rhs.trend[i].sum_y;
+        r.trend[i].sum_xy = trend[i].sum_xy + rhs.trend[i].sum_xy;
+        r.trend[i].sum_y2 = trend[i].sum_y2 + rhs.trend[i].sum_y2;
+    }
+    r.raPeak = wxMax(raPeak, rhs.raPeak);
+    r.decPeak = wxMax(decPeak, rhs.decPeak);
+    r.maxDur = wxMax(maxDur, rhs.maxDur);
+    r.maxStarMass = wxMax(maxStarMass, rhs.maxStarMass);
+    r.maxStarSNR = wxMax(maxStarSNR, rhs.maxStarSNR);
+    r.raSameSides = raSameSides + rhs.raSameSides;
+    r.raLimited = raLimited + rhs.raLimited;
+    r.decLimited = decLimited + rhs.decLimited;
+    return r;
+}
+
 void GraphLogClientWindow::ResetData(void)
 {
     m_history.clear();
-    reset_trend_accums(m_trendLineAccum);
-    m_raSameSides = 0;
+    m_aggregates.clear();
+    m_seq = 0;
+    m_window = HistoryAggregate();
+    m_plotValid = false;
     UpdateStats(0, 0);
     m_stats.ra_peak = m_stats.dec_peak = 0.0;
     m_stats.star_lost_cnt = 0;
@@ -826,6 +864,7 @@ bool GraphLogClientWindow::SetMaxLength(unsigned int maxLength)
     }
 
     m_history.resize(maxLength);
+    m_aggregates.resize(maxLength);
 
     delete [] m_line1;
     m_line1 = new wxPoint[maxLength];
@@ -887,29 +926,6 @@ bool GraphLogClientWindow::SetMaxHeight(unsigned int maxHeight)
     return bError;
 }
 
-// update_trend - update running accumulators for trend line calculations
-//
-static void update_trend(int nr, int max_nr, double newval, const double& oldval, TrendLineAccum *accum)
-{
-    // note: not safe to dereference oldval when nr == 0
-
-    if (nr < max_nr)
-    {
-        // number of items is increasing, increment sums
-        accum->sum_y += newval;
-        accum->sum_xy += nr * newval;
-        accum->sum_y2 += newval * newval;
-    }
-    else
-    {
-        // number of items has reached limit. Update counters to reflect
-        // removal of oldest value (oldval) and addition of new value.
-        accum->sum_xy += (max_nr - 1) * newval + oldval - accum->sum_y;
-        accum->sum_y += newval - oldval;
-        accum->sum_y2 += newval * newval - oldval * oldval;
-    }
-}
-
 static double rms(unsigned int nr, const TrendLineAccum *accum)
 {
     if (nr == 0)
@@ -922,13 +938,13 @@ static double rms(unsigned int nr, const TrendLineAccum *accum)
 
 void GraphLogClientWindow::UpdateStats(unsigned int nr, const S_HISTORY *cur)
 {
-    m_stats.rms_ra = rms(nr, &m_trendLineAccum[2]);
-    m_stats.rms_dec = rms(nr, &m_trendLineAccum[3]);
+    m_stats.rms_ra = rms(nr, &m_window.trend[2]);
+    m_stats.rms_dec = rms(nr, &m_window.trend[3]);
     m_stats.rms_tot = hypot(m_stats.rms_ra, m_stats.rms_dec);
 
     if (nr >= 2)
     {
-        m_stats.osc_index = 1.0 - (double) m_raSameSides / (double)(nr - 1);
+        m_stats.osc_index = 1.0 - (double) m_window.raSameSides / (double)(nr - 1);
         m_stats.osc_alert = m_stats.osc_index > 0.6 || m_stats.osc_index < 0.15;
     }
     else
@@ -946,62 +962,14 @@ void GraphLogClientWindow::UpdateStats(unsigned int nr, const S_HISTORY *cur)
     }
 }
 
-static double peak_ra(const circular_buffer<S_HISTORY> &history, unsigned int nr)
-{
-    double peak = 0.0;
-    const int end = history.size();
-    const int begin = end - nr;
-    for (int i = begin; i < end; i++) {
-        double val = fabs(history[i].ra);
-        if (val > peak)
-            peak = val;
-    }
-    return peak;
-}
-
-static double peak_dec(const circular_buffer<S_HISTORY> &history, unsigned int nr)
-{
-    double peak = 0.0;
-    const int end = history.size();
-    const int begin = end - nr;
-    for (int i = begin; i < end; i++) {
-        double val = fabs(history[i].dec);
-        if (val > peak)
-            peak = val;
-    }
-    return peak;
-}
-
 void GraphLogClientWindow::AppendData(const GuideStepInfo& step)
 {
-    unsigned int trend_items = GetItemCount();
-    const int oldest_idx = m_history.size() - trend_items;
-
-    S_HISTORY oldest;
-    if (m_history.size() > 0)
-        oldest = m_history[oldest_idx];
-    update_trend(trend_items, m_length, step.cameraOffset.X, oldest.dx, &m_trendLineAccum[0]);
-    update_trend(trend_items, m_length, step.cameraOffset.Y, oldest.dy, &m_trendLineAccum[1]);
-    update_trend(trend_items, m_length, step.mountOffset.X, oldest.ra, &m_trendLineAccum[2]);
-    update_trend(trend_items, m_length, step.mountOffset.Y, oldest.dec, &m_trendLineAccum[3]);
-
-    // update counter for osc index
-    if (trend_items >= 1)
-    {
-        if (step.mountOffset.X * m_history[m_history.size() - 1].ra > 0.0)
-            ++m_raSameSides;
-        if (trend_items >= m_length)
-        {
-            if (m_history[oldest_idx].ra * m_history[oldest_idx + 1].ra > 0.0)
-                --m_raSameSides;
-        }
-    }
-
-    m_stats.ra_limit_cnt += (step.raLimited ? 1 : 0) - ((trend_items >= m_length && oldest.raLimited) ? 1 : 0);
-    m_stats.dec_limit_cnt += (step.decLimited ? 1 : 0) - ((trend_items >= m_length && oldest.decLimited) ? 1 : 0);
+    bool raSameSide = m_history.size() > 0 && step.mountOffset.X * m_history[m_history.size() - 1].ra > 0.0;
 
     S_HISTORY cur(step);
     m_history.push_front(cur);
+    m_aggregates.push_front(HistoryAggregate(cur, m_seq, raSameSide));
+    ++m_seq;
 
     // remove any dither history entries older than the first guide step history entry
     wxLongLong_t t0 = m_history[0].timestamp;
@@ -1014,22 +982,7 @@ void GraphLogClientWindow::AppendData(const GuideStepInfo& step)
             break;
     }
 
-    unsigned int new_nr = GetItemCount();
-    UpdateStats(new_nr, &cur);
-
-    double ax = fabs(step.mountOffset.X);
-    if (ax > m_stats.ra_peak)
-        m_stats.ra_peak = ax;
-    else if (fabs(oldest.ra) == m_stats.ra_peak)
-        m_stats.ra_peak = peak_ra(m_history, new_nr);
-
-    double ay = fabs(step.mountOffset.Y);
-    if (ay > m_stats.dec_peak)
-        m_stats.dec_peak = ay;
-    else if (fabs(oldest.dec) == m_stats.dec_peak)
-        m_stats.dec_peak = peak_dec(m_history, new_nr);
-
-    pFrame->pStatsWin->UpdateStats();
+    RecalculateTrendLines();
 }
 
 void GraphLogClientWindow::AppendData(const FrameDroppedInfo& info)
@@ -1045,49 +998,25 @@ void GraphLogClientWindow::AppendData(const DitherInfo& info)
 
 void GraphLogClientWindow::RecalculateTrendLines(void)
 {
-    reset_trend_accums(m_trendLineAccum);
     unsigned int trend_items = GetItemCount();
-    const int begin = m_history.size() - trend_items;
-    for (unsigned int x = 0, i = begin; x < trend_items; i++, x++) {
-        const S_HISTORY& h = m_history[i];
-        update_trend(x, trend_items, h.dx, 0.0, &m_trendLineAccum[0]);
-        update_trend(x, trend_items, h.dy, 0.0, &m_trendLineAccum[1]);
-        update_trend(x, trend_items, h.ra, 0.0, &m_trendLineAccum[2]);
-        update_trend(x, trend_items, h.dec, 0.0, &m_trendLineAccum[3]);
-    }
-    // recalculate ra same side counter
-    m_raSameSides = 0;
-    if (trend_items >= 2)
-    {
-        const int end = m_history.size() - 1;
-        double cur = m_history[begin].ra;
-        for (int i = begin; i < end; i++)
-        {
-            double next = m_history[i + 1].ra;
-            if (cur * next > 0.0)
-                ++m_raSameSides;
-            cur = next;
-        }
-    }
+    const unsigned int end = m_history.size();
+    const unsigned int begin = end - trend_items;
 
-    m_stats.ra_peak = peak_ra(m_history, trend_items);
-    m_stats.dec_peak = peak_dec(m_history, trend_items);
+    // the same side count of the first entry shown refers to an entry that is
+    // not shown
+    HistoryAggregate rest = trend_items > 0 ? m_aggregates.query(begin + 1, end) : HistoryAggregate();
+    m_window = trend_items > 0 ? m_aggregates.query(begin, begin + 1) + rest : rest;
+    m_window.raSameSides = rest.raSameSides;
 
-    {
-        unsigned int raLimitedCnt = 0;
-        unsigned int decLimitedCnt = 0;
-        const int end = m_history.size();
-        for (int i = begin; i < end; i++)
-        {
-            const S_HISTORY& h = m_history[i];
-            if (h.raLimited)
-                ++raLimitedCnt;
-            if (h.decLimited)
-                ++decLimitedCnt;
-        }
-        m_stats.ra_limit_cnt = raLimitedCnt;
-        m_stats.dec_limit_cnt = decLimitedCnt;
-    }
+    // trend line x origin at the first entry shown
+    const double x0 = (double)(m_seq - trend_items);
+    for (int i = 0; i < 4; i++)
+        m_window.trend[i].sum_xy -= x0 * m_window.trend[i].sum_y;
+
+    m_stats.ra_peak = m_window.raPeak;
+    m_stats.dec_peak = m_window.decPeak;
+    m_stats.ra_limit_cnt = m_window.raLimited;
+    m_stats.dec_limit_cnt = m_window.decLimited;
 
     const S_HISTORY *latest = 0;
     if (m_history.size() > 0)
@@ -1136,47 +1065,206 @@ static wxString rms_label(double rms, double sampling)
         return wxString::Format("%4.2f", rms);
 }
 
-static int GetMaxDuration(const circular_buffer<S_HISTORY>& history, int start_item)
+static const wxFont& SmallFont(void)
 {
-    int maxdur = 1; // always return at least 1 to protect against divide-by-zero
-    for (unsigned int i = start_item; i < history.size(); i++)
-    {
-        const S_HISTORY& h = history[i];
-        int d = abs(h.raDur);
-        if (d > maxdur)
-            maxdur = d;
-        d = abs(h.decDur);
-        if (d > maxdur)
-            maxdur = d;
-    }
-    return maxdur;
+#if defined(__WXOSX__)
+    return *wxSMALL_FONT;
+#else
+    return *wxSWISS_FONT;
+#endif
+}
+
+enum { GRAPH_BORDER = 5 };
+
+// room on the right of the plot bitmap for what is drawn past the position of
+// the latest entries (correction bars, dither labels), so that it is there
+// when the plot scrolls into view
+enum { PLOT_MARGIN = 64 };
+
+bool GraphLogClientWindow::PlotLayout::operator==(const PlotLayout& rhs) const
+{
+    return size == rhs.size && xmag == rhs.xmag && ymag == rhs.ymag && mode == rhs.mode &&
+        showCorrections == rhs.showCorrections && showStarMass == rhs.showStarMass && showStarSNR == rhs.showStarSNR &&
+        maxDur == rhs.maxDur && maxStarMass == rhs.maxStarMass && maxStarSNR == rhs.maxStarSNR &&
+        raOrDxColor == rhs.raOrDxColor && decOrDyColor == rhs.decOrDyColor;
+}
+
+static int plot_x(int xorig, unsigned int seq, double xmag)
+{
+    return xorig + (int)(seq * xmag);
 }
 
-static double GetMaxStarMass(const circular_buffer<S_HISTORY>& history, int start_item)
+// brings the plot bitmap up to date with the entries shown
+void GraphLogClientWindow::UpdatePlot(const PlotLayout& layout)
 {
-    double maxMass = 0.0;
-    for (unsigned int i = start_item; i < history.size(); i++)
+    const unsigned int end = m_seq;
+    const unsigned int begin = end - GetItemCount();
+
+    wxSize bmpSize(layout.size.x + PLOT_MARGIN, layout.size.y);
+    if (!m_plot.IsOk() || m_plot.GetSize() != bmpSize)
+    {
+        m_plot.Create(bmpSize);
+        m_plotScratch.Create(bmpSize);
+        m_plotValid = false;
+    }
+
+    bool full = !m_plotValid || !(layout == m_plotLayout) ||
+        begin < m_plotBegin || end < m_plotEnd || m_plotEnd <= begin;
+
+    if (full)
     {
-        const S_HISTORY& h = history[i];
-        if (h.starMass > maxMass)
-            maxMass = h.starMass;
+        wxMemoryDC dc(m_plot);
+        dc.SetBackground(*wxBLACK_BRUSH);
+        dc.Clear();
+        m_plotBegin = begin;
+        DrawPlot(dc, layout, begin, end);
     }
-    return maxMass;
+    else if (begin != m_plotBegin || end != m_plotEnd)
+    {
+        int dx = (int)(begin * layout.xmag) - (int)(m_plotBegin * layout.xmag);
+        if (dx > 0)
+        {
+            {
+                wxMemoryDC src(m_plot);
+                wxMemoryDC dst(m_plotScratch);
+                dst.SetBackground(*wxBLACK_BRUSH);
+                dst.Clear();
+                if (dx < bmpSize.x)
+                    dst.Blit(0, 0, bmpSize.x - dx, bmpSize.y, &src, dx, 0);
+            }
+            wxBitmap tmp(m_plot);
+            m_plot = m_plotScratch;
+            m_plotScratch = tmp;
+        }
+        m_plotBegin = begin;
+
+        wxMemoryDC dc(m_plot);
+        DrawPlot(dc, layout, m_plotEnd, end);
+    }
+
+    m_plotEnd = end;
+    m_plotLayout = layout;
+    m_plotValid = true;
 }
 
-static double GetMaxStarSNR(const circular_buffer<S_HISTORY>& history, int start_item)
+// draws the entries with sequence numbers [begin, end), the lines continue
+// from the entry before them
+void GraphLogClientWindow::DrawPlot(wxDC& dc, const PlotLayout& layout, unsigned int begin, unsigned int end)
 {
-    double maxSNR = 0.0;
-    for (unsigned int i = start_item; i < history.size(); i++)
+    if (begin >= end)
+        return;
+
+    const unsigned int seq0 = m_seq - m_history.size();     // sequence number of m_history[0]
+    const unsigned int lineBegin = begin > m_plotBegin ? begin - 1 : begin;
+    const int xorig = -(int)(m_plotBegin * layout.xmag);
+    const int yorig = layout.size.y / 2;
+
+    if (layout.showCorrections)
     {
-        const S_HISTORY& h = history[i];
-        if (h.starSNR > maxSNR)
-            maxSNR = h.starSNR;
+        const double ymag = (layout.size.y - 10) * 0.5 / (double) layout.maxDur;
+
+        dc.SetBrush(*wxTRANSPARENT_BRUSH);
+        dc.SetPen(wxPen(layout.raOrDxColor.ChangeLightness(60)));
+
+        for (unsigned int seq = begin; seq < end; seq++)
+        {
+            const S_HISTORY& h = m_history[seq - seq0];
+
+            if (h.raDur != 0)
+            {
+                // West corrections => Up on graph
+                const int raDur = h.ra > 0.0 ? -h.raDur : h.raDur;
+                wxPoint pt(plot_x(xorig, seq, layout.xmag), yorig + (int)(raDur * ymag));
+                if (raDur < 0)
+                    dc.DrawRectangle(pt, wxSize(4, yorig - pt.y));
+                else
+                    dc.DrawRectangle(wxPoint(pt.x, yorig), wxSize(4, pt.y - yorig));
+            }
+        }
+
+        dc.SetPen(wxPen(layout.decOrDyColor.ChangeLightness(60)));
+
+        for (unsigned int seq = begin; seq < end; seq++)
+        {
+            const S_HISTORY& h = m_history[seq - seq0];
+
+            if (h.decDur != 0)
+            {
+                // North Corrections => Up on graph
+                const int decDur = h.dec > 0.0 ? h.decDur : -h.decDur;
+                wxPoint pt(plot_x(xorig, seq, layout.xmag) + 5, yorig + (int)(decDur * ymag));
+                if (decDur < 0)
+                    dc.DrawRectangle(pt,wxSize(4, yorig - pt.y));
+                else
+                    dc.DrawRectangle(wxPoint(pt.x, yorig), wxSize(4, pt.y - yorig));
+            }
+        }
     }
-    return maxSNR;
-}
 
-enum { GRAPH_BORDER = 5 };
+    const int npts = end - lineBegin;
+
+    if (layout.showStarMass)
+    {
+        const double ymag = (layout.size.y - 10) * 0.5 / layout.maxStarMass;
+
+        for (unsigned int seq = lineBegin, j = 0; seq < end; seq++, j++)
+            m_line1[j] = wxPoint(plot_x(xorig, seq, layout.xmag), yorig - (int)(m_history[seq - seq0].starMass * ymag));
+
+        dc.SetPen(*wxYELLOW_PEN);
+        dc.DrawLines(npts, m_line1);
+    }
+
+    if (layout.showStarSNR)
+    {
+        const double ymag = (layout.size.y - 10) * 0.5 / layout.maxStarSNR;
+
+        for (unsigned int seq = lineBegin, j = 0; seq < end; seq++, j++)
+            m_line1[j] = wxPoint(plot_x(xorig, seq, layout.xmag), yorig - (int)(m_history[seq - seq0].starSNR * ymag));
+
+        dc.SetPen(*wxWHITE_PEN);
+        dc.DrawLines(npts, m_line1);
+    }
+
+    dc.SetTextForeground(*wxLIGHT_GREY);
+    dc.SetFont(SmallFont());
+
+    std::deque<DitherInfo>::const_iterator it = m_dithers.begin();
+    { // advance to the first dither after the entries already drawn
+        const S_HISTORY& h = m_history[lineBegin - seq0];
+        while (it != m_dithers.end() && it->timestamp < h.timestamp)
+            ++it;
+    }
+
+    for (unsigned int seq = lineBegin, j = 0; seq < end; seq++, j++)
+    {
+        const S_HISTORY& h = m_history[seq - seq0];
+
+        if (it != m_dithers.end() && it->timestamp < h.timestamp)
+        {
+            wxPoint pt(xorig + (int)(((double) seq - 0.5) * layout.xmag), GRAPH_BORDER + 6);
+            dc.DrawText(_("Dither"), pt);
+            ++it;
+        }
+
+        switch (layout.mode)
+        {
+        case MODE_RADEC:
+            m_line1[j] = wxPoint(plot_x(xorig, seq, layout.xmag), yorig + (int)(h.ra * layout.ymag));
+            m_line2[j] = wxPoint(plot_x(xorig, seq, layout.xmag), yorig + (int)(-h.dec * layout.ymag)); // North corrections Up, North offsets down
+            break;
+        case MODE_DXDY:
+            m_line1[j] = wxPoint(plot_x(xorig, seq, layout.xmag), yorig + (int)(h.dx * layout.ymag));
+            m_line2[j] = wxPoint(plot_x(xorig, seq, layout.xmag), yorig + (int)(h.dy * layout.ymag));
+            break;
+        }
+    }
+
+    dc.SetPen(wxPen(layout.raOrDxColor, 2));
+    dc.DrawLines(npts, m_line1);
+
+    dc.SetPen(wxPen(layout.decOrDyColor, 2));
+    dc.DrawLines(npts, m_line2);
+}
 
 void GraphLogClientWindow::OnPaint(wxPaintEvent& WXUNUSED(evt))
 {
@@ -1206,8 +1294,26 @@ void GraphLogClientWindow::OnPaint(wxPaintEvent& WXUNUSED(evt))
         units = UNIT_PIXELS;
     }
 
-    dc.SetBackground(*wxBLACK_BRUSH);
-    dc.Clear();
+    const double xmag = size.x / (double) m_length;
+    const double ymag = yPixelsPerDivision * (double)(m_yDivisions + 1) / (double)m_height * (units == UNIT_ARCSEC ? sampling : 1.0);
+
+    // Draw data
+    PlotLayout layout;
+    layout.size = size;
+    layout.xmag = xmag;
+    layout.ymag = ymag;
+    layout.mode = m_mode;
+    layout.showCorrections = m_showCorrections;
+    layout.showStarMass = m_showStarMass;
+    layout.showStarSNR = m_showStarSNR;
+    layout.maxDur = wxMax(m_window.maxDur, 1); // protect against divide-by-zero
+    layout.maxStarMass = m_window.maxStarMass;
+    layout.maxStarSNR = m_window.maxStarSNR;
+    layout.raOrDxColor = m_raOrDxColor;
+    layout.decOrDyColor = m_decOrDyColor;
+
+    UpdatePlot(layout);
+    dc.DrawBitmap(m_plot, 0, 0);
 
     wxPen GreyDashPen(wxColour(200,200,200),1, wxDOT);
 
@@ -1225,13 +1331,7 @@ void GraphLogClientWindow::OnPaint(wxPaintEvent& WXUNUSED(evt))
     // Draw horiz rule (scale is 1 pixel error per 25 pixels) + scale labels
     dc.SetPen(GreyDashPen);
     dc.SetTextForeground(*wxLIGHT_GREY);
-    const wxFont& SmallFont =
-#if defined(__WXOSX__)
-        *wxSMALL_FONT;
-#else
-        *wxSWISS_FONT;
-#endif
-    dc.SetFont(SmallFont);
+    dc.SetFont(SmallFont());
 
     for (int i = 1; i <= m_yDivisions; i++)
     {
@@ -1250,9 +1350,6 @@ void GraphLogClientWindow::OnPaint(wxPaintEvent& WXUNUSED(evt))
         dc.DrawLine(center.x + i * xPixelsPerDivision, topEdge, center.x + i * xPixelsPerDivision, bottomEdge);
     }
 
-    const double xmag = size.x / (double) m_length;
-    const double ymag = yPixelsPerDivision * (double)(m_yDivisions + 1) / (double)m_height * (units == UNIT_ARCSEC ? sampling : 1.0);
-
     ScaleAndTranslate sctr(xorig, yorig, xmag, ymag);
 
     if (m_showCorrections && !(pMount && pMount->IsStepGuider()))
@@ -1271,134 +1368,16 @@ void GraphLogClientWindow::OnPaint(wxPaintEvent& WXUNUSED(evt))
         dc.SetTextForeground(m_raOrDxColor.ChangeLightness(75));
         dc.DrawText(lblE, rightEdge - szE.GetWidth() - 4, bottomEdge - szE.GetHeight() - 2);
         dc.SetTextForeground(*wxLIGHT_GREY);
-        dc.SetFont(SmallFont);
+        dc.SetFont(SmallFont());
     }
 
-    // Draw data
     if (m_history.size() > 0)
     {
         unsigned int plot_length = GetItemCount();
         unsigned int start_item = m_history.size() - plot_length;
 
-        if (m_showCorrections)
-        {
-            int maxDur = GetMaxDuration(m_history, start_item);
-
-            const double ymag = (size.y - 10) * 0.5 / (double) maxDur;
-            ScaleAndTranslate sctr(xorig, yorig, xmag, ymag);
-
-            dc.SetBrush(*wxTRANSPARENT_BRUSH);
-            dc.SetPen(wxPen(m_raOrDxColor.ChangeLightness(60)));
-
-            for (unsigned int i = start_item, j = 0; i < m_history.size(); i++, j++)
-            {
-                const S_HISTORY& h = m_history[i];
-
-                if (h.raDur != 0)
-                {
-                    // West corrections => Up on graph
-                    const int raDur = h.ra > 0.0 ? -h.raDur : h.raDur;
-                    wxPoint pt(sctr.pt(j, raDur));
-                    if (raDur < 0)
-                        dc.DrawRectangle(pt, wxSize(4, yorig - pt.y));
-                    else
-                        dc.DrawRectangle(wxPoint(pt.x, yorig), wxSize(4, pt.y - yorig));
-                }
-            }
-
-            dc.SetPen(wxPen(m_decOrDyColor.ChangeLightness(60)));
-
-            for (unsigned int i = start_item, j = 0; i < m_history.size(); i++, j++)
-            {
-                const S_HISTORY& h = m_history[i];
-
-                if (h.decDur != 0)
-                {
-                    // North Corrections => Up on graph
-                    const int decDur = h.dec > 0.0 ? h.decDur : -h.decDur;
-                    wxPoint pt(sctr.pt(j, decDur));
-                    pt.x += 5;
-                    if (decDur < 0)
-                        dc.DrawRectangle(pt,wxSize(4, yorig - pt.y));
-                    else
-                        dc.DrawRectangle(wxPoint(pt.x, yorig), wxSize(4, pt.y - yorig));
-                }
-            }
-        }
-
-        if (m_showStarMass)
-        {
-            double maxMass = GetMaxStarMass(m_history, start_item);
-
-            const double ymag = (size.y - 10) * 0.5 / maxMass;
-            ScaleAndTranslate sctr(xorig, yorig, xmag, -ymag);
-
-            for (unsigned int i = start_item, j = 0; i < m_history.size(); i++, j++)
-            {
-                const S_HISTORY& h = m_history[i];
-                m_line1[j] = sctr.pt(j, h.starMass);
-            }
-
-            dc.SetPen(*wxYELLOW_PEN);
-            dc.DrawLines(plot_length, m_line1);
-        }
-
-        if (m_showStarSNR)
-        {
-            double maxSNR = GetMaxStarSNR(m_history, start_item);
-
-            const double ymag = (size.y - 10) * 0.5 / maxSNR;
-            ScaleAndTranslate sctr(xorig, yorig, xmag, -ymag);
-
-            for (unsigned int i = start_item, j = 0; i < m_history.size(); i++, j++)
-            {
-                const S_HISTORY& h = m_history[i];
-                m_line1[j] = sctr.pt(j, h.starSNR);
-            }
-
-            dc.SetPen(*wxWHITE_PEN);
-            dc.DrawLines(plot_length, m_line1);
-        }
-
-        std::deque<DitherInfo>::const_iterator it = m_dithers.begin();
-        { // advance to the first dither that will show on the plot
-            const S_HISTORY& h = m_history[start_item];
-            while (it != m_dithers.end() && it->timestamp < h.timestamp)
-                ++it;
-        }
-
-        for (unsigned int i = start_item, j = 0; i < m_history.size(); i++, j++)
-        {
-            const S_HISTORY& h = m_history[i];
-
-            if (it != m_dithers.end() && it->timestamp < h.timestamp)
-            {
-                wxPoint pt(sctr.pt((double) j - 0.5, 0.0));
-                pt.y = topEdge + 6;
-                dc.DrawText(_("Dither"), pt);
-                ++it;
-            }
-
-            switch (m_mode)
-            {
-            case MODE_RADEC:
-                m_line1[j] = sctr.pt(j, h.ra);
-                m_line2[j] = sctr.pt(j, -h.dec); // North corrections Up, North offsets down
-                break;
-            case MODE_DXDY:
-                m_line1[j] = sctr.pt(j, h.dx);
-                m_line2[j] = sctr.pt(j, h.dy);
-                break;
-            }
-        }
-
         wxPen raOrDxPen(m_raOrDxColor, 2);
-        dc.SetPen(raOrDxPen);
-        dc.DrawLines(plot_length, m_line1);
-
         wxPen decOrDyPen(m_decOrDyColor, 2);
-        dc.SetPen(decOrDyPen);
-        dc.DrawLines(plot_length, m_line2);
 
         // draw trend lines
         double polarAlignCircleRadius = 0.0;
@@ -1409,14 +1388,14 @@ void GraphLogClientWindow::OnPaint(wxPaintEvent& WXUNUSED(evt))
             switch (m_mode)
             {
             case MODE_RADEC:
-                trendRaOrDx = trendline(m_trendLineAccum[2], plot_length);
-                trendDecOrDy = trendline(m_trendLineAccum[3], plot_length);
+                trendRaOrDx = trendline(m_window.trend[2], plot_length);
+                trendDecOrDy = trendline(m_window.trend[3], plot_length);
                 // North offsets plotted downward
                 trendDecOrDy = std::make_pair(-trendDecOrDy.first, -trendDecOrDy.second);
                 break;
             case MODE_DXDY:
-                trendRaOrDx = trendline(m_trendLineAccum[0], plot_length);
-                trendDecOrDy = trendline(m_trendLineAccum[1], plot_length);
+                trendRaOrDx = trendline(m_window.trend[0], plot_length);
+                trendDecOrDy = trendline(m_window.trend[1], plot_length);
                 break;
             }
 
@@ -1507,6 +1486,7 @@ void GraphLogClientWindow::OnLeftBtnDown(wxMouseEvent& evt)
             if (i < m_history.size())
             {
                 m_history.pop_back(i);
+                m_aggregates.pop_back(i);
                 RecalculateTrendLines();
                 Refresh();
             }
@@ -74,6 +74,24 @@ struct S_HISTORY
         raLimited(step.raLimited), decLimited(step.decLimited) { }
 };
 
+// aggregate of a run of history entries, see circular_aggregate
+struct HistoryAggregate
+{
+    TrendLineAccum trend[4];    // dx, dy, ra, dec; x is the sequence number of the entry
+    double raPeak;
+    double decPeak;
+    int maxDur;
+    double maxStarMass;
+    double maxStarSNR;
+    unsigned int raSameSides;   // entries with RA on the same side as the entry before them
+    unsigned int raLimited;
+    unsigned int decLimited;
+
+    HistoryAggregate();
+    HistoryAggregate(const S_HISTORY& h, unsigned int seq, bool raSameSide);
+    HistoryAggregate operator+(const HistoryAggregate& rhs) const;
+};
+
 struct DitherInfo
 {
     wxLongLong_t timestamp;
@@ -117,16 +135,46 @@ private:
     unsigned int m_minHeight;
     unsigned int m_maxHeight;
 
+    // everything the plotted data depends on, apart from the data
+    struct PlotLayout
+    {
+        wxSize size;
+        double xmag;
+        double ymag;
+        GRAPH_MODE mode;
+        bool showCorrections;
+        bool showStarMass;
+        bool showStarSNR;
+        int maxDur;
+        double maxStarMass;
+        double maxStarSNR;
+        wxColour raOrDxColor;
+        wxColour decOrDyColor;
+
+        bool operator==(const PlotLayout& rhs) const;
+    };
+
     circular_buffer<S_HISTORY> m_history;
+    circular_aggregate<HistoryAggregate> m_aggregates;
+    unsigned int m_seq;                 // sequence number of the next history entry
     std::deque<DitherInfo> m_dithers;
 
     wxPoint *m_line1;
     wxPoint *m_line2;
 
-    TrendLineAccum m_trendLineAccum[4]; // dx, dy, ra, dec
-    int m_raSameSides; // accumulator for RA osc index
+    HistoryAggregate m_window;          // the entries shown, trend line x origin at the first one
     SummaryStats m_stats;
 
+    // The plotted data is cached in a bitmap. New entries are drawn onto it,
+    // and it scrolls by whole pixels when the oldest entries go out of view;
+    // it is only redrawn completely when the layout or the scale changes.
+    wxBitmap m_plot;
+    wxBitmap m_plotScratch;
+    PlotLayout m_plotLayout;
+    bool m_plotValid;
+    unsigned int m_plotBegin;           // sequence numbers of the plotted entries
+    unsigned int m_plotEnd;
+
     GRAPH_MODE m_mode;
 
     unsigned int m_length;
@@ -160,6 +208,8 @@ public:
 private:
     void RecalculateTrendLines(void);
     void UpdateStats(unsigned int nr, const S_HISTORY *cur);
+    void UpdatePlot(const PlotLayout& layout);
+    void DrawPlot(wxDC& dc, const PlotLayout& layout, unsigned int begin, unsigned int end);
 
     void OnPaint(wxPaintEvent& evt);
     void OnLeftBtnDown(wxMouseEvent& evt);
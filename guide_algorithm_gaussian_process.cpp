@@ -34,13 +34,11 @@
 
 #include "phd.h"
 
-#include "UDPGuidingInteraction.h"
 #include "tools/circular_buffer.h"
+#include "tools/sliding_window_gp.h"
 
 #include "guide_algorithm_gaussian_process.h"
 #include <wx/stopwatch.h>
-#include "tools/math_tools.h"
-#include "UDPGuidingInteraction.h"
 
 
 class GuideGaussianProcess::GuideGaussianProcessDialogPane : public ConfigDialogPane
@@ -90,28 +88,32 @@ public:
 
 
 
+// number of past gear displacements the GP is conditioned on
+static const int WindowSize = 100;
+
+// the GP prediction is only used once there is enough data to be meaningful
+static const int MinimumMeasurements = 5;
+
 // parameters of the GP guiding algorithm
 struct GuideGaussianProcess::gp_guide_parameters
 {
-    UDPGuidingInteraction udpInteraction;
-    CircularDoubleBuffer timestamps_;
     CircularDoubleBuffer measurements_;
-    CircularDoubleBuffer modified_measurements_;
-    wxStopWatch timer_;
+    SlidingWindowGP gp_;
+    wxLongLong start_time_;
     double control_signal_;
     int number_of_measurements_;
     double control_gain_;
     double elapsed_time_ms_;
+    double timestamp_ms_;
 
     gp_guide_parameters() :
-      udpInteraction(_T("localhost"), _T("1308"), _T("1309")),
-      timestamps_(100),
-      measurements_(100),
-      modified_measurements_(100),
-      timer_(),
+      measurements_(WindowSize),
+      gp_(WindowSize),
+      start_time_(0),
       control_signal_(0.0),
       number_of_measurements_(0),
-      elapsed_time_ms_(0.0)
+      elapsed_time_ms_(0.0),
+      timestamp_ms_(0.0)
     {
 
     }
@@ -120,10 +122,11 @@ struct GuideGaussianProcess::gp_guide_parameters
 
     void clear()
     {
-        timestamps_.clear();
         measurements_.clear();
-        modified_measurements_.clear();
+        gp_.clear();
+        control_signal_ = 0.0;
         number_of_measurements_ = 0;
+        elapsed_time_ms_ = 0.0;
     }
 
 };
@@ -204,12 +207,12 @@ void GuideGaussianProcess::HandleTimestamps()
 {
     if (parameters->number_of_measurements_ == 0)
     {
-        parameters->timer_.Start();
+        parameters->start_time_ = ReplayClock::Now();
     }
-    double time_now = parameters->timer_.Time();
+    double time_now = (ReplayClock::Now() - parameters->start_time_).ToDouble();
     double delta_measurement_time_ms = time_now - parameters->elapsed_time_ms_;
     parameters->elapsed_time_ms_ = time_now;
-    parameters->timestamps_.append(parameters->elapsed_time_ms_ - delta_measurement_time_ms / 2);
+    parameters->timestamp_ms_ = parameters->elapsed_time_ms_ - delta_measurement_time_ms / 2;
 }
 
 void GuideGaussianProcess::HandleMeasurements(double input)
@@ -219,27 +222,24 @@ void GuideGaussianProcess::HandleMeasurements(double input)
 
 void GuideGaussianProcess::HandleModifiedMeasurements(double input)
 {
-    // If there is no previous measurement, a random one is generated.
-    if(parameters->number_of_measurements_ == 0)
-    {
-        //The daytime indoor measurement noise SD is 0.25-0.35
-        double indoor_noise_standard_deviation = 0.25;
-        double first_random_measurement = indoor_noise_standard_deviation *
-            math_tools::generate_normal_random_double();
-        double new_modified_measurement =
-            parameters->control_signal_ +
-            first_random_measurement * (1 - parameters->control_gain_) -
-            input;
-        parameters->modified_measurements_.append(new_modified_measurement);
-    }
-    else
+    // The first measurement has no predecessor, so the displacement of the
+    // gears since the last measurement is unknown.
+    if (parameters->number_of_measurements_ == 0)
     {
-        double new_modified_measurement =
-            parameters->control_signal_ +
-            parameters->measurements_.getSecondLastElement() * (1 - parameters->control_gain_) -
-            parameters->measurements_.getLastElement();
-        parameters->modified_measurements_.append(new_modified_measurement);
+        return;
     }
+
+    /*
+     * The error changed by the gear displacement minus the correction applied
+     * at the previous step: e(k) = e(k-1) - u(k-1) + d(k). The GP learns
+     * d(k), sampled at the middle of the measurement interval.
+     */
+    double gear_displacement =
+        input - parameters->measurements_.getSecondLastElement() +
+        parameters->control_signal_;
+
+    // the GP works in seconds to keep the hyperparameters readable
+    parameters->gp_.append(parameters->timestamp_ms_ / 1000.0, gear_displacement);
 }
 
 double GuideGaussianProcess::result(double input)
@@ -252,84 +252,22 @@ double GuideGaussianProcess::result(double input)
     /*
      * Need to read this value here because it is not loaded at the construction
      * time of this object.
-     * 
-     *
-     * Not used when testing the Code with Matlab, will be used in the actual GP
      */
     double delta_controller_time_ms = pFrame->RequestedExposureDuration();
 
+    // reactive part, as for the other algorithms
+    double control_signal = parameters->control_gain_ * input;
 
-
-    // This is the Code sending the circular buffers to Matlab:
-
-    double* timestamp_data = parameters->timestamps_.getEigenVector()->data();
-    double* modified_measurement_data = parameters->modified_measurements_.getEigenVector()->data();
-    double result;
-    double wait_time = 100;
-
-    bool sent = false;
-    bool received = false;
-
-    // Send the input
-    double input_buf[] = { input };
-    sent = parameters->udpInteraction.SendToUDPPort(input_buf, 8);
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-    wxMilliSleep(wait_time);
-
-    // Send the size of the buffer
-    double size = parameters->timestamps_.getEigenVector()->size();
-    double size_buf[] = { size };
-    sent = parameters->udpInteraction.SendToUDPPort(size_buf, 8);
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-    wxMilliSleep(wait_time);
-
-    // Send modified measurements
-    sent = parameters->udpInteraction.SendToUDPPort(modified_measurement_data, size * 8);
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-    wxMilliSleep(wait_time);
-
-    // Send timestamps
-    sent = parameters->udpInteraction.SendToUDPPort(timestamp_data, size * 8);
-    // Receive the final control signal
-    received = parameters->udpInteraction.ReceiveFromUDPPort(&result, 8);
-
-    return result;
-
-
-    /*
-     * This is the code running the actual GP
-     *
-     * TODO: 
-     * - Let GP class be a member of this Guiding Class
-     * - Call the GP´s BFGS Optimizer every once in a while (how often?)
-     *
-     */
-
-
-    /*
-
-    if (number_of_measurements_ > 5)
+    if (parameters->number_of_measurements_ > MinimumMeasurements)
     {
-
-        // Inference
-        gp_->infer(*timestamps_.getEigenVector(),
-                   *modified_measurements_.getEigenVector());
-        // Prediction of new control_signal_
-        Eigen::VectorXd prediction =
-            gp_->predict(elapsed_time_ms_ + delta_controller_time_ms / 2) -
-            control_gain_ * input / delta_controller_time_ms;
-        control_signal_ = prediction(0);
-
-    }
-    else
-    {
-        // Simpler prediction when there are not enough data points for the GP
-        control_signal_ = -input / delta_controller_time_ms;
+        // feed-forward the gear displacement expected until the middle of the next exposure
+        double prediction_time_s = (parameters->elapsed_time_ms_ + delta_controller_time_ms / 2) / 1000.0;
+        control_signal += parameters->gp_.predict(prediction_time_s);
     }
 
-    return control_signal_;
+    parameters->control_signal_ = control_signal;
 
-     */
+    return control_signal;
 }
 
 
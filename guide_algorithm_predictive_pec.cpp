@@ -0,0 +1,392 @@
+/*
+ *  guide_algorithm_predictive_pec.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+
+static const double DefaultAggressiveness = 0.7;
+static const double DefaultPredictionGain = 0.8;
+static const double DefaultMinMove = 0.2;
+static const double MaxAggressiveness = 1.0;
+static const double MaxPredictionGain = 1.0;
+
+GuideAlgorithmPredictivePec::GuideAlgorithmPredictivePec(Mount *pMount, GuideAxis axis)
+    : GuideAlgorithm(pMount, axis)
+{
+    wxString configPath = GetConfigPath();
+
+    double aggressiveness = pConfig->Profile.GetDouble(configPath + "/aggressiveness", DefaultAggressiveness);
+    SetAggressiveness(aggressiveness);
+
+    double predictionGain = pConfig->Profile.GetDouble(configPath + "/predictionGain", DefaultPredictionGain);
+    SetPredictionGain(predictionGain);
+
+    double minMove = pConfig->Profile.GetDouble(configPath + "/minMove", DefaultMinMove);
+    SetMinMove(minMove);
+
+    reset();
+}
+
+GuideAlgorithmPredictivePec::~GuideAlgorithmPredictivePec(void)
+{
+}
+
+GUIDE_ALGORITHM GuideAlgorithmPredictivePec::Algorithm(void)
+{
+    return GUIDE_ALGORITHM_PREDICTIVE_PEC;
+}
+
+void GuideAlgorithmPredictivePec::reset(void)
+{
+    m_predictor.Reset();
+    m_correction = 0.0;
+    m_lastPulseStart = m_pMount->LastPulse().start;
+    m_lastTime = 0.0;
+    m_predictedUntil = 0.0;
+}
+
+// adds the correction made since the last call to the running sum
+void GuideAlgorithmPredictivePec::AccumulateLastPulse(void)
+{
+    const PulseRecord& pulse = m_pMount->LastPulse();
+
+    if (pulse.start != m_lastPulseStart)
+    {
+        m_lastPulseStart = pulse.start;
+        m_correction += pulse.amount.X;
+    }
+}
+
+// the periodic error expected to build up between time and time + interval
+double GuideAlgorithmPredictivePec::PredictedMove(double time, double interval) const
+{
+    if (!m_predictor.IsValid())
+        return 0.0;
+
+    return m_predictionGain * (m_predictor.Predict(time + interval) - m_predictor.Predict(time));
+}
+
+double GuideAlgorithmPredictivePec::result(double input)
+{
+    AccumulateLastPulse();
+
+    double const exposure = pFrame->RequestedExposureDuration() / 1000.0;
+    double const time = ReplayClock::Now().ToDouble() / 1000.0 - exposure / 2.0;
+
+    m_predictor.AddSample(time, input + m_correction);
+
+    // the next measurement is expected one guide cycle later
+    double interval = exposure;
+    if (m_lastTime > 0.0 && time > m_lastTime && time - m_lastTime < 3.0 * exposure + 5.0)
+        interval = time - m_lastTime;
+    m_lastTime = time;
+
+    double dReturn = fabs(input) >= m_minMove ? m_aggressiveness * input : 0.0;
+    double const predicted = PredictedMove(time, interval);
+    dReturn += predicted;
+    m_predictedUntil = time + interval;
+
+    Debug.Write(wxString::Format("GuideAlgorithmPredictivePec::result() returns %.2f from input %.2f, predicted %.2f, %u samples, %u components\n",
+        dReturn, input, predicted, m_predictor.Count(), m_predictor.ComponentCount()));
+
+    return dReturn;
+}
+
+double GuideAlgorithmPredictivePec::deduceResult(void)
+{
+    // the star was lost: keep following the periodic error
+    if (m_predictedUntil <= 0.0)
+        return 0.0;
+
+    double const exposure = pFrame->RequestedExposureDuration() / 1000.0;
+    double const until = ReplayClock::Now().ToDouble() / 1000.0 + exposure / 2.0;
+
+    if (until <= m_predictedUntil)
+        return 0.0;
+
+    double const dReturn = PredictedMove(m_predictedUntil, until - m_predictedUntil);
+    m_predictedUntil = until;
+
+    Debug.Write(wxString::Format("GuideAlgorithmPredictivePec::deduceResult() returns %.2f\n", dReturn));
+
+    return dReturn;
+}
+
+void GuideAlgorithmPredictivePec::GuidingDithered(double amt)
+{
+    // the periodic error goes on regardless of the lock position, so keep the
+    // history and only account for the jump of the reference
+    m_predictor.Discontinuity();
+}
+
+double GuideAlgorithmPredictivePec::GetAggressiveness(void)
+{
+    return m_aggressiveness;
+}
+
+bool GuideAlgorithmPredictivePec::SetAggressiveness(double aggressiveness)
+{
+    bool bError = false;
+
+    try
+    {
+        if (aggressiveness < 0.0 || aggressiveness > MaxAggressiveness)
+        {
+            throw ERROR_INFO("invalid aggressiveness");
+        }
+
+        m_aggressiveness = aggressiveness;
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+        m_aggressiveness = DefaultAggressiveness;
+    }
+
+    pConfig->Profile.SetDouble(GetConfigPath() + "/aggressiveness", m_aggressiveness);
+
+    return bError;
+}
+
+double GuideAlgorithmPredictivePec::GetPredictionGain(void)
+{
+    return m_predictionGain;
+}
+
+bool GuideAlgorithmPredictivePec::SetPredictionGain(double predictionGain)
+{
+    bool bError = false;
+
+    try
+    {
+        if (predictionGain < 0.0 || predictionGain > MaxPredictionGain)
+        {
+            throw ERROR_INFO("invalid prediction gain");
+        }
+
+        m_predictionGain = predictionGain;
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+        m_predictionGain = DefaultPredictionGain;
+    }
+
+    pConfig->Profile.SetDouble(GetConfigPath() + "/predictionGain", m_predictionGain);
+
+    return bError;
+}
+
+double GuideAlgorithmPredictivePec::GetMinMove(void)
+{
+    return m_minMove;
+}
+
+bool GuideAlgorithmPredictivePec::SetMinMove(double minMove)
+{
+    bool bError = false;
+
+    try
+    {
+        if (minMove < 0.0)
+        {
+            throw ERROR_INFO("invalid minMove");
+        }
+
+        m_minMove = minMove;
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+        m_minMove = DefaultMinMove;
+    }
+
+    pConfig->Profile.SetDouble(GetConfigPath() + "/minMove", m_minMove);
+
+    return bError;
+}
+
+wxString GuideAlgorithmPredictivePec::GetSettingsSummary()
+{
+    // return a loggable summary of current mount settings
+    wxString s = wxString::Format("Aggressiveness = %.3f, Prediction gain = %.3f, Minimum move = %.3f",
+        m_aggressiveness, m_predictionGain, m_minMove);
+
+    for (unsigned int i = 0; i < m_predictor.ComponentCount(); i++)
+    {
+        const PecPredictor::Component& c = m_predictor.GetComponent(i);
+        s += wxString::Format(", Period %u = %.1f s (%.2f px)", i + 1, c.period, c.amplitude);
+    }
+
+    return s + "\n";
+}
+
+ConfigDialogPane *GuideAlgorithmPredictivePec::GetConfigDialogPane(wxWindow *pParent)
+{
+    return new GuideAlgorithmPredictivePecConfigDialogPane(pParent, this);
+}
+
+GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecConfigDialogPane::
+GuideAlgorithmPredictivePecConfigDialogPane(wxWindow *pParent, GuideAlgorithmPredictivePec *pGuideAlgorithm)
+    : ConfigDialogPane(_("Predictive PEC Guide Algorithm"), pParent)
+{
+    int width;
+
+    m_pGuideAlgorithm = pGuideAlgorithm;
+
+    width = StringWidth(_T("000"));
+    m_pAggressiveness = new wxSpinCtrlDouble(pParent, wxID_ANY, _T(""), wxPoint(-1, -1),
+        wxSize(width + 30, -1), wxSP_ARROW_KEYS, 0.0, MaxAggressiveness * 100.0, 0.0, 5.0, _T("Aggressiveness"));
+    m_pAggressiveness->SetDigits(0);
+
+    DoAdd(_("Aggressiveness"), m_pAggressiveness,
+        wxString::Format(_("What percent of the measured error should be applied? Default = %.f%%, adjust if responding too much or too slowly"), DefaultAggressiveness * 100.0));
+
+    width = StringWidth(_T("000"));
+    m_pPredictionGain = new wxSpinCtrlDouble(pParent, wxID_ANY, _T(""), wxPoint(-1, -1),
+        wxSize(width + 30, -1), wxSP_ARROW_KEYS, 0.0, MaxPredictionGain * 100.0, 0.0, 5.0, _T("PredictionGain"));
+    m_pPredictionGain->SetDigits(0);
+
+    DoAdd(_("Prediction gain"), m_pPredictionGain,
+        wxString::Format(_("What percent of the predicted periodic error should be corrected ahead of time? Default = %.f%%, "
+        "set to 0 to disable the prediction"), DefaultPredictionGain * 100.0));
+
+    width = StringWidth(_T("00.00"));
+    m_pMinMove = new wxSpinCtrlDouble(pParent, wxID_ANY, _T(""), wxPoint(-1, -1),
+        wxSize(width + 30, -1), wxSP_ARROW_KEYS, 0.0, 20.0, 0.0, 0.05, _T("MinMove"));
+    m_pMinMove->SetDigits(2);
+
+    DoAdd(_("Minimum Move (pixels)"), m_pMinMove,
+        wxString::Format(_("How many (fractional) pixels must the star move to trigger a guide pulse? \n"
+        "If camera is binned, this is a fraction of the binned pixel size. Default = %.2f"), DefaultMinMove));
+}
+
+GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecConfigDialogPane::
+~GuideAlgorithmPredictivePecConfigDialogPane(void)
+{
+}
+
+void GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecConfigDialogPane::
+LoadValues(void)
+{
+    m_pAggressiveness->SetValue(100.0 * m_pGuideAlgorithm->GetAggressiveness());
+    m_pPredictionGain->SetValue(100.0 * m_pGuideAlgorithm->GetPredictionGain());
+    m_pMinMove->SetValue(m_pGuideAlgorithm->GetMinMove());
+}
+
+void GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecConfigDialogPane::
+UnloadValues(void)
+{
+    m_pGuideAlgorithm->SetAggressiveness(m_pAggressiveness->GetValue() / 100.0);
+    m_pGuideAlgorithm->SetPredictionGain(m_pPredictionGain->GetValue() / 100.0);
+    m_pGuideAlgorithm->SetMinMove(m_pMinMove->GetValue());
+}
+
+GraphControlPane *GuideAlgorithmPredictivePec::GetGraphControlPane(wxWindow *pParent, const wxString& label)
+{
+    return new GuideAlgorithmPredictivePecGraphControlPane(pParent, this, label);
+}
+
+GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecGraphControlPane::
+GuideAlgorithmPredictivePecGraphControlPane(wxWindow *pParent, GuideAlgorithmPredictivePec *pGuideAlgorithm, const wxString& label)
+    : GraphControlPane(pParent, label)
+{
+    int width;
+
+    m_pGuideAlgorithm = pGuideAlgorithm;
+
+    // Aggressiveness
+    width = StringWidth(_T("000"));
+    m_pAggressiveness = new wxSpinCtrlDouble(this, wxID_ANY, _T(""), wxDefaultPosition,
+        wxSize(width + 30, -1), wxSP_ARROW_KEYS | wxALIGN_RIGHT, 0.0, MaxAggressiveness * 100.0, 0.0, 5.0, _T("Aggressiveness"));
+    m_pAggressiveness->SetDigits(0);
+    m_pAggressiveness->Bind(wxEVT_COMMAND_SPINCTRLDOUBLE_UPDATED, &GuideAlgorithmPredictivePec::GuideAlgorithmPredictivePecGraphControlPane::OnAggressivenessSpinCtrlDouble, this);
+    DoAdd(m_pAggressiveness, _("Agr"));
+
+    // Prediction gain
+    width = StringWidth(_T("000"));
+    m_pPredictionGain = new wxSpinCtrlDouble(this, wxID_ANY, _T(""), wxDefaultPosition,
+        wxSize(width + 30, -1), wxSP_ARROW_KEYS | wxALIGN_RIGHT, 0.0, MaxPredictionGain * 100.0, 0.0, 5.0, _T("PredictionGain"));
+    m_pPredictionGain->SetDigits(0);
+    m_pPredictionGain->Bind(wxEVT_COMMAND_SPINCTRLDOUBLE_UPDATED, &GuideAlgorithmPredictivePec::GuideAlgorithmPredictivePecGraphControlPane::OnPredictionGainSpinCtrlDouble, this);
+    DoAdd(m_pPredictionGain, _("PGn"));
+
+    // Min move
+    width = StringWidth(_T("00.00"));
+    m_pMinMove = new wxSpinCtrlDouble(this, wxID_ANY, _T(""), wxDefaultPosition,
+        wxSize(width + 30, -1), wxSP_ARROW_KEYS | wxALIGN_RIGHT, 0.0, 20.0, 0.0, 0.05, _T("MinMove"));
+    m_pMinMove->SetDigits(2);
+    m_pMinMove->Bind(wxEVT_COMMAND_SPINCTRLDOUBLE_UPDATED, &GuideAlgorithmPredictivePec::GuideAlgorithmPredictivePecGraphControlPane::OnMinMoveSpinCtrlDouble, this);
+    DoAdd(m_pMinMove, _("MnMo"));
+
+    m_pAggressiveness->SetValue(100.0 * m_pGuideAlgorithm->GetAggressiveness());
+    m_pPredictionGain->SetValue(100.0 * m_pGuideAlgorithm->GetPredictionGain());
+    m_pMinMove->SetValue(m_pGuideAlgorithm->GetMinMove());
+}
+
+GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecGraphControlPane::
+~GuideAlgorithmPredictivePecGraphControlPane(void)
+{
+}
+
+void GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecGraphControlPane::
+OnAggressivenessSpinCtrlDouble(wxSpinDoubleEvent& WXUNUSED(evt))
+{
+    m_pGuideAlgorithm->SetAggressiveness(m_pAggressiveness->GetValue() / 100.0);
+    GuideLog.SetGuidingParam(m_pGuideAlgorithm->GetAxis() + " Predictive PEC aggressiveness", m_pAggressiveness->GetValue());
+}
+
+void GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecGraphControlPane::
+OnPredictionGainSpinCtrlDouble(wxSpinDoubleEvent& WXUNUSED(evt))
+{
+    m_pGuideAlgorithm->SetPredictionGain(m_pPredictionGain->GetValue() / 100.0);
+    GuideLog.SetGuidingParam(m_pGuideAlgorithm->GetAxis() + " Predictive PEC prediction gain", m_pPredictionGain->GetValue());
+}
+
+void GuideAlgorithmPredictivePec::
+GuideAlgorithmPredictivePecGraphControlPane::
+OnMinMoveSpinCtrlDouble(wxSpinDoubleEvent& WXUNUSED(evt))
+{
+    m_pGuideAlgorithm->SetMinMove(m_pMinMove->GetValue());
+    GuideLog.SetGuidingParam(m_pGuideAlgorithm->GetAxis() + " Predictive PEC minimum move", m_pMinMove->GetValue());
+}
@@ -0,0 +1,119 @@
+/*
+ *  guide_algorithm_predictive_pec.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GUIDE_ALGORITHM_PREDICTIVE_PEC_H_INCLUDED
+#define GUIDE_ALGORITHM_PREDICTIVE_PEC_H_INCLUDED
+
+#include "pec_predictor.h"
+
+/*
+ * RA guide algorithm that learns the periodic error of the mount while
+ * guiding and corrects it ahead of time.
+ *
+ * The position the axis would have reached without guiding is the measured
+ * error plus all the corrections applied so far (as reported by
+ * Mount::LastPulse()). A PecPredictor estimates the periodic error from the
+ * history of these positions; each guide pulse is the proportional correction
+ * of the measured error plus the periodic error predicted to build up until
+ * the middle of the next exposure.
+ */
+class GuideAlgorithmPredictivePec : public GuideAlgorithm
+{
+    PecPredictor m_predictor;
+    double m_aggressiveness;
+    double m_predictionGain;
+    double m_minMove;
+    double m_correction;            // sum of the corrections applied, px
+    wxLongLong m_lastPulseStart;
+    double m_lastTime;              // seconds, middle of the last exposure
+    double m_predictedUntil;        // end of the span already corrected ahead of time
+
+protected:
+    class GuideAlgorithmPredictivePecConfigDialogPane : public ConfigDialogPane
+    {
+        GuideAlgorithmPredictivePec *m_pGuideAlgorithm;
+        wxSpinCtrlDouble *m_pAggressiveness;
+        wxSpinCtrlDouble *m_pPredictionGain;
+        wxSpinCtrlDouble *m_pMinMove;
+
+    public:
+        GuideAlgorithmPredictivePecConfigDialogPane(wxWindow *pParent, GuideAlgorithmPredictivePec *pGuideAlgorithm);
+        virtual ~GuideAlgorithmPredictivePecConfigDialogPane(void);
+
+        virtual void LoadValues(void);
+        virtual void UnloadValues(void);
+    };
+
+    class GuideAlgorithmPredictivePecGraphControlPane : public GraphControlPane
+    {
+    public:
+        GuideAlgorithmPredictivePecGraphControlPane(wxWindow *pParent, GuideAlgorithmPredictivePec *pGuideAlgorithm, const wxString& label);
+        ~GuideAlgorithmPredictivePecGraphControlPane(void);
+
+    private:
+        GuideAlgorithmPredictivePec *m_pGuideAlgorithm;
+        wxSpinCtrlDouble *m_pAggressiveness;
+        wxSpinCtrlDouble *m_pPredictionGain;
+        wxSpinCtrlDouble *m_pMinMove;
+
+        void OnAggressivenessSpinCtrlDouble(wxSpinDoubleEvent& evt);
+        void OnPredictionGainSpinCtrlDouble(wxSpinDoubleEvent& evt);
+        void OnMinMoveSpinCtrlDouble(wxSpinDoubleEvent& evt);
+    };
+
+    double GetAggressiveness(void);
+    bool SetAggressiveness(double aggressiveness);
+    double GetPredictionGain(void);
+    bool SetPredictionGain(double predictionGain);
+
+    void AccumulateLastPulse(void);
+    double PredictedMove(double time, double interval) const;
+
+public:
+    GuideAlgorithmPredictivePec(Mount *pMount, GuideAxis axis);
+    virtual ~GuideAlgorithmPredictivePec(void);
+    virtual GUIDE_ALGORITHM Algorithm(void);
+
+    virtual void reset(void);
+    virtual double result(double input);
+    virtual double deduceResult(void);
+    virtual void GuidingDithered(double amt);
+    virtual ConfigDialogPane *GetConfigDialogPane(wxWindow *pParent);
+    virtual GraphControlPane *GetGraphControlPane(wxWindow *pParent, const wxString& label);
+    virtual wxString GetSettingsSummary();
+    virtual wxString GetGuideAlgorithmClassName(void) const { return "Predictive PEC"; }
+    virtual double GetMinMove(void);
+    virtual bool SetMinMove(double minMove);
+};
+
+#endif /* GUIDE_ALGORITHM_PREDICTIVE_PEC_H_INCLUDED */
@@ -53,6 +53,8 @@ enum GUIDE_ALGORITHM
     GUIDE_ALGORITHM_GAUSSIAN_PROCESS,
 #endif
 
+    GUIDE_ALGORITHM_PREDICTIVE_PEC,     // RA only
+
 };
 
 #include "guide_algorithm.h"
@@ -60,6 +62,7 @@ enum GUIDE_ALGORITHM
 #include "guide_algorithm_hysteresis.h"
 #include "guide_algorithm_lowpass.h"
 #include "guide_algorithm_lowpass2.h"
+#include "guide_algorithm_predictive_pec.h"
 #include "guide_algorithm_resistswitch.h"
 
 #if defined(MPIIS_GAUSSIAN_PROCESS_GUIDING_ENABLED__)
@@ -0,0 +1,208 @@
+/*
+ *  guide_stats.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+#include "guide_stats.h"
+
+#include <algorithm>
+
+void GuideStats::AxisStats::Reset()
+{
+    n = 0;
+    a = q = 0.0;
+    hpf = lpf = xprev = 0.0;
+    peakRawDx = 0.0;
+    min = max = 0.0;
+    st = stt = sx = stx = 0.0;
+}
+
+void GuideStats::AxisStats::Add(double t, double x, double alphaHp, double alphaLp)
+{
+    if (n == 0)
+    {
+        // first point
+        hpf = lpf = x;
+        min = max = x;
+    }
+    else
+    {
+        hpf = alphaHp * (hpf + x - xprev);
+        lpf += alphaLp * (x - lpf);
+
+        double const dx = fabs(x - xprev);
+        if (dx > peakRawDx)
+            peakRawDx = dx;
+        if (x < min)
+            min = x;
+        if (x > max)
+            max = x;
+    }
+
+    xprev = x;
+
+    st += t;
+    stt += t * t;
+    sx += x;
+    stx += t * x;
+
+    double const h = hpf;
+    ++n;
+    double const a0 = a;
+    a += (h - a) / (double) n;
+    q += (h - a0) * (h - a);
+}
+
+GuideStats::GuideStats()
+{
+    Init(1.0, 6.0, 1.0);
+}
+
+void GuideStats::Init(double hpfCutoffPeriod, double lpfCutoffPeriod, double samplePeriod)
+{
+    m_alphaHp = hpfCutoffPeriod / (hpfCutoffPeriod + wxMax(1.0, samplePeriod));
+    m_alphaLp = 1.0 - (lpfCutoffPeriod / (lpfCutoffPeriod + wxMax(1.0, samplePeriod)));
+    m_t0 = 0.0;
+    m_axis[RA].Reset();
+    m_axis[DEC].Reset();
+    m_maxDriftRateRA = 0.0;
+    m_time.clear();
+    m_ra.clear();
+    m_dec.clear();
+    m_peaksCount = 0;
+    m_peaks.clear();
+}
+
+void GuideStats::AddSample(double time, double ra, double dec)
+{
+    if (m_time.empty())
+        m_t0 = time;
+
+    double const t = time - m_t0;
+
+    if (!m_time.empty())
+    {
+        double const prevLpf = m_axis[RA].lpf;
+        double const dt = t - m_time.back();
+        m_axis[RA].Add(t, ra, m_alphaHp, m_alphaLp);
+        if (dt > 0.0001)
+        {
+            double const rate = fabs(m_axis[RA].lpf - prevLpf) / dt;
+            if (rate > m_maxDriftRateRA)
+                m_maxDriftRateRA = rate;
+        }
+    }
+    else
+        m_axis[RA].Add(t, ra, m_alphaHp, m_alphaLp);
+
+    m_axis[DEC].Add(t, dec, m_alphaHp, m_alphaLp);
+
+    m_time.push_back((float) t);
+    m_ra.push_back((float) ra);
+    m_dec.push_back((float) dec);
+}
+
+void GuideStats::GetSummary(Summary *summary) const
+{
+    summary->count = Count();
+    summary->span = m_time.empty() ? 0.0 : m_time.back();
+
+    for (int i = 0; i < 2; i++)
+    {
+        const AxisStats& s = m_axis[i];
+        summary->rms[i] = s.n ? sqrt(s.q / (double) s.n) : 0.0;
+        summary->peak[i] = s.peakRawDx;
+        summary->peakPeak[i] = s.max - s.min;
+
+        double slope, intercept;
+        GetDriftFit((Axis) i, &slope, &intercept);
+        summary->driftRate[i] = slope * 60.0;
+    }
+
+    summary->maxDriftRateRA = m_maxDriftRateRA;
+}
+
+double GuideStats::WindowedRms(Axis axis, double windowSecs) const
+{
+    if (m_time.empty())
+        return 0.0;
+
+    const std::vector<float>& x = axis == RA ? m_ra : m_dec;
+    float const start = (float) (m_time.back() - windowSecs);
+    size_t const first = std::lower_bound(m_time.begin(), m_time.end(), start) - m_time.begin();
+    size_t const n = m_time.size() - first;
+
+    double sum = 0.0, sum2 = 0.0;
+    for (size_t i = first; i < m_time.size(); i++)
+    {
+        sum += x[i];
+        sum2 += (double) x[i] * x[i];
+    }
+
+    double const mean = sum / (double) n;
+    return sqrt(wxMax(0.0, sum2 / (double) n - mean * mean));
+}
+
+void GuideStats::GetDriftFit(Axis axis, double *slope, double *intercept) const
+{
+    const AxisStats& s = m_axis[axis];
+    double const n = (double) s.n;
+    double const denom = n * s.stt - s.st * s.st;
+
+    if (s.n < 2 || denom <= 0.0)
+    {
+        *slope = 0.0;
+        *intercept = s.n ? s.sx / n : 0.0;
+        return;
+    }
+
+    *slope = (n * s.stx - s.st * s.sx) / denom;
+    *intercept = (s.sx - *slope * s.st) / n;
+}
+
+void GuideStats::GetPeriodicComponents(std::vector<PeriodicComponent> *components, unsigned int maxCount) const
+{
+    components->clear();
+
+    unsigned int const n = Count();
+
+    if (m_peaksCount != n)
+    {
+        m_peaksCount = n;
+
+        std::vector<double> t(m_time.begin(), m_time.end());
+        std::vector<double> x(m_ra.begin(), m_ra.end());
+        FindSpectralPeaks(n ? &t[0] : NULL, n ? &x[0] : NULL, n, n ? m_time.back() / 2.0 : 0.0, &m_peaks);
+    }
+
+    components->assign(m_peaks.begin(), m_peaks.begin() + wxMin((size_t) maxCount, m_peaks.size()));
+}
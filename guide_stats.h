@@ -0,0 +1,127 @@
+/*
+ *  guide_stats.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GUIDE_STATS_INCLUDED
+#define GUIDE_STATS_INCLUDED
+
+#include "spectrum.h"
+
+#include <vector>
+
+/*
+ * Statistics of the RA and Dec star displacement over a measurement run, as
+ * used by the Guiding Assistant.
+ *
+ * The samples are kept in compact columns (time, RA, Dec) for the analyses
+ * that need the whole history, while everything the summary reports is
+ * maintained incrementally, so adding a sample and getting the summary are
+ * O(1) however long the run is. The periodic error analysis resamples the RA
+ * history on a uniform grid, removes the linear drift and takes the power
+ * spectrum with an FFT; it is computed on demand and cached until the next
+ * sample.
+ */
+class GuideStats
+{
+public:
+    enum Axis { RA = 0, DEC = 1 };
+
+    struct Summary
+    {
+        unsigned int count;
+        double span;            // seconds between the first and the last sample
+        double rms[2];          // of the high-pass filtered displacement, px
+        double peak[2];         // largest sample to sample change, px
+        double peakPeak[2];     // px
+        double driftRate[2];    // least squares slope, px/min
+        double maxDriftRateRA;  // of the low-pass filtered RA displacement, px/sec
+    };
+
+    typedef SpectralPeak PeriodicComponent;   // period in seconds, amplitude in px
+
+    GuideStats();
+
+    void Init(double hpfCutoffPeriod, double lpfCutoffPeriod, double samplePeriod);
+    void AddSample(double time, double ra, double dec);
+
+    unsigned int Count() const { return (unsigned int) m_time.size(); }
+    void GetSummary(Summary *summary) const;
+
+    // RMS about the mean of the samples in the last windowSecs seconds
+    double WindowedRms(Axis axis, double windowSecs) const;
+
+    // least squares line through the samples, slope in px/sec, intercept at
+    // the time of the first sample
+    void GetDriftFit(Axis axis, double *slope, double *intercept) const;
+
+    // the strongest RA periodic components, largest amplitude first; only
+    // periods that repeat at least twice during the run are considered
+    void GetPeriodicComponents(std::vector<PeriodicComponent> *components, unsigned int maxCount) const;
+
+private:
+    struct AxisStats
+    {
+        unsigned int n;
+        double a;               // running mean and
+        double q;               // sum of squares of the high-pass filtered value
+        double hpf;
+        double lpf;
+        double xprev;
+        double peakRawDx;
+        double min;
+        double max;
+        // sums for the drift fit
+        double st;
+        double stt;
+        double sx;
+        double stx;
+
+        void Reset();
+        void Add(double t, double x, double alphaHp, double alphaLp);
+    };
+
+    double m_alphaHp;
+    double m_alphaLp;
+    double m_t0;
+    AxisStats m_axis[2];
+    double m_maxDriftRateRA;
+
+    std::vector<float> m_time;  // seconds since the first sample
+    std::vector<float> m_ra;
+    std::vector<float> m_dec;
+
+    // the RA periodic components, computed when they are requested
+    mutable unsigned int m_peaksCount;
+    mutable std::vector<PeriodicComponent> m_peaks;
+};
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ *  guidelog_binary.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "guidelog_binary.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+static const char GUIDELOG_BIN_MAGIC[8] = { 'P', 'H', 'D', '2', 'G', 'L', 'O', 'G' };
+
+void InitGuideLogBinHeader(GuideLogBinHeader *hdr, const char *phdVersion)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, GUIDELOG_BIN_MAGIC, sizeof(hdr->magic));
+    hdr->version = GUIDELOG_BIN_VERSION;
+    hdr->byteOrder = GUIDELOG_BIN_BYTE_ORDER;
+    hdr->headerSize = sizeof(GuideLogBinHeader);
+    hdr->recordSize = GUIDELOG_BIN_RECORD_SIZE;
+    strncpy(hdr->phdVersion, phdVersion, sizeof(hdr->phdVersion) - 1);
+}
+
+void AppendGuideLogRecord(std::vector<char> *buf, const GuideLogRecord& rec)
+{
+    const char *p = (const char *) &rec;
+    buf->insert(buf->end(), p, p + sizeof(rec));
+}
+
+void AppendGuideLogText(std::vector<char> *buf, const char *text, size_t len)
+{
+    // an empty text still takes one record
+    do
+    {
+        GuideLogRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        size_t n = len < sizeof(rec.text.text) ? len : sizeof(rec.text.text);
+        rec.text.type = GUIDELOG_REC_TEXT;
+        rec.text.length = (uint16_t) n;
+        memcpy(rec.text.text, text, n);
+        text += n;
+        len -= n;
+        if (len)
+            rec.text.flags = GUIDELOG_TEXT_CONTINUED;
+        AppendGuideLogRecord(buf, rec);
+    } while (len);
+}
+
+GuideLogReader::GuideLogReader(void)
+    :
+    m_base(0),
+    m_length(0),
+    m_count(0),
+#ifdef _WIN32
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(0)
+#else
+    m_fd(-1)
+#endif
+{
+}
+
+GuideLogReader::~GuideLogReader(void)
+{
+    Close();
+}
+
+void GuideLogReader::Close(void)
+{
+#ifdef _WIN32
+    if (m_base)
+        UnmapViewOfFile(m_base);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = 0;
+#else
+    if (m_base)
+        munmap((void *) m_base, m_length);
+    if (m_fd != -1)
+        close(m_fd);
+    m_fd = -1;
+#endif
+    m_base = 0;
+    m_length = 0;
+    m_count = 0;
+}
+
+bool GuideLogReader::Open(const char *fileName, std::string *errorMsg)
+{
+    Close();
+
+    const char *err = 0;
+
+#ifdef _WIN32
+    m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER size;
+    if (m_file == INVALID_HANDLE_VALUE)
+        err = "cannot open file";
+    else if (!GetFileSizeEx(m_file, &size))
+        err = "cannot get file size";
+    else if ((ULONGLONG) size.QuadPart < sizeof(GuideLogBinHeader))
+        err = "file too short";
+    else if ((ULONGLONG) size.QuadPart > (size_t) -1)
+        err = "file too large";
+    else
+    {
+        m_length = (size_t) size.QuadPart;
+        m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping)
+            m_base = (const unsigned char *) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!m_base)
+            err = "cannot map file";
+    }
+#else
+    m_fd = open(fileName, O_RDONLY);
+    struct stat st;
+    if (m_fd == -1)
+        err = "cannot open file";
+    else if (fstat(m_fd, &st) != 0)
+        err = "cannot get file size";
+    else if ((unsigned long long) st.st_size < sizeof(GuideLogBinHeader))
+        err = "file too short";
+    else if ((unsigned long long) st.st_size > (size_t) -1)
+        err = "file too large";
+    else
+    {
+        m_length = (size_t) st.st_size;
+        void *p = mmap(NULL, m_length, PROT_READ, MAP_SHARED, m_fd, 0);
+        if (p == MAP_FAILED)
+            err = "cannot map file";
+        else
+        {
+            m_base = (const unsigned char *) p;
+            madvise(p, m_length, MADV_SEQUENTIAL);
+        }
+    }
+#endif
+
+    if (!err)
+    {
+        const GuideLogBinHeader& hdr = Header();
+        if (memcmp(hdr.magic, GUIDELOG_BIN_MAGIC, sizeof(hdr.magic)) != 0)
+            err = "not a binary guide log";
+        else if (hdr.byteOrder != GUIDELOG_BIN_BYTE_ORDER)
+            err = "the guide log was written on a machine with a different byte order";
+        else if (hdr.version != GUIDELOG_BIN_VERSION || hdr.headerSize != sizeof(GuideLogBinHeader) ||
+                 hdr.recordSize != GUIDELOG_BIN_RECORD_SIZE)
+        {
+            err = "unsupported binary guide log version";
+        }
+    }
+
+    if (err)
+    {
+        if (errorMsg)
+            *errorMsg = err;
+        Close();
+        return true;
+    }
+
+    // a partially written last record, e.g. after a crash, is ignored
+    m_count = (m_length - sizeof(GuideLogBinHeader)) / GUIDELOG_BIN_RECORD_SIZE;
+
+    return false;
+}
+
+size_t GuideLogReader::ReadText(size_t idx, std::string *text) const
+{
+    text->clear();
+
+    for (; idx < m_count; idx++)
+    {
+        const GuideLogTextRecord& rec = Record(idx).text;
+        if (rec.type != GUIDELOG_REC_TEXT)
+            break;
+        size_t len = rec.length < sizeof(rec.text) ? rec.length : sizeof(rec.text);
+        text->append(rec.text, len);
+        if (!(rec.flags & GUIDELOG_TEXT_CONTINUED))
+            return idx + 1;
+    }
+
+    return idx;
+}
+
+static void AppendFormat(std::string *out, const char *fmt, ...)
+{
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        out->append(buf, (size_t) n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// The formats are those of GuidingLog::GuideStep and GuidingLog::FrameDropped
+size_t GuideLogReader::Format(size_t idx, std::string *out) const
+{
+    const GuideLogRecord& rec = Record(idx);
+
+    switch (rec.type)
+    {
+    case GUIDELOG_REC_TEXT: {
+        std::string text;
+        idx = ReadText(idx, &text);
+        out->append(text);
+        return idx;
+    }
+
+    case GUIDELOG_REC_STEP: {
+        const GuideLogStepRecord& step = rec.step;
+        AppendFormat(out, "%d,%.3f,\"%s\",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,",
+            step.frameNumber, step.time,
+            step.isStepGuider ? "AO" : "Mount",
+            step.cameraOffsetX, step.cameraOffsetY,
+            step.mountOffsetX, step.mountOffsetY,
+            step.guideDistanceRA, step.guideDistanceDec);
+
+        if (step.isStepGuider)
+        {
+            AppendFormat(out, ",,,,%d,%d,", step.durationRA, step.durationDec);
+        }
+        else
+        {
+            char ra[2] = { step.directionRA, 0 };
+            char dec[2] = { step.directionDec, 0 };
+            AppendFormat(out, "%d,%s,%d,%s,,,", step.durationRA, ra, step.durationDec, dec);
+        }
+
+        AppendFormat(out, "%.f,%.2f,%d\n", step.starMass, step.starSNR, step.starError);
+        return idx + 1;
+    }
+
+    case GUIDELOG_REC_DROP: {
+        const GuideLogDropRecord& drop = rec.drop;
+        std::string status;
+        size_t next = ReadText(idx + 1, &status);
+        AppendFormat(out, "%d,%.3f,\"DROP\",,,,,,,,,,,,,%.f,%.2f,%d,\"",
+            drop.frameNumber, drop.time, drop.starMass, drop.starSNR, drop.starError);
+        out->append(status);
+        out->append("\"\n");
+        return next;
+    }
+
+    default:
+        // unknown record type from a newer version, skip it
+        return idx + 1;
+    }
+}
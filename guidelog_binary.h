@@ -0,0 +1,205 @@
+/*
+ *  guidelog_binary.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GUIDELOG_BINARY_H_INCLUDED
+#define GUIDELOG_BINARY_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * The binary guide log format.
+ *
+ * The file is a GuideLogBinHeader followed by records of
+ * GUIDELOG_BIN_RECORD_SIZE bytes. Guide steps and dropped frames are stored in
+ * binary records; everything else that goes into the text guide log is stored
+ * verbatim (UTF-8) in text records, so that the text log can be reproduced
+ * exactly with GuideLogReader::Format().
+ *
+ * Values are in the byte order of the machine that wrote the file.
+ *
+ * This header and guidelog_binary.cpp do not depend on wxWidgets, so that
+ * analysis tools can use them directly.
+ */
+
+enum
+{
+    GUIDELOG_BIN_VERSION = 1,
+    GUIDELOG_BIN_RECORD_SIZE = 96,
+    GUIDELOG_BIN_BYTE_ORDER = 0x01020304,
+};
+
+enum GuideLogRecordType
+{
+    GUIDELOG_REC_TEXT = 1,
+    GUIDELOG_REC_STEP = 2,
+    GUIDELOG_REC_DROP = 3,
+};
+
+enum
+{
+    GUIDELOG_TEXT_CONTINUED = 0x01,     // the text goes on in the next record
+};
+
+struct GuideLogBinHeader
+{
+    char        magic[8];               // "PHD2GLOG"
+    uint32_t    version;
+    uint32_t    byteOrder;              // GUIDELOG_BIN_BYTE_ORDER
+    uint32_t    headerSize;
+    uint32_t    recordSize;
+    char        phdVersion[32];
+    char        reserved[8];
+};
+
+// A piece of text. Longer texts take several consecutive records, all but the
+// last with GUIDELOG_TEXT_CONTINUED set.
+struct GuideLogTextRecord
+{
+    uint8_t     type;
+    uint8_t     flags;
+    uint16_t    length;
+    char        text[GUIDELOG_BIN_RECORD_SIZE - 4];
+};
+
+struct GuideLogStepRecord
+{
+    uint8_t     type;
+    uint8_t     isStepGuider;
+    char        directionRA;            // direction character, 0 if there was no RA pulse
+    char        directionDec;
+    int32_t     frameNumber;
+    double      time;
+    double      cameraOffsetX;
+    double      cameraOffsetY;
+    double      mountOffsetX;
+    double      mountOffsetY;
+    double      guideDistanceRA;
+    double      guideDistanceDec;
+    int32_t     durationRA;             // signed X steps for a step guider
+    int32_t     durationDec;            // signed Y steps for a step guider
+    double      starMass;
+    double      starSNR;
+    int32_t     starError;
+    int32_t     reserved;
+};
+
+// A dropped frame. The status message follows in text records.
+struct GuideLogDropRecord
+{
+    uint8_t     type;
+    uint8_t     reserved1[3];
+    int32_t     frameNumber;
+    double      time;
+    double      starMass;
+    double      starSNR;
+    int32_t     starError;
+    char        reserved2[GUIDELOG_BIN_RECORD_SIZE - 36];
+};
+
+union GuideLogRecord
+{
+    uint8_t             type;
+    GuideLogTextRecord  text;
+    GuideLogStepRecord  step;
+    GuideLogDropRecord  drop;
+};
+
+static_assert(sizeof(GuideLogBinHeader) == 64, "binary guide log header layout");
+static_assert(sizeof(GuideLogRecord) == GUIDELOG_BIN_RECORD_SIZE, "binary guide log record layout");
+
+extern void InitGuideLogBinHeader(GuideLogBinHeader *hdr, const char *phdVersion);
+
+// append the bytes of a record to a write buffer
+extern void AppendGuideLogRecord(std::vector<char> *buf, const GuideLogRecord& rec);
+// append a UTF-8 text to a write buffer, split over as many text records as it needs
+extern void AppendGuideLogText(std::vector<char> *buf, const char *text, size_t len);
+
+/*
+ * Read-only access to a binary guide log through a memory mapping of the file.
+ *
+ *  GuideLogReader rdr;
+ *  if (!rdr.Open("PHD2_GuideLog_2016-05-01_201500.bin", &err))
+ *      for (size_t i = 0; i < rdr.RecordCount(); i++)
+ *          if (rdr.Record(i).type == GUIDELOG_REC_STEP)
+ *              ... rdr.Record(i).step ...
+ */
+class GuideLogReader
+{
+    const unsigned char *m_base;
+    size_t m_length;
+    size_t m_count;
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#else
+    int m_fd;
+#endif
+
+    GuideLogReader(const GuideLogReader&);
+    GuideLogReader& operator=(const GuideLogReader&);
+
+public:
+    GuideLogReader(void);
+    ~GuideLogReader(void);
+
+    // returns true on error
+    bool Open(const char *fileName, std::string *errorMsg);
+    void Close(void);
+
+    const GuideLogBinHeader& Header(void) const;
+    size_t RecordCount(void) const { return m_count; }
+    const GuideLogRecord& Record(size_t idx) const;
+
+    // gets the text starting at record idx, returns the index of the record
+    // following it
+    size_t ReadText(size_t idx, std::string *text) const;
+
+    // appends the text log output of the entry starting at record idx,
+    // returns the index of the next entry
+    size_t Format(size_t idx, std::string *out) const;
+};
+
+inline const GuideLogBinHeader& GuideLogReader::Header(void) const
+{
+    return *(const GuideLogBinHeader *) m_base;
+}
+
+inline const GuideLogRecord& GuideLogReader::Record(size_t idx) const
+{
+    return ((const GuideLogRecord *) (m_base + sizeof(GuideLogBinHeader)))[idx];
+}
+
+#endif // GUIDELOG_BINARY_H_INCLUDED
@@ -0,0 +1,106 @@
+/*
+ *  guidelog_convert.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Converts a binary guide log to the text guide log PHD2 would have written.
+ *
+ *   phd2_guidelog_convert PHD2_GuideLog_2016-05-01_201500.bin [output.txt]
+ *
+ * Without an output file name, the output goes to the input file name with
+ * the extension replaced by .txt.
+ */
+
+#include "guidelog_binary.h"
+
+#include <stdio.h>
+#include <string>
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s BINARY_GUIDE_LOG [TEXT_GUIDE_LOG]\n", argv[0]);
+        return 2;
+    }
+
+    std::string inName(argv[1]);
+    std::string outName;
+    if (argc > 2)
+        outName = argv[2];
+    else
+    {
+        size_t dot = inName.find_last_of('.');
+        size_t sep = inName.find_last_of("/\\");
+        outName = (dot != std::string::npos && (sep == std::string::npos || dot > sep) ? inName.substr(0, dot) : inName) + ".txt";
+    }
+
+    GuideLogReader reader;
+    std::string err;
+    if (reader.Open(inName.c_str(), &err))
+    {
+        fprintf(stderr, "%s: %s\n", inName.c_str(), err.c_str());
+        return 1;
+    }
+
+    // text mode, as the guide log is written by PHD2
+    FILE *out = fopen(outName.c_str(), "w");
+    if (!out)
+    {
+        fprintf(stderr, "cannot create %s\n", outName.c_str());
+        return 1;
+    }
+
+    std::string buf;
+    for (size_t idx = 0; idx < reader.RecordCount(); )
+    {
+        idx = reader.Format(idx, &buf);
+        if (buf.size() >= 64 * 1024 || idx >= reader.RecordCount())
+        {
+            if (fwrite(buf.data(), 1, buf.size(), out) != buf.size())
+            {
+                fprintf(stderr, "error writing %s\n", outName.c_str());
+                fclose(out);
+                return 1;
+            }
+            buf.clear();
+        }
+    }
+
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "error writing %s\n", outName.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -109,7 +109,8 @@ Guider::Guider(wxWindow *parent, int xSize, int ySize) :
 {
     m_state = STATE_UNINITIALIZED;
     m_scaleFactor = 1.0;
-    m_displayedImage = new wxImage(XWinSize,YWinSize,true);
+    m_display.image = new wxImage(XWinSize,YWinSize,true);
+    m_displayedFrame = NULL;
     m_paused = PAUSE_NONE;
     m_starFoundTimestamp = 0;
     m_avgDistanceNeedReset = false;
@@ -147,7 +148,6 @@ Guider::Guider(wxWindow *parent, int xSize, int ySize) :
 
 Guider::~Guider(void)
 {
-    delete m_displayedImage;
     delete m_pCurrentImage;
 
     s_deflectionLogger.Uninit();
@@ -348,6 +348,97 @@ void Guider::OnClose(wxCloseEvent& evt)
     Destroy();
 }
 
+// options of the last paint of the guider window, for the worker thread
+static wxCriticalSection s_displayOptionsLock;
+static DisplayOptions s_displayOptions;
+
+// Returns the number of display pixels per frame pixel for a frame of the given
+// size.
+double Guider::DisplayScale(const wxSize& imageSize, const DisplayOptions& options)
+{
+    int imageWidth   = imageSize.GetWidth();
+    int imageHeight  = imageSize.GetHeight();
+
+    if (imageWidth == options.winSize.GetWidth() && imageHeight == options.winSize.GetHeight())
+        return 1.0;
+
+    if (options.winSize.GetWidth() <= 0 || options.winSize.GetHeight() <= 0)
+        return 1.0;
+
+    // The image is not the exact right size -- figure out what to do.
+    double xScaleFactor = imageWidth / (double) options.winSize.GetWidth();
+    double yScaleFactor = imageHeight / (double) options.winSize.GetHeight();
+
+    double newScaleFactor = (xScaleFactor > yScaleFactor) ?
+                            xScaleFactor :
+                            yScaleFactor;
+
+    // we rescale the image if:
+    // - The image is either too big
+    // - The image is so small that at least one dimension is less
+    //   than half the width of the window or
+    // - The user has requsted rescaling
+
+    if (xScaleFactor > 1.0 || yScaleFactor > 1.0 ||
+        xScaleFactor < 0.45 || yScaleFactor < 0.45 || options.scaleImage)
+    {
+        return 1.0 / newScaleFactor;
+    }
+
+    return 1.0;
+}
+
+// Converts a frame to the image shown in the window. Frames are scaled down
+// before the conversion, so a large frame costs one pass over its pixels.
+static void RenderFrame(usImage& img, const DisplayOptions& options, FrameRendering *r)
+{
+    int const blevel = img.FiltMin;
+    int const wlevel = img.FiltMax;
+    double scale = Guider::DisplayScale(img.Size, options);
+    int const newWidth = ROUND(img.Size.GetWidth() * scale);
+    int const newHeight = ROUND(img.Size.GetHeight() * scale);
+
+    if (scale == 1.0 || newWidth <= 0 || newHeight <= 0)
+    {
+        img.CopyToImage(&r->image, blevel, wlevel, options.gamma, &r->area);
+        scale = 1.0;
+    }
+    else if (scale < 1.0)
+    {
+        img.ScaledCopyToImage(&r->image, wxSize(newWidth, newHeight), blevel, wlevel, options.gamma);
+        r->area = wxRect(r->image->GetSize());
+    }
+    else
+    {
+        // small frames are enlarged after the conversion
+        img.CopyToImage(&r->image, blevel, wlevel, options.gamma, &r->area);
+        r->image->Rescale(newWidth, newHeight, wxIMAGE_QUALITY_HIGH);
+        r->area = wxRect(r->image->GetSize());
+    }
+
+    // overlays are drawn from sensor coordinates
+    r->options = options;
+    r->scale = scale / img.BinFactor;
+    r->valid = true;
+}
+
+// Renders a new frame for the guider window, with the options of the last
+// paint. Called by the worker thread, so that painting the frame on the main
+// thread only needs a blit.
+void Guider::RenderForDisplay(usImage *pImage)
+{
+    DisplayOptions options;
+    {
+        wxCriticalSectionLocker lock(s_displayOptionsLock);
+        options = s_displayOptions;
+    }
+
+    if (!pImage->ImageData || options.winSize.GetWidth() <= 0 || options.winSize.GetHeight() <= 0)
+        return;
+
+    RenderFrame(*pImage, options, &pImage->Rendering);
+}
+
 bool Guider::PaintHelper(wxAutoBufferedPaintDCBase& dc, wxMemoryDC& memDC)
 {
     bool bError = false;
@@ -357,73 +448,53 @@ bool Guider::PaintHelper(wxAutoBufferedPaintDCBase& dc, wxMemoryDC& memDC)
         GUIDER_STATE state = GetState();
         GetSize(&XWinSize, &YWinSize);
 
-        if (m_pCurrentImage->ImageData)
+        DisplayOptions options;
+        options.winSize = wxSize(XWinSize, YWinSize);
+        options.scaleImage = m_scaleImage;
+        options.gamma = pFrame->Stretch_gamma;
+
         {
-            int blevel = m_pCurrentImage->FiltMin;
-            int wlevel = m_pCurrentImage->FiltMax;
-            m_pCurrentImage->CopyToImage(&m_displayedImage, blevel, wlevel, pFrame->Stretch_gamma);
+            wxCriticalSectionLocker lock(s_displayOptionsLock);
+            s_displayOptions = options;
         }
 
-        int imageWidth   = m_displayedImage->GetWidth();
-        int imageHeight  = m_displayedImage->GetHeight();
-
-        // scale the image if necessary
-
-        if (imageWidth != XWinSize || imageHeight != YWinSize)
+        if (m_pCurrentImage->ImageData)
         {
-            // The image is not the exact right size -- figure out what to do.
-            double xScaleFactor = imageWidth / (double)XWinSize;
-            double yScaleFactor = imageHeight / (double)YWinSize;
-            int newWidth = imageWidth;
-            int newHeight = imageHeight;
-
-            double newScaleFactor = (xScaleFactor > yScaleFactor) ?
-                                    xScaleFactor :
-                                    yScaleFactor;
-
-//            Debug.Write(wxString::Format("xScaleFactor=%.2f, yScaleFactor=%.2f, newScaleFactor=%.2f\n", xScaleFactor,
-//                    yScaleFactor, newScaleFactor));
-
-            // we rescale the image if:
-            // - The image is either too big
-            // - The image is so small that at least one dimension is less
-            //   than half the width of the window or
-            // - The user has requsted rescaling
-
-            if (xScaleFactor > 1.0 || yScaleFactor > 1.0 ||
-                xScaleFactor < 0.45 || yScaleFactor < 0.45 || m_scaleImage)
-            {
-
-                newWidth /= newScaleFactor;
-                newHeight /= newScaleFactor;
-
-                newScaleFactor = 1.0 / newScaleFactor;
+            FrameRendering& rendering = m_pCurrentImage->Rendering;
 
-                m_scaleFactor = newScaleFactor;
-
-                Debug.Write(wxString::Format("Resizing image to %d,%d\n", newWidth, newHeight));
-
-                if (newWidth > 0 && newHeight > 0)
-                {
-                    m_displayedImage->Rescale(newWidth, newHeight, wxIMAGE_QUALITY_HIGH);
-                }
+            if (rendering.valid && rendering.options == options)
+            {
+                // rendered by the worker thread, which gets our previous
+                // image to reuse for a later frame
+                m_display.Swap(rendering);
+                rendering.valid = false;
             }
-            else
+            else if (!m_display.valid || m_displayedFrame != m_pCurrentImage || !(m_display.options == options))
             {
-                m_scaleFactor = 1.0;
+                RenderFrame(*m_pCurrentImage, options, &m_display);
             }
+
+            m_displayedFrame = m_pCurrentImage;
         }
 
-        // important to provide explicit color for r,g,b, optional args to Size().
-        // If default args are provided wxWidgets performs some expensive histogram
-        // operations.
-        wxBitmap DisplayedBitmap(m_displayedImage->Size(wxSize(XWinSize, YWinSize), wxPoint(0, 0), 0, 0, 0));
+        m_scaleFactor = m_display.scale;
+
+        int XImgSize = m_display.image->GetWidth();
+        int YImgSize = m_display.image->GetHeight();
+
+        wxBitmap DisplayedBitmap(*m_display.image);
         memDC.SelectObject(DisplayedBitmap);
 
-        dc.Blit(0, 0, DisplayedBitmap.GetWidth(), DisplayedBitmap.GetHeight(), &memDC, 0, 0, wxCOPY, false);
+        dc.Blit(0, 0, XImgSize, YImgSize, &memDC, 0, 0, wxCOPY, false);
+
+        // blank the part of the window the image does not cover
+        dc.SetPen(*wxTRANSPARENT_PEN);
+        dc.SetBrush(*wxBLACK_BRUSH);
+        if (XImgSize < XWinSize)
+            dc.DrawRectangle(XImgSize, 0, XWinSize - XImgSize, YWinSize);
+        if (YImgSize < YWinSize)
+            dc.DrawRectangle(0, YImgSize, wxMin(XImgSize, XWinSize), YWinSize - YImgSize);
 
-        int XImgSize = m_displayedImage->GetWidth();
-        int YImgSize = m_displayedImage->GetHeight();
 
         if (m_overlayMode)
         {
@@ -642,6 +713,9 @@ void Guider::UpdateImageDisplay(usImage *pImage)
     Debug.Write(wxString::Format("UpdateImageDisplay: Size=(%d,%d) min=%d, max=%d, FiltMin=%d, FiltMax=%d\n",
         pImage->Size.x, pImage->Size.y, pImage->Min, pImage->Max, pImage->FiltMin, pImage->FiltMax));
 
+    // the image may have changed since it was last drawn
+    m_display.valid = false;
+
     Refresh();
     Update();
 }
@@ -680,12 +754,14 @@ bool Guider::SetLockPosition(const PHD_Point& position)
         double y = position.Y;
         Debug.Write(wxString::Format("setting lock position to (%.2f, %.2f)\n", x, y));
 
-        if ((x < 0.0) || (x >= m_pCurrentImage->Size.x))
+        wxSize sensorSize = m_pCurrentImage->SensorSize();
+
+        if ((x < 0.0) || (x >= sensorSize.x))
         {
             throw ERROR_INFO("invalid x value");
         }
 
-        if ((y < 0.0) || (y >= m_pCurrentImage->Size.y))
+        if ((y < 0.0) || (y >= sensorSize.y))
         {
             throw ERROR_INFO("invalid y value");
         }
@@ -955,7 +1031,7 @@ void Guider::SetState(GUIDER_STATE newState)
 
 void Guider::UpdateCurrentDistance(double distance)
 {
-    m_starFoundTimestamp = wxDateTime::GetTimeNow();
+    m_starFoundTimestamp = ReplayClock::GetTimeNow();
 
     if (IsGuiding())
     {
@@ -987,7 +1063,7 @@ double Guider::CurrentError(void)
         return LARGE_DISTANCE;
     }
 
-    if (wxDateTime::GetTimeNow() - m_starFoundTimestamp > THRESHOLD_SECONDS)
+    if (ReplayClock::GetTimeNow() - m_starFoundTimestamp > THRESHOLD_SECONDS)
     {
         return LARGE_DISTANCE;
     }
@@ -1062,7 +1138,7 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
 
             usImage *pPrevImage = m_pCurrentImage;
             m_pCurrentImage = pImage;
-            delete pPrevImage;
+            usImagePool::Release(pPrevImage);
         }
         else
         {
@@ -1144,6 +1220,8 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
         else
             statusMessage = info.status;
 
+        pImage->Latency.Stamp(LAT_CENTROIDED);
+
         // we have a star selected, so re-enable subframes
         if (m_forceFullFrame)
         {
@@ -1248,7 +1326,8 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
                 assert(m_state == STATE_CALIBRATED);
                 SetState(STATE_GUIDING);
                 pFrame->StatusMsg(_("Guiding"));
-                pFrame->m_guidingStarted = wxDateTime::UNow();
+                pFrame->m_guidingStarted = ReplayClock::UNow();
+                LatencyStats::Reset();
                 pFrame->m_frameCounter = 0;
                 GuideLog.StartGuiding();
                 EvtServer.NotifyStartGuiding();
@@ -1289,7 +1368,8 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
                 {
                     // ordinary guide step
                     s_deflectionLogger.Log(CurrentPosition());
-                    pFrame->SchedulePrimaryMove(pMount, CurrentPosition() - LockPosition(), MOVETYPE_ALGO);
+                    pFrame->SchedulePrimaryMove(pMount, CurrentPosition() - LockPosition(), MOVETYPE_ALGO,
+                        ExposureWindow(pImage->ImgExposureStart, pImage->ImgExpDur), &pImage->Latency);
                 }
                 break;
 
@@ -1318,6 +1398,8 @@ void Guider::UpdateGuideState(usImage *pImage, bool bStopping)
 
     pFrame->UpdateButtonsStatus();
 
+    FrameSrv.NotifyFrame(pImage, CurrentPosition());
+
     UpdateImageDisplay(pImage);
 
     Debug.AddLine("UpdateGuideState exits: " + statusMessage);
@@ -1442,6 +1524,9 @@ void Guider::GuiderConfigDialogPane::LayoutControls(Guider *pGuider, BrainCtrlId
     wxFlexGridSizer *pSharedSizer = new wxFlexGridSizer(2, 2, 10, 10);
 
     pStarTrack->Add(GetSizerCtrl(CtrlMap, AD_szStarTracking), def_flags);
+    wxSizer *pMultiStar = GetSizerCtrl(CtrlMap, AD_szMultiStar);
+    if (pMultiStar)
+        pStarTrack->Add(pMultiStar, def_flags);
     pStarTrack->Layout();
 
     pCalibSizer->Add(GetSizerCtrl(CtrlMap, AD_szFocalLength));
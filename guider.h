@@ -141,7 +141,8 @@ class Guider : public wxWindow
 {
     // Private member data.
 
-    wxImage *m_displayedImage;
+    FrameRendering m_display;           // what the window shows
+    const usImage *m_displayedFrame;    // the frame m_display was rendered from
     OVERLAY_MODE m_overlayMode;
     OverlaySlitCoords m_overlaySlitCoords;
     const DefectMap *m_defectMapPreview;
@@ -216,6 +217,8 @@ public:
     void OnClose(wxCloseEvent& evt);
     void OnErase(wxEraseEvent& evt);
     void UpdateImageDisplay(usImage *pImage=NULL);
+    static double DisplayScale(const wxSize& imageSize, const DisplayOptions& options);
+    static void RenderForDisplay(usImage *pImage);
 
     bool MoveLockPosition(const PHD_Point& mountDelta);
     bool SetLockPosition(const PHD_Point& position);
@@ -365,7 +368,7 @@ inline usImage *Guider::CurrentImage(void)
 
 inline wxImage *Guider::DisplayedImage(void)
 {
-    return m_displayedImage;
+    return m_display.image;
 }
 
 inline double Guider::ScaleFactor(void)
@@ -0,0 +1,463 @@
+/*
+ *  guider_multistar.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+
+static const double DefaultMassTolerance = 0.5; // when star mass change detection is disabled
+static const double MinSecondarySNR = 6.0;
+static const double MassSmoothing = 0.1;
+
+enum {
+    DEFAULT_MAX_STARS = 9,
+    MAX_MAX_STARS = 16,
+    MAX_LOST_FRAMES = 10,   // a secondary star unusable for this many frames in a row is dropped
+    MAX_POOL_THREADS = 4,
+};
+
+/*
+ * Centroids the secondary stars on a few worker threads. Jobs are posted
+ * before the guide star is centroided on the calling thread; Finish() then
+ * takes any jobs the workers have not started and waits for the rest, so
+ * with N stars a frame costs about N / (threads + 1) centroids.
+ */
+class StarFindPool
+{
+    struct Job
+    {
+        Star *star;             // NULL tells a worker to exit
+        const usImage *image;
+        int searchRegion;
+        Star::FindMode mode;
+    };
+
+    class Worker : public wxThread
+    {
+        StarFindPool *m_pool;
+    public:
+        Worker(StarFindPool *pool) : wxThread(wxTHREAD_JOINABLE), m_pool(pool) { }
+        ExitCode Entry();
+    };
+
+    wxMessageQueue<Job> m_jobs;
+    wxSemaphore m_done;
+    std::vector<Worker *> m_workers;
+    unsigned int m_pending;
+
+    static void RunJob(const Job& job)
+    {
+        job.star->Find(job.image, job.searchRegion, job.mode);
+    }
+
+public:
+    StarFindPool();
+    ~StarFindPool();
+    void Post(Star *star, const usImage *image, int searchRegion, Star::FindMode mode);
+    void Finish(void);
+};
+
+StarFindPool::StarFindPool()
+    : m_pending(0)
+{
+    int nthreads = std::min(wxThread::GetCPUCount() - 1, (int) MAX_POOL_THREADS);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        Worker *worker = new Worker(this);
+        if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR)
+        {
+            delete worker;
+            break;
+        }
+        m_workers.push_back(worker);
+    }
+
+    Debug.Write(wxString::Format("StarFindPool: started %u threads\n", (unsigned int) m_workers.size()));
+}
+
+StarFindPool::~StarFindPool()
+{
+    Job stop;
+    memset(&stop, 0, sizeof(stop));
+
+    for (size_t i = 0; i < m_workers.size(); i++)
+        m_jobs.Post(stop);
+
+    for (std::vector<Worker *>::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+    {
+        (*it)->Wait();
+        delete *it;
+    }
+}
+
+wxThread::ExitCode StarFindPool::Worker::Entry()
+{
+    Job job;
+    while (m_pool->m_jobs.Receive(job) == wxMSGQUEUE_NO_ERROR && job.star)
+    {
+        RunJob(job);
+        m_pool->m_done.Post();
+    }
+    return 0;
+}
+
+void StarFindPool::Post(Star *star, const usImage *image, int searchRegion, Star::FindMode mode)
+{
+    Job job;
+    job.star = star;
+    job.image = image;
+    job.searchRegion = searchRegion;
+    job.mode = mode;
+
+    m_jobs.Post(job);
+    ++m_pending;
+}
+
+void StarFindPool::Finish(void)
+{
+    Job job;
+    while (m_jobs.ReceiveTimeout(0, job) == wxMSGQUEUE_NO_ERROR)
+    {
+        RunJob(job);
+        m_done.Post();
+    }
+
+    for (; m_pending > 0; --m_pending)
+        m_done.Wait();
+}
+
+GuiderMultiStar::GuiderMultiStar(wxWindow *parent)
+    : GuiderOneStar(parent),
+      m_pool(0),
+      m_multiStarEnabled(false),
+      m_maxStars(DEFAULT_MAX_STARS)
+{
+}
+
+GuiderMultiStar::~GuiderMultiStar()
+{
+    delete m_pool;
+}
+
+void GuiderMultiStar::LoadProfileSettings(void)
+{
+    GuiderOneStar::LoadProfileSettings();
+
+    SetMultiStarEnabled(pConfig->Profile.GetBoolean("/guider/multistar/Enabled", false));
+    SetMaxStars(pConfig->Profile.GetInt("/guider/multistar/MaxStars", DEFAULT_MAX_STARS));
+}
+
+void GuiderMultiStar::SetMultiStarEnabled(bool enable)
+{
+    m_multiStarEnabled = enable;
+    pConfig->Profile.SetBoolean("/guider/multistar/Enabled", enable);
+
+    if (!enable)
+    {
+        m_others.clear();
+        m_position.Invalidate();
+    }
+}
+
+bool GuiderMultiStar::SetMaxStars(int maxStars)
+{
+    bool bError = false;
+
+    try
+    {
+        if (maxStars < 2)
+        {
+            m_maxStars = 2;
+            throw ERROR_INFO("maxStars < 2");
+        }
+        else if (maxStars > MAX_MAX_STARS)
+        {
+            m_maxStars = MAX_MAX_STARS;
+            throw ERROR_INFO("maxStars > MAX_MAX_STARS");
+        }
+        m_maxStars = maxStars;
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+    }
+
+    pConfig->Profile.SetInt("/guider/multistar/MaxStars", m_maxStars);
+
+    if (m_others.size() > (size_t) m_maxStars - 1)
+        m_others.resize(m_maxStars - 1);
+
+    return bError;
+}
+
+const PHD_Point& GuiderMultiStar::CurrentPosition(void)
+{
+    if (m_position.IsValid())
+        return m_position;
+    return m_star;
+}
+
+bool GuiderMultiStar::AutoFindStar(const usImage& image, int edgeAllowance, Star *star)
+{
+    m_others.clear();
+    m_position.Invalidate();
+
+    if (!m_multiStarEnabled)
+        return GuiderOneStar::AutoFindStar(image, edgeAllowance, star);
+
+    std::vector<Star> candidates;
+    if (!star->AutoFind(image, edgeAllowance, m_searchRegion, &candidates))
+        return false;
+
+    // the first candidate is the guide star, as AutoSelect will centroid it
+    const Star& primary = candidates[0];
+
+    for (size_t i = 1; i < candidates.size() && m_others.size() < (size_t) m_maxStars - 1; i++)
+    {
+        GuideStar gs;
+        gs.star = candidates[i];
+        gs.offset.SetXY(gs.star.X - primary.X, gs.star.Y - primary.Y);
+        gs.refMass = gs.star.Mass;
+        gs.lostCount = 0;
+        m_others.push_back(gs);
+
+        Debug.Write(wxString::Format("MultiStar: secondary star at (%.2f, %.2f) offset (%.2f, %.2f) Mass %.f SNR %.1f\n",
+            gs.star.X, gs.star.Y, gs.offset.X, gs.offset.Y, gs.star.Mass, gs.star.SNR));
+    }
+
+    return true;
+}
+
+void GuiderMultiStar::InvalidateCurrentPosition(bool fullReset)
+{
+    GuiderOneStar::InvalidateCurrentPosition(fullReset);
+
+    m_position.Invalidate();
+    if (fullReset)
+        m_others.clear();
+}
+
+bool GuiderMultiStar::SetCurrentPosition(usImage *pImage, const PHD_Point& position)
+{
+    // a star picked by position has no candidate list to take secondary stars from
+    m_others.clear();
+    m_position.Invalidate();
+
+    return GuiderOneStar::SetCurrentPosition(pImage, position);
+}
+
+bool GuiderMultiStar::UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo)
+{
+    m_position.Invalidate();
+
+    bool useOthers = m_multiStarEnabled && !m_others.empty() && pImage->Subframe.IsEmpty();
+
+    // the secondary stars are centroided by the pool while the base class
+    // handles the guide star
+    std::vector<Star> found;
+    if (useOthers)
+    {
+        if (!m_pool)
+            m_pool = new StarFindPool();
+
+        Star::FindMode mode = pFrame->GetStarFindMode();
+        found.resize(m_others.size());
+        for (size_t i = 0; i < m_others.size(); i++)
+        {
+            found[i] = m_others[i].star;
+            m_pool->Post(&found[i], pImage, m_searchRegion, mode);
+        }
+    }
+
+    bool bError = GuiderOneStar::UpdateCurrentPosition(pImage, errorInfo);
+
+    if (useOthers)
+    {
+        m_pool->Finish();
+
+        if (!bError)
+            UpdateOtherStars(found);
+    }
+
+    return bError;
+}
+
+void GuiderMultiStar::UpdateOtherStars(std::vector<Star>& found)
+{
+    double massTolerance = m_massChangeThresholdEnabled ? m_massChangeThreshold : DefaultMassTolerance;
+
+    // weight each star by the inverse of its centroid variance, ~ 1 / SNR^2
+    double w = m_star.SNR * m_star.SNR;
+    double sumw = w;
+    double sumx = w * m_star.X;
+    double sumy = w * m_star.Y;
+    int used = 1;
+
+    std::vector<GuideStar>::iterator gs = m_others.begin();
+    for (std::vector<Star>::iterator s = found.begin(); s != found.end(); ++s)
+    {
+        bool ok = s->WasFound();
+
+        if (ok && s->SNR < MinSecondarySNR)
+        {
+            Debug.Write(wxString::Format("MultiStar: reject (%.2f, %.2f) SNR %.1f\n", s->X, s->Y, s->SNR));
+            ok = false;
+        }
+
+        if (ok && fabs(s->Mass - gs->refMass) > massTolerance * gs->refMass)
+        {
+            Debug.Write(wxString::Format("MultiStar: reject (%.2f, %.2f) Mass %.f vs %.f\n", s->X, s->Y, s->Mass, gs->refMass));
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            if (++gs->lostCount >= MAX_LOST_FRAMES)
+            {
+                Debug.Write(wxString::Format("MultiStar: dropping secondary star at (%.2f, %.2f)\n", gs->star.X, gs->star.Y));
+                gs = m_others.erase(gs);
+            }
+            else
+                ++gs;
+            continue;
+        }
+
+        gs->star = *s;
+        gs->lostCount = 0;
+        gs->refMass += MassSmoothing * (s->Mass - gs->refMass);
+
+        w = s->SNR * s->SNR;
+        sumw += w;
+        sumx += w * (s->X - gs->offset.X);
+        sumy += w * (s->Y - gs->offset.Y);
+        ++used;
+
+        ++gs;
+    }
+
+    m_position.SetXY(sumx / sumw, sumy / sumw);
+
+    Debug.Write(wxString::Format("MultiStar: %d of %u stars, guide star (%.2f, %.2f) mean (%.2f, %.2f)\n",
+        used, (unsigned int) found.size() + 1, m_star.X, m_star.Y, m_position.X, m_position.Y));
+}
+
+inline static void DrawBox(wxDC& dc, const PHD_Point& star, int halfW, double scale)
+{
+    dc.SetBrush(*wxTRANSPARENT_BRUSH);
+    double w = ROUND((halfW * 2 + 1) * scale);
+    dc.DrawRectangle(int((star.X - halfW) * scale), int((star.Y - halfW) * scale), w, w);
+}
+
+void GuiderMultiStar::DrawOtherStars(wxDC& dc)
+{
+    if (!m_multiStarEnabled)
+        return;
+
+    for (std::vector<GuideStar>::const_iterator it = m_others.begin(); it != m_others.end(); ++it)
+    {
+        if (it->lostCount == 0)
+            dc.SetPen(wxPen(wxColour(0,160,255), 1, wxSOLID));
+        else
+            dc.SetPen(wxPen(wxColour(230,130,30), 1, wxDOT));
+        DrawBox(dc, it->star, m_searchRegion / 2, m_scaleFactor);
+    }
+}
+
+wxString GuiderMultiStar::GetSettingsSummary()
+{
+    wxString s = GuiderOneStar::GetSettingsSummary();
+
+    if (GetMultiStarEnabled())
+        s += wxString::Format(_T("Multi-star guiding = enabled, max stars = %d\n"), GetMaxStars());
+    else
+        s += _T("Multi-star guiding = disabled\n");
+
+    return s;
+}
+
+GuiderConfigDialogCtrlSet *GuiderMultiStar::GetConfigDialogCtrlSet(wxWindow *pParent, Guider *pGuider, AdvancedDialog *pAdvancedDialog, BrainCtrlIdMap& CtrlMap)
+{
+    return new GuiderMultiStarConfigDialogCtrlSet(pParent, pGuider, pAdvancedDialog, CtrlMap);
+}
+
+GuiderMultiStarConfigDialogCtrlSet::GuiderMultiStarConfigDialogCtrlSet(wxWindow *pParent, Guider *pGuider, AdvancedDialog *pAdvancedDialog, BrainCtrlIdMap& CtrlMap)
+    : GuiderOneStarConfigDialogCtrlSet(pParent, pGuider, pAdvancedDialog, CtrlMap)
+{
+    assert(pGuider);
+
+    m_pGuiderMultiStar = (GuiderMultiStar *) pGuider;
+    wxWindow *parent = GetParentWindow(AD_szMultiStar);
+
+    m_pEnableMultiStar = new wxCheckBox(parent, MULTI_STAR_ENABLE, _("Use multiple stars"));
+    m_pEnableMultiStar->SetToolTip(_("Check to track additional stars found by Auto-select along with the guide star, "
+        "and guide on their averaged motion. This reduces the effect of seeing on the guide star position. "
+        "Additional stars are only used with full frames."));
+    parent->Bind(wxEVT_COMMAND_CHECKBOX_CLICKED, &GuiderMultiStarConfigDialogCtrlSet::OnMultiStarEnableChecked, this, MULTI_STAR_ENABLE);
+
+    int width = StringWidth(_T("00"));
+    m_pMaxStars = new wxSpinCtrl(parent, wxID_ANY, _T("foo2"), wxPoint(-1, -1),
+        wxSize(width + 30, -1), wxSP_ARROW_KEYS, 2, MAX_MAX_STARS, DEFAULT_MAX_STARS, _T("MaxStars"));
+    wxSizer *pMaxStars = MakeLabeledControl(AD_szMultiStar, _("Max stars"), m_pMaxStars,
+        wxString::Format(_("Maximum number of stars to track, including the guide star. Default = %d"), DEFAULT_MAX_STARS));
+
+    wxBoxSizer *pMultiStar = new wxBoxSizer(wxHORIZONTAL);
+    pMultiStar->Add(m_pEnableMultiStar, wxSizerFlags(0).Border(wxTOP, 3));
+    pMultiStar->Add(pMaxStars, wxSizerFlags(0).Border(wxLEFT, 40));
+
+    AddGroup(CtrlMap, AD_szMultiStar, pMultiStar);
+}
+
+GuiderMultiStarConfigDialogCtrlSet::~GuiderMultiStarConfigDialogCtrlSet()
+{
+}
+
+void GuiderMultiStarConfigDialogCtrlSet::LoadValues()
+{
+    bool enabled = m_pGuiderMultiStar->GetMultiStarEnabled();
+    m_pEnableMultiStar->SetValue(enabled);
+    m_pMaxStars->Enable(enabled);
+    m_pMaxStars->SetValue(m_pGuiderMultiStar->GetMaxStars());
+    GuiderOneStarConfigDialogCtrlSet::LoadValues();
+}
+
+void GuiderMultiStarConfigDialogCtrlSet::UnloadValues()
+{
+    m_pGuiderMultiStar->SetMultiStarEnabled(m_pEnableMultiStar->GetValue());
+    m_pGuiderMultiStar->SetMaxStars(m_pMaxStars->GetValue());
+    GuiderOneStarConfigDialogCtrlSet::UnloadValues();
+}
+
+void GuiderMultiStarConfigDialogCtrlSet::OnMultiStarEnableChecked(wxCommandEvent& event)
+{
+    m_pMaxStars->Enable(event.IsChecked());
+}
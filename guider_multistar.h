@@ -0,0 +1,126 @@
+/*
+ *  guider_multistar.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GUIDER_MULTISTAR_H_INCLUDED
+#define GUIDER_MULTISTAR_H_INCLUDED
+
+class GuiderMultiStar;
+class StarFindPool;
+
+class GuiderMultiStarConfigDialogCtrlSet : public GuiderOneStarConfigDialogCtrlSet
+{
+public:
+    GuiderMultiStarConfigDialogCtrlSet(wxWindow *pParent, Guider *pGuider, AdvancedDialog *pAdvancedDialog, BrainCtrlIdMap& CtrlMap);
+    virtual ~GuiderMultiStarConfigDialogCtrlSet();
+
+    GuiderMultiStar *m_pGuiderMultiStar;
+    wxCheckBox *m_pEnableMultiStar;
+    wxSpinCtrl *m_pMaxStars;
+
+    virtual void LoadValues(void);
+    virtual void UnloadValues(void);
+    void OnMultiStarEnableChecked(wxCommandEvent& event);
+};
+
+/*
+ * A guider that tracks the guide star selected by the user or by AutoSelect,
+ * plus up to MaxStars - 1 secondary stars taken from the AutoFind candidates.
+ *
+ * The offset of each secondary star from the guide star is recorded when it
+ * is selected. On each frame the secondary stars are centroided on a small
+ * pool of threads while the guide star is centroided on the calling thread,
+ * and the reported position is the mean of the star positions less their
+ * offsets, weighted by SNR^2 (the inverse of the centroid variance). Stars
+ * whose SNR or mass is out of line are left out of the frame, and stars lost
+ * for several frames in a row are dropped.
+ *
+ * The guide star alone drives the guider state: if it is lost, the frame is
+ * dropped as with GuiderOneStar. Secondary stars are only used on full frames.
+ */
+class GuiderMultiStar : public GuiderOneStar
+{
+    struct GuideStar
+    {
+        Star star;
+        PHD_Point offset;   // position relative to the guide star when selected
+        double refMass;     // running average of the star mass
+        int lostCount;      // consecutive frames the star was not usable
+    };
+
+    std::vector<GuideStar> m_others;
+    PHD_Point m_position;   // weighted mean position for the current frame
+    StarFindPool *m_pool;
+
+    // parameters
+    bool m_multiStarEnabled;
+    int m_maxStars;
+
+public:
+    GuiderMultiStar(wxWindow *parent);
+    virtual ~GuiderMultiStar(void);
+
+    bool GetMultiStarEnabled(void) const;
+    void SetMultiStarEnabled(bool enable);
+    int GetMaxStars(void) const;
+    bool SetMaxStars(int maxStars);
+
+    const PHD_Point& CurrentPosition(void);
+    wxString GetSettingsSummary();
+
+    GuiderConfigDialogCtrlSet *GetConfigDialogCtrlSet(wxWindow *pParent, Guider *pGuider, AdvancedDialog *pAdvancedDialog, BrainCtrlIdMap& CtrlMap);
+
+    void LoadProfileSettings(void);
+
+protected:
+    void InvalidateCurrentPosition(bool fullReset = false);
+    bool UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo);
+    bool SetCurrentPosition(usImage *pImage, const PHD_Point& position);
+
+    bool AutoFindStar(const usImage& image, int edgeAllowance, Star *star);
+    void DrawOtherStars(wxDC& dc);
+
+private:
+    void UpdateOtherStars(std::vector<Star>& found);
+};
+
+inline bool GuiderMultiStar::GetMultiStarEnabled(void) const
+{
+    return m_multiStarEnabled;
+}
+
+inline int GuiderMultiStar::GetMaxStars(void) const
+{
+    return m_maxStars;
+}
+
+#endif /* GUIDER_MULTISTAR_H_INCLUDED */
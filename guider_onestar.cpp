@@ -92,7 +92,7 @@ public:
 
     void AppendData(double mass)
     {
-        wxLongLong_t now = ::wxGetUTCTimeMillis().GetValue();
+        wxLongLong_t now = ReplayClock::Now().GetValue();
         wxLongLong_t oldest = now - m_timeWindow;
 
         while (m_data.size() > 0 && m_data.front().time < oldest)
@@ -267,12 +267,14 @@ bool GuiderOneStar::SetCurrentPosition(usImage *pImage, const PHD_Point& positio
 
         Debug.AddLine(wxString::Format("SetCurrentPosition(%.2f,%.2f)", x, y ));
 
-        if ((x <= 0) || (x >= pImage->Size.x))
+        wxSize sensorSize = pImage->SensorSize();
+
+        if ((x <= 0) || (x >= sensorSize.x))
         {
             throw ERROR_INFO("invalid x value");
         }
 
-        if ((y <= 0) || (y >= pImage->Size.y))
+        if ((y <= 0) || (y >= sensorSize.y))
         {
             throw ERROR_INFO("invalid y value");
         }
@@ -398,7 +400,7 @@ bool GuiderOneStar::AutoSelect(void)
             edgeAllowance = wxMax(edgeAllowance, pSecondaryMount->CalibrationTotDistance());
 
         Star newStar;
-        if (!newStar.AutoFind(*pImage, edgeAllowance, m_searchRegion))
+        if (!AutoFindStar(*pImage, edgeAllowance, &newStar))
         {
             throw ERROR_INFO("Unable to AutoFind");
         }
@@ -444,6 +446,11 @@ bool GuiderOneStar::AutoSelect(void)
     return bError;
 }
 
+bool GuiderOneStar::AutoFindStar(const usImage& image, int edgeAllowance, Star *star)
+{
+    return star->AutoFind(image, edgeAllowance, m_searchRegion);
+}
+
 bool GuiderOneStar::IsLocked(void)
 {
     return m_star.WasFound();
@@ -625,10 +632,11 @@ bool GuiderOneStar::IsValidLockPosition(const PHD_Point& pt)
     if (!pImage)
         return false;
     // this is a bit ugly as it is tightly coupled to Star::Find
+    wxSize sensorSize = pImage->SensorSize();
     return pt.X >= 1 + m_searchRegion &&
-        pt.X + 1 + m_searchRegion < pImage->Size.GetX() &&
+        pt.X + 1 + m_searchRegion < sensorSize.GetX() &&
         pt.Y >= 1 + m_searchRegion &&
-        pt.Y + 1 + m_searchRegion < pImage->Size.GetY();
+        pt.Y + 1 + m_searchRegion < sensorSize.GetY();
 }
 
 void GuiderOneStar::OnLClick(wxMouseEvent &mevent)
@@ -754,12 +762,14 @@ void GuiderOneStar::OnPaint(wxPaintEvent& event)
             else
                 dc.SetPen(wxPen(wxColour(230,130,30), 1, wxDOT));
             DrawBox(dc, m_star, m_searchRegion, m_scaleFactor);
+            DrawOtherStars(dc);
         }
         else if (state == STATE_CALIBRATING_PRIMARY || state == STATE_CALIBRATING_SECONDARY)
         {
             // in the calibration process
             dc.SetPen(wxPen(wxColour(32,196,32), 1, wxSOLID));  // Draw the box around the star
             DrawBox(dc, m_star, m_searchRegion, m_scaleFactor);
+            DrawOtherStars(dc);
         }
         else if (state == STATE_CALIBRATED || state == STATE_GUIDING)
         {
@@ -769,6 +779,7 @@ void GuiderOneStar::OnPaint(wxPaintEvent& event)
             else
                 dc.SetPen(wxPen(wxColour(230,130,30), 1, wxDOT));
             DrawBox(dc, m_star, m_searchRegion, m_scaleFactor);
+            DrawOtherStars(dc);
         }
 
         // Image logging
@@ -820,9 +831,9 @@ void GuiderOneStar::OnPaint(wxPaintEvent& event)
 
 void GuiderOneStar::SaveStarFITS()
 {
-    double StarX = m_star.X;
-    double StarY = m_star.Y;
     usImage *pImage = CurrentImage();
+    double StarX = pImage->FrameCoord(m_star.X);
+    double StarY = pImage->FrameCoord(m_star.Y);
     usImage tmpimg;
 
     tmpimg.Init(60,60);
@@ -875,7 +886,7 @@ void GuiderOneStar::SaveStarFITS()
         float dur = (float) pImage->ImgExpDur / 1000.0;
         if (!status) fits_write_key(fptr, TFLOAT, keyname, &dur, keycomment, &status);
 
-        unsigned int tmp = 1;
+        unsigned int tmp = pImage->BinFactor;
         sprintf(keyname,"XBINNING");
         sprintf(keycomment,"Camera binning mode");
         fits_write_key(fptr, TUINT, keyname, &tmp, keycomment, &status);
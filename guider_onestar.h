@@ -63,7 +63,7 @@ public:
 
 class GuiderOneStar : public Guider
 {
-private:
+protected:
     Star m_star;
     MassChecker *m_massChecker;
 
@@ -116,12 +116,17 @@ public:
 
     void LoadProfileSettings(void);
 
-private:
+protected:
     bool IsValidLockPosition(const PHD_Point& pt);
     void InvalidateCurrentPosition(bool fullReset = false);
     bool UpdateCurrentPosition(usImage *pImage, FrameDroppedInfo *errorInfo);
     bool SetCurrentPosition(usImage *pImage, const PHD_Point& position);
 
+    // hooks for guiders tracking more than the one star
+    virtual bool AutoFindStar(const usImage& image, int edgeAllowance, Star *star);
+    virtual void DrawOtherStars(wxDC& dc) { }
+
+private:
     void OnLClick(wxMouseEvent& evt);
 
     void SaveStarFITS();
@@ -35,80 +35,7 @@
 #include "phd.h"
 #include "guiding_assistant.h"
 #include "backlash_comp.h"
-
-struct Stats
-{
-    double alpha_lp;
-    double alpha_hp;
-    unsigned int n;
-    double sum;
-    double a;
-    double q;
-    double hpf;
-    double lpf;
-    double xprev;
-    double peakRawDx;
-
-    void InitStats(double hpfCutoffPeriod, double lpfCutoffPeriod, double samplePeriod)
-    {
-        alpha_hp = hpfCutoffPeriod / (hpfCutoffPeriod + wxMax(1.0, samplePeriod));
-        alpha_lp = 1.0 - (lpfCutoffPeriod / (lpfCutoffPeriod + wxMax(1.0, samplePeriod)));
-        Reset();
-    }
-
-    void Reset()
-    {
-        n = 0;
-        sum = 0.0;
-        a = 0.0;
-        q = 0.0;
-        peakRawDx = 0.0;
-    }
-
-    void AddSample(double x)
-    {
-        if (n == 0)
-        {
-            // first point
-            hpf = lpf = x;
-        }
-        else
-        {
-            hpf = alpha_hp * (hpf + x - xprev);
-            lpf += alpha_lp * (x - lpf);
-        }
-
-        if (n >= 1)
-        {
-            double const dx = fabs(x - xprev);
-            if (dx > peakRawDx)
-                peakRawDx = dx;
-        }
-
-        xprev = x;
-
-        x = hpf;
-        ++n;
-        sum += x;
-        double const k = (double) n;
-        double const a0 = a;
-        a += (x - a) / k;
-        q += (x - a0) * (x - a);
-    }
-
-    void GetMeanAndStdev(double *mean, double *stdev)
-    {
-        if (n == 0)
-        {
-            *mean = *stdev = 0.0;
-            return;
-        }
-
-        double const nn = (double) n;
-        *mean = sum / nn;
-        *stdev = sqrt(q / nn);
-    }
-};
+#include "guide_stats.h"
 
 inline static void StartRow(int& row, int& column)
 {
@@ -165,6 +92,7 @@ struct GuidingAsstWin : public wxDialog
     wxGridCellCoords m_pae_loc;
     wxGridCellCoords m_ra_peak_drift_loc;
     wxGridCellCoords m_backlash_loc;
+    wxGridCellCoords m_ra_pe_loc;
     wxButton *m_raMinMoveButton;
     wxButton *m_decMinMoveButton;
     wxButton *m_decBacklashButton;
@@ -183,17 +111,12 @@ struct GuidingAsstWin : public wxDialog
     DialogState m_dlgState;
     bool m_measuring;
     wxLongLong_t m_startTime;
-    PHD_Point m_startPos;
     wxString startStr;
     double m_freqThresh;
-    Stats m_statsRA;
-    Stats m_statsDec;
+    GuideStats m_stats;
     double sumSNR;
     double sumMass;
-    double minRA;
-    double maxRA;
-    double m_lastTime;
-    double maxRateRA; // arc-sec per second
+    wxLongLong_t m_lastRefresh;
     double alignmentError; // arc-minutes
 
     bool m_guideOutputDisabled;
@@ -225,6 +148,7 @@ struct GuidingAsstWin : public wxDialog
     wxStaticText *AddRecommendationEntry(const wxString& msg);
     void FillResultCell(wxGrid *pGrid, const wxGridCellCoords& loc, double pxVal, double asVal, const wxString& units1, const wxString& units2, const wxString& extraInfo = wxEmptyString);
     void UpdateInfo(const GuideStepInfo& info);
+    void RefreshInfo();
     void FillInstructions(DialogState eState);
     void MakeRecommendations();
     void LogResults();
@@ -340,7 +264,7 @@ GuidingAsstWin::GuidingAsstWin()
     // Start of "Other" (peak and drift) group
     wxStaticBoxSizer *other_group = new wxStaticBoxSizer(wxVERTICAL, this, _("Other Star Motion"));
     m_othergrid = new wxGrid(this, wxID_ANY);
-    m_othergrid->CreateGrid(9, 2);
+    m_othergrid->CreateGrid(10, 2);
     m_othergrid->GetGridWindow()->Bind(wxEVT_MOTION, &GuidingAsstWin::OnMouseMove, this, wxID_ANY, wxID_ANY, new GridTooltipInfo(m_othergrid, 3));
     m_othergrid->SetRowLabelSize(1);
     m_othergrid->SetColLabelSize(1);
@@ -384,6 +308,10 @@ GuidingAsstWin::GuidingAsstWin()
     m_othergrid->SetCellValue(row, col++, _("Polar Alignment Error"));
     m_pae_loc.Set(row, col++);
 
+    StartRow(row, col);
+    m_othergrid->SetCellValue(row, col++, _("Right ascension Periodic Error"));
+    m_ra_pe_loc.Set(row, col++);
+
     other_group->Add(m_othergrid);
     m_vResultsSizer->Add(other_group, wxSizerFlags(0).Border(wxALL, 8));
     // End of peak and drift group
@@ -521,6 +449,7 @@ static bool GetGridToolTip(int gridNum, const wxGridCellCoords& coords, wxString
         case 306: *s = _("Estimated overall drift rate in declination."); break;
         case 307: *s = _("Estimate of declination backlash if backlash testing was completed successfully"); break;
         case 308: *s = _("Estimate of polar alignment error. If the scope declination is unknown, the value displayed is a lower bound and the actual error may be larger."); break;
+        case 309: *s = _("Amplitude and period of the strongest periodic component of the right ascension motion, usually the periodic error of the mount worm gear."); break;
 
         default: return false;
     }
@@ -716,6 +645,11 @@ void GuidingAsstWin::LogResults()
         m_othergrid->GetCellValue(m_dec_drift_loc), m_othergrid->GetCellValue(m_dec_peak_loc),
         m_othergrid->GetCellValue(m_pae_loc)));
 
+    std::vector<GuideStats::PeriodicComponent> pe;
+    m_stats.GetPeriodicComponents(&pe, 3);
+    for (unsigned int i = 0; i < pe.size(); i++)
+        Debug.Write(wxString::Format("RA periodic component: period=%.1f s, amplitude=%.2f px\n", pe[i].period, pe[i].amplitude));
+
     if (m_backlashTool->GetBacklashResultPx() > 0)
     {
         Debug.Write(wxString::Format("Backlash measures: %0.2f px, %d ms\n", m_backlashTool->GetBacklashResultPx(), m_backlashTool->GetBacklashResultMs()));
@@ -733,14 +667,13 @@ static wxString SizedMsg(wxString msg)
 
 void GuidingAsstWin::MakeRecommendations()
 {
-    double rarms;
-    double ramean;
-    m_statsRA.GetMeanAndStdev(&ramean, &rarms);
+    GuideStats::Summary summary;
+    m_stats.GetSummary(&summary);
 
-    double decrms;
-    double decmean;
+    double rarms = summary.rms[GuideStats::RA];
+    double decrms = summary.rms[GuideStats::DEC];
+    double maxRateRA = summary.maxDriftRateRA;
     bool largeBL = false;
-    m_statsDec.GetMeanAndStdev(&decmean, &decrms);
 
     double multiplier_ra  = 1.28;  // 80% prediction interval
     double multiplier_dec = 1.64;  // 90% prediction interval
@@ -808,7 +741,7 @@ void GuidingAsstWin::MakeRecommendations()
         Debug.Write(wxString::Format("Recommendation: %s\n", m_calibration_msg->GetLabelText()));
     }
 
-    if ((sumSNR / (double)m_statsRA.n) < 5.0)
+    if ((sumSNR / (double)summary.count) < 5.0)
     {
         wxString msg(_("Consider using a brighter star for the test or increasing the exposure time"));
         if (!m_snr_msg)
@@ -916,10 +849,10 @@ void GuidingAsstWin::OnStart(wxCommandEvent& event)
     double lp_cutoff = wxMax(6.0, 3.0 * exposure);
     double hp_cutoff = 1.0;
     m_freqThresh = 1.0 / hp_cutoff;
-    m_statsRA.InitStats(hp_cutoff, lp_cutoff, exposure);
-    m_statsDec.InitStats(hp_cutoff, lp_cutoff, exposure);
+    m_stats.Init(hp_cutoff, lp_cutoff, exposure);
 
     sumSNR = sumMass = 0.0;
+    m_lastRefresh = 0;
 
     m_start->Enable(false);
     m_stop->Enable(true);
@@ -1011,6 +944,11 @@ void GuidingAsstWin::EndBacklashTest(bool normal)
 
 void GuidingAsstWin::OnStop(wxCommandEvent& event)
 {
+    // the display is refreshed at a limited rate, bring it up to date for
+    // the recommendations and the log
+    if (m_stats.Count() > 0)
+        RefreshInfo();
+
     if (m_backlashCB->IsChecked())
     {
         if (!m_measuringBacklash)                               // Run the backlash test after the sampling was completed
@@ -1086,57 +1024,36 @@ void GuidingAsstWin::FillResultCell(wxGrid *pGrid, const wxGridCellCoords& loc,
 
 void GuidingAsstWin::UpdateInfo(const GuideStepInfo& info)
 {
-    double ra = info.mountOffset.X;
-    double dec = info.mountOffset.Y;
-    double prevRAlpf = m_statsRA.lpf;
-
-    m_statsRA.AddSample(ra);
-    m_statsDec.AddSample(dec);
+    m_stats.AddSample(info.time, info.mountOffset.X, info.mountOffset.Y);
+    sumSNR += info.starSNR;
+    sumMass += info.starMass;
 
-    if (m_statsRA.n == 1)
+    // formatting the grids on every step is expensive, refresh about once a second
+    wxLongLong_t now = ::wxGetUTCTimeMillis().GetValue();
+    if (now - m_lastRefresh >= 1000)
     {
-        minRA = maxRA = ra;
-        m_startPos = info.mountOffset;
-        maxRateRA = 0.0;
+        RefreshInfo();
+        m_lastRefresh = now;
     }
-    else
-    {
-        if (ra < minRA)
-            minRA = ra;
-        if (ra > maxRA)
-            maxRA = ra;
-
-        double dt = info.time - m_lastTime;
-        if (dt > 0.0001)
-        {
-            double raRate = fabs(m_statsRA.lpf - prevRAlpf) / dt;
-            if (raRate > maxRateRA)
-                maxRateRA = raRate;
-        }
-    }
-    double rangeRA = maxRA - minRA;
-    double driftRA = ra - m_startPos.X;
-    double driftDec = dec - m_startPos.Y;
+}
 
-    m_lastTime = info.time;
-    sumSNR += info.starSNR;
-    sumMass += info.starMass;
+void GuidingAsstWin::RefreshInfo()
+{
+    GuideStats::Summary summary;
+    m_stats.GetSummary(&summary);
 
-    double ramean, rarms;
-    double decmean, decrms;
     double pxscale = pFrame->GetCameraPixelScale();
 
-    m_statsRA.GetMeanAndStdev(&ramean, &rarms);
-    m_statsDec.GetMeanAndStdev(&decmean, &decrms);
-
-    double n = (double) m_statsRA.n;
+    double n = (double) summary.count;
+    double rarms = summary.rms[GuideStats::RA];
+    double decrms = summary.rms[GuideStats::DEC];
     double combined = hypot(rarms, decrms);
+    double maxRateRA = summary.maxDriftRateRA;
 
     wxLongLong_t elapsedms = ::wxGetUTCTimeMillis().GetValue() - m_startTime;
-    double elapsed = (double) elapsedms / 1000.0;
 
-    double raDriftRate = driftRA / elapsed * 60.0;
-    double decDriftRate = driftDec / elapsed * 60.0;
+    double raDriftRate = summary.driftRate[GuideStats::RA];
+    double decDriftRate = summary.driftRate[GuideStats::DEC];
     double declination = pPointingSource->GetDeclination();
     double cosdec;
     if (declination == UNKNOWN_DECLINATION)
@@ -1147,6 +1064,9 @@ void GuidingAsstWin::UpdateInfo(const GuideStepInfo& info)
     // http://celestialwonders.com/articles/polaralignment/PolarAlignmentAccuracy.pdf
     alignmentError = 3.8197 * fabs(decDriftRate) * pxscale / cosdec;
 
+    std::vector<GuideStats::PeriodicComponent> pe;
+    m_stats.GetPeriodicComponents(&pe, 1);
+
     wxString SEC(_("s"));
     wxString PX(_("px"));
     wxString ARCSEC(_("arc-sec"));
@@ -1168,15 +1088,20 @@ void GuidingAsstWin::UpdateInfo(const GuideStepInfo& info)
     FillResultCell(m_displacementgrid, m_dec_rms_loc, decrms, decrms * pxscale, PX, ARCSEC);
     FillResultCell(m_displacementgrid, m_total_rms_loc, combined, combined * pxscale, PX, ARCSEC);
 
-    FillResultCell(m_othergrid, m_ra_peak_loc, m_statsRA.peakRawDx, m_statsRA.peakRawDx * pxscale, PX, ARCSEC);
-    FillResultCell(m_othergrid, m_dec_peak_loc, m_statsDec.peakRawDx, m_statsDec.peakRawDx * pxscale, PX, ARCSEC);
-    FillResultCell(m_othergrid, m_ra_peakpeak_loc, rangeRA, rangeRA * pxscale, PX, ARCSEC);
+    FillResultCell(m_othergrid, m_ra_peak_loc, summary.peak[GuideStats::RA], summary.peak[GuideStats::RA] * pxscale, PX, ARCSEC);
+    FillResultCell(m_othergrid, m_dec_peak_loc, summary.peak[GuideStats::DEC], summary.peak[GuideStats::DEC] * pxscale, PX, ARCSEC);
+    FillResultCell(m_othergrid, m_ra_peakpeak_loc, summary.peakPeak[GuideStats::RA], summary.peakPeak[GuideStats::RA] * pxscale, PX, ARCSEC);
     FillResultCell(m_othergrid, m_ra_drift_loc, raDriftRate, raDriftRate * pxscale, PXPERMIN, ARCSECPERMIN);
     FillResultCell(m_othergrid, m_ra_peak_drift_loc, maxRateRA, maxRateRA * pxscale, PXPERSEC, ARCSECPERSEC);
     m_othergrid->SetCellValue(m_ra_drift_exp_loc, maxRateRA <= 0.0 ? _(" ") :
         wxString::Format("%6.1f %s ",  1.3 * rarms / maxRateRA, SEC));
     FillResultCell(m_othergrid, m_dec_drift_loc, decDriftRate, decDriftRate * pxscale, PXPERMIN, ARCSECPERMIN);
     m_othergrid->SetCellValue(m_pae_loc, wxString::Format("%s %.1f %s", declination == UNKNOWN_DECLINATION ? "> " : "", alignmentError, ARCMIN));
+    if (pe.empty())
+        m_othergrid->SetCellValue(m_ra_pe_loc, _(" "));
+    else
+        FillResultCell(m_othergrid, m_ra_pe_loc, pe[0].amplitude, pe[0].amplitude * pxscale, PX, ARCSEC,
+            wxString::Format(_("period %.0f s"), pe[0].period));
 }
 
 wxWindow *GuidingAssistant::CreateDialogBox()
@@ -1194,6 +1119,17 @@ void GuidingAssistant::NotifyGuideStep(const GuideStepInfo& info)
     }
 }
 
+const GuideStats *GuidingAssistant::GetStats()
+{
+    if (pFrame && pFrame->pGuidingAssistant)
+    {
+        GuidingAsstWin *win = static_cast<GuidingAsstWin *>(pFrame->pGuidingAssistant);
+        if (win->m_stats.Count() > 0)
+            return &win->m_stats;
+    }
+    return NULL;
+}
+
 void GuidingAssistant::NotifyFrameDropped(const FrameDroppedInfo& info)
 {
     if (pFrame && pFrame->pGuidingAssistant)
@@ -35,6 +35,8 @@
 #ifndef GUIDING_ASSISTANT_INCLUDED
 #define GUIDING_ASSISTANT_INCLUDED
 
+class GuideStats;
+
 class GuidingAssistant
 {
     GuidingAssistant(); // not implemented
@@ -45,6 +47,10 @@ public:
     static void NotifyBacklashStep(const PHD_Point& camLoc);
     static void NotifyBacklashError();
     static void UpdateUIControls();
+
+    // the statistics of the current or last measurement run, or NULL if the
+    // Guiding Assistant has no samples
+    static const GuideStats *GetStats();
 };
 
 #endif
@@ -34,20 +34,142 @@
  */
 
 #include "phd.h"
+#include "guidelog_binary.h"
+
+#ifdef __WINDOWS__
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
 
 #define GUIDELOG_VERSION _T("2.5")
 
 const int RetentionPeriod = 60;
 
+static const bool DefaultBinaryFormat = false;
+
+/*
+ * Buffers the records of a binary guide log. The buffer is handed to the OS
+ * when it fills up or when it has not been written for FLUSH_INTERVAL, and the
+ * file is synced to disk every SYNC_INTERVAL, so a guide step costs neither
+ * formatting nor a system call.
+ */
+class GuideLogBinWriter
+{
+    enum
+    {
+        BUFFER_SIZE = 64 * 1024,
+        FLUSH_INTERVAL = 2000,  // ms
+        SYNC_INTERVAL = 30000,  // ms
+    };
+
+    wxFFile& m_file;
+    std::vector<char> m_buf;
+    wxLongLong m_lastWrite;
+    wxLongLong m_lastSync;
+
+public:
+    GuideLogBinWriter(wxFFile& file);
+    void WriteHeader(void);
+    void AddRecord(const GuideLogRecord& rec);
+    void AddText(const wxString& str);
+    bool Flush(bool force);
+};
+
+GuideLogBinWriter::GuideLogBinWriter(wxFFile& file)
+    : m_file(file)
+{
+    m_buf.reserve(BUFFER_SIZE + GUIDELOG_BIN_RECORD_SIZE);
+    m_lastWrite = m_lastSync = ::wxGetUTCTimeMillis();
+}
+
+void GuideLogBinWriter::WriteHeader(void)
+{
+    GuideLogBinHeader hdr;
+    InitGuideLogBinHeader(&hdr, wxString(FULLVER).ToAscii());
+    const char *p = (const char *) &hdr;
+    m_buf.insert(m_buf.end(), p, p + sizeof(hdr));
+}
+
+void GuideLogBinWriter::AddRecord(const GuideLogRecord& rec)
+{
+    AppendGuideLogRecord(&m_buf, rec);
+}
+
+void GuideLogBinWriter::AddText(const wxString& str)
+{
+    const wxScopedCharBuffer utf8 = str.utf8_str();
+    AppendGuideLogText(&m_buf, utf8.data(), utf8.length());
+}
+
+bool GuideLogBinWriter::Flush(bool force)
+{
+    // returns true on error
+
+    wxLongLong now = ::wxGetUTCTimeMillis();
+
+    if (!force && m_buf.size() < BUFFER_SIZE && now - m_lastWrite < FLUSH_INTERVAL)
+        return false;
+
+    bool err = false;
+
+    if (!m_buf.empty())
+    {
+        err = m_file.Write(&m_buf[0], m_buf.size()) != m_buf.size() || !m_file.Flush();
+        m_buf.clear();
+    }
+    m_lastWrite = now;
+
+    if (force || now - m_lastSync >= SYNC_INTERVAL)
+    {
+#ifdef __WINDOWS__
+        _commit(_fileno(m_file.fp()));
+#else
+        fsync(fileno(m_file.fp()));
+#endif
+        m_lastSync = now;
+    }
+
+    return err;
+}
+
 GuidingLog::GuidingLog(void)
     : m_enabled(false),
     m_keepFile(false),
-    m_isGuiding(false)
+    m_isGuiding(false),
+    m_binWriter(0)
 {
 }
 
 GuidingLog::~GuidingLog(void)
 {
+    delete m_binWriter;
+}
+
+void GuidingLog::Write(const wxString& str)
+{
+    if (m_binWriter)
+        m_binWriter->AddText(str);
+    else
+        m_file.Write(str);
+}
+
+bool GuidingLog::GetBinaryFormat(void) const
+{
+    return pConfig->Global.GetBoolean("/GuideLogBinary", DefaultBinaryFormat);
+}
+
+// The format of an open log only changes when a new log file is started
+void GuidingLog::SetBinaryFormat(bool binary)
+{
+    bool prev = GetBinaryFormat();
+    pConfig->Global.SetBoolean("/GuideLogBinary", binary);
+
+    if (binary != prev && m_enabled && !m_isGuiding)
+    {
+        Close();
+        EnableLogging();
+    }
 }
 
 bool GuidingLog::EnableLogging(void)
@@ -62,19 +184,27 @@ bool GuidingLog::EnableLogging(void)
         wxDateTime now = wxDateTime::Now();
         if (!m_file.IsOpened())
         {
+            bool binary = GetBinaryFormat();
+
             m_fileName = GetLogDir() + PATHSEPSTR + "PHD2_GuideLog" + now.Format(_T("_%Y-%m-%d")) +
-                now.Format(_T("_%H%M%S")) + ".txt";
+                now.Format(_T("_%H%M%S")) + (binary ? ".bin" : ".txt");
 
-            if (!m_file.Open(m_fileName, "w"))
+            if (!m_file.Open(m_fileName, binary ? "wb" : "w"))
             {
                 throw ERROR_INFO("unable to open file");
             }
             m_keepFile = false;             // Don't keep it until something meaningful is logged
+
+            if (binary)
+            {
+                m_binWriter = new GuideLogBinWriter(m_file);
+                m_binWriter->WriteHeader();
+            }
         }
 
         assert(m_file.IsOpened());
 
-        m_file.Write(_T("PHD2 version ") FULLVER _T(", Log version ") GUIDELOG_VERSION _T(". Log enabled at ") +
+        Write(_T("PHD2 version ") FULLVER _T(", Log version ") GUIDELOG_VERSION _T(". Log enabled at ") +
             now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
         Flush();
 
@@ -113,8 +243,10 @@ void GuidingLog::DisableLogging(void)
     assert(m_file.IsOpened());
     wxDateTime now = wxDateTime::Now();
 
-    m_file.Write("\n");
-    m_file.Write("Log disabled at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("\n");
+    Write("Log disabled at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    if (m_binWriter)
+        m_binWriter->Flush(true);
     Flush();
     m_enabled = false;
 
@@ -147,6 +279,7 @@ bool GuidingLog::ChangeDirLog(const wxString& newdir)
 void GuidingLog::RemoveOldFiles()
 {
     Logger::RemoveMatchingFiles("PHD2_GuideLog*.txt", RetentionPeriod);
+    Logger::RemoveMatchingFiles("PHD2_GuideLog*.bin", RetentionPeriod);
 }
 
 bool GuidingLog::Flush(void)
@@ -160,7 +293,8 @@ bool GuidingLog::Flush(void)
     {
         assert(m_file.IsOpened());
 
-        if (!m_file.Flush())
+        // the binary log is only written out periodically
+        if (m_binWriter ? m_binWriter->Flush(false) : !m_file.Flush())
         {
             throw ERROR_INFO("unable to flush file");
         }
@@ -182,8 +316,14 @@ void GuidingLog::Close(void)
     assert(m_file.IsOpened());
     wxDateTime now = wxDateTime::Now();
 
-    m_file.Write("\n");
-    m_file.Write("Log closed at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("\n");
+    Write("Log closed at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    if (m_binWriter)
+    {
+        m_binWriter->Flush(true);
+        delete m_binWriter;
+        m_binWriter = 0;
+    }
     Flush();
     m_file.Close();
     m_enabled = false;
@@ -254,35 +394,35 @@ void GuidingLog::StartCalibration(Mount *pCalibrationMount)
     assert(m_file.IsOpened());
     wxDateTime now = wxDateTime::Now();
 
-    m_file.Write("\n");
-    m_file.Write("Calibration Begins at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
-    m_file.Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
+    Write("\n");
+    Write("Calibration Begins at " + now.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
 
     assert(pCalibrationMount && pCalibrationMount->IsConnected());
 
     if (pCamera)
     {
         // phdlab v0.5.3 expects camera name on a line by itself
-        m_file.Write(wxString::Format("Camera = %s\nExposure = %s\n",
+        Write(wxString::Format("Camera = %s\nExposure = %s\n",
             pCamera->Name, pFrame->ExposureDurationSummary()));
     }
-    m_file.Write(pFrame->PixelScaleSummary() + "\n");
+    Write(pFrame->PixelScaleSummary() + "\n");
 
-    m_file.Write("Mount = " + pCalibrationMount->Name());
+    Write("Mount = " + pCalibrationMount->Name());
     wxString calSettings = pCalibrationMount->CalibrationSettingsSummary();
     if (!calSettings.IsEmpty())
-        m_file.Write(", " + calSettings);
-    m_file.Write("\n");
+        Write(", " + calSettings);
+    Write("\n");
 
-    m_file.Write(wxString::Format("%s\n", PointingInfo()));
+    Write(wxString::Format("%s\n", PointingInfo()));
 
-    m_file.Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f, HFD = %.2f px\n",
+    Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f, HFD = %.2f px\n",
                 pFrame->pGuider->LockPosition().X,
                 pFrame->pGuider->LockPosition().Y,
                 pFrame->pGuider->CurrentPosition().X,
                 pFrame->pGuider->CurrentPosition().Y, 
                 pFrame->pGuider->HFD()));
-    m_file.Write("Direction,Step,dx,dy,x,y,Dist\n");
+    Write("Direction,Step,dx,dy,x,y,Dist\n");
     Flush();
 
     m_keepFile = true;
@@ -296,7 +436,7 @@ void GuidingLog::CalibrationFailed(Mount *pCalibrationMount, const wxString& msg
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write(msg); m_file.Write("\n");
+    Write(msg); Write("\n");
     Flush();
 }
 
@@ -308,7 +448,7 @@ void GuidingLog::CalibrationStep(Mount *pCalibrationMount, const wxString& direc
 
     assert(m_file.IsOpened());
     // Direction,Step,dx,dy,x,y,Dist
-    m_file.Write(wxString::Format("%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+    Write(wxString::Format("%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n",
         direction,
         steps,
         dx, dy,
@@ -323,7 +463,7 @@ void GuidingLog::CalibrationDirectComplete(Mount *pCalibrationMount, const wxStr
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write(wxString::Format("%s calibration complete. Angle = %.1f deg, Rate = %.3f px/sec, Parity = %s\n",
+    Write(wxString::Format("%s calibration complete. Angle = %.1f deg, Rate = %.3f px/sec, Parity = %s\n",
         direction, degrees(angle), rate * 1000.0, ParityStr(parity)));
     Flush();
 }
@@ -336,7 +476,7 @@ void GuidingLog::CalibrationComplete(Mount *pCalibrationMount)
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write(wxString::Format("Calibration complete, mount = %s.\n", pCalibrationMount->Name()));
+    Write(wxString::Format("Calibration complete, mount = %s.\n", pCalibrationMount->Name()));
     Flush();
 }
 
@@ -349,8 +489,8 @@ void GuidingLog::StartGuiding()
 
     assert(m_file.IsOpened());
 
-    m_file.Write("\n");
-    m_file.Write("Guiding Begins at " + pFrame->m_guidingStarted.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("\n");
+    Write("Guiding Begins at " + pFrame->m_guidingStarted.Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
     m_keepFile = true;
 
     // add common guiding header
@@ -365,39 +505,39 @@ void GuidingLog::StopGuiding(void)
         return;
 
     assert(m_file.IsOpened());
-    m_file.Write("Guiding Ends at " + wxDateTime::Now().Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
+    Write("Guiding Ends at " + wxDateTime::Now().Format(_T("%Y-%m-%d %H:%M:%S")) + "\n");
 }
 
 void GuidingLog::GuidingHeader(void)
     // output guiding header to log file
 {
-    m_file.Write(pFrame->GetSettingsSummary());
-    m_file.Write(pFrame->pGuider->GetSettingsSummary());
+    Write(pFrame->GetSettingsSummary());
+    Write(pFrame->pGuider->GetSettingsSummary());
 
-    m_file.Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
+    Write("Equipment Profile = " + pConfig->GetCurrentProfile() + "\n");
 
     if (pCamera)
     {
-        m_file.Write(pCamera->GetSettingsSummary());
-        m_file.Write("Exposure = " + pFrame->ExposureDurationSummary() + "\n");
+        Write(pCamera->GetSettingsSummary());
+        Write("Exposure = " + pFrame->ExposureDurationSummary() + "\n");
     }
 
     if (pMount)
-        m_file.Write(pMount->GetSettingsSummary());
+        Write(pMount->GetSettingsSummary());
 
     if (pSecondaryMount)
-        m_file.Write(pSecondaryMount->GetSettingsSummary());
+        Write(pSecondaryMount->GetSettingsSummary());
 
-    m_file.Write(wxString::Format("%s\n", PointingInfo()));
+    Write(wxString::Format("%s\n", PointingInfo()));
 
-    m_file.Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f, HFD = %.2f px\n",
+    Write(wxString::Format("Lock position = %.3f, %.3f, Star position = %.3f, %.3f, HFD = %.2f px\n",
                 pFrame->pGuider->LockPosition().X,
                 pFrame->pGuider->LockPosition().Y,
                 pFrame->pGuider->CurrentPosition().X,
                 pFrame->pGuider->CurrentPosition().Y,
                 pFrame->pGuider->HFD()));
 
-    m_file.Write("Frame,Time,mount,dx,dy,RARawDistance,DECRawDistance,RAGuideDistance,DECGuideDistance,RADuration,RADirection,DECDuration,DECDirection,XStep,YStep,StarMass,SNR,ErrorCode\n");
+    Write("Frame,Time,mount,dx,dy,RARawDistance,DECRawDistance,RAGuideDistance,DECGuideDistance,RADuration,RADirection,DECDuration,DECDirection,XStep,YStep,StarMass,SNR,ErrorCode\n");
 
     Flush();
 }
@@ -409,7 +549,44 @@ void GuidingLog::GuideStep(const GuideStepInfo& step)
 
     assert(m_file.IsOpened());
 
-    m_file.Write(wxString::Format("%d,%.3f,\"%s\",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,",
+    if (m_binWriter)
+    {
+        GuideLogRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        GuideLogStepRecord& r = rec.step;
+        r.type = GUIDELOG_REC_STEP;
+        r.isStepGuider = step.mount->IsStepGuider();
+        r.frameNumber = step.frameNumber;
+        r.time = step.time;
+        r.cameraOffsetX = step.cameraOffset.X;
+        r.cameraOffsetY = step.cameraOffset.Y;
+        r.mountOffsetX = step.mountOffset.X;
+        r.mountOffsetY = step.mountOffset.Y;
+        r.guideDistanceRA = step.guideDistanceRA;
+        r.guideDistanceDec = step.guideDistanceDec;
+        if (r.isStepGuider)
+        {
+            r.durationRA = step.directionRA == LEFT ? -step.durationRA : step.durationRA;
+            r.durationDec = step.directionDec == DOWN ? -step.durationDec : step.durationDec;
+        }
+        else
+        {
+            r.durationRA = step.durationRA;
+            r.durationDec = step.durationDec;
+            if (step.durationRA > 0)
+                r.directionRA = step.mount->DirectionChar((GUIDE_DIRECTION)step.directionRA)[0];
+            if (step.durationDec > 0)
+                r.directionDec = step.mount->DirectionChar((GUIDE_DIRECTION)step.directionDec)[0];
+        }
+        r.starMass = step.starMass;
+        r.starSNR = step.starSNR;
+        r.starError = step.starError;
+        m_binWriter->AddRecord(rec);
+        Flush();
+        return;
+    }
+
+    Write(wxString::Format("%d,%.3f,\"%s\",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,",
         step.frameNumber, step.time,
         step.mount->IsStepGuider() ? "AO" : "Mount",
         step.cameraOffset.X, step.cameraOffset.Y,
@@ -420,16 +597,16 @@ void GuidingLog::GuideStep(const GuideStepInfo& step)
     {
         int xSteps = step.directionRA == LEFT ? -step.durationRA : step.durationRA;
         int ySteps = step.directionDec == DOWN ? -step.durationDec : step.durationDec;
-        m_file.Write(wxString::Format(",,,,%d,%d,", xSteps, ySteps));
+        Write(wxString::Format(",,,,%d,%d,", xSteps, ySteps));
     }
     else
     {
-        m_file.Write(wxString::Format("%d,%s,%d,%s,,,",
+        Write(wxString::Format("%d,%s,%d,%s,,,",
             step.durationRA, step.durationRA > 0 ? step.mount->DirectionChar((GUIDE_DIRECTION)step.directionRA) : "",
             step.durationDec, step.durationDec > 0 ? step.mount->DirectionChar((GUIDE_DIRECTION)step.directionDec): ""));
     }
 
-    m_file.Write(wxString::Format("%.f,%.2f,%d\n",
+    Write(wxString::Format("%.f,%.2f,%d\n",
             step.starMass, step.starSNR, step.starError));
 
     Flush();
@@ -442,7 +619,24 @@ void GuidingLog::FrameDropped(const FrameDroppedInfo& info)
 
     assert(m_file.IsOpened());
 
-    m_file.Write(wxString::Format("%d,%.3f,\"DROP\",,,,,,,,,,,,,%.f,%.2f,%d,\"%s\"\n",
+    if (m_binWriter)
+    {
+        GuideLogRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        GuideLogDropRecord& r = rec.drop;
+        r.type = GUIDELOG_REC_DROP;
+        r.frameNumber = info.frameNumber;
+        r.time = info.time;
+        r.starMass = info.starMass;
+        r.starSNR = info.starSNR;
+        r.starError = info.starError;
+        m_binWriter->AddRecord(rec);
+        m_binWriter->AddText(info.status);
+        Flush();
+        return;
+    }
+
+    Write(wxString::Format("%d,%.3f,\"DROP\",,,,,,,,,,,,,%.f,%.2f,%d,\"%s\"\n",
         info.frameNumber, info.time, info.starMass, info.starSNR, info.starError, info.status));
 
     Flush();
@@ -453,14 +647,14 @@ void GuidingLog::NotifyGuidingDithered(Guider *guider, double dx, double dy)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: DITHER by %.3f, %.3f, new lock pos = %.3f, %.3f\n",
+    Write(wxString::Format("INFO: DITHER by %.3f, %.3f, new lock pos = %.3f, %.3f\n",
         dx, dy, guider->LockPosition().X, guider->LockPosition().Y));
     Flush();
 }
 
 void GuidingLog::NotifySettlingStateChange(const wxString& msg)
 {
-    m_file.Write(wxString::Format("INFO: SETTLING STATE CHANGE, %s\n", msg));
+    Write(wxString::Format("INFO: SETTLING STATE CHANGE, %s\n", msg));
     Flush();
 }
 
@@ -469,7 +663,7 @@ void GuidingLog::NotifySetLockPosition(Guider *guider)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: SET LOCK POSITION, new lock pos = %.3f, %.3f\n",
+    Write(wxString::Format("INFO: SET LOCK POSITION, new lock pos = %.3f, %.3f\n",
         guider->LockPosition().X, guider->LockPosition().Y));
     m_keepFile = true;
     Flush();
@@ -491,7 +685,7 @@ void GuidingLog::NotifyLockShiftParams(const LockPosShiftParams& shiftParams, co
                                     cameraRate.IsValid() ? cameraRate.X * 3600.0 : 0.0,
                                     cameraRate.IsValid() ? cameraRate.Y * 3600.0 : 0.0);
     }
-    m_file.Write(wxString::Format("INFO: LOCK SHIFT, enabled = %d %s\n", shiftParams.shiftEnabled, details));
+    Write(wxString::Format("INFO: LOCK SHIFT, enabled = %d %s\n", shiftParams.shiftEnabled, details));
     m_keepFile = true;
     Flush();
 }
@@ -501,7 +695,7 @@ void GuidingLog::ServerCommand(Guider *guider, const wxString& cmd)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Server received %s\n", cmd));
+    Write(wxString::Format("INFO: Server received %s\n", cmd));
     m_keepFile = true;
     Flush();
 }
@@ -511,7 +705,7 @@ void GuidingLog::SetGuidingParam(const wxString& name, double val)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Guiding parameter change, %s = %.2f\n", name, val));
+    Write(wxString::Format("INFO: Guiding parameter change, %s = %.2f\n", name, val));
     m_keepFile = true;
     Flush();
 }
@@ -521,7 +715,7 @@ void GuidingLog::SetGuidingParam(const wxString& name, int val)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Guiding parameter change, %s = %d\n", name, val));
+    Write(wxString::Format("INFO: Guiding parameter change, %s = %d\n", name, val));
     m_keepFile = true;
     Flush();
 }
@@ -531,7 +725,7 @@ void GuidingLog::SetGuidingParam(const wxString& name, const wxString& val)
     if (!m_enabled || !m_isGuiding)
         return;
 
-    m_file.Write(wxString::Format("INFO: Guiding parameter change, %s = %s\n", name, val));
+    Write(wxString::Format("INFO: Guiding parameter change, %s = %s\n", name, val));
     m_keepFile = true;
     Flush();
 }
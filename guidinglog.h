@@ -41,6 +41,7 @@
 class Mount;
 class Guider;
 struct LockPosShiftParams;
+class GuideLogBinWriter;
 
 struct GuideStepInfo
 {
@@ -85,6 +86,9 @@ class GuidingLog : public Logger
     wxString m_fileName;
     bool m_keepFile;
     bool m_isGuiding;
+    GuideLogBinWriter *m_binWriter;     // non-NULL when the log file is binary
+
+    void Write(const wxString& str);
 
 protected:
     void GuidingHeader(void);
@@ -100,6 +104,9 @@ public:
     bool Flush(void);
     void Close(void);
 
+    bool GetBinaryFormat(void) const;
+    void SetBinaryFormat(bool binary);
+
     void StartCalibration(Mount *pCalibrationMount);
     void CalibrationFailed(Mount *pCalibrationMount, const wxString& msg);
     void CalibrationStep(Mount *pCalibrationMount, const wxString& direction, int steps, double dx, double dy, const PHD_Point &xy, double dist);
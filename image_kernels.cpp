@@ -0,0 +1,671 @@
+/*
+ *  image_kernels.cpp
+ *  PHD Guiding
+ *
+ *  Created by Craig Stark.
+ *  Copyright (c) 2006-2010 Craig Stark.
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "image_kernels.h"
+
+#include <algorithm>
+#include <stddef.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define HAVE_SSE2 1
+# include <emmintrin.h>
+#endif
+
+#if defined(HAVE_SSE2) && (defined(_MSC_VER) || defined(__GNUC__))
+# define HAVE_AVX2 1
+# include <immintrin.h>
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define TARGET_AVX2
+# else
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
+
+/*
+ * Row kernels used by the image filters. The scalar versions are the reference; the
+ * SSE2 and AVX2 versions produce bit-identical results, and fall back to the scalar
+ * versions for the pixels left over at the end of a row.
+ */
+
+static void median9Row_Scalar(unsigned short *d, const unsigned short *r0, const unsigned short *r1, const unsigned short *r2, int n)
+{
+    unsigned short a[9];
+
+    for (int i = 0; i < n; i++)
+    {
+        a[0] = r0[i - 1];
+        a[1] = r0[i    ];
+        a[2] = r0[i + 1];
+        a[3] = r1[i - 1];
+        a[4] = r1[i    ];
+        a[5] = r1[i + 1];
+        a[6] = r2[i - 1];
+        a[7] = r2[i    ];
+        a[8] = r2[i + 1];
+        d[i] = median9(a);
+    }
+}
+
+static void avg4Row_Scalar(unsigned short *d, const unsigned short *r0, const unsigned short *r1, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        unsigned int t = r0[i];
+        t += r0[i + 1];
+        t += r1[i];
+        t += r1[i + 1];
+        d[i] = (unsigned short)(t >> 2);
+    }
+}
+
+static unsigned short maxDeficit_Scalar(const unsigned short *light, const unsigned short *dark, int n, unsigned short cur)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (dark[i] > light[i] && dark[i] - light[i] > cur)
+            cur = dark[i] - light[i];
+    }
+    return cur;
+}
+
+static void subtractRow_Scalar(unsigned short *light, const unsigned short *dark, int n, unsigned short offset)
+{
+    for (int i = 0; i < n; i++)
+    {
+        int newval = (int) light[i] - (int) dark[i] + offset;
+        if (newval < 0) newval = 0; // shouldn't hit this...
+        else if (newval > 65535) newval = 65535;
+        light[i] = (unsigned short) newval;
+    }
+}
+
+static void minMax_Scalar(const unsigned short *p, int n, unsigned short *pmin, unsigned short *pmax)
+{
+    unsigned short mn = *pmin, mx = *pmax;
+    for (int i = 0; i < n; i++)
+    {
+        if (p[i] < mn) mn = p[i];
+        if (p[i] > mx) mx = p[i];
+    }
+    *pmin = mn;
+    *pmax = mx;
+}
+
+static void scaledDarkRow_Scalar(unsigned short *d, const unsigned short *bias, const float *rate, int n, float t)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float v = (float) bias[i] + rate[i] * t;
+        if (v < 0.f) v = 0.f;
+        else if (v > 65535.f) v = 65535.f;
+        d[i] = (unsigned short)(int)(v + 0.5f);
+    }
+}
+
+// Paeth's 19 compare-exchange median-of-9 network. SORT2(a, b) leaves the
+// smaller value in a and the larger one in b; the median ends up in p[4].
+#define MEDIAN9_NETWORK(SORT2, p) \
+    SORT2(p[1], p[2]); SORT2(p[4], p[5]); SORT2(p[7], p[8]); \
+    SORT2(p[0], p[1]); SORT2(p[3], p[4]); SORT2(p[6], p[7]); \
+    SORT2(p[1], p[2]); SORT2(p[4], p[5]); SORT2(p[7], p[8]); \
+    SORT2(p[0], p[3]); SORT2(p[5], p[8]); SORT2(p[4], p[7]); \
+    SORT2(p[3], p[6]); SORT2(p[1], p[4]); SORT2(p[2], p[5]); \
+    SORT2(p[4], p[7]); SORT2(p[4], p[2]); SORT2(p[6], p[4]); \
+    SORT2(p[4], p[2])
+
+#ifdef HAVE_SSE2
+
+// SSE2 has no unsigned 16-bit min/max. The median and min/max kernels flip the
+// sign bit of the pixels so that signed comparisons order them as unsigned values.
+
+#define SORT2_SSE2(a, b) do { __m128i t_ = a; a = _mm_min_epi16(t_, b); b = _mm_max_epi16(t_, b); } while (0)
+
+static void median9Row_SSE2(unsigned short *d, const unsigned short *r0, const unsigned short *r1, const unsigned short *r2, int n)
+{
+    const __m128i bias = _mm_set1_epi16((short) 0x8000);
+    __m128i p[9];
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        p[0] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r0 + i - 1)), bias);
+        p[1] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r0 + i    )), bias);
+        p[2] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r0 + i + 1)), bias);
+        p[3] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r1 + i - 1)), bias);
+        p[4] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r1 + i    )), bias);
+        p[5] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r1 + i + 1)), bias);
+        p[6] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r2 + i - 1)), bias);
+        p[7] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r2 + i    )), bias);
+        p[8] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(r2 + i + 1)), bias);
+
+        MEDIAN9_NETWORK(SORT2_SSE2, p);
+
+        _mm_storeu_si128((__m128i *)(d + i), _mm_xor_si128(p[4], bias));
+    }
+
+    median9Row_Scalar(d + i, r0 + i, r1 + i, r2 + i, n - i);
+}
+
+static void avg4Row_SSE2(unsigned short *d, const unsigned short *r0, const unsigned short *r1, int n)
+{
+    // (a + b + c + e) >> 2 == (a>>2) + (b>>2) + (c>>2) + (e>>2) + (sum of the low 2 bits >> 2),
+    // which never overflows 16 bits
+    const __m128i lowbits = _mm_set1_epi16(3);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(r0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(r0 + i + 1));
+        __m128i c = _mm_loadu_si128((const __m128i *)(r1 + i));
+        __m128i e = _mm_loadu_si128((const __m128i *)(r1 + i + 1));
+
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_srli_epi16(a, 2), _mm_srli_epi16(b, 2)),
+                                   _mm_add_epi16(_mm_srli_epi16(c, 2), _mm_srli_epi16(e, 2)));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lowbits), _mm_and_si128(b, lowbits)),
+                                   _mm_add_epi16(_mm_and_si128(c, lowbits), _mm_and_si128(e, lowbits)));
+
+        _mm_storeu_si128((__m128i *)(d + i), _mm_add_epi16(hi, _mm_srli_epi16(lo, 2)));
+    }
+
+    avg4Row_Scalar(d + i, r0 + i, r1 + i, n - i);
+}
+
+static unsigned short maxDeficit_SSE2(const unsigned short *light, const unsigned short *dark, int n, unsigned short cur)
+{
+    __m128i mx = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i *)(light + i));
+        __m128i k = _mm_loadu_si128((const __m128i *)(dark + i));
+        __m128i def = _mm_subs_epu16(k, l);
+        // unsigned max(mx, def)
+        mx = _mm_adds_epu16(_mm_subs_epu16(mx, def), def);
+    }
+
+    unsigned short lanes[8];
+    _mm_storeu_si128((__m128i *) lanes, mx);
+    for (int j = 0; j < 8; j++)
+        if (lanes[j] > cur)
+            cur = lanes[j];
+
+    return maxDeficit_Scalar(light + i, dark + i, n - i, cur);
+}
+
+static void subtractRow_SSE2(unsigned short *light, const unsigned short *dark, int n, unsigned short offset)
+{
+    // light - dark + offset without widening: where light >= dark the result is
+    // (light - dark) + offset, saturated; elsewhere it is offset - (dark - light),
+    // which cannot go below zero since offset covers the largest deficit
+    const __m128i ofs = _mm_set1_epi16((short) offset);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i *)(light + i));
+        __m128i k = _mm_loadu_si128((const __m128i *)(dark + i));
+        __m128i pos = _mm_subs_epu16(l, k);
+        __m128i neg = _mm_subs_epu16(k, l);
+        _mm_storeu_si128((__m128i *)(light + i), _mm_subs_epu16(_mm_adds_epu16(pos, ofs), neg));
+    }
+
+    subtractRow_Scalar(light + i, dark + i, n - i, offset);
+}
+
+static void minMax_SSE2(const unsigned short *p, int n, unsigned short *pmin, unsigned short *pmax)
+{
+    const __m128i bias = _mm_set1_epi16((short) 0x8000);
+    __m128i mn = _mm_xor_si128(_mm_set1_epi16((short) *pmin), bias);
+    __m128i mx = _mm_xor_si128(_mm_set1_epi16((short) *pmax), bias);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)), bias);
+        mn = _mm_min_epi16(mn, v);
+        mx = _mm_max_epi16(mx, v);
+    }
+
+    unsigned short lmin[8], lmax[8];
+    _mm_storeu_si128((__m128i *) lmin, _mm_xor_si128(mn, bias));
+    _mm_storeu_si128((__m128i *) lmax, _mm_xor_si128(mx, bias));
+    for (int j = 0; j < 8; j++)
+    {
+        if (lmin[j] < *pmin) *pmin = lmin[j];
+        if (lmax[j] > *pmax) *pmax = lmax[j];
+    }
+
+    minMax_Scalar(p + i, n - i, pmin, pmax);
+}
+
+static void scaledDarkRow_SSE2(unsigned short *d, const unsigned short *bias, const float *rate, int n, float t)
+{
+    // SSE2 can only pack to signed 16-bit values, so the results are offset by
+    // 32768 before packing and the sign bit is flipped back afterwards
+    const __m128 vt = _mm_set1_ps(t);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 lo = _mm_setzero_ps();
+    const __m128 hi = _mm_set1_ps(65535.f);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ofs = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16((short) 0x8000);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i *)(bias + i));
+        __m128 v0 = _mm_add_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero)), _mm_mul_ps(_mm_loadu_ps(rate + i), vt));
+        __m128 v1 = _mm_add_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(b, zero)), _mm_mul_ps(_mm_loadu_ps(rate + i + 4), vt));
+        v0 = _mm_min_ps(_mm_max_ps(v0, lo), hi);
+        v1 = _mm_min_ps(_mm_max_ps(v1, lo), hi);
+        __m128i i0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(v0, half)), ofs);
+        __m128i i1 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(v1, half)), ofs);
+        _mm_storeu_si128((__m128i *)(d + i), _mm_xor_si128(_mm_packs_epi32(i0, i1), flip));
+    }
+
+    scaledDarkRow_Scalar(d + i, bias + i, rate + i, n - i, t);
+}
+
+static const ImageKernels s_sse2Kernels =
+{
+    "SSE2", median9Row_SSE2, avg4Row_SSE2, maxDeficit_SSE2, subtractRow_SSE2, minMax_SSE2, scaledDarkRow_SSE2,
+};
+
+#endif // HAVE_SSE2
+
+#ifdef HAVE_AVX2
+
+#define SORT2_AVX2(a, b) do { __m256i t_ = a; a = _mm256_min_epu16(t_, b); b = _mm256_max_epu16(t_, b); } while (0)
+
+TARGET_AVX2 static void median9Row_AVX2(unsigned short *d, const unsigned short *r0, const unsigned short *r1, const unsigned short *r2, int n)
+{
+    __m256i p[9];
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        p[0] = _mm256_loadu_si256((const __m256i *)(r0 + i - 1));
+        p[1] = _mm256_loadu_si256((const __m256i *)(r0 + i    ));
+        p[2] = _mm256_loadu_si256((const __m256i *)(r0 + i + 1));
+        p[3] = _mm256_loadu_si256((const __m256i *)(r1 + i - 1));
+        p[4] = _mm256_loadu_si256((const __m256i *)(r1 + i    ));
+        p[5] = _mm256_loadu_si256((const __m256i *)(r1 + i + 1));
+        p[6] = _mm256_loadu_si256((const __m256i *)(r2 + i - 1));
+        p[7] = _mm256_loadu_si256((const __m256i *)(r2 + i    ));
+        p[8] = _mm256_loadu_si256((const __m256i *)(r2 + i + 1));
+
+        MEDIAN9_NETWORK(SORT2_AVX2, p);
+
+        _mm256_storeu_si256((__m256i *)(d + i), p[4]);
+    }
+
+    median9Row_Scalar(d + i, r0 + i, r1 + i, r2 + i, n - i);
+}
+
+TARGET_AVX2 static void avg4Row_AVX2(unsigned short *d, const unsigned short *r0, const unsigned short *r1, int n)
+{
+    const __m256i lowbits = _mm256_set1_epi16(3);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(r0 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(r0 + i + 1));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(r1 + i));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(r1 + i + 1));
+
+        __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_srli_epi16(a, 2), _mm256_srli_epi16(b, 2)),
+                                      _mm256_add_epi16(_mm256_srli_epi16(c, 2), _mm256_srli_epi16(e, 2)));
+        __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a, lowbits), _mm256_and_si256(b, lowbits)),
+                                      _mm256_add_epi16(_mm256_and_si256(c, lowbits), _mm256_and_si256(e, lowbits)));
+
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_add_epi16(hi, _mm256_srli_epi16(lo, 2)));
+    }
+
+    avg4Row_Scalar(d + i, r0 + i, r1 + i, n - i);
+}
+
+TARGET_AVX2 static unsigned short maxDeficit_AVX2(const unsigned short *light, const unsigned short *dark, int n, unsigned short cur)
+{
+    __m256i mx = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i l = _mm256_loadu_si256((const __m256i *)(light + i));
+        __m256i k = _mm256_loadu_si256((const __m256i *)(dark + i));
+        mx = _mm256_max_epu16(mx, _mm256_subs_epu16(k, l));
+    }
+
+    unsigned short lanes[16];
+    _mm256_storeu_si256((__m256i *) lanes, mx);
+    for (int j = 0; j < 16; j++)
+        if (lanes[j] > cur)
+            cur = lanes[j];
+
+    return maxDeficit_Scalar(light + i, dark + i, n - i, cur);
+}
+
+TARGET_AVX2 static void subtractRow_AVX2(unsigned short *light, const unsigned short *dark, int n, unsigned short offset)
+{
+    const __m256i ofs = _mm256_set1_epi16((short) offset);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i l = _mm256_loadu_si256((const __m256i *)(light + i));
+        __m256i k = _mm256_loadu_si256((const __m256i *)(dark + i));
+        __m256i pos = _mm256_subs_epu16(l, k);
+        __m256i neg = _mm256_subs_epu16(k, l);
+        _mm256_storeu_si256((__m256i *)(light + i), _mm256_subs_epu16(_mm256_adds_epu16(pos, ofs), neg));
+    }
+
+    subtractRow_Scalar(light + i, dark + i, n - i, offset);
+}
+
+TARGET_AVX2 static void minMax_AVX2(const unsigned short *p, int n, unsigned short *pmin, unsigned short *pmax)
+{
+    __m256i mn = _mm256_set1_epi16((short) *pmin);
+    __m256i mx = _mm256_set1_epi16((short) *pmax);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        mn = _mm256_min_epu16(mn, v);
+        mx = _mm256_max_epu16(mx, v);
+    }
+
+    unsigned short lmin[16], lmax[16];
+    _mm256_storeu_si256((__m256i *) lmin, mn);
+    _mm256_storeu_si256((__m256i *) lmax, mx);
+    for (int j = 0; j < 16; j++)
+    {
+        if (lmin[j] < *pmin) *pmin = lmin[j];
+        if (lmax[j] > *pmax) *pmax = lmax[j];
+    }
+
+    minMax_Scalar(p + i, n - i, pmin, pmax);
+}
+
+TARGET_AVX2 static void scaledDarkRow_AVX2(unsigned short *d, const unsigned short *bias, const float *rate, int n, float t)
+{
+    const __m256 vt = _mm256_set1_ps(t);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 lo = _mm256_setzero_ps();
+    const __m256 hi = _mm256_set1_ps(65535.f);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(bias + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(bias + i + 8));
+        __m256 v0 = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(b0)), _mm256_mul_ps(_mm256_loadu_ps(rate + i), vt));
+        __m256 v1 = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(b1)), _mm256_mul_ps(_mm256_loadu_ps(rate + i + 8), vt));
+        v0 = _mm256_min_ps(_mm256_max_ps(v0, lo), hi);
+        v1 = _mm256_min_ps(_mm256_max_ps(v1, lo), hi);
+        __m256i i0 = _mm256_cvttps_epi32(_mm256_add_ps(v0, half));
+        __m256i i1 = _mm256_cvttps_epi32(_mm256_add_ps(v1, half));
+        // the pack works within 128-bit lanes, put the quarters back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(i0, i1), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(d + i), packed);
+    }
+
+    scaledDarkRow_Scalar(d + i, bias + i, rate + i, n - i, t);
+}
+
+static const ImageKernels s_avx2Kernels =
+{
+    "AVX2", median9Row_AVX2, avg4Row_AVX2, maxDeficit_AVX2, subtractRow_AVX2, minMax_AVX2, scaledDarkRow_AVX2,
+};
+
+static bool CpuHasAVX2(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool const osxsave = (info[2] & (1 << 27)) != 0;
+    bool const avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // OS must save the YMM registers
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // HAVE_AVX2
+
+static const ImageKernels s_scalarKernels =
+{
+    "scalar", median9Row_Scalar, avg4Row_Scalar, maxDeficit_Scalar, subtractRow_Scalar, minMax_Scalar, scaledDarkRow_Scalar,
+};
+
+const ImageKernels *ScalarKernels(void)
+{
+    return &s_scalarKernels;
+}
+
+const ImageKernels *SSE2Kernels(void)
+{
+#ifdef HAVE_SSE2
+    return &s_sse2Kernels;
+#else
+    return NULL;
+#endif
+}
+
+const ImageKernels *AVX2Kernels(void)
+{
+#ifdef HAVE_AVX2
+    static bool const s_supported = CpuHasAVX2();
+    return s_supported ? &s_avx2Kernels : NULL;
+#else
+    return NULL;
+#endif
+}
+
+const ImageKernels& BestKernels(void)
+{
+    const ImageKernels *k = AVX2Kernels();
+    if (!k)
+        k = SSE2Kernels();
+    if (!k)
+        k = ScalarKernels();
+    return *k;
+}
+
+// The neighbors of a pixel that lie inside the frame, by where the pixel is:
+// s_neighbors[row class][column class], with class 0 for the first row or
+// column, 1 inside, and 2 for the last
+struct NeighborOffsets
+{
+    int n;
+    signed char dx[8];
+    signed char dy[8];
+};
+
+static const NeighborOffsets s_neighbors[3][3] =
+{
+    {
+        { 3, {  1,  0,  1,  0,  0,  0,  0,  0 }, {  0,  1,  1,  0,  0,  0,  0,  0 } },
+        { 5, { -1,  1, -1,  0,  1,  0,  0,  0 }, {  0,  0,  1,  1,  1,  0,  0,  0 } },
+        { 3, { -1, -1,  0,  0,  0,  0,  0,  0 }, {  0,  1,  1,  0,  0,  0,  0,  0 } },
+    },
+    {
+        { 5, {  0,  1,  1,  0,  1,  0,  0,  0 }, { -1, -1,  0,  1,  1,  0,  0,  0 } },
+        { 8, { -1,  0,  1, -1,  1, -1,  0,  1 }, { -1, -1, -1,  0,  0,  1,  1,  1 } },
+        { 5, { -1,  0, -1, -1,  0,  0,  0,  0 }, { -1, -1,  0,  1,  1,  0,  0,  0 } },
+    },
+    {
+        { 3, {  0,  1,  1,  0,  0,  0,  0,  0 }, { -1, -1,  0,  0,  0,  0,  0,  0 } },
+        { 5, { -1,  0,  1, -1,  1,  0,  0,  0 }, { -1, -1, -1,  0,  0,  0,  0,  0 } },
+        { 3, { -1,  0, -1,  0,  0,  0,  0,  0 }, { -1, -1,  0,  0,  0,  0,  0,  0 } },
+    },
+};
+
+DefectFixer::DefectFixer(unsigned short *data, int width, int height)
+    : m_data(data), m_width(width), m_height(height)
+{
+    for (int cy = 0; cy < 3; cy++)
+        for (int cx = 0; cx < 3; cx++)
+        {
+            const NeighborOffsets& nb = s_neighbors[cy][cx];
+            m_count[cy][cx] = nb.n;
+            for (int i = 0; i < nb.n; i++)
+                m_offsets[cy][cx][i] = nb.dx[i] + nb.dy[i] * m_width;
+        }
+}
+
+void DefectFixer::FixRow(int y, const int *first, const int *last, int x0, int x1)
+{
+    if (first == last || y < 0 || y >= m_height)
+        return;
+    first = std::lower_bound(first, last, std::max(x0, 0));
+    last = std::upper_bound(first, last, std::min(x1, m_width - 1));
+    for (; first != last; ++first)
+        Fix(*first, y);
+}
+
+void Median3Rect(unsigned short *dst, const unsigned short *src, int width, int rx, int ry, int rw, int rh, const ImageKernels& k)
+{
+    int const W = width;
+    int const RX = rx;
+    int const RY = ry;
+    int const RW = rw;
+    int const RH = rh;
+
+    unsigned short a[9];
+    unsigned short *d;
+
+#define IX(x_, y_) ((RY + (y_)) * W + RX + (x_))
+
+    // top row
+    d = &dst[IX(0, 0)];
+
+    // top-left corner
+    a[0] = src[IX(0, 0)];
+    a[1] = src[IX(1, 0)];
+    a[2] = src[IX(0, 1)];
+    a[3] = src[IX(1, 1)];
+    *d++ = median4(a);
+
+    // top row middle pixels
+    for (int x = 1; x <= RW - 2; x++)
+    {
+        a[0] = src[IX(x - 1, 0)];
+        a[1] = src[IX(x,     0)];
+        a[2] = src[IX(x + 1, 0)];
+        a[3] = src[IX(x - 1, 1)];
+        a[4] = src[IX(x,     1)];
+        a[5] = src[IX(x + 1, 1)];
+        *d++ = median6(a);
+    }
+
+    // top-right corner
+    a[0] = src[IX(RW - 2, 0)];
+    a[1] = src[IX(RW - 1, 0)];
+    a[2] = src[IX(RW - 2, 1)];
+    a[3] = src[IX(RW - 1, 1)];
+    *d = median4(a);
+
+    for (int y = 1; y <= RH - 2; y++)
+    {
+        d = &dst[IX(0, y)];
+
+        // leftmost pixel
+        a[0] = src[IX(0, y - 1)];
+        a[1] = src[IX(1, y - 1)];
+        a[2] = src[IX(0, y    )];
+        a[3] = src[IX(1, y    )];
+        a[4] = src[IX(0, y + 1)];
+        a[5] = src[IX(1, y + 1)];
+        *d++ = median6(a);
+
+        if (RW > 2)
+        {
+            k.median9Row(d, &src[IX(1, y - 1)], &src[IX(1, y)], &src[IX(1, y + 1)], RW - 2);
+            d += RW - 2;
+        }
+
+        // rightmost pixel
+        a[0] = src[IX(RW - 2, y - 1)];
+        a[1] = src[IX(RW - 1, y - 1)];
+        a[2] = src[IX(RW - 2, y    )];
+        a[3] = src[IX(RW - 1, y    )];
+        a[4] = src[IX(RW - 2, y + 1)];
+        a[5] = src[IX(RW - 1, y + 1)];
+        *d++ = median6(a);
+    }
+
+    // bottom row
+    d = &dst[IX(0, RH - 1)];
+
+    // bottom-left corner
+    a[0] = src[IX(0, RH - 2)];
+    a[1] = src[IX(1, RH - 2)];
+    a[2] = src[IX(0, RH - 1)];
+    a[3] = src[IX(1, RH - 1)];
+    *d++ = median4(a);
+
+    // bottom row middle pixels
+    for (int x = 1; x <= RW - 2; x++)
+    {
+        a[0] = src[IX(x - 1, RH - 2)];
+        a[1] = src[IX(x    , RH - 2)];
+        a[2] = src[IX(x + 1, RH - 2)];
+        a[3] = src[IX(x - 1, RH - 1)];
+        a[4] = src[IX(x    , RH - 1)];
+        a[5] = src[IX(x + 1, RH - 1)];
+        *d++ = median6(a);
+    }
+
+    // bottom-right corner
+    a[0] = src[IX(RW - 2, RH - 2)];
+    a[1] = src[IX(RW - 1, RH - 2)];
+    a[2] = src[IX(RW - 2, RH - 1)];
+    a[3] = src[IX(RW - 1, RH - 1)];
+    *d = median4(a);
+
+#undef IX
+}
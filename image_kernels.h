@@ -0,0 +1,269 @@
+/*
+ *  image_kernels.h
+ *  PHD Guiding
+ *
+ *  Created by Craig Stark.
+ *  Copyright (c) 2006-2010 Craig Stark.
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of Craig Stark, Stark Labs nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef IMAGE_KERNELS_INCLUDED
+#define IMAGE_KERNELS_INCLUDED
+
+/*
+ * Per-row pixel kernels of the image filters, with scalar, SSE2 and AVX2
+ * implementations, the small fixed-size medians they are built on, and the
+ * replacement of defective pixels.
+ *
+ * This header and image_kernels.cpp do not depend on wxWidgets, so that the
+ * kernels can be unit tested directly.
+ */
+
+// per-row pixel kernels, selected at runtime according to the instruction
+// sets supported by the CPU
+struct ImageKernels
+{
+    const char *name;
+    // d[i] = median of the 3x3 neighborhood centered on r1[i]
+    void (*median9Row)(unsigned short *d, const unsigned short *r0, const unsigned short *r1, const unsigned short *r2, int n);
+    // d[i] = (r0[i] + r0[i+1] + r1[i] + r1[i+1]) / 4
+    void (*avg4Row)(unsigned short *d, const unsigned short *r0, const unsigned short *r1, int n);
+    // largest amount by which dark[i] exceeds light[i], or cur if larger
+    unsigned short (*maxDeficit)(const unsigned short *light, const unsigned short *dark, int n, unsigned short cur);
+    // light[i] = clamp(light[i] - dark[i] + offset), with offset >= the deficit of the row
+    void (*subtractRow)(unsigned short *light, const unsigned short *dark, int n, unsigned short offset);
+    // extend *pmin, *pmax with the pixel values of the row
+    void (*minMax)(const unsigned short *p, int n, unsigned short *pmin, unsigned short *pmax);
+    // d[i] = round(clamp(bias[i] + rate[i] * t))
+    void (*scaledDarkRow)(unsigned short *d, const unsigned short *bias, const float *rate, int n, float t);
+};
+
+// the fastest kernels supported by the CPU
+extern const ImageKernels& BestKernels(void);
+
+// a specific implementation, NULL when it is not built in or the CPU does not
+// support it
+extern const ImageKernels *ScalarKernels(void);
+extern const ImageKernels *SSE2Kernels(void);
+extern const ImageKernels *AVX2Kernels(void);
+
+inline static void swap(unsigned short& a, unsigned short& b)
+{
+    unsigned short const t = a;
+    a = b;
+    b = t;
+}
+
+inline static unsigned short median9(const unsigned short l[9])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
+    unsigned short x;
+    x = l[5];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[6];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[7];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[8];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+
+    if (l1 > l0) l0 = l1;
+    if (l2 > l0) l0 = l2;
+    if (l3 > l0) l0 = l3;
+    if (l4 > l0) l0 = l4;
+
+    return l0;
+}
+
+inline static unsigned short median8(const unsigned short l[8])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
+    unsigned short x;
+
+    x = l[5];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[6];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+    x = l[7];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    if (x < l4) swap(x, l4);
+
+    if (l2 > l0) swap(l2, l0);
+    if (l2 > l1) swap(l2, l1);
+
+    if (l3 > l0) swap(l3, l0);
+    if (l3 > l1) swap(l3, l1);
+
+    if (l4 > l0) swap(l4, l0);
+    if (l4 > l1) swap(l4, l1);
+
+    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+}
+
+inline static unsigned short median6(const unsigned short l[6])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3];
+    unsigned short x;
+
+    x = l[4];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+    x = l[5];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    if (x < l3) swap(x, l3);
+
+    if (l2 > l0) swap(l2, l0);
+    if (l2 > l1) swap(l2, l1);
+
+    if (l3 > l0) swap(l3, l0);
+    if (l3 > l1) swap(l3, l1);
+
+    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+}
+
+inline static unsigned short median5(const unsigned short l[5])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
+    unsigned short x;
+    x = l[3];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+    x = l[4];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+
+    if (l1 > l0) l0 = l1;
+    if (l2 > l0) l0 = l2;
+
+    return l0;
+}
+
+inline static unsigned short median4(const unsigned short l[4])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
+    unsigned short x;
+    x = l[3];
+    if (x < l0) swap(x, l0);
+    if (x < l1) swap(x, l1);
+    if (x < l2) swap(x, l2);
+
+    if (l2 > l0) swap(l2, l0);
+    if (l2 > l1) swap(l2, l1);
+
+    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+}
+
+inline static unsigned short median3(const unsigned short l[3])
+{
+    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
+    if (l2 < l0) swap(l2, l0);
+    if (l2 < l1) swap(l2, l1);
+    if (l1 > l0) l0 = l1;
+    return l0;
+}
+
+// Replaces defective pixels with the median of their neighbors. The neighbor
+// offsets are worked out once per frame, so fixing a defect is a table lookup
+// and a gather whether or not it is on the edge of the frame.
+class DefectFixer
+{
+    unsigned short *m_data;
+    int m_width;
+    int m_height;
+    int m_count[3][3];
+    int m_offsets[3][3][8];
+
+    static int Class(int v, int last) { return v == 0 ? 0 : v == last ? 2 : 1; }
+
+public:
+    DefectFixer(unsigned short *data, int width, int height);
+
+    // frames with a single row or column have no neighbor layout to use
+    bool CanFix(void) const { return m_width > 1 && m_height > 1; }
+
+    void Fix(int x, int y)
+    {
+        int const cy = Class(y, m_height - 1);
+        int const cx = Class(x, m_width - 1);
+        int const n = m_count[cy][cx];
+        const int *offs = m_offsets[cy][cx];
+        unsigned short *p = m_data + y * m_width + x;
+
+        unsigned short array[8];
+        for (int i = 0; i < n; i++)
+            array[i] = p[offs[i]];
+
+        *p = n == 8 ? median8(array) : n == 5 ? median5(array) : median3(array);
+    }
+
+    // Fixes the defects of row y at the sorted columns [first, last) that lie
+    // within columns x0..x1 and within the frame. The defects may come from a
+    // larger frame.
+    void FixRow(int y, const int *first, const int *last, int x0, int x1);
+};
+
+// 3x3 median filter of the rectangle rx, ry, rw x rh of an image of the given
+// width, writing the same rectangle of dst. The pixels on the edges of the
+// rectangle take the median of their neighbors within it.
+extern void Median3Rect(unsigned short *dst, const unsigned short *src, int width, int rx, int ry, int rw, int rh,
+    const ImageKernels& k);
+
+#endif // IMAGE_KERNELS_INCLUDED
@@ -34,6 +34,7 @@
 
 #include "phd.h"
 #include "image_math.h"
+#include "image_kernels.h"
 
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
@@ -41,6 +42,19 @@
 
 #include <algorithm>
 
+static const ImageKernels *SelectKernels(void)
+{
+    const ImageKernels *k = &BestKernels();
+    Debug.Write(wxString::Format("Image processing kernels: %s\n", k->name));
+    return k;
+}
+
+static const ImageKernels& Kernels(void)
+{
+    static const ImageKernels *s_kernels = SelectKernels();
+    return *s_kernels;
+}
+
 int dbl_sort_func (double *first, double *second)
 {
     if (*first < *second)
@@ -79,8 +93,8 @@ double CalcSlope(const ArrayOfDbl& y)
 bool QuickLRecon(usImage& img)
 {
     // Does a simple debayer of luminance data only -- sliding 2x2 window
-    usImage tmp;
-    if (tmp.Init(img.Size))
+    unsigned short *tmp = img.Subframe.IsEmpty() ? img.ScratchData() : img.ScratchData(img.Subframe);
+    if (!tmp)
     {
         pFrame->Alert(_("Memory allocation error"));
         return true;
@@ -100,26 +114,20 @@ bool QuickLRecon(usImage& img)
         RY = img.Subframe.GetY();
         RW = img.Subframe.GetWidth();
         RH = img.Subframe.GetHeight();
-        tmp.Clear();
     }
 
 #define IX(x_, y_) ((RY + (y_)) * W + RX + (x_))
 
     unsigned short *d;
     unsigned int t;
+    const ImageKernels& k = Kernels();
 
     for (int y = 0; y <= RH - 2; y++)
     {
-        d = &tmp.ImageData[IX(0, y)];
+        d = &tmp[IX(0, y)];
 
-        for (int x = 0; x <= RW - 2; x++)
-        {
-            t  = img.ImageData[IX(x    , y    )];
-            t += img.ImageData[IX(x + 1, y    )];
-            t += img.ImageData[IX(x    , y + 1)];
-            t += img.ImageData[IX(x + 1, y + 1)];
-            *d++ = (unsigned short)(t >> 2);
-        }
+        k.avg4Row(d, &img.ImageData[IX(0, y)], &img.ImageData[IX(0, y + 1)], RW - 1);
+        d += RW - 1;
 
         // last col
         t  = img.ImageData[IX(RW - 1, y    )];
@@ -129,7 +137,7 @@ bool QuickLRecon(usImage& img)
 
     // last row
 
-    d = &tmp.ImageData[IX(0, RH - 1)];
+    d = &tmp[IX(0, RH - 1)];
 
     for (int x = 0; x <= RW - 2; x++)
     {
@@ -143,430 +151,383 @@ bool QuickLRecon(usImage& img)
 
 #undef IX
 
-    img.SwapImageData(tmp);
+    img.SwapScratchData();
     return false;
 }
 
 bool Median3(usImage& img)
 {
-    usImage tmp;
-    tmp.Init(img.Size);
-
     bool err;
 
     if (img.Subframe.IsEmpty())
     {
-        err = Median3(tmp.ImageData, img.ImageData, img.Size, wxRect(img.Size));
+        unsigned short *tmp = img.ScratchData();
+        err = Median3(tmp, img.ImageData, img.Size, wxRect(img.Size));
     }
     else
     {
-        tmp.Clear();
-        err = Median3(tmp.ImageData, img.ImageData, img.Size, img.Subframe);
+        unsigned short *tmp = img.ScratchData(img.Subframe);
+        err = Median3(tmp, img.ImageData, img.Size, img.Subframe);
     }
 
-    img.SwapImageData(tmp);
+    img.SwapScratchData();
     return err;
 }
 
-inline static void swap(unsigned short& a, unsigned short& b)
+class RowBandThread : public wxThread
 {
-    unsigned short const t = a;
-    a = b;
-    b = t;
-}
+    RowBandJob& m_job;
+    int m_band;
+    int m_y0;
+    int m_y1;
+
+public:
+    RowBandThread(RowBandJob& job, int band, int y0, int y1)
+        : wxThread(wxTHREAD_JOINABLE), m_job(job), m_band(band), m_y0(y0), m_y1(y1) { }
+    ExitCode Entry() { m_job.Run(m_band, m_y0, m_y1); return 0; }
+};
 
-inline static unsigned short median9(const unsigned short l[9])
+// number of bands to split an image of the given height into
+int RowBandCount(int rows)
 {
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
-    unsigned short x;
-    x = l[5];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[6];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[7];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[8];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-
-    if (l1 > l0) l0 = l1;
-    if (l2 > l0) l0 = l2;
-    if (l3 > l0) l0 = l3;
-    if (l4 > l0) l0 = l4;
-
-    return l0;
-}
+    // below this, starting a thread costs more than it saves
+    enum { MIN_BAND_ROWS = 64 };
 
-inline static unsigned short median8(const unsigned short l[8])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3], l4 = l[4];
-    unsigned short x;
-
-    x = l[5];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[6];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-    x = l[7];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    if (x < l4) swap(x, l4);
-
-    if (l2 > l0) swap(l2, l0);
-    if (l2 > l1) swap(l2, l1);
-
-    if (l3 > l0) swap(l3, l0);
-    if (l3 > l1) swap(l3, l1);
-
-    if (l4 > l0) swap(l4, l0);
-    if (l4 > l1) swap(l4, l1);
-
-    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+    int ncpu = wxThread::GetCPUCount(); // -1 when unknown
+    int nbands = std::min(ncpu, rows / MIN_BAND_ROWS);
+    return std::max(nbands, 1);
 }
 
-inline static unsigned short median6(const unsigned short l[6])
+// Run the job over rows [y0, y1) split into nbands bands. The first band runs
+// on the calling thread, and bands are handed out in ascending row order so
+// that a job collecting results per band can merge them in raster order.
+void RunRowBands(RowBandJob& job, int nbands, int y0, int y1)
 {
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2], l3 = l[3];
-    unsigned short x;
-
-    x = l[4];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-    x = l[5];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    if (x < l3) swap(x, l3);
-
-    if (l2 > l0) swap(l2, l0);
-    if (l2 > l1) swap(l2, l1);
-
-    if (l3 > l0) swap(l3, l0);
-    if (l3 > l1) swap(l3, l1);
-
-    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
-}
+    std::vector<RowBandThread *> threads;
+    int rows = y1 - y0;
 
-inline static unsigned short median5(const unsigned short l[5])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
-    unsigned short x;
-    x = l[3];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-    x = l[4];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
-
-    if (l1 > l0) l0 = l1;
-    if (l2 > l0) l0 = l2;
-
-    return l0;
-}
-
-inline static unsigned short median4(const unsigned short l[4])
-{
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
-    unsigned short x;
-    x = l[3];
-    if (x < l0) swap(x, l0);
-    if (x < l1) swap(x, l1);
-    if (x < l2) swap(x, l2);
+    for (int i = 1; i < nbands; i++)
+    {
+        int by0 = y0 + rows * i / nbands;
+        int by1 = y0 + rows * (i + 1) / nbands;
+        RowBandThread *thread = new RowBandThread(job, i, by0, by1);
+        if (thread->Create() == wxTHREAD_NO_ERROR && thread->Run() == wxTHREAD_NO_ERROR)
+            threads.push_back(thread);
+        else
+        {
+            delete thread;
+            job.Run(i, by0, by1);
+        }
+    }
 
-    if (l2 > l0) swap(l2, l0);
-    if (l2 > l1) swap(l2, l1);
+    job.Run(0, y0, y0 + rows / nbands);
 
-    return (unsigned short)(((unsigned int) l0 + (unsigned int) l1) / 2);
+    for (std::vector<RowBandThread *>::iterator it = threads.begin(); it != threads.end(); ++it)
+    {
+        (*it)->Wait();
+        delete *it;
+    }
 }
 
-inline static unsigned short median3(const unsigned short l[3])
+void PixelMinMax(const unsigned short *p, int n, int *pmin, int *pmax)
 {
-    unsigned short l0 = l[0], l1 = l[1], l2 = l[2];
-    if (l2 < l0) swap(l2, l0);
-    if (l2 < l1) swap(l2, l1);
-    if (l1 > l0) l0 = l1;
-    return l0;
+    unsigned short mn = (unsigned short) wxMin(*pmin, 65535);
+    unsigned short mx = (unsigned short) wxMax(*pmax, 0);
+    Kernels().minMax(p, n, &mn, &mx);
+    *pmin = mn;
+    *pmax = mx;
 }
 
 bool Median3(unsigned short *dst, const unsigned short *src, const wxSize& size, const wxRect& rect)
 {
-    int const W = size.GetWidth();
-    int const RX = rect.GetX();
-    int const RY = rect.GetY();
-    int const RW = rect.GetWidth();
-    int const RH = rect.GetHeight();
-
-    unsigned short a[9];
-    unsigned short *d;
+    Median3Rect(dst, src, size.GetWidth(), rect.GetX(), rect.GetY(), rect.GetWidth(), rect.GetHeight(), Kernels());
+    return false;
+}
 
-#define IX(x_, y_) ((RY + (y_)) * W + RX + (x_))
+bool SquarePixels(usImage& img, float xsize, float ysize)
+{
+    // Stretches one dimension to square up pixels
+    if (!img.ImageData)
+        return true;
 
-    // top row
-    d = &dst[IX(0, 0)];
+    if (xsize <= ysize)
+        return false;
 
-    // top-left corner
-    a[0] = src[IX(0, 0)];
-    a[1] = src[IX(1, 0)];
-    a[2] = src[IX(0, 1)];
-    a[3] = src[IX(1, 1)];
-    *d++ = median4(a);
+    // Move the existing data to a temp image
+    usImage tempimg;
+    if (tempimg.Init(img.Size))
+    {
+        pFrame->Alert(_("Memory allocation error"));
+        return true;
+    }
+    tempimg.SwapImageData(img);
 
-    // top row middle pixels
-    for (int x = 1; x <= RW - 2; x++)
+    // if X > Y, when viewing stock, Y is unnaturally stretched, so stretch X to match
+    double ratio = ysize / xsize;
+    int newsize = ROUND((double) tempimg.Size.GetWidth() / ratio);  // make new image correct size
+    img.Init(newsize,tempimg.Size.GetHeight());
+    unsigned short *optr = img.ImageData;
+    int linesize = tempimg.Size.GetWidth();  // size of an original line
+    for (int y = 0; y < img.Size.GetHeight(); y++)
     {
-        a[0] = src[IX(x - 1, 0)];
-        a[1] = src[IX(x,     0)];
-        a[2] = src[IX(x + 1, 0)];
-        a[3] = src[IX(x - 1, 1)];
-        a[4] = src[IX(x,     1)];
-        a[5] = src[IX(x + 1, 1)];
-        *d++ = median6(a);
+        for (int x = 0; x < newsize; x++, optr++)
+        {
+            double oldposition = x * ratio;
+            int ind1 = (unsigned int) floor(oldposition);
+            int ind2 = (unsigned int) ceil(oldposition);
+            if (ind2 > (tempimg.Size.GetWidth() - 1))
+                ind2 = tempimg.Size.GetWidth() - 1;
+            double weight = ceil(oldposition) - oldposition;
+            *optr = (unsigned short) (((float) *(tempimg.ImageData + y*linesize + ind1) * weight) + ((float) *(tempimg.ImageData + y*linesize + ind1) * (1.0 - weight)));
+        }
     }
 
-    // top-right corner
-    a[0] = src[IX(RW - 2, 0)];
-    a[1] = src[IX(RW - 1, 0)];
-    a[2] = src[IX(RW - 2, 1)];
-    a[3] = src[IX(RW - 1, 1)];
-    *d = median4(a);
+    return false;
+}
 
-    for (int y = 1; y <= RH - 2; y++)
+class SoftwareBinJob : public RowBandJob
+{
+    usImage& m_dst;
+    const usImage& m_src;
+    int m_factor;
+    bool m_mean;
+    int m_x0;
+    int m_x1;
+
+public:
+    SoftwareBinJob(usImage& dst, const usImage& src, int factor, bool mean, int x0, int x1)
+        : m_dst(dst), m_src(src), m_factor(factor), m_mean(mean), m_x0(x0), m_x1(x1) { }
+
+    void Run(int band, int y0, int y1)
     {
-        d = &dst[IX(0, y)];
-
-        // leftmost pixel
-        a[0] = src[IX(0, y - 1)];
-        a[1] = src[IX(1, y - 1)];
-        a[2] = src[IX(0, y    )];
-        a[3] = src[IX(1, y    )];
-        a[4] = src[IX(0, y + 1)];
-        a[5] = src[IX(1, y + 1)];
-        *d++ = median6(a);
-
-        for (int x = 1; x <= RW - 2; x++)
+        int const f = m_factor;
+        unsigned int const n = f * f;
+        int const srcW = m_src.Size.GetWidth();
+
+        for (int y = y0; y < y1; y++)
         {
-            a[0] = src[IX(x - 1, y - 1)];
-            a[1] = src[IX(x    , y - 1)];
-            a[2] = src[IX(x + 1, y - 1)];
-            a[3] = src[IX(x - 1, y    )];
-            a[4] = src[IX(x    , y    )];
-            a[5] = src[IX(x + 1, y    )];
-            a[6] = src[IX(x - 1, y + 1)];
-            a[7] = src[IX(x    , y + 1)];
-            a[8] = src[IX(x + 1, y + 1)];
-            *d++ = median9(a);
+            unsigned short *d = &m_dst.Pixel(m_x0, y);
+            const unsigned short *s0 = &m_src.Pixel(m_x0 * f, y * f);
+            for (int x = m_x0; x < m_x1; x++, s0 += f)
+            {
+                unsigned int t = 0;
+                const unsigned short *s = s0;
+                for (int j = 0; j < f; j++, s += srcW)
+                    for (int i = 0; i < f; i++)
+                        t += s[i];
+                if (m_mean)
+                    t = (t + n / 2) / n;
+                else if (t > 65535)
+                    t = 65535;
+                *d++ = (unsigned short) t;
+            }
         }
-
-        // rightmost pixel
-        a[0] = src[IX(RW - 2, y - 1)];
-        a[1] = src[IX(RW - 1, y - 1)];
-        a[2] = src[IX(RW - 2, y    )];
-        a[3] = src[IX(RW - 1, y    )];
-        a[4] = src[IX(RW - 2, y + 1)];
-        a[5] = src[IX(RW - 1, y + 1)];
-        *d++ = median6(a);
     }
+};
 
-    // bottom row
-    d = &dst[IX(0, RH - 1)];
+// Bins src by factor x factor into dst, adding up the pixels of each bin or
+// averaging them. Rows and columns left over at the right and bottom edges are
+// dropped. dst.BinFactor records the binning so that star positions can be
+// reported in full-resolution sensor coordinates.
+bool SoftwareBin(usImage& dst, const usImage& src, int factor, bool mean)
+{
+    if (!src.ImageData || factor < 2)
+        return true;
+
+    wxSize size(src.Size.GetWidth() / factor, src.Size.GetHeight() / factor);
+    if (size.GetWidth() < 1 || size.GetHeight() < 1)
+        return true;
 
-    // bottom-left corner
-    a[0] = src[IX(0, RH - 2)];
-    a[1] = src[IX(1, RH - 2)];
-    a[2] = src[IX(0, RH - 1)];
-    a[3] = src[IX(1, RH - 1)];
-    *d++ = median4(a);
+    if (dst.Init(size))
+        return true;
 
-    // bottom row middle pixels
-    for (int x = 1; x <= RW - 2; x++)
+    wxRect area(size);
+    if (!src.Subframe.IsEmpty())
     {
-        a[0] = src[IX(x - 1, RH - 2)];
-        a[1] = src[IX(x    , RH - 2)];
-        a[2] = src[IX(x + 1, RH - 2)];
-        a[3] = src[IX(x - 1, RH - 1)];
-        a[4] = src[IX(x    , RH - 1)];
-        a[5] = src[IX(x + 1, RH - 1)];
-        *d++ = median6(a);
+        // the bins touched by the subframe
+        int x0 = src.Subframe.GetLeft() / factor;
+        int y0 = src.Subframe.GetTop() / factor;
+        int x1 = (src.Subframe.GetRight() + factor) / factor;
+        int y1 = (src.Subframe.GetBottom() + factor) / factor;
+        area = wxRect(wxPoint(x0, y0), wxPoint(x1 - 1, y1 - 1)).Intersect(wxRect(size));
+        if (area.IsEmpty())
+            return true;
+        dst.InitSubframe(area);
     }
 
-    // bottom-right corner
-    a[0] = src[IX(RW - 2, RH - 2)];
-    a[1] = src[IX(RW - 1, RH - 2)];
-    a[2] = src[IX(RW - 2, RH - 1)];
-    a[3] = src[IX(RW - 1, RH - 1)];
-    *d = median4(a);
+    SoftwareBinJob job(dst, src, factor, mean, area.GetLeft(), area.GetRight() + 1);
+    RunRowBands(job, RowBandCount(area.GetHeight()), area.GetTop(), area.GetBottom() + 1);
 
-#undef IX
+    int const n = factor * factor;
+
+    dst.BinFactor = src.BinFactor * factor;
+    dst.ImgStartTime = src.ImgStartTime;
+    dst.ImgExposureStart = src.ImgExposureStart;
+    dst.ImgExpDur = src.ImgExpDur;
+    dst.ImgStackCnt = src.ImgStackCnt;
+    if (mean)
+    {
+        dst.BitsPerPixel = src.BitsPerPixel;
+        dst.Pedestal = src.Pedestal;
+    }
+    else
+    {
+        int extraBits = 0;
+        while ((1 << extraBits) < n)
+            ++extraBits;
+        dst.BitsPerPixel = (wxByte) std::min(16, src.BitsPerPixel + extraBits);
+        dst.Pedestal = (unsigned short) std::min(65535, src.Pedestal * n);
+    }
 
     return false;
 }
 
-static unsigned short MedianBorderingPixels(const usImage& img, int x, int y)
+ScaledDark::ScaledDark()
+    : m_darkCount(0),
+      m_minExp(0),
+      m_maxExp(0)
 {
-    unsigned short array[8];
-    int const xsize = img.Size.GetWidth();
-    int const ysize = img.Size.GetHeight();
+}
 
-    if (x > 0 && y > 0 && x < xsize - 1 && y < ysize - 1)
-    {
-        array[0] = img.ImageData[(x-1) + (y-1) * xsize];
-        array[1] = img.ImageData[(x)   + (y-1) * xsize];
-        array[2] = img.ImageData[(x+1) + (y-1) * xsize];
-        array[3] = img.ImageData[(x-1) + (y)   * xsize];
-        array[4] = img.ImageData[(x+1) + (y)   * xsize];
-        array[5] = img.ImageData[(x-1) + (y+1) * xsize];
-        array[6] = img.ImageData[(x)   + (y+1) * xsize];
-        array[7] = img.ImageData[(x+1) + (y+1) * xsize];
-        return median8(array);
-    }
+bool ScaledDark::Init(const wxSize& size, int darkCount, int minExp, int maxExp)
+{
+    int npixels = size.GetWidth() * size.GetHeight();
+    if (npixels <= 0)
+        return true;
 
-    if (x == 0 && y > 0 && y < ysize - 1)
-    {
-        // On left edge
-        array[0] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x + 1) + (y - 1) * xsize];
-        array[3] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x + 1) + (y + 1) * xsize];
-        return median5(array);
-    }
+    m_size = size;
+    m_bias.assign(npixels, 0);
+    m_rate.assign(npixels, 0.f);
+    m_darkCount = darkCount;
+    m_minExp = minExp;
+    m_maxExp = maxExp;
 
-    if (x == xsize - 1 && y > 0 && y < ysize - 1)
-    {
-        // On right edge
-        array[0] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x - 1) + (y - 1) * xsize];
-        array[3] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x - 1) + (y + 1) * xsize];
-        return median5(array);
-    }
+    return false;
+}
 
-    if (y == 0 && x > 0 && x < xsize - 1)
+class ScaledDarkFitJob : public RowBandJob
+{
+    ScaledDark& m_model;
+    std::vector<const unsigned short *> m_darks;
+    std::vector<float> m_dt;    // exposure time minus the mean exposure time, seconds
+    float m_tmean;
+    float m_denom;
+
+public:
+    ScaledDarkFitJob(ScaledDark& model, const std::vector<const usImage *>& darks)
+        : m_model(model)
     {
-        // On bottom edge
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x - 1) + (y + 1) * xsize];
-        array[2] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[3] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x + 1) + (y + 1) * xsize];
-        return median5(array);
-    }
+        m_tmean = 0.f;
+        for (size_t k = 0; k < darks.size(); k++)
+        {
+            m_darks.push_back(darks[k]->ImageData);
+            m_tmean += darks[k]->ImgExpDur / 1000.f;
+        }
+        m_tmean /= darks.size();
 
-    if (y == ysize - 1 && x > 0 && x < xsize - 1)
-    {
-        // On top edge
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x - 1) + (y - 1) * xsize];
-        array[2] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[3] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[4] = img.ImageData[(x + 1) + (y - 1) * xsize];
-        return median5(array);
+        m_denom = 0.f;
+        for (size_t k = 0; k < darks.size(); k++)
+        {
+            float dt = darks[k]->ImgExpDur / 1000.f - m_tmean;
+            m_dt.push_back(dt);
+            m_denom += dt * dt;
+        }
     }
 
-    if (x == 0 && y == 0)
-    {
-        // At lower left corner
-        array[0] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x + 1) + (y + 1) * xsize];
-    }
-    else if (x == 0 && y == ysize - 1)
+    // least squares line through the pixel values of the darks
+    void Run(int band, int y0, int y1)
     {
-        // At upper left corner
-        array[0] = img.ImageData[(x + 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[2] = img.ImageData[(x + 1) + (y - 1) * xsize];
+        int const w = m_model.Size().GetWidth();
+        size_t const K = m_darks.size();
+        unsigned short *bias = m_model.BiasData();
+        float *rate = m_model.RateData();
+
+        for (int i = y0 * w; i < y1 * w; i++)
+        {
+            float sum = 0.f, sxy = 0.f;
+            for (size_t k = 0; k < K; k++)
+            {
+                float y = m_darks[k][i];
+                sum += y;
+                sxy += m_dt[k] * y;
+            }
+            float r = sxy / m_denom;
+            float b = sum / K - r * m_tmean;
+            if (b < 0.f) b = 0.f;
+            else if (b > 65535.f) b = 65535.f;
+            bias[i] = (unsigned short)(int)(b + 0.5f);
+            rate[i] = r;
+        }
     }
-    else if (x == xsize - 1 && y == ysize - 1)
+};
+
+// Fits the model to master darks of at least two different exposure times.
+// Returns NULL if the darks cannot be fitted.
+ScaledDark *ScaledDark::Fit(const std::vector<const usImage *>& darks)
+{
+    if (darks.size() < 2)
+        return NULL;
+
+    int minExp = darks[0]->ImgExpDur;
+    int maxExp = minExp;
+    for (size_t k = 1; k < darks.size(); k++)
     {
-        // At upper right corner
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y - 1) * xsize];
-        array[2] = img.ImageData[(x - 1) + (y - 1) * xsize];
+        if (darks[k]->Size != darks[0]->Size)
+        {
+            Debug.Write("ScaledDark: dark frames have different sizes\n");
+            return NULL;
+        }
+        minExp = std::min(minExp, darks[k]->ImgExpDur);
+        maxExp = std::max(maxExp, darks[k]->ImgExpDur);
     }
-    else if (x == xsize - 1 && y == 0)
+    if (minExp == maxExp)
     {
-        // At lower right corner
-        array[0] = img.ImageData[(x - 1) + (y)     * xsize];
-        array[1] = img.ImageData[(x)     + (y + 1) * xsize];
-        array[2] = img.ImageData[(x - 1) + (y + 1) * xsize];
+        Debug.Write("ScaledDark: need darks of at least two exposure times\n");
+        return NULL;
     }
-    else
+
+    ScaledDark *model = new ScaledDark();
+    if (model->Init(darks[0]->Size, (int) darks.size(), minExp, maxExp))
     {
-        // unreachable
-        return 0;
+        delete model;
+        return NULL;
     }
 
-    return median3(array);
+    ScaledDarkFitJob job(*model, darks);
+    int const h = model->Size().GetHeight();
+    RunRowBands(job, RowBandCount(h), 0, h);
+
+    return model;
 }
 
-bool SquarePixels(usImage& img, float xsize, float ysize)
+class ScaledDarkJob : public RowBandJob
 {
-    // Stretches one dimension to square up pixels
-    if (!img.ImageData)
-        return true;
+    const ScaledDark& m_model;
+    unsigned short *m_dst;
+    float m_t;
 
-    if (xsize <= ysize)
-        return false;
+public:
+    ScaledDarkJob(const ScaledDark& model, unsigned short *dst, float t) : m_model(model), m_dst(dst), m_t(t) { }
 
-    // Move the existing data to a temp image
-    usImage tempimg;
-    if (tempimg.Init(img.Size))
+    void Run(int band, int y0, int y1)
     {
-        pFrame->Alert(_("Memory allocation error"));
-        return true;
+        int const w = m_model.Size().GetWidth();
+        int const ofs = y0 * w;
+        Kernels().scaledDarkRow(m_dst + ofs, m_model.BiasData() + ofs, m_model.RateData() + ofs, (y1 - y0) * w, m_t);
     }
-    tempimg.SwapImageData(img);
+};
 
-    // if X > Y, when viewing stock, Y is unnaturally stretched, so stretch X to match
-    double ratio = ysize / xsize;
-    int newsize = ROUND((double) tempimg.Size.GetWidth() / ratio);  // make new image correct size
-    img.Init(newsize,tempimg.Size.GetHeight());
-    unsigned short *optr = img.ImageData;
-    int linesize = tempimg.Size.GetWidth();  // size of an original line
-    for (int y = 0; y < img.Size.GetHeight(); y++)
-    {
-        for (int x = 0; x < newsize; x++, optr++)
-        {
-            double oldposition = x * ratio;
-            int ind1 = (unsigned int) floor(oldposition);
-            int ind2 = (unsigned int) ceil(oldposition);
-            if (ind2 > (tempimg.Size.GetWidth() - 1))
-                ind2 = tempimg.Size.GetWidth() - 1;
-            double weight = ceil(oldposition) - oldposition;
-            *optr = (unsigned short) (((float) *(tempimg.ImageData + y*linesize + ind1) * weight) + ((float) *(tempimg.ImageData + y*linesize + ind1) * (1.0 - weight)));
-        }
-    }
+// Makes the dark frame for the given exposure time, returns true on error
+bool ScaledDark::MakeDark(usImage& dark, int expTime) const
+{
+    if (m_bias.empty() || dark.Init(m_size))
+        return true;
 
+    ScaledDarkJob job(*this, dark.ImageData, expTime / 1000.f);
+    int const h = m_size.GetHeight();
+    RunRowBands(job, RowBandCount(h), 0, h);
+
+    dark.ImgExpDur = expTime;
     return false;
 }
 
@@ -592,29 +553,22 @@ bool Subtract(usImage& light, const usImage& dark)
         height = light.Size.GetHeight();
     }
 
-    int mindiff = 65535;
+    const ImageKernels& k = Kernels();
+
+    // largest amount by which the dark is brighter than the light
+    unsigned short offset = 0;
 
     unsigned short *pl0 = &light.Pixel(left, top);
     const unsigned short *pd0 = &dark.Pixel(left, top);
     for (unsigned int r = 0; r < height;
          r++, pl0 += light.Size.GetWidth(), pd0 += light.Size.GetWidth())
     {
-        unsigned short *const endl = pl0 + width;
-        unsigned short *pl;
-        const unsigned short *pd;
-        for (pl = pl0, pd = pd0; pl < endl; pl++, pd++)
-        {
-            int diff = (int) *pl - (int) *pd;
-            if (diff < mindiff)
-                mindiff = diff;
-        }
+        offset = k.maxDeficit(pl0, pd0, width, offset);
     }
 
-    int offset = 0;
-    if (mindiff < 0) // dark was lighter than light
+    if (offset > 0) // dark was lighter than light
     {
-        offset = -mindiff;
-        light.Pedestal = (unsigned short) offset;
+        light.Pedestal = offset;
     }
 
     pl0 = &light.Pixel(left, top);
@@ -622,168 +576,244 @@ bool Subtract(usImage& light, const usImage& dark)
     for (unsigned int r = 0; r < height;
          r++, pl0 += light.Size.GetWidth(), pd0 += light.Size.GetWidth())
     {
-        unsigned short *const endl = pl0 + width;
-        unsigned short *pl;
-        const unsigned short *pd;
-        for (pl = pl0, pd = pd0; pl < endl; pl++, pd++)
-        {
-            int newval = (int) *pl - (int) *pd + offset;
-            if (newval < 0) newval = 0; // shouldn't hit this...
-            else if (newval > 65535) newval = 65535;
-            *pl = (unsigned short) newval;
-        }
+        k.subtractRow(pl0, pd0, width, offset);
     }
 
     return false;
 }
 
-inline static unsigned short histo_median(unsigned short histo1[256], unsigned short histo2[65536], int n)
+// Histogram of the pixels in a moving window. The median is found by walking
+// from the previous median, which moves little from one window to the next.
+struct MedianHisto
 {
-    n /= 2;
-    unsigned int i;
-    for (i = 0; i < 256; i++)
+    unsigned short histo1[256];         // coarse histogram, to skip empty runs of values
+    std::vector<unsigned short> histo2;
+    unsigned int n;
+    unsigned int pos;                   // previous median
+    unsigned int below;                 // number of pixels less than pos
+
+    MedianHisto() : histo2(65536, 0), n(0), pos(0), below(0) { memset(&histo1[0], 0, sizeof(histo1)); }
+
+    void Add(const unsigned short *p, int count, int stride)
     {
-        if (histo1[i] > n)
-            break;
-        n -= histo1[i];
+        for (int i = 0; i < count; i++, p += stride)
+        {
+            ++histo1[*p >> 8];
+            ++histo2[*p];
+            if (*p < pos)
+                ++below;
+        }
+        n += count;
     }
-    for (i <<= 8; i < 65536; i++)
+
+    void Remove(const unsigned short *p, int count, int stride)
     {
-        if (histo2[i] > n)
-            break;
-        n -= histo2[i];
+        for (int i = 0; i < count; i++, p += stride)
+        {
+            --histo1[*p >> 8];
+            --histo2[*p];
+            if (*p < pos)
+                --below;
+        }
+        n -= count;
     }
-    return i;
-}
 
-static void MedianFilter(usImage& dst, const usImage& src, int halfWidth)
+    unsigned short Median()
+    {
+        unsigned int const k = n / 2;
+
+        // move down until no more than k pixels are below pos
+        while (below > k)
+        {
+            if ((pos & 255) == 0 && below - histo1[(pos >> 8) - 1] > k)
+            {
+                below -= histo1[(pos >> 8) - 1];
+                pos -= 256;
+            }
+            else
+                below -= histo2[--pos];
+        }
+
+        // move up until pos is the value of rank k
+        while (below + histo2[pos] <= k)
+        {
+            if ((pos & 255) == 0 && below + histo1[pos >> 8] <= k)
+            {
+                below += histo1[pos >> 8];
+                pos += 256;
+            }
+            else
+                below += histo2[pos++];
+        }
+
+        return pos;
+    }
+};
+
+// Median filter over a square window, clipped at the edges of the image. Each
+// band of rows is scanned in a serpentine, left to right then right to left,
+// so the histogram of the window is only built once per band.
+class MedianFilterJob : public RowBandJob
 {
-    dst.Init(src.Size);
-    unsigned short *d = &dst.ImageData[0];
+    usImage& m_dst;
+    const usImage& m_src;
+    int m_halfWidth;
 
-    int const width = src.Size.GetWidth();
-    int const height = src.Size.GetHeight();
+public:
+    MedianFilterJob(usImage& dst, const usImage& src, int halfWidth) : m_dst(dst), m_src(src), m_halfWidth(halfWidth) { }
 
-    for (int y = 0; y < height; y++)
+    void Run(int band, int y0, int y1)
     {
-        int top = std::max(0, y - halfWidth);
-        int bot = std::min(y + halfWidth, height - 1);
-        int left = 0;
-        int right = halfWidth;
+        int const width = m_src.Size.GetWidth();
+        int const height = m_src.Size.GetHeight();
+        int const hw = m_halfWidth;
 
-        // TODO: we initialize the histogram at the start of each row, but we could make this faster
-        // if we scan left to right, move down, scan right to left, move down so we never need to
-        // reinitialize the histogram
-
-        // initialize 2-level histogram
-        unsigned short histo1[256];
-        unsigned short histo2[65536];
-        memset(&histo1[0], 0, sizeof(histo1));
-        memset(&histo2[0], 0, sizeof(histo2));
+        MedianHisto histo;
 
+        // window of the first pixel of the band
+        int top = std::max(0, y0 - hw);
+        int bot = std::min(y0 + hw, height - 1);
+        int left = 0;
+        int right = std::min(hw, width - 1);
         for (int j = top; j <= bot; j++)
+            histo.Add(&m_src.Pixel(left, j), right - left + 1, 1);
+
+        int x = 0;
+        for (int y = y0; y < y1; y++)
         {
-            const unsigned short *p = &src.Pixel(left, j);
-            for (int i = left; i <= right; i++, p++)
+            if (y > y0)
             {
-                ++histo1[*p >> 8];
-                ++histo2[*p];
+                // move the window down a row
+                if (y - hw - 1 >= 0)
+                    histo.Remove(&m_src.Pixel(left, y - hw - 1), right - left + 1, 1);
+                if (y + hw <= height - 1)
+                    histo.Add(&m_src.Pixel(left, y + hw), right - left + 1, 1);
+                top = std::max(0, y - hw);
+                bot = std::min(y + hw, height - 1);
             }
-        }
-        unsigned int n = (right - left + 1) * (bot - top + 1);
 
-        // read off first value for this row
-        *d++ = histo_median(histo1, histo2, n);
+            int const rows = bot - top + 1;
+            unsigned short *d = &m_dst.Pixel(x, y);
+            *d = histo.Median();
 
-        // loop across remaining columns for this row
-        for (int i = 1; i < width; i++)
-        {
-            left = std::max(0, i - halfWidth);
-            right = std::min(i + halfWidth, width - 1);
-
-            // remove leftmost column
-            if (left > 0)
+            if (((y - y0) & 1) == 0)
             {
-                const unsigned short *p = &src.Pixel(left - 1, top);
-                for (int j = top; j <= bot; j++, p += width)
+                // left to right
+                for (x = x + 1; x < width; x++)
                 {
-                    --histo1[*p >> 8];
-                    --histo2[*p];
+                    if (x - hw - 1 >= 0)
+                        histo.Remove(&m_src.Pixel(x - hw - 1, top), rows, width);
+                    if (x + hw <= width - 1)
+                        histo.Add(&m_src.Pixel(x + hw, top), rows, width);
+                    *++d = histo.Median();
                 }
-                n -= (bot - top + 1);
+                x = width - 1;
             }
-
-            // add new column on right
-            if (i + halfWidth <= width - 1)
+            else
             {
-                const unsigned short *p = &src.Pixel(right, top);
-                for (int j = top; j <= bot; j++, p += width)
+                // right to left
+                for (x = x - 1; x >= 0; x--)
                 {
-                    ++histo1[*p >> 8];
-                    ++histo2[*p];
+                    if (x + hw + 1 <= width - 1)
+                        histo.Remove(&m_src.Pixel(x + hw + 1, top), rows, width);
+                    if (x - hw >= 0)
+                        histo.Add(&m_src.Pixel(x - hw, top), rows, width);
+                    *--d = histo.Median();
                 }
-                n += (bot - top + 1);
+                x = 0;
             }
-
-            *d++ = histo_median(histo1, histo2, n);
+            left = std::max(0, x - hw);
+            right = std::min(x + hw, width - 1);
         }
     }
-}
+};
 
-struct ImageStatsWork
+static void MedianFilter(usImage& dst, const usImage& src, int halfWidth)
 {
-    ImageStats stats;
-    usImage temp;
-};
+    dst.Init(src.Size);
 
-static void GetImageStats(ImageStatsWork& w, const usImage& img, const wxRect& win)
+    MedianFilterJob job(dst, src, halfWidth);
+    int const height = src.Size.GetHeight();
+    RunRowBands(job, RowBandCount(height), 0, height);
+}
+
+// Histogram of the pixel values in a window, counted in bands of rows
+class HistogramJob : public RowBandJob
 {
-    w.temp.Init(img.Size);
+    const usImage& m_img;
+    wxRect m_win;
+    std::vector<std::vector<unsigned int> > m_histos;
 
-    // Determine the mean and standard deviation
-    double sum = 0.0;
-    double a = 0.0;
-    double q = 0.0;
-    double k = 1.0;
-    double km1 = 0.0;
+public:
+    HistogramJob(const usImage& img, const wxRect& win, int nbands) : m_img(img), m_win(win), m_histos(nbands) { }
 
-    const unsigned short *p0 = &img.Pixel(win.GetLeft(), win.GetTop());
-    unsigned short *dst = &w.temp.ImageData[0];
-    for (int y = 0; y < win.GetHeight(); y++)
+    void Run(int band, int y0, int y1)
     {
-        const unsigned short *end = p0 + win.GetWidth();
-        for (const unsigned short *p = p0; p < end; p++)
+        std::vector<unsigned int>& histo = m_histos[band];
+        histo.assign(65536, 0);
+        for (int y = y0; y < y1; y++)
         {
-            *dst++ = *p;
-            double const x = (double) *p;
-            sum += x;
-            double const a0 = a;
-            a += (x - a) / k;
-            q += (x - a0) * (x - a);
-            km1 = k;
-            k += 1.0;
+            const unsigned short *p = &m_img.Pixel(m_win.GetLeft(), y);
+            const unsigned short *end = p + m_win.GetWidth();
+            for (; p < end; p++)
+                ++histo[*p];
         }
-        p0 += img.Size.GetWidth();
     }
 
-    w.stats.mean = sum / km1;
-    w.stats.stdev = sqrt(q / km1);
+    void Merge(std::vector<unsigned int>& histo) const
+    {
+        histo.assign(65536, 0);
+        for (size_t b = 0; b < m_histos.size(); b++)
+            for (int v = 0; v < 65536; v++)
+                histo[v] += m_histos[b][v];
+    }
+};
+
+// value of rank k (counting from 0) in a histogram
+static unsigned short HistoRank(const std::vector<unsigned int>& histo, unsigned int k)
+{
+    unsigned int v;
+    for (v = 0; v < 65535; v++)
+    {
+        if (histo[v] > k)
+            break;
+        k -= histo[v];
+    }
+    return v;
+}
+
+static void GetImageStats(ImageStats& stats, const usImage& img, const wxRect& win)
+{
+    int const nbands = RowBandCount(win.GetHeight());
+    HistogramJob job(img, win, nbands);
+    RunRowBands(job, nbands, win.GetTop(), win.GetBottom() + 1);
 
-    int winPixels = win.GetWidth() * win.GetHeight();
-    unsigned short *tmp = &w.temp.ImageData[0];
-    std::nth_element(tmp, tmp + winPixels / 2, tmp + winPixels);
+    std::vector<unsigned int> histo;
+    job.Merge(histo);
 
-    w.stats.median = tmp[winPixels / 2];
+    unsigned int const winPixels = win.GetWidth() * win.GetHeight();
 
-    // replace each pixel with the absolute deviation from the median
-    unsigned short *p = tmp;
-    for (int i = 0; i < winPixels; i++)
+    // Determine the mean and standard deviation
+    double sum = 0.0;
+    for (int v = 0; v < 65536; v++)
+        sum += (double) v * histo[v];
+    stats.mean = sum / winPixels;
+
+    double q = 0.0;
+    for (int v = 0; v < 65536; v++)
     {
-        unsigned short ad = (unsigned short) std::abs((int) *p - (int) w.stats.median);
-        *p++ = ad;
+        double const d = (double) v - stats.mean;
+        q += d * d * histo[v];
     }
-    std::nth_element(tmp, tmp + winPixels / 2, tmp + winPixels);
-    w.stats.mad = tmp[winPixels / 2];
+    stats.stdev = sqrt(q / winPixels);
+
+    stats.median = HistoRank(histo, winPixels / 2);
+
+    // histogram of the absolute deviations from the median
+    std::vector<unsigned int> adHisto(65536, 0);
+    for (int v = 0; v < 65536; v++)
+        adHisto[std::abs(v - (int) stats.median)] += histo[v];
+    stats.mad = HistoRank(adHisto, winPixels / 2);
 }
 
 void DefectMapDarks::BuildFilteredDark()
@@ -827,30 +857,111 @@ void DefectMapDarks::LoadDarks()
     filteredDark.Load(DefectMapFilterPath());
 }
 
-struct BadPx
+// Pixels of the master dark that deviate from the median filtered dark by more
+// than the lowest threshold, in ascending order of deviation, so the pixels
+// over any higher threshold are a tail of the list
+struct DefectCandidates
 {
-    unsigned short x;
-    unsigned short y;
-    int v;
+    std::vector<unsigned int> px;       // pixel indexes
+    std::vector<unsigned int> start;    // start[v] = position of the first pixel deviating by v or more
 
-    BadPx();
-    BadPx(int x_, int y_, int v_) : x(x_), y(y_), v(v_) { }
-    bool operator<(const BadPx& rhs) const { return v < rhs.v; }
+    unsigned int Begin(int thresh) const
+    {
+        if (start.empty())
+            return 0;
+        return start[std::max(0, std::min(thresh, 65536))];
+    }
 };
 
-typedef std::set<BadPx> BadPxSet;
+// Collects the candidates in bands of rows with a counting sort: the first
+// pass counts the pixels of each band by deviation, the second pass puts them
+// in place, in raster order within each deviation
+class DefectScanJob : public RowBandJob
+{
+    const usImage& m_dark;
+    const usImage& m_filt;
+    int m_thresh;
+    DefectCandidates& m_cold;
+    DefectCandidates& m_hot;
+    std::vector<std::vector<unsigned int> > m_coldPos; // per band, count per deviation, then next position
+    std::vector<std::vector<unsigned int> > m_hotPos;
+    bool m_place;
+
+    static void Place(DefectCandidates& c, std::vector<std::vector<unsigned int> >& pos)
+    {
+        c.start.resize(65537);
+        unsigned int total = 0;
+        for (int v = 0; v < 65536; v++)
+        {
+            c.start[v] = total;
+            for (size_t b = 0; b < pos.size(); b++)
+            {
+                unsigned int const n = pos[b][v];
+                pos[b][v] = total;
+                total += n;
+            }
+        }
+        c.start[65536] = total;
+        c.px.resize(total);
+    }
+
+public:
+    DefectScanJob(const usImage& dark, const usImage& filt, int thresh, DefectCandidates& cold, DefectCandidates& hot, int nbands)
+        : m_dark(dark), m_filt(filt), m_thresh(thresh), m_cold(cold), m_hot(hot),
+          m_coldPos(nbands), m_hotPos(nbands), m_place(false)
+    { }
+
+    void Run(int band, int y0, int y1)
+    {
+        if (!m_place)
+        {
+            m_coldPos[band].assign(65536, 0);
+            m_hotPos[band].assign(65536, 0);
+        }
+        unsigned int *coldPos = &m_coldPos[band][0];
+        unsigned int *hotPos = &m_hotPos[band][0];
+
+        int const width = m_dark.Size.GetWidth();
+        for (int i = y0 * width; i < y1 * width; i++)
+        {
+            int v = (int) m_dark.ImageData[i] - (int) m_filt.ImageData[i];
+            if (v > m_thresh)
+            {
+                if (m_place)
+                    m_hot.px[hotPos[v]++] = i;
+                else
+                    ++hotPos[v];
+            }
+            else if (-v > m_thresh)
+            {
+                if (m_place)
+                    m_cold.px[coldPos[-v]++] = i;
+                else
+                    ++coldPos[-v];
+            }
+        }
+    }
+
+    // after counting, turn the counts into positions for the second pass
+    void Place()
+    {
+        Place(m_cold, m_coldPos);
+        Place(m_hot, m_hotPos);
+        m_place = true;
+    }
+};
 
 struct DefectMapBuilderImpl
 {
     DefectMapDarks *darks;
-    ImageStatsWork w;
+    ImageStats stats;
     wxArrayString mapInfo;
     int aggrCold;
     int aggrHot;
-    BadPxSet coldPx;
-    BadPxSet hotPx;
-    BadPxSet::const_iterator coldPxThresh;
-    BadPxSet::const_iterator hotPxThresh;
+    DefectCandidates coldPx;
+    DefectCandidates hotPx;
+    unsigned int coldPxThresh;
+    unsigned int hotPxThresh;
     unsigned int coldPxSelected;
     unsigned int hotPxSelected;
     bool threshValid;
@@ -886,10 +997,10 @@ void DefectMapBuilder::Init(DefectMapDarks& darks)
 
     Debug.AddLine("DefectMapBuilder: Init");
 
-    ::GetImageStats(m_impl->w, darks.masterDark,
+    ::GetImageStats(m_impl->stats, darks.masterDark,
         wxRect(0, 0, darks.masterDark.Size.GetWidth(), darks.masterDark.Size.GetHeight()));
 
-    const ImageStats& stats = m_impl->w.stats;
+    const ImageStats& stats = m_impl->stats;
 
     Debug.Write(wxString::Format("DefectMapBuilder: Dark N = %d Mean = %.f Median = %d Standard Deviation = %.f MAD=%d\n",
                                  darks.masterDark.NPixels, stats.mean, stats.median, stats.stdev, stats.mad));
@@ -903,33 +1014,23 @@ void DefectMapBuilder::Init(DefectMapDarks& darks)
     usImage& dark = m_impl->darks->masterDark;
     usImage& medianFilt = m_impl->darks->filteredDark;
 
-    m_impl->coldPx.clear();
-    m_impl->hotPx.clear();
+    // the thresholds of all aggressiveness settings are found in these lists,
+    // so they are only built once
+    int const height = dark.Size.GetHeight();
+    int const nbands = RowBandCount(height);
+    DefectScanJob job(dark, medianFilt, thresh, m_impl->coldPx, m_impl->hotPx, nbands);
+    RunRowBands(job, nbands, 0, height);
+    job.Place();
+    RunRowBands(job, nbands, 0, height);
 
-    for (int y = 0; y < dark.Size.GetHeight(); y++)
-    {
-        for (int x = 0; x < dark.Size.GetWidth(); x++)
-        {
-            int filt = (int) medianFilt.Pixel(x, y);
-            int val = (int) dark.Pixel(x, y);
-            int v = val - filt;
-            if (v > thresh)
-            {
-                m_impl->hotPx.insert(BadPx(x, y, v));
-            }
-            else if (-v > thresh)
-            {
-                m_impl->coldPx.insert(BadPx(x, y, -v));
-            }
-        }
-    }
+    m_impl->threshValid = false;
 
-    Debug.Write(wxString::Format("DefectMapBuilder: Loaded %d cold %d hot\n", m_impl->coldPx.size(), m_impl->hotPx.size()));
+    Debug.Write(wxString::Format("DefectMapBuilder: Loaded %d cold %d hot\n", m_impl->coldPx.px.size(), m_impl->hotPx.px.size()));
 }
 
 const ImageStats& DefectMapBuilder::GetImageStats() const
 {
-    return m_impl->w.stats;
+    return m_impl->stats;
 }
 
 void DefectMapBuilder::SetAggressiveness(int aggrCold, int aggrHot)
@@ -947,17 +1048,17 @@ static void FindThresh(DefectMapBuilderImpl *impl)
     double multCold = AggrToSigma(impl->aggrCold);
     double multHot = AggrToSigma(impl->aggrHot);
 
-    int coldThresh = (int) (multCold * impl->w.stats.stdev);
-    int hotThresh = (int) (multHot * impl->w.stats.stdev);
+    int coldThresh = (int) (multCold * impl->stats.stdev);
+    int hotThresh = (int) (multHot * impl->stats.stdev);
 
     Debug.Write(wxString::Format("DefectMap: find thresholds aggr:(%d,%d) sigma:(%.1f,%.1f) px:(%+d,%+d)\n",
                                  impl->aggrCold, impl->aggrHot, multCold, multHot, -coldThresh, hotThresh));
 
-    impl->coldPxThresh = impl->coldPx.lower_bound(BadPx(0, 0, coldThresh));
-    impl->hotPxThresh = impl->hotPx.lower_bound(BadPx(0, 0, hotThresh));
+    impl->coldPxThresh = impl->coldPx.Begin(coldThresh);
+    impl->hotPxThresh = impl->hotPx.Begin(hotThresh);
 
-    impl->coldPxSelected = std::distance(impl->coldPxThresh, impl->coldPx.end());
-    impl->hotPxSelected = std::distance(impl->hotPxThresh, impl->hotPx.end());
+    impl->coldPxSelected = impl->coldPx.px.size() - impl->coldPxThresh;
+    impl->hotPxSelected = impl->hotPx.px.size() - impl->hotPxThresh;
 
     Debug.Write(wxString::Format("DefectMap: find thresholds found (%d,%d)\n", impl->coldPxSelected, impl->hotPxSelected));
 
@@ -976,17 +1077,21 @@ int DefectMapBuilder::GetHotPixelCnt() const
     return m_impl->hotPxSelected;
 }
 
-inline static unsigned int emit_defects(DefectMap& defectMap, BadPxSet::const_iterator p0, BadPxSet::const_iterator p1, double stdev, int sign, bool verbose)
+inline static unsigned int emit_defects(DefectMap& defectMap, const DefectCandidates& c, unsigned int begin, const DefectMapDarks& darks, double stdev, bool verbose)
 {
+    int const width = darks.masterDark.Size.GetWidth();
     unsigned int cnt = 0;
-    for (BadPxSet::const_iterator it = p0; it != p1; ++it, ++cnt)
+    for (unsigned int k = begin; k < c.px.size(); k++, cnt++)
     {
+        unsigned int const i = c.px[k];
+        int const x = i % width;
+        int const y = i / width;
         if (verbose)
         {
-            int v = sign * it->v;
-            Debug.Write(wxString::Format("DefectMap: defect @ (%d, %d) val = %d (%+.1f sigma)\n", it->x, it->y, v, stdev > 0.1 ? (double)v / stdev : 0.0));
+            int v = (int) darks.masterDark.ImageData[i] - (int) darks.filteredDark.ImageData[i];
+            Debug.Write(wxString::Format("DefectMap: defect @ (%d, %d) val = %d (%+.1f sigma)\n", x, y, v, stdev > 0.1 ? (double)v / stdev : 0.0));
         }
-        defectMap.push_back(wxPoint(it->x, it->y));
+        defectMap.push_back(wxPoint(x, y));
     }
     return cnt;
 }
@@ -997,7 +1102,7 @@ void DefectMapBuilder::BuildDefectMap(DefectMap& defectMap, bool verbose) const
 
     double multCold = AggrToSigma(m_impl->aggrCold);
     double multHot = AggrToSigma(m_impl->aggrHot);
-    const ImageStats& stats = m_impl->w.stats;
+    const ImageStats& stats = m_impl->stats;
 
     info.Clear();
     info.push_back(wxString::Format("Generated: %s", wxDateTime::UNow().FormatISOCombined(' ')));
@@ -1024,8 +1129,10 @@ void DefectMapBuilder::BuildDefectMap(DefectMap& defectMap, bool verbose) const
     FindThresh(m_impl);
 
     defectMap.clear();
-    unsigned int nr_cold = emit_defects(defectMap, m_impl->coldPxThresh, m_impl->coldPx.end(), stats.stdev, -1, verbose);
-    unsigned int nr_hot = emit_defects(defectMap, m_impl->hotPxThresh, m_impl->hotPx.end(), stats.stdev, +1, verbose);
+    defectMap.reserve(m_impl->coldPxSelected + m_impl->hotPxSelected);
+    unsigned int nr_cold = emit_defects(defectMap, m_impl->coldPx, m_impl->coldPxThresh, *m_impl->darks, stats.stdev, verbose);
+    unsigned int nr_hot = emit_defects(defectMap, m_impl->hotPx, m_impl->hotPxThresh, *m_impl->darks, stats.stdev, verbose);
+    defectMap.BuildIndex();
 
     if (verbose) Debug.Write(wxString::Format("New defect map created, count=%d (cold=%d, hot=%d)\n", defectMap.size(), nr_cold, nr_hot));
 }
@@ -1041,35 +1148,30 @@ bool RemoveDefects(usImage& light, const DefectMap& defectMap)
     if (!light.ImageData)
         return true;
 
+    DefectFixer fixer(light.ImageData, light.Size.GetWidth(), light.Size.GetHeight());
+    if (!fixer.CanFix())
+        return false;
+
+    wxRect area(light.Size);
     if (!light.Subframe.IsEmpty())
+        area.Intersect(light.Subframe);
+
+    if (!defectMap.IsIndexed())
     {
-        // Step over each defect and replace the light value
-        // with the median of the surrounding pixels
+        // the points were changed without rebuilding the index
         for (DefectMap::const_iterator it = defectMap.begin(); it != defectMap.end(); ++it)
         {
-            const wxPoint& pt = *it;
-            // Check to see if we are within the subframe before correcting the defect
-            if (light.Subframe.Contains(pt))
-            {
-                light.Pixel(pt.x, pt.y) = MedianBorderingPixels(light, pt.x, pt.y);
-            }
+            if (area.Contains(*it))
+                fixer.Fix(it->x, it->y);
         }
+        return false;
     }
-    else
-    {
-        // Step over each defect and replace the light value
-        // with the median of the surrounding pixels
-        for (DefectMap::const_iterator it = defectMap.begin(); it != defectMap.end(); ++it)
-        {
-            int const x = it->x;
-            int const y = it->y;
 
-            if (x >= 0 && x < light.Size.GetWidth() && y >= 0 && y < light.Size.GetHeight())
-            {
-                light.Pixel(x, y) = MedianBorderingPixels(light, x, y);
-            }
-        }
-    }
+    // Step over the defects on each row of the subframe and replace the light
+    // value with the median of the surrounding pixels
+    int const y1 = std::min(area.GetBottom(), defectMap.IndexedRows() - 1);
+    for (int y = area.GetTop(); y <= y1; y++)
+        fixer.FixRow(y, defectMap.RowBegin(y), defectMap.RowEnd(y), area.GetLeft(), area.GetRight());
 
     return false;
 }
@@ -1186,24 +1288,68 @@ void DefectMap::Save(const wxArrayString& info) const
 }
 
 DefectMap::DefectMap()
-    : m_profileId(pConfig->GetCurrentProfileId())
+    : m_profileId(pConfig->GetCurrentProfileId()),
+      m_indexedCount(0)
 {
 }
 
 DefectMap::DefectMap(int profileId)
-    : m_profileId(profileId)
+    : m_profileId(profileId),
+      m_indexedCount(0)
+{
+}
+
+inline static bool RowMajorLess(const wxPoint& a, const wxPoint& b)
 {
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+// Rebuilds the row index from the points. Must be called after changing the
+// points directly, otherwise lookups and corrections fall back to scanning
+// the whole list.
+void DefectMap::BuildIndex()
+{
+    std::vector<wxPoint> sorted;
+    sorted.reserve(size());
+    int rows = 0;
+    for (const_iterator it = begin(); it != end(); ++it)
+    {
+        // defects with negative coordinates can never be inside a frame
+        if (it->x < 0 || it->y < 0)
+            continue;
+        sorted.push_back(*it);
+        rows = std::max(rows, it->y + 1);
+    }
+    std::sort(sorted.begin(), sorted.end(), RowMajorLess);
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    m_cols.resize(sorted.size());
+    m_rowStart.assign(rows + 1, 0);
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        m_cols[i] = sorted[i].x;
+        ++m_rowStart[sorted[i].y + 1];
+    }
+    for (int y = 0; y < rows; y++)
+        m_rowStart[y + 1] += m_rowStart[y];
+
+    m_indexedCount = size();
 }
 
 bool DefectMap::FindDefect(const wxPoint& pt) const
 {
-    return std::find(begin(), end(), pt) != end();
+    if (!IsIndexed())
+        return std::find(begin(), end(), pt) != end();
+    if (pt.y < 0 || pt.y >= IndexedRows())
+        return false;
+    return std::binary_search(RowBegin(pt.y), RowEnd(pt.y), pt.x);
 }
 
 void DefectMap::AddDefect(const wxPoint& pt)
 {
     // first add the point
     push_back(pt);
+    BuildIndex();
 
     wxString filename = DefectMapFileName(m_profileId);
     wxFile file(filename, wxFile::write_append);
@@ -1270,6 +1416,8 @@ DefectMap *DefectMap::LoadDefectMap(int profileId)
         }
     }
 
+    defectMap->BuildIndex();
+
     Debug.AddLine(wxString::Format("Loaded %d defects", defectMap->size()));
     return defectMap;
 }
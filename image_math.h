@@ -39,6 +39,13 @@
 class DefectMap : public std::vector<wxPoint>
 {
     int m_profileId;
+
+    // row index of the defects: the columns of the defects on row y are
+    // m_cols[m_rowStart[y]] up to m_cols[m_rowStart[y + 1]], sorted
+    std::vector<int> m_rowStart;
+    std::vector<int> m_cols;
+    size_t m_indexedCount;
+
     DefectMap(int profileId);
 public:
     static void DeleteDefectMap(int profileId);
@@ -51,17 +58,60 @@ public:
     bool FindDefect(const wxPoint& pt) const;
     void AddDefect(const wxPoint& pt);
 
+    void BuildIndex();
+    bool IsIndexed() const { return m_indexedCount == size(); }
+    int IndexedRows() const { return m_rowStart.empty() ? 0 : (int) m_rowStart.size() - 1; }
+    const int *RowBegin(int y) const { return m_cols.empty() ? NULL : &m_cols[0] + m_rowStart[y]; }
+    const int *RowEnd(int y) const { return m_cols.empty() ? NULL : &m_cols[0] + m_rowStart[y + 1]; }
+};
+
+/*
+ * Dark frames modelled per pixel as a bias plus a dark current that grows
+ * linearly with the exposure time. The model is fitted to master darks of a
+ * few exposure times, and a dark for any exposure time is made from it on
+ * demand.
+ */
+class ScaledDark
+{
+    wxSize m_size;
+    std::vector<unsigned short> m_bias;     // ADU
+    std::vector<float> m_rate;              // ADU per second
+    int m_darkCount;                        // master darks the model was fitted to
+    int m_minExp;                           // their range of exposure times, ms
+    int m_maxExp;
+
+public:
+    ScaledDark();
+
+    bool Init(const wxSize& size, int darkCount, int minExp, int maxExp);
+    static ScaledDark *Fit(const std::vector<const usImage *>& darks);
+    bool MakeDark(usImage& dark, int expTime) const;
+
+    const wxSize& Size() const { return m_size; }
+    int NPixels() const { return (int) m_bias.size(); }
+    int DarkCount() const { return m_darkCount; }
+    int MinExposure() const { return m_minExp; }
+    int MaxExposure() const { return m_maxExp; }
+    unsigned short *BiasData() { return &m_bias[0]; }
+    const unsigned short *BiasData() const { return &m_bias[0]; }
+    float *RateData() { return &m_rate[0]; }
+    const float *RateData() const { return &m_rate[0]; }
 };
 
 extern bool QuickLRecon(usImage& img);
 extern bool Median3(unsigned short *dst, const unsigned short *src, const wxSize& size, const wxRect& rect);
 extern bool Median3(usImage& img);
 extern bool SquarePixels(usImage& img, float xsize, float ysize);
+extern bool SoftwareBin(usImage& dst, const usImage& src, int factor, bool mean);
 extern int dbl_sort_func(double *first, double *second);
 extern bool Subtract(usImage& light, const usImage& dark);
+extern void PixelMinMax(const unsigned short *p, int n, int *pmin, int *pmax);
 extern double CalcSlope(const ArrayOfDbl& y);
 extern bool RemoveDefects(usImage& light, const DefectMap& defectMap);
 
+extern int RowBandCount(int rows);
+extern void RunRowBands(RowBandJob& job, int nbands, int y0, int y1);
+
 struct DefectMapBuilderImpl;
 
 struct DefectMapDarks
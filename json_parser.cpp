@@ -693,3 +693,101 @@ json_value *JsonParser::Root()
 {
     return m_impl->root;
 }
+
+JsonStream::JsonStream()
+{
+    Reset();
+}
+
+void JsonStream::Reset()
+{
+    m_buf.clear();
+    m_start = m_scan = 0;
+    m_depth = 0;
+    m_inString = m_escape = m_bare = false;
+}
+
+void JsonStream::Append(const char *data, size_t len)
+{
+    // discard the messages already returned so the buffer only grows with
+    // the size of the largest message
+    if (m_start > 0)
+    {
+        m_buf.erase(m_buf.begin(), m_buf.begin() + m_start);
+        m_scan -= m_start;
+        m_start = 0;
+    }
+
+    m_buf.insert(m_buf.end(), data, data + len);
+}
+
+char *JsonStream::Next()
+{
+    size_t const end = m_buf.size();
+
+    for (size_t i = m_scan; i < end; i++)
+    {
+        char const c = m_buf[i];
+        size_t msgEnd = 0;
+
+        if (m_depth == 0 && !m_bare)
+        {
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                m_start = i + 1;
+            else if (c == '{' || c == '[')
+            {
+                m_start = i;
+                m_depth = 1;
+            }
+            else
+            {
+                m_start = i;
+                m_bare = true;
+            }
+            continue;
+        }
+        else if (m_bare)
+        {
+            if (c != '\r' && c != '\n')
+                continue;
+            m_bare = false;
+            msgEnd = i;
+        }
+        else if (m_inString)
+        {
+            if (m_escape)
+                m_escape = false;
+            else if (c == '\\')
+                m_escape = true;
+            else if (c == '"')
+                m_inString = false;
+            continue;
+        }
+        else
+        {
+            if (c == '"')
+                m_inString = true;
+            else if (c == '{' || c == '[')
+                ++m_depth;
+            else if ((c == '}' || c == ']') && --m_depth == 0)
+                msgEnd = i + 1;
+            if (msgEnd == 0)
+                continue;
+        }
+
+        // the parser works in place and needs a terminator, which cannot be
+        // written into the receive buffer when the next message follows
+        // immediately, so the message is copied
+        m_msg.assign(m_buf.begin() + m_start, m_buf.begin() + msgEnd);
+        m_msg.push_back(0);
+
+        m_start = m_scan = i + 1;
+        return &m_msg[0];
+    }
+
+    m_scan = end;
+    if (m_depth == 0 && !m_bare)
+        m_start = end;
+
+    return 0;
+}
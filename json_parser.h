@@ -57,6 +57,8 @@
 #ifndef JSON_PARSER_H
 #define JSON_PARSER_H
 
+#include <vector>
+
 enum json_type
 {
     JSON_NULL,
@@ -107,4 +109,37 @@ public:
     json_value *Root();
 };
 
+// Splits a stream of bytes into complete JSON-RPC messages. Bytes can be
+// appended in chunks of any size; a message may span several chunks and a
+// chunk may hold several (pipelined) messages. A message is a balanced
+// top-level object or array, which need not be followed by a line ending;
+// anything else at the top level is returned up to the next line ending so
+// that the parser can report the error.
+class JsonStream
+{
+    std::vector<char> m_buf;
+    std::vector<char> m_msg;
+    size_t m_start;         // start of the message being scanned
+    size_t m_scan;          // next byte to scan
+    int m_depth;
+    bool m_inString;
+    bool m_escape;
+    bool m_bare;
+
+public:
+    JsonStream();
+
+    void Append(const char *data, size_t len);
+
+    // Returns the next complete message as a null-terminated string that
+    // JsonParser::Parse can modify, or NULL when more input is needed. The
+    // string is valid until the next call to Next or Reset.
+    char *Next();
+
+    // number of bytes received for the message that is not complete yet
+    size_t Pending() const { return m_buf.size() - m_start; }
+
+    void Reset();
+};
+
 #endif
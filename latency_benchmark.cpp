@@ -0,0 +1,255 @@
+/*
+ *  latency_benchmark.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "phd.h"
+
+// dispatch modes compared, without and with pipelined capture
+static const struct
+{
+    MoveDispatch dispatch;
+    bool pipelined;
+} s_runs[] = {
+    { MOVE_DISPATCH_SHARED, false },
+    { MOVE_DISPATCH_MOUNT, false },
+    { MOVE_DISPATCH_SHARED, true },
+    { MOVE_DISPATCH_MOUNT, true },
+};
+
+static const unsigned int RunCount = WXSIZEOF(s_runs);
+
+static const int PollInterval = 250;            // milliseconds
+static const int GuideStartTimeout = 600000;    // milliseconds, long enough for a calibration
+static const int MeasureTimeout = 1800000;      // milliseconds
+static const int StopTimeout = 60000;           // milliseconds
+
+static const char *dispatch_name(MoveDispatch dispatch)
+{
+    return dispatch == MOVE_DISPATCH_SHARED ? "primary" : "mount";
+}
+
+LatencyBenchmark::LatencyBenchmark(const wxString& outFile)
+    :
+    m_outFile(outFile),
+    m_state(STATE_START_RUN),
+    m_run(0),
+    m_prevPipelined(false)
+{
+}
+
+bool LatencyBenchmark::Start(const wxString& outFile)
+{
+    bool bError = false;
+
+    try
+    {
+        Debug.AddLine(wxString::Format("LatencyBenchmark: begin, results to %s", outFile));
+
+        wxString err;
+        if (pFrame->pGearDialog->ConnectAll(&err))
+        {
+            throw ERROR_INFO("LatencyBenchmark: cannot connect the equipment of the profile");
+        }
+
+        if (!pCamera || pCamera->Name != _T("Simulator") || !pMount || pMount->IsStepGuider() || !pMount->SynchronousOnly())
+        {
+            throw ERROR_INFO("LatencyBenchmark: the profile must use the simulator camera and its on-camera mount");
+        }
+
+        LatencyBenchmark *bench = new LatencyBenchmark(outFile);
+        bench->m_prevPipelined = pFrame->GetPipelinedCapture();
+        bench->wxTimer::Start(PollInterval);
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+    }
+
+    return bError;
+}
+
+void LatencyBenchmark::Notify(void)
+{
+    try
+    {
+        Step();
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        Finish(true);
+    }
+}
+
+void LatencyBenchmark::Step(void)
+{
+    switch (m_state)
+    {
+        case STATE_START_RUN: {
+            if (m_run == RunCount)
+            {
+                WriteResults();
+                Finish(false);
+                break;
+            }
+
+            pFrame->SetMoveDispatch(s_runs[m_run].dispatch);
+            pFrame->SetPipelinedCapture(s_runs[m_run].pipelined);
+
+            Debug.AddLine(wxString::Format("LatencyBenchmark: run %u, moves on the %s thread, pipelined=%d", m_run + 1,
+                dispatch_name(s_runs[m_run].dispatch), s_runs[m_run].pipelined));
+
+            // guiding is considered settled on the first frame, the measurement starts later anyway
+            SettleParams settle;
+            settle.tolerancePx = 99.;
+            settle.settleTimeSec = 0;
+            settle.timeoutSec = 60;
+            settle.frames = 1;
+
+            wxString err;
+            if (!PhdController::CanGuide(&err) || !PhdController::Guide(false, settle, &err))
+            {
+                throw ERROR_INFO("LatencyBenchmark: cannot start guiding");
+            }
+
+            m_deadline = ::wxGetUTCTimeMillis() + GuideStartTimeout;
+            m_state = STATE_WAIT_GUIDING;
+            break;
+        }
+
+        case STATE_WAIT_GUIDING:
+            if (pFrame->pGuider->IsGuiding() && !pFrame->pGuider->IsPaused())
+            {
+                // drop the steps of the calibration and of the previous run
+                LatencyStats::Reset();
+                m_deadline = ::wxGetUTCTimeMillis() + MeasureTimeout;
+                m_state = STATE_MEASURE;
+            }
+            else if (::wxGetUTCTimeMillis() > m_deadline)
+            {
+                throw ERROR_INFO("LatencyBenchmark: timed out waiting for guiding to start");
+            }
+            break;
+
+        case STATE_MEASURE: {
+            if (!pFrame->pGuider->IsGuiding())
+            {
+                throw ERROR_INFO("LatencyBenchmark: guiding stopped");
+            }
+
+            Result result;
+            LatencyStats::GetSummary(&result.summary);
+
+            if (result.summary.frames >= LatencyStats::WINDOW)
+            {
+                result.dispatch = s_runs[m_run].dispatch;
+                result.pipelined = s_runs[m_run].pipelined;
+                m_results.push_back(result);
+
+                pFrame->StopCapturing();
+                m_deadline = ::wxGetUTCTimeMillis() + StopTimeout;
+                m_state = STATE_STOPPING;
+            }
+            else if (::wxGetUTCTimeMillis() > m_deadline)
+            {
+                throw ERROR_INFO("LatencyBenchmark: timed out waiting for the guide steps");
+            }
+            break;
+        }
+
+        case STATE_STOPPING:
+            // the dispatch can only change once the last move of the run is done
+            if (!pFrame->CaptureActive && !pMount->IsBusy())
+            {
+                ++m_run;
+                m_state = STATE_START_RUN;
+            }
+            else if (::wxGetUTCTimeMillis() > m_deadline)
+            {
+                throw ERROR_INFO("LatencyBenchmark: timed out waiting for capture to stop");
+            }
+            break;
+    }
+}
+
+void LatencyBenchmark::WriteResults(void)
+{
+    wxFFile out(m_outFile, "w");
+    if (!out.IsOpened())
+    {
+        throw ERROR_INFO("LatencyBenchmark: cannot open the output file");
+    }
+
+    int exposure;
+    bool autoExp;
+    pFrame->GetExposureInfo(&exposure, &autoExp);
+
+    wxString summary = wxString::Format("# PHD2 version %s guide pulse latency, simulator, %d ms exposures, %u guide steps per run\n",
+        FULLVER, exposure, (unsigned int) LatencyStats::WINDOW);
+    summary += "Moves,Pipelined,Steps,PulseP50,PulseP95,PulseP99,MoveDispatchP50,MoveDispatchP95,MoveDispatchP99,TotalP50,TotalP95,TotalP99\n";
+
+    for (std::vector<Result>::const_iterator it = m_results.begin(); it != m_results.end(); ++it)
+    {
+        const LatencyStats::Summary& s = it->summary;
+        summary += wxString::Format("%s,%d,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+            dispatch_name(it->dispatch), it->pipelined, s.frames,
+            s.p50[LatencyStats::INT_PULSE], s.p95[LatencyStats::INT_PULSE], s.p99[LatencyStats::INT_PULSE],
+            s.p50[LatencyStats::INT_MOVE_DISPATCH], s.p95[LatencyStats::INT_MOVE_DISPATCH], s.p99[LatencyStats::INT_MOVE_DISPATCH],
+            s.p50[LatencyStats::INT_TOTAL], s.p95[LatencyStats::INT_TOTAL], s.p99[LatencyStats::INT_TOTAL]);
+    }
+
+    out.Write(summary);
+    Debug.Write(summary);
+}
+
+void LatencyBenchmark::Finish(bool error)
+{
+    Stop();
+
+    if (error && pFrame->CaptureActive)
+    {
+        pFrame->StopCapturing();
+    }
+
+    if (!pFrame->CaptureActive)
+    {
+        pFrame->SetMoveDispatch(MOVE_DISPATCH_AUTO);
+    }
+    pFrame->SetPipelinedCapture(m_prevPipelined);
+
+    Debug.AddLine(wxString::Format("LatencyBenchmark: end, error=%d", error));
+
+    wxGetApp().CallAfter(&PhdApp::LatencyBenchmarkDone, error);
+    wxGetApp().ScheduleForDestruction(this);
+}
@@ -0,0 +1,87 @@
+/*
+ *  latency_benchmark.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef LATENCY_BENCHMARK_H_INCLUDED
+#define LATENCY_BENCHMARK_H_INCLUDED
+
+/*
+ * Headless comparison of the guide pulse latency with the moves on the
+ * primary worker thread and on the mount worker thread.
+ *
+ * The simulator camera and its guide port of the current profile run through
+ * the real MyFrame workers: guiding starts in each dispatch mode, without and
+ * with pipelined capture, and once LatencyStats holds a full window of guide
+ * steps the percentiles of the time from queuing the move to the start of the
+ * pulse are written to the output file. The calibration of the profile is
+ * used if there is one.
+ */
+class LatencyBenchmark : public wxTimer
+{
+public:
+    // starts the benchmark, returns true on error; PhdApp::LatencyBenchmarkDone()
+    // is called when the benchmark is over
+    static bool Start(const wxString& outFile);
+
+private:
+    enum State
+    {
+        STATE_START_RUN,
+        STATE_WAIT_GUIDING,
+        STATE_MEASURE,
+        STATE_STOPPING,
+    };
+
+    struct Result
+    {
+        MoveDispatch dispatch;
+        bool pipelined;
+        LatencyStats::Summary summary;
+    };
+
+    wxString m_outFile;
+    State m_state;
+    unsigned int m_run;
+    wxLongLong m_deadline;
+    bool m_prevPipelined;
+    std::vector<Result> m_results;
+
+    LatencyBenchmark(const wxString& outFile);
+
+    void Notify(void);
+    void Step(void);
+    void Finish(bool error);
+    void WriteResults(void);
+};
+
+#endif // LATENCY_BENCHMARK_H_INCLUDED
@@ -0,0 +1,151 @@
+/*
+ *  latency_stats.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+
+#include <algorithm>
+#include <chrono>
+
+static wxCriticalSection s_lock;
+static double s_samples[LatencyStats::INTERVAL_COUNT][LatencyStats::WINDOW];   // milliseconds
+static unsigned int s_count;        // number of valid samples, up to WINDOW
+static unsigned int s_next;         // next slot to write
+static unsigned int s_unpublished;
+
+static const LatencyStage IntervalBegin[LatencyStats::INTERVAL_COUNT] = {
+    LAT_CAPTURED, LAT_PROCESSED, LAT_DISPATCHED, LAT_CENTROIDED, LAT_MOVE_QUEUED, LAT_MOVE_STARTED, LAT_MOVE_QUEUED, LAT_CAPTURED,
+};
+
+static const LatencyStage IntervalEnd[LatencyStats::INTERVAL_COUNT] = {
+    LAT_PROCESSED, LAT_DISPATCHED, LAT_CENTROIDED, LAT_MOVE_QUEUED, LAT_MOVE_STARTED, LAT_PULSE_STARTED, LAT_PULSE_STARTED, LAT_PULSE_STARTED,
+};
+
+long long LatencyStats::Ticks(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char *LatencyStats::IntervalName(Interval interval)
+{
+    switch (interval)
+    {
+        case INT_PROCESS:       return "Process";
+        case INT_DISPATCH:      return "Dispatch";
+        case INT_CENTROID:      return "Centroid";
+        case INT_SCHEDULE:      return "Schedule";
+        case INT_MOVE_DISPATCH: return "MoveDispatch";
+        case INT_ALGORITHM:     return "Algorithm";
+        case INT_PULSE:         return "Pulse";
+        case INT_TOTAL:         return "Total";
+        default:                return "Unknown";
+    }
+}
+
+void LatencyStats::Add(const FrameLatency& rec)
+{
+    if (!rec.IsComplete())
+        return;
+
+    double ms[INTERVAL_COUNT];
+    for (int i = 0; i < INTERVAL_COUNT; i++)
+        ms[i] = (double)(rec.t[IntervalEnd[i]] - rec.t[IntervalBegin[i]]) / 1000.0;
+
+    Debug.Write(wxString::Format("latency: process=%.1f dispatch=%.1f centroid=%.1f schedule=%.1f movedispatch=%.1f algorithm=%.1f pulse=%.1f total=%.1f ms\n",
+        ms[INT_PROCESS], ms[INT_DISPATCH], ms[INT_CENTROID], ms[INT_SCHEDULE], ms[INT_MOVE_DISPATCH], ms[INT_ALGORITHM], ms[INT_PULSE],
+        ms[INT_TOTAL]));
+
+    wxCriticalSectionLocker lock(s_lock);
+
+    for (int i = 0; i < INTERVAL_COUNT; i++)
+        s_samples[i][s_next] = ms[i];
+
+    s_next = (s_next + 1) % WINDOW;
+    if (s_count < WINDOW)
+        ++s_count;
+    ++s_unpublished;
+}
+
+static double percentile(const double *sorted, unsigned int n, double p)
+{
+    unsigned int idx = std::min(n - 1, (unsigned int)(p * n));
+    return sorted[idx];
+}
+
+void LatencyStats::GetSummary(Summary *summary)
+{
+    double samples[INTERVAL_COUNT][WINDOW];
+    unsigned int n;
+
+    {
+        wxCriticalSectionLocker lock(s_lock);
+        n = s_count;
+        for (int i = 0; i < INTERVAL_COUNT; i++)
+            std::copy(s_samples[i], s_samples[i] + n, samples[i]);
+    }
+
+    summary->frames = n;
+
+    for (int i = 0; i < INTERVAL_COUNT; i++)
+    {
+        if (n == 0)
+        {
+            summary->p50[i] = summary->p95[i] = summary->p99[i] = 0.0;
+            continue;
+        }
+
+        std::sort(samples[i], samples[i] + n);
+        summary->p50[i] = percentile(samples[i], n, 0.50);
+        summary->p95[i] = percentile(samples[i], n, 0.95);
+        summary->p99[i] = percentile(samples[i], n, 0.99);
+    }
+}
+
+bool LatencyStats::PublishDue(void)
+{
+    wxCriticalSectionLocker lock(s_lock);
+
+    if (s_unpublished < PUBLISH_INTERVAL)
+        return false;
+
+    s_unpublished = 0;
+    return true;
+}
+
+void LatencyStats::Reset(void)
+{
+    wxCriticalSectionLocker lock(s_lock);
+    s_count = 0;
+    s_next = 0;
+    s_unpublished = 0;
+}
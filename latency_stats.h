@@ -0,0 +1,126 @@
+/*
+ *  latency_stats.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef LATENCY_STATS_H_INCLUDED
+#define LATENCY_STATS_H_INCLUDED
+
+// boundaries between the stages a guide frame goes through, from the end of
+// the exposure to the start of the guide pulse
+enum LatencyStage
+{
+    LAT_CAPTURED,       // GuideCamera::Capture() returned
+    LAT_PROCESSED,      // noise reduction and image statistics done
+    LAT_DISPATCHED,     // MyFrame::OnExposeComplete() entered on the main thread
+    LAT_CENTROIDED,     // star position updated
+    LAT_MOVE_QUEUED,    // move request queued to the worker thread
+    LAT_MOVE_STARTED,   // worker thread entered Mount::Move()
+    LAT_PULSE_STARTED,  // guide algorithms done, first pulse issued
+    LAT_STAGE_COUNT
+};
+
+// high resolution timestamps of one frame, 0 for the stages not reached
+struct FrameLatency
+{
+    long long t[LAT_STAGE_COUNT];   // microseconds, monotonic
+
+    FrameLatency() { Reset(); }
+    void Reset(void);
+    void Stamp(LatencyStage stage);
+    bool IsComplete(void) const;
+};
+
+/*
+ * Rolling statistics of the time spent in each stage over the last WINDOW
+ * frames that went all the way from the camera to a guide pulse.
+ *
+ * Records are added from the worker thread, the statistics are read from the
+ * main thread.
+ */
+class LatencyStats
+{
+public:
+    enum { WINDOW = 100, PUBLISH_INTERVAL = 10 };
+
+    // intervals reported, each one between two consecutive stage boundaries,
+    // plus the time from queuing the move to the pulse and the total
+    enum Interval
+    {
+        INT_PROCESS,        // LAT_CAPTURED -> LAT_PROCESSED
+        INT_DISPATCH,       // LAT_PROCESSED -> LAT_DISPATCHED
+        INT_CENTROID,       // LAT_DISPATCHED -> LAT_CENTROIDED
+        INT_SCHEDULE,       // LAT_CENTROIDED -> LAT_MOVE_QUEUED
+        INT_MOVE_DISPATCH,  // LAT_MOVE_QUEUED -> LAT_MOVE_STARTED
+        INT_ALGORITHM,      // LAT_MOVE_STARTED -> LAT_PULSE_STARTED
+        INT_PULSE,          // LAT_MOVE_QUEUED -> LAT_PULSE_STARTED
+        INT_TOTAL,          // LAT_CAPTURED -> LAT_PULSE_STARTED
+        INTERVAL_COUNT
+    };
+
+    struct Summary
+    {
+        unsigned int frames;                // number of frames the percentiles are computed from
+        double p50[INTERVAL_COUNT];         // milliseconds
+        double p95[INTERVAL_COUNT];
+        double p99[INTERVAL_COUNT];
+    };
+
+    static long long Ticks(void);
+    static const char *IntervalName(Interval interval);
+
+    static void Add(const FrameLatency& rec);
+    static void GetSummary(Summary *summary);
+    // true once every PUBLISH_INTERVAL new records
+    static bool PublishDue(void);
+    static void Reset(void);
+};
+
+inline void FrameLatency::Reset(void)
+{
+    for (int i = 0; i < LAT_STAGE_COUNT; i++)
+        t[i] = 0;
+}
+
+inline void FrameLatency::Stamp(LatencyStage stage)
+{
+    t[stage] = LatencyStats::Ticks();
+}
+
+inline bool FrameLatency::IsComplete(void) const
+{
+    for (int i = 0; i < LAT_STAGE_COUNT; i++)
+        if (t[i] == 0)
+            return false;
+    return true;
+}
+
+#endif // LATENCY_STATS_H_INCLUDED
@@ -134,6 +134,7 @@ void Mount::MountConfigDialogPane::LayoutControls(wxPanel *pParent, BrainCtrlIdM
 #if defined(MPIIS_GAUSSIAN_PROCESS_GUIDING_ENABLED__)
             _("Gaussian Process"),
 #endif
+            _("Predictive PEC"),
         };
 
         width = StringArrayWidth(xAlgorithms, WXSIZEOF(xAlgorithms));
@@ -482,6 +483,12 @@ bool Mount::CreateGuideAlgorithm(int guideAlgorithm, Mount *mount, GuideAxis axi
             case GUIDE_ALGORITHM_GAUSSIAN_PROCESS:
 #endif
                 break;
+            case GUIDE_ALGORITHM_PREDICTIVE_PEC:
+                if (axis != GUIDE_RA)
+                {
+                    throw ERROR_INFO("Predictive PEC is only available for RA");
+                }
+                break;
             case GUIDE_ALGORITHM_NONE:
             default:
                 throw ERROR_INFO("invalid guideAlgorithm");
@@ -518,6 +525,9 @@ bool Mount::CreateGuideAlgorithm(int guideAlgorithm, Mount *mount, GuideAxis axi
             *ppAlgorithm = new GuideGaussianProcess(mount, axis);
             break;
 #endif
+        case GUIDE_ALGORITHM_PREDICTIVE_PEC:
+            *ppAlgorithm = new GuideAlgorithmPredictivePec(mount, axis);
+            break;
 
         case GUIDE_ALGORITHM_NONE:
         default:
@@ -764,7 +774,50 @@ void Mount::LogGuideStepInfo()
     m_lastStep.frameNumber = -1; // invalidate
 }
 
-Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, MountMoveType moveType)
+/*
+ * Fraction of the correction described by this pulse record that was not yet
+ * visible in an exposure taken during the given window.
+ *
+ * The star is assumed to move linearly from its old position to its new position
+ * while the pulse is being issued, and the measured centroid to be the average
+ * position over the exposure. With g(t) the normalized displacement (0 before the
+ * pulse, 1 after it) and G its integral, the fraction of the move seen by the
+ * exposure [s, e] is (G(e) - G(s)) / (e - s).
+ */
+double PulseRecord::PendingFraction(const ExposureWindow& exposure) const
+{
+    if (!exposure.IsValid() || end <= 0)
+        return 0.0;
+
+    double p0 = start.ToDouble();
+    double p1 = end.ToDouble();
+    double s = exposure.start.ToDouble();
+    double e = s + exposure.duration;
+
+    if (s >= p1)
+        return 0.0;                 // exposure started after the move completed
+    if (e <= p0)
+        return 1.0;                 // exposure completed before the move started
+
+    struct Ramp
+    {
+        double p0, p1;
+        double operator()(double t) const
+        {
+            if (t <= p0)
+                return 0.0;
+            if (t >= p1)
+                return (p1 - p0) / 2.0 + (t - p1);
+            return (t - p0) * (t - p0) / (2.0 * (p1 - p0));
+        }
+    } G = { p0, p1 };
+
+    double seen = (G(e) - G(s)) / (e - s);
+
+    return 1.0 - wxMin(1.0, wxMax(0.0, seen));
+}
+
+Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure)
 {
     MOVE_RESULT result = MOVE_OK;
 
@@ -800,6 +853,18 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, MountMoveT
 
             if (moveType == MOVETYPE_ALGO)
             {
+                // When the exposure overlapped the previous correction, part of that correction
+                // is not reflected in the measured position yet; don't correct for it twice
+                double pending = m_lastPulse.PendingFraction(exposure);
+                if (pending > 0.0)
+                {
+                    xDistance -= pending * m_lastPulse.amount.X;
+                    yDistance -= pending * m_lastPulse.amount.Y;
+
+                    Debug.Write(wxString::Format("Latency model: %.0f%% of last move pending, adjusted xDistance=%.2f yDistance=%.2f\n",
+                        pending * 100.0, xDistance, yDistance));
+                }
+
                 // Feed the raw distances to the guide algorithms
                 if (m_pXGuideAlgorithm)
                 {
@@ -826,6 +891,9 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, MountMoveT
         GUIDE_DIRECTION xDirection = xDistance > 0.0 ? LEFT : RIGHT;
         GUIDE_DIRECTION yDirection = yDistance > 0.0 ? DOWN : UP;
 
+        wxLongLong pulseStart = ReplayClock::Now();
+        long long pulseStartTicks = LatencyStats::Ticks();
+
         int requestedXAmount = (int) floor(fabs(xDistance / m_xRate) + 0.5);
         MoveResultInfo xMoveResult;
         result = Move(xDirection, requestedXAmount, moveType, &xMoveResult);
@@ -841,6 +909,12 @@ Mount::MOVE_RESULT Mount::Move(const PHD_Point& cameraVectorEndpoint, MountMoveT
             result = Move(yDirection, requestedYAmount, moveType, &yMoveResult);
         }
 
+        m_lastPulse.start = pulseStart;
+        m_lastPulse.startTicks = pulseStartTicks;
+        m_lastPulse.end = ReplayClock::Now();
+        m_lastPulse.amount.X = (xDistance > 0.0 ? 1.0 : -1.0) * xMoveResult.amountMoved * m_xRate;
+        m_lastPulse.amount.Y = (yDistance > 0.0 ? 1.0 : -1.0) * yMoveResult.amountMoved * m_cal.yRate;
+
         // Record the info about the guide step. The info will be picked up back in the main UI thread.
         // We don't want to do anything with the info here in the worker thread since UI operations are
         // not allowed outside the main UI thread.
@@ -1491,7 +1565,11 @@ wxString Mount::GetSettingsSummary()
 {
     // return a loggable summary of current mount settings
     wxString algorithms[] = {
-        _T("None"),_T("Hysteresis"),_T("Lowpass"),_T("Lowpass2"), _T("Resist Switch")
+        _T("None"),_T("Hysteresis"),_T("Lowpass"),_T("Lowpass2"), _T("Resist Switch"),
+#if defined(MPIIS_GAUSSIAN_PROCESS_GUIDING_ENABLED__)
+        _T("Gaussian Process"),
+#endif
+        _T("Predictive PEC"),
     };
     wxString auxMountStr = wxEmptyString;
     if (m_Name == _("On Camera") && pPointingSource && pPointingSource->IsConnected() && pPointingSource->CanReportPosition())
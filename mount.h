@@ -131,6 +131,30 @@ struct MoveResultInfo
     MoveResultInfo() : amountMoved(0), limited(false) { }
 };
 
+// Start time (wxGetUTCTimeMillis) and duration of the exposure a guide move was
+// computed from. With pipelined capture, the exposure may overlap the previous move.
+struct ExposureWindow
+{
+    wxLongLong start;
+    int duration;
+
+    ExposureWindow() : start(0), duration(0) { }
+    ExposureWindow(const wxLongLong& start_, int duration_) : start(start_), duration(duration_) { }
+    bool IsValid(void) const { return start > 0 && duration > 0; }
+};
+
+// Time span of the last correction, and the distance it moved (mount coordinates)
+struct PulseRecord
+{
+    wxLongLong start;
+    wxLongLong end;
+    PHD_Point amount;
+    long long startTicks;       // LatencyStats::Ticks() at the start
+
+    PulseRecord() : start(0), end(0), amount(0., 0.), startTicks(0) { }
+    double PendingFraction(const ExposureWindow& exposure) const;
+};
+
 class MountConfigDialogCtrlSet : public ConfigDialogCtrlSet
 {
     Mount* m_pMount;
@@ -164,6 +188,7 @@ protected:
     wxString m_Name;
     BacklashComp *m_backlashComp;
     GuideStepInfo m_lastStep;
+    PulseRecord m_lastPulse;
 
     // Things related to the Advanced Config Dialog
 public:
@@ -239,7 +264,7 @@ public:
     bool GetGuidingEnabled(void);
     void SetGuidingEnabled(bool guidingEnabled);
 
-    virtual MOVE_RESULT Move(const PHD_Point& cameraVectorEndpoint, MountMoveType moveType);
+    virtual MOVE_RESULT Move(const PHD_Point& cameraVectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure);
     bool TransformCameraCoordinatesToMountCoordinates(const PHD_Point& cameraVectorEndpoint,
                                                       PHD_Point& mountVectorEndpoint);
 
@@ -247,6 +272,7 @@ public:
                                                      PHD_Point& cameraVectorEndpoint);
 
     void LogGuideStepInfo(void);
+    const PulseRecord& LastPulse(void) const { return m_lastPulse; }
 
     GraphControlPane *GetXGuideAlgorithmControlPane(wxWindow *pParent);
     GraphControlPane *GetYGuideAlgorithmControlPane(wxWindow *pParent);
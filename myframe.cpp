@@ -50,6 +50,7 @@
 #include <memory>
 
 static const int DefaultNoiseReductionMethod = 0;
+static const int DefaultSoftwareBinning = SWBIN_NONE;
 static const double DefaultDitherScaleFactor = 1.00;
 static const bool DefaultDitherRaOnly = false;
 static const DitherMode DefaultDitherMode = DITHER_RANDOM;
@@ -172,6 +173,13 @@ MyFrame::MyFrame(int instanceNumber, wxLocale *locale)
     StartWorkerThread(m_pPrimaryWorkerThread);
     m_pSecondaryWorkerThread = NULL;
     StartWorkerThread(m_pSecondaryWorkerThread);
+    m_pCaptureWorkerThread = NULL;
+    StartWorkerThread(m_pCaptureWorkerThread);
+    m_pMountWorkerThread = NULL;
+    StartWorkerThread(m_pMountWorkerThread);
+    m_pExposureWorkerThread = m_pPrimaryWorkerThread;
+    m_pipelinedCapture = false;
+    m_moveDispatch = MOVE_DISPATCH_AUTO;
 
     m_statusbarTimer.SetOwner(this, STATUSBAR_TIMER_EVENT);
 
@@ -222,7 +230,7 @@ MyFrame::MyFrame(int instanceNumber, wxLocale *locale)
 
     sizer->Add(m_infoBar, wxSizerFlags().Expand());
 
-    pGuider = new GuiderOneStar(guiderWin);
+    pGuider = new GuiderMultiStar(guiderWin);
     sizer->Add(pGuider, wxSizerFlags().Proportion(1).Expand());
 
     guiderWin->SetSizer(sizer);
@@ -344,6 +352,7 @@ MyFrame::MyFrame(int instanceNumber, wxLocale *locale)
     m_continueCapturing = false;
     CaptureActive     = false;
     m_exposurePending = false;
+    m_exposureDeferred = false;
 
     m_mgr.GetArtProvider()->SetColour(wxAUI_DOCKART_BACKGROUND_COLOUR, *wxBLACK);
     m_mgr.GetArtProvider()->SetMetric(wxAUI_DOCKART_GRADIENT_TYPE, wxAUI_GRADIENT_VERTICAL);
@@ -414,6 +423,8 @@ MyFrame::~MyFrame()
 
     delete m_showBookmarksAccel;
     delete m_bookmarkLockPosAccel;
+
+    usImagePool::Purge();
 }
 
 void MyFrame::UpdateTitle(void)
@@ -735,6 +746,9 @@ void MyFrame::LoadProfileSettings(void)
     int noiseReductionMethod = pConfig->Profile.GetInt("/NoiseReductionMethod", DefaultNoiseReductionMethod);
     SetNoiseReductionMethod(noiseReductionMethod);
 
+    int softwareBinning = pConfig->Profile.GetInt("/SoftwareBinning", DefaultSoftwareBinning);
+    SetSoftwareBinning(softwareBinning);
+
     double ditherScaleFactor = pConfig->Profile.GetDouble("/DitherScaleFactor", DefaultDitherScaleFactor);
     SetDitherScaleFactor(ditherScaleFactor);
 
@@ -749,6 +763,8 @@ void MyFrame::LoadProfileSettings(void)
 
     SetAutoLoadCalibration(pConfig->Profile.GetBoolean("/AutoLoadCalibration", false));
 
+    SetPipelinedCapture(pConfig->Profile.GetBoolean("/frame/PipelinedCapture", false));
+
     int focalLength = pConfig->Profile.GetInt("/frame/focalLength", DefaultFocalLength);
     SetFocalLength(focalLength);
 
@@ -1391,7 +1407,7 @@ void MyFrame::OnRequestMountMove(wxCommandEvent& evt)
     }
     else
     {
-        pRequest->moveResult = pRequest->pMount->Move(pRequest->vectorEndpoint, pRequest->moveType);
+        pRequest->moveResult = pRequest->pMount->Move(pRequest->vectorEndpoint, pRequest->moveType, pRequest->exposure);
     }
 
     pRequest->pSemaphore->Post();
@@ -1408,41 +1424,105 @@ void MyFrame::OnStatusbarTimerEvent(wxTimerEvent& evt)
         m_statusbar->StatusMsg(wxEmptyString);
 }
 
-void MyFrame::ScheduleExposure(void)
+/*
+ * With pipelined capture, the exposure runs on its own worker thread so that it can start
+ * while the guide correction for the previous frame is still being issued on the primary
+ * worker thread. Mount::Move compensates the next correction for the part of this one that
+ * the overlapped exposure did not see.
+ */
+void MyFrame::ScheduleExposure(bool pipelined)
 {
     int exposureDuration = RequestedExposureDuration();
     int exposureOptions = GetRawImageMode() ? CAPTURE_BPM_REVIEW : CAPTURE_LIGHT;
     const wxRect& subframe = pGuider->GetBoundingBox();
 
-    Debug.Write(wxString::Format("ScheduleExposure(%d,%x,%d) exposurePending=%d\n",
-        exposureDuration, exposureOptions, !subframe.IsEmpty(), m_exposurePending));
+    Debug.Write(wxString::Format("ScheduleExposure(%d,%x,%d) exposurePending=%d pipelined=%d\n",
+        exposureDuration, exposureOptions, !subframe.IsEmpty(), m_exposurePending, pipelined));
 
     assert(wxThread::IsMain()); // m_exposurePending only updated in main thread
     assert(!m_exposurePending);
 
     m_exposurePending = true;
+    m_exposureDeferred = false;
 
-    usImage *img = new usImage();
+    usImage *img = usImagePool::Acquire();
 
     wxCriticalSectionLocker lock(m_CSpWorkerThread);
-    assert(m_pPrimaryWorkerThread);
-    m_pPrimaryWorkerThread->EnqueueWorkerThreadExposeRequest(img, exposureDuration, exposureOptions, subframe);
+    m_pExposureWorkerThread = pipelined ? m_pCaptureWorkerThread : m_pPrimaryWorkerThread;
+    assert(m_pExposureWorkerThread);
+    m_pExposureWorkerThread->EnqueueWorkerThreadExposeRequest(img, exposureDuration, exposureOptions, subframe);
+}
+
+// mounts that guide through the camera cannot move while it is exposing, unless the latency
+// benchmark forces the dispatch of the simulator's guide port
+bool MyFrame::SynchronousMountConnected(void) const
+{
+    if (m_moveDispatch != MOVE_DISPATCH_AUTO)
+        return false;
+
+    return (pMount && pMount->SynchronousOnly()) || (pSecondaryMount && pSecondaryMount->SynchronousOnly());
+}
+
+bool MyFrame::CanPipelineCapture(void) const
+{
+    if (!m_pipelinedCapture || !pCamera || !pCamera->HasNonGuiCapture())
+        return false;
+
+    if (SynchronousMountConnected())
+        return false;
+
+    // calibration needs to see the result of each calibration step
+    return pGuider->IsGuiding() || !pGuider->IsCalibratingOrGuiding();
+}
+
+/*
+ * Guide pulses run on the mount thread so that they never wait behind an exposure or a time
+ * lapse delay on the thread running the exposure. When a mount guides through the camera, its
+ * pulses and the exposures are serialized on the primary thread as before.
+ */
+WorkerThread *MyFrame::MoveWorkerThread(void) const
+{
+    switch (m_moveDispatch)
+    {
+        case MOVE_DISPATCH_SHARED:
+            return m_pPrimaryWorkerThread;
+        case MOVE_DISPATCH_MOUNT:
+            return m_pMountWorkerThread;
+        default:
+            return SynchronousMountConnected() ? m_pPrimaryWorkerThread : m_pMountWorkerThread;
+    }
 }
 
-void MyFrame::SchedulePrimaryMove(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType)
+void MyFrame::SchedulePrimaryMove(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure,
+    const FrameLatency *latency)
 {
     Debug.Write(wxString::Format("SchedulePrimaryMove(%p, x=%.2f, y=%.2f, type=%d)\n", mount, vectorEndpoint.X, vectorEndpoint.Y, moveType));
 
+    if (ReplayDriver::IsActive())
+    {
+        // a replay does not wait for the worker thread
+        ReplayDriver::Move(mount, vectorEndpoint, moveType, exposure);
+        return;
+    }
+
     wxCriticalSectionLocker lock(m_CSpWorkerThread);
 
     assert(mount);
     mount->IncrementRequestCount();
 
-    assert(m_pPrimaryWorkerThread);
-    m_pPrimaryWorkerThread->EnqueueWorkerThreadMoveRequest(mount, vectorEndpoint, moveType);
+    FrameLatency moveLatency;
+    if (latency)
+    {
+        moveLatency = *latency;
+        moveLatency.Stamp(LAT_MOVE_QUEUED);
+    }
+
+    WorkerThread *thread = MoveWorkerThread();
+    assert(thread);
+    thread->EnqueueWorkerThreadMoveRequest(mount, vectorEndpoint, moveType, exposure, &moveLatency);
 }
 
-void MyFrame::ScheduleSecondaryMove(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType)
+void MyFrame::ScheduleSecondaryMove(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure)
 {
     Debug.Write(wxString::Format("ScheduleSecondaryMove(%p, x=%.2f, y=%.2f, type=%d)\n", mount, vectorEndpoint.X, vectorEndpoint.Y, moveType));
 
@@ -1453,14 +1533,14 @@ void MyFrame::ScheduleSecondaryMove(Mount *mount, const PHD_Point& vectorEndpoin
     if (mount->SynchronousOnly())
     {
         // some mounts must run on the Primary thread even if the secondary is requested.
-        SchedulePrimaryMove(mount, vectorEndpoint, moveType);
+        SchedulePrimaryMove(mount, vectorEndpoint, moveType, exposure);
     }
     else
     {
         mount->IncrementRequestCount();
 
         assert(m_pSecondaryWorkerThread);
-        m_pSecondaryWorkerThread->EnqueueWorkerThreadMoveRequest(mount, vectorEndpoint, moveType);
+        m_pSecondaryWorkerThread->EnqueueWorkerThreadMoveRequest(mount, vectorEndpoint, moveType, exposure);
     }
 }
 
@@ -1472,8 +1552,9 @@ void MyFrame::ScheduleCalibrationMove(Mount *mount, const GUIDE_DIRECTION direct
 
     mount->IncrementRequestCount();
 
-    assert(m_pPrimaryWorkerThread);
-    m_pPrimaryWorkerThread->EnqueueWorkerThreadMoveRequest(mount, direction, duration);
+    WorkerThread *thread = MoveWorkerThread();
+    assert(thread);
+    thread->EnqueueWorkerThreadMoveRequest(mount, direction, duration);
 }
 
 void MyFrame::StartCapturing()
@@ -1510,9 +1591,13 @@ void MyFrame::StopCapturing(void)
         StatusMsgNoTimeout(_("Waiting for devices..."));
         m_continueCapturing = false;
 
+        // interrupt a guide pulse in progress as well, as when the moves
+        // shared the exposure thread
+        m_pMountWorkerThread->RequestStop();
+
         if (m_exposurePending)
         {
-            m_pPrimaryWorkerThread->RequestStop();
+            m_pExposureWorkerThread->RequestStop();
         }
         else
         {
@@ -1778,6 +1863,10 @@ void MyFrame::OnClose(wxCloseEvent& event)
     bool killed = StopWorkerThread(m_pPrimaryWorkerThread);
     if (StopWorkerThread(m_pSecondaryWorkerThread))
         killed = true;
+    if (StopWorkerThread(m_pCaptureWorkerThread))
+        killed = true;
+    if (StopWorkerThread(m_pMountWorkerThread))
+        killed = true;
 
     // disconnect all gear
     pGearDialog->Shutdown(killed);
@@ -1787,12 +1876,16 @@ void MyFrame::OnClose(wxCloseEvent& event)
 
     GuideLog.Close();
 
-    pConfig->Global.SetString("/perspective", m_mgr.SavePerspective());
-    wxString geometry = wxString::Format("%c;%d;%d;%d;%d",
-        this->IsMaximized() ? '1' : '0',
-        this->GetSize().x, this->GetSize().y,
-        this->GetPosition().x, this->GetPosition().y);
-    pConfig->Global.SetString("/geometry", geometry);
+    // the frame is never shown during a headless replay, keep the saved layout
+    if (IsShown())
+    {
+        pConfig->Global.SetString("/perspective", m_mgr.SavePerspective());
+        wxString geometry = wxString::Format("%c;%d;%d;%d;%d",
+            this->IsMaximized() ? '1' : '0',
+            this->GetSize().x, this->GetSize().y,
+            this->GetPosition().x, this->GetPosition().y);
+        pConfig->Global.SetString("/geometry", geometry);
+    }
 
     if (help->GetFrame())
         help->GetFrame()->Close();
@@ -1837,6 +1930,36 @@ bool MyFrame::SetNoiseReductionMethod(int noiseReductionMethod)
     return bError;
 }
 
+SOFTWARE_BINNING MyFrame::GetSoftwareBinning(void)
+{
+    return m_softwareBinning;
+}
+
+bool MyFrame::SetSoftwareBinning(int softwareBinning)
+{
+    bool bError = false;
+
+    try
+    {
+        if (softwareBinning < SWBIN_NONE || softwareBinning > SWBIN_4x4MEAN)
+        {
+            throw ERROR_INFO("invalid softwareBinning");
+        }
+        m_softwareBinning = (SOFTWARE_BINNING) softwareBinning;
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+
+        bError = true;
+        m_softwareBinning = (SOFTWARE_BINNING) DefaultSoftwareBinning;
+    }
+
+    pConfig->Profile.SetInt("/SoftwareBinning", m_softwareBinning);
+
+    return bError;
+}
+
 double MyFrame::GetDitherScaleFactor(void)
 {
     return m_ditherScaleFactor;
@@ -1904,6 +2027,27 @@ void MyFrame::SetAutoLoadCalibration(bool val)
     }
 }
 
+bool MyFrame::GetPipelinedCapture(void) const
+{
+    return m_pipelinedCapture;
+}
+
+void MyFrame::SetPipelinedCapture(bool val)
+{
+    if (m_pipelinedCapture != val)
+    {
+        m_pipelinedCapture = val;
+        pConfig->Profile.SetBoolean("/frame/PipelinedCapture", m_pipelinedCapture);
+    }
+}
+
+void MyFrame::SetMoveDispatch(MoveDispatch dispatch)
+{
+    assert(!CaptureActive);
+    Debug.Write(wxString::Format("SetMoveDispatch(%d)\n", dispatch));
+    m_moveDispatch = dispatch;
+}
+
 inline static GuideParity guide_parity(int p)
 {
     switch (p) {
@@ -2000,7 +2144,75 @@ static bool save_multi_darks(const ExposureImgMap& darks, const wxString& fname,
     return bError;
 }
 
-static bool load_multi_darks(GuideCamera *camera, const wxString& fname)
+// Saves the dark frame model as two images: the bias in ADU and the dark
+// current in ADU per second
+static bool save_dark_model(const ScaledDark& model, const wxString& fname, const wxString& note)
+{
+    bool bError = false;
+
+    try
+    {
+        fitsfile *fptr;  // FITS file pointer
+        int status = 0;  // CFITSIO status value MUST be initialized to zero!
+
+        PHD_fits_create_file(&fptr, fname, true, &status);
+        if (status)
+            throw ERROR_INFO("fits_create_file failed");
+
+        long fpixel[3] = { 1, 1, 1 };
+        long fsize[] = {
+            (long)model.Size().GetWidth(),
+            (long)model.Size().GetHeight(),
+        };
+        char *DARKMODL = const_cast<char *>("DARKMODL");
+
+        // bias image, with the properties of the model
+        if (!status) fits_create_img(fptr, USHORT_IMG, 2, fsize, &status);
+
+        char *bias = const_cast<char *>("BIAS");
+        if (!status) fits_write_key(fptr, TSTRING, DARKMODL, bias, const_cast<char *>("Dark model bias, ADU"), &status);
+
+        int darkCount = model.DarkCount();
+        float minExp = (float)model.MinExposure() / 1000.0;
+        float maxExp = (float)model.MaxExposure() / 1000.0;
+        if (!status) fits_write_key(fptr, TINT, const_cast<char *>("EXPCOUNT"), &darkCount, const_cast<char *>("Number of master darks fitted"), &status);
+        if (!status) fits_write_key(fptr, TFLOAT, const_cast<char *>("EXPMIN"), &minExp, const_cast<char *>("Shortest exposure fitted, seconds"), &status);
+        if (!status) fits_write_key(fptr, TFLOAT, const_cast<char *>("EXPMAX"), &maxExp, const_cast<char *>("Longest exposure fitted, seconds"), &status);
+
+        if (!note.IsEmpty())
+        {
+            char *USERNOTE = const_cast<char *>("USERNOTE");
+            if (!status) fits_write_key(fptr, TSTRING, USERNOTE, note.char_str(), NULL, &status);
+        }
+
+        if (!status) fits_write_pix(fptr, TUSHORT, fpixel, model.NPixels(), const_cast<unsigned short *>(model.BiasData()), &status);
+
+        // dark current image
+        if (!status) fits_create_img(fptr, FLOAT_IMG, 2, fsize, &status);
+
+        char *rate = const_cast<char *>("RATE");
+        if (!status) fits_write_key(fptr, TSTRING, DARKMODL, rate, const_cast<char *>("Dark model dark current, ADU/s"), &status);
+
+        if (!status) fits_write_pix(fptr, TFLOAT, fpixel, model.NPixels(), const_cast<float *>(model.RateData()), &status);
+
+        Debug.Write(wxString::Format("saving dark model, %d darks, exposures %d..%d\n", darkCount, model.MinExposure(), model.MaxExposure()));
+
+        PHD_fits_close_file(fptr);
+        bError = status ? true : false;
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+    }
+
+    return bError;
+}
+
+// Reads the dark frames of the dark library one at a time and either writes
+// them to the dark library cache or, without a cache writer, adds them to the
+// camera
+static bool read_multi_darks(GuideCamera *camera, DarkLibCacheWriter *cache, const wxString& fname)
 {
     bool bError = false;
     fitsfile *fptr = 0;
@@ -2076,7 +2288,10 @@ static bool load_multi_darks(GuideCamera *camera, const wxString& fname)
                 img->ImgExpDur = (int)(exposure * 1000.0);
 
                 Debug.Write(wxString::Format("loaded dark frame exposure = %d\n", img->ImgExpDur));
-                camera->AddDark(img.release());
+                if (cache)
+                    cache->Add(*img);
+                else
+                    camera->AddDark(img.release());
 
                 // if this is the last hdu, we are done
                 int hdunr = 0;
@@ -2108,6 +2323,139 @@ static bool load_multi_darks(GuideCamera *camera, const wxString& fname)
     return bError;
 }
 
+// Loads the dark frame model if the dark library holds one. Returns false if
+// the model was loaded, true otherwise with *isModel telling if the file was
+// a dark frame model.
+static bool read_dark_model(GuideCamera *camera, const wxString& fname, bool *isModel)
+{
+    bool bError = false;
+    fitsfile *fptr = 0;
+    int status = 0;  // CFITSIO status value MUST be initialized to zero!
+
+    *isModel = false;
+
+    // a library of dark frames has no DARKMODL key, leave any errors opening
+    // the file to the dark frame reader
+    char keyname[] = "DARKMODL";
+    char value[FLEN_VALUE];
+    if (PHD_fits_open_diskfile(&fptr, fname, READONLY, &status) == 0)
+        fits_read_key(fptr, TSTRING, keyname, value, NULL, &status);
+    if (status)
+    {
+        if (fptr)
+            PHD_fits_close_file(fptr);
+        return true;
+    }
+
+    *isModel = true;
+
+    try
+    {
+
+        long fsize[2];
+        fits_get_img_size(fptr, 2, fsize, &status);
+
+        int darkCount = 0;
+        float minExp = 0.f, maxExp = 0.f;
+        char expcount[] = "EXPCOUNT";
+        char expmin[] = "EXPMIN";
+        char expmax[] = "EXPMAX";
+        fits_read_key(fptr, TINT, expcount, &darkCount, NULL, &status);
+        fits_read_key(fptr, TFLOAT, expmin, &minExp, NULL, &status);
+        fits_read_key(fptr, TFLOAT, expmax, &maxExp, NULL, &status);
+        if (status)
+        {
+            pFrame->Alert(_("Error reading data from ") + fname);
+            throw ERROR_INFO("Error reading dark model keys");
+        }
+
+        std::auto_ptr<ScaledDark> model(new ScaledDark());
+        if (model->Init(wxSize((int)fsize[0], (int)fsize[1]), darkCount, (int)(minExp * 1000.0), (int)(maxExp * 1000.0)))
+        {
+            pFrame->Alert(_("Memory allocation error reading FITS file ") + fname);
+            throw ERROR_INFO("Memory Allocation failure");
+        }
+
+        long fpixel[] = { 1, 1, 1 };
+        if (fits_read_pix(fptr, TUSHORT, fpixel, fsize[0] * fsize[1], NULL, model->BiasData(), NULL, &status) ||
+            fits_movrel_hdu(fptr, +1, NULL, &status) ||
+            fits_read_pix(fptr, TFLOAT, fpixel, fsize[0] * fsize[1], NULL, model->RateData(), NULL, &status))
+        {
+            pFrame->Alert(_("Error reading data from ") + fname);
+            throw ERROR_INFO("Error reading");
+        }
+
+        Debug.Write(wxString::Format("loaded dark model, %d darks, exposures %d..%d\n", darkCount, model->MinExposure(), model->MaxExposure()));
+        camera->SetScaledDark(model.release());
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+    }
+
+    if (fptr)
+    {
+        PHD_fits_close_file(fptr);
+    }
+
+    return bError;
+}
+
+static bool load_multi_darks(GuideCamera *camera, const wxString& fname)
+{
+    wxStopWatch swatch;
+    double rssBefore = GetResidentMemoryMB();
+
+    if (!wxFileExists(fname))
+        return true;
+
+    camera->ClearDarks();
+
+    // a dark frame model is small, it is read directly
+    bool isModel;
+    if (!read_dark_model(camera, fname, &isModel))
+    {
+        Debug.Write(wxString::Format("dark model loaded in %ld ms, RSS %.1f MB -> %.1f MB\n",
+            swatch.Time(), rssBefore, GetResidentMemoryMB()));
+        return false;
+    }
+    if (isModel)
+        return true;
+
+    // Map the uncompressed cache of the dark library, building it first if
+    // needed. Only the pages of the selected dark become resident.
+    const char *source = "cache";
+    DarkLibCache *cache = DarkLibCache::Open(fname);
+    if (!cache)
+    {
+        DarkLibCacheWriter writer(fname);
+        if (writer.IsOk())
+        {
+            if (read_multi_darks(camera, &writer, fname))
+                return true;
+            if (!writer.Commit())
+                cache = DarkLibCache::Open(fname);
+            source = "rebuilt cache";
+        }
+    }
+
+    if (cache)
+        camera->SetDarkLibCache(cache);
+    else
+    {
+        Debug.Write(wxString::Format("could not map the cache of %s, loading dark frames into memory\n", fname));
+        if (read_multi_darks(camera, NULL, fname))
+            return true;
+        source = "FITS file";
+    }
+
+    Debug.Write(wxString::Format("dark library loaded from %s in %ld ms, RSS %.1f MB -> %.1f MB\n",
+        source, swatch.Time(), rssBefore, GetResidentMemoryMB()));
+
+    return false;
+}
+
 wxString MyFrame::GetDarksDir()
 {
     wxString dirpath = GetDefaultFileDir() + PATHSEPSTR + "darks_defects";
@@ -2256,10 +2604,14 @@ void MyFrame::SaveDarkLibrary(const wxString& note)
 
     Debug.Write("saving dark library\n");
 
-    if (save_multi_darks(pCamera->Darks, filename, note))
+    const ScaledDark *model = pCamera->GetScaledDark();
+    if (model ? save_dark_model(*model, filename, note) : save_multi_darks(pCamera->Darks, filename, note))
     {
         Alert(_("Error saving darks FITS file ") + filename);
     }
+
+    // the cache is rebuilt from the new file on the next load
+    DarkLibCache::Remove(filename);
 }
 
 // Delete both the dark library file and any defect map file for this profile
@@ -2272,6 +2624,7 @@ void MyFrame::DeleteDarkLibraryFiles(int profileId)
         Debug.Write(wxString::Format("Removing dark library file: %s\n", filename));
         wxRemoveFile(filename);
     }
+    DarkLibCache::Remove(filename);
 
     DefectMap::DeleteDefectMap(profileId);
 }
@@ -2393,11 +2746,13 @@ wxString MyFrame::PixelScaleSummary(void) const
 wxString MyFrame::GetSettingsSummary()
 {
     // return a loggable summary of current global configs managed by MyFrame
-    return wxString::Format("Dither = %s, Dither scale = %.3f, Image noise reduction = %s, Guide-frame time lapse = %d, Server %s\n"
+    int binFactor = SoftwareBinFactor(m_softwareBinning);
+    return wxString::Format("Dither = %s, Dither scale = %.3f, Image noise reduction = %s, Software binning = %s, Guide-frame time lapse = %d, Server %s\n"
         "%s\n",
         m_ditherRaOnly ? "RA only" : "both axes",
         m_ditherScaleFactor,
         m_noiseReductionMethod == NR_NONE ? "none" : m_noiseReductionMethod == NR_2x2MEAN ? "2x2 mean" : "3x3 mean",
+        binFactor == 1 ? wxString("none") : wxString::Format("%dx%d %s", binFactor, binFactor, SoftwareBinMean(m_softwareBinning) ? "mean" : "sum"),
         m_timeLapse,
         m_serverMode ? "enabled" : "disabled",
         PixelScaleSummary()
@@ -2491,6 +2846,19 @@ MyFrameConfigDialogCtrlSet::MyFrameConfigDialogCtrlSet(MyFrame *pFrame, Advanced
     AddLabeledCtrl(CtrlMap, AD_szImageLoggingFormat, _("Image logging format"), m_pLoggedImageFormat,
         _("File format of logged images"));
 
+    wxString swbin_choices[] =
+    {
+        _("None"), _("2x2 sum"), _("2x2 mean"), _("3x3 sum"), _("3x3 mean"), _("4x4 sum"), _("4x4 mean")
+    };
+
+    width = StringArrayWidth(swbin_choices, WXSIZEOF(swbin_choices));
+    parent = GetParentWindow(AD_szSoftwareBinning);
+    m_pSoftwareBinning = new wxChoice(parent, wxID_ANY, wxPoint(-1, -1),
+        wxSize(width + 35, -1), WXSIZEOF(swbin_choices), swbin_choices);
+    AddLabeledCtrl(CtrlMap, AD_szSoftwareBinning, _("Software binning"), m_pSoftwareBinning,
+        _("Bin the guide frames in software after dark subtraction and defect removal. "
+          "Speeds up star finding on large sensors. Sum keeps faint stars bright, mean keeps the original pixel range."));
+
     wxString nralgo_choices[] =
     {
         _("None"), _("2x2 mean"), _("3x3 median")
@@ -2510,6 +2878,11 @@ MyFrameConfigDialogCtrlSet::MyFrameConfigDialogCtrlSet(MyFrame *pFrame, Advanced
     AddLabeledCtrl(CtrlMap, AD_szTimeLapse, _("Time Lapse (ms)"), m_pTimeLapse,
         _("How long should PHD wait between guide frames? Default = 0ms, useful when using very short exposures (e.g., using a video camera) but wanting to send guide commands less frequently"));
 
+    parent = GetParentWindow(AD_cbPipelinedCapture);
+    m_pPipelinedCapture = new wxCheckBox(parent, wxID_ANY, _("Overlap exposures with guide corrections"));
+    AddCtrl(CtrlMap, AD_cbPipelinedCapture, m_pPipelinedCapture,
+        _("Start the next guide exposure while the guide correction for the previous frame is being sent. Shortens the guide cycle with long guide pulses. Not used during calibration or with on-camera guiding."));
+
     parent = GetParentWindow(AD_szFocalLength);
     m_pFocalLength = new wxTextCtrl(parent, wxID_ANY, _T("    "), wxDefaultPosition, wxSize(width + 30, -1));
     AddLabeledCtrl(CtrlMap, AD_szFocalLength, _("Focal length (mm)"), m_pFocalLength,
@@ -2570,6 +2943,10 @@ MyFrameConfigDialogCtrlSet::MyFrameConfigDialogCtrlSet(MyFrame *pFrame, Advanced
 
     pInputGroupBox->Add(m_pLogDir, wxSizerFlags(0).Expand());
     pInputGroupBox->Add(pButtonSizer, wxSizerFlags(0).Align(wxRIGHT).Border(wxTop, 20));
+    m_pBinaryGuideLog = new wxCheckBox(parent, wxID_ANY, _("Binary guide log"));
+    m_pBinaryGuideLog->SetToolTip(_("Write the guide log in a compact binary format that is cheaper to write. "
+        "Use phd2_guidelog_convert to convert it to the usual text guide log."));
+    pInputGroupBox->Add(m_pBinaryGuideLog, wxSizerFlags(0).Align(wxALIGN_CENTER_VERTICAL).Border(wxLEFT, 10));
     AddGroup(CtrlMap, AD_szLogFileInfo, pInputGroupBox);
 
     // Dither
@@ -2634,6 +3011,7 @@ void MyFrameConfigDialogCtrlSet::LoadValues()
     m_pResetDontAskAgain->SetValue(false);
     m_pLoggedImageFormat->SetSelection(pFrame->GetLoggedImageFormat());
     m_pNoiseReduction->SetSelection(pFrame->GetNoiseReductionMethod());
+    m_pSoftwareBinning->SetSelection(pFrame->GetSoftwareBinning());
     if (m_pFrame->GetDitherMode() == DITHER_RANDOM)
         m_ditherRandom->SetValue(true);
     else
@@ -2652,7 +3030,9 @@ void MyFrameConfigDialogCtrlSet::LoadValues()
     m_pLogDir->SetValue(GuideLog.GetLogDir());
     m_pLogDir->Enable(!pFrame->CaptureActive);
     m_pSelectDir->Enable(!pFrame->CaptureActive);
+    m_pBinaryGuideLog->SetValue(GuideLog.GetBinaryFormat());
     m_pAutoLoadCalibration->SetValue(m_pFrame->GetAutoLoadCalibration());
+    m_pPipelinedCapture->SetValue(m_pFrame->GetPipelinedCapture());
 
     const AutoExposureCfg& cfg = m_pFrame->GetAutoExposureCfg();
     int idx = dur_index(cfg.minExposure);
@@ -2691,6 +3071,7 @@ void MyFrameConfigDialogCtrlSet::UnloadValues()
 
         m_pFrame->SetLoggedImageFormat((LOGGED_IMAGE_FORMAT)m_pLoggedImageFormat->GetSelection());
         m_pFrame->SetNoiseReductionMethod(m_pNoiseReduction->GetSelection());
+        m_pFrame->SetSoftwareBinning(m_pSoftwareBinning->GetSelection());
         m_pFrame->SetDitherMode(m_ditherRandom->GetValue() ? DITHER_RANDOM : DITHER_SPIRAL);
         m_pFrame->SetDitherRaOnly(m_ditherRaOnly->GetValue());
         m_pFrame->SetDitherScaleFactor(m_ditherScaleFactor->GetValue());
@@ -2710,8 +3091,10 @@ void MyFrameConfigDialogCtrlSet::UnloadValues()
             GuideLog.ChangeDirLog(newdir);
             Debug.ChangeDirLog(newdir);
         }
+        GuideLog.SetBinaryFormat(m_pBinaryGuideLog->GetValue());
 
         m_pFrame->SetAutoLoadCalibration(m_pAutoLoadCalibration->GetValue());
+        m_pFrame->SetPipelinedCapture(m_pPipelinedCapture->GetValue());
 
         wxString sel = m_autoExpDurationMin->GetValue();
         int durationMin = m_pFrame->ExposureDurationFromSelection(sel);
@@ -64,6 +64,27 @@ enum NOISE_REDUCTION_METHOD
     NR_3x3MEDIAN
 };
 
+enum SOFTWARE_BINNING
+{
+    SWBIN_NONE,
+    SWBIN_2x2SUM,
+    SWBIN_2x2MEAN,
+    SWBIN_3x3SUM,
+    SWBIN_3x3MEAN,
+    SWBIN_4x4SUM,
+    SWBIN_4x4MEAN
+};
+
+inline static int SoftwareBinFactor(SOFTWARE_BINNING binning)
+{
+    return binning == SWBIN_NONE ? 1 : (binning + 3) / 2;
+}
+
+inline static bool SoftwareBinMean(SOFTWARE_BINNING binning)
+{
+    return binning == SWBIN_2x2MEAN || binning == SWBIN_3x3MEAN || binning == SWBIN_4x4MEAN;
+}
+
 enum LOGGED_IMAGE_FORMAT
 {
     LIF_LOW_Q_JPEG,
@@ -99,6 +120,14 @@ enum DitherMode
     DITHER_SPIRAL,
 };
 
+// worker thread the primary mount moves go to
+enum MoveDispatch
+{
+    MOVE_DISPATCH_AUTO,     // mount thread, or primary thread for a mount guiding through the camera
+    MOVE_DISPATCH_SHARED,   // primary thread, as before the mount thread
+    MOVE_DISPATCH_MOUNT,    // mount thread, even for a mount guiding through the camera
+};
+
 struct DitherSpiral
 {
     int x, y, dx, dy;
@@ -120,6 +149,7 @@ class MyFrameConfigDialogCtrlSet : public ConfigDialogCtrlSet
     wxSpinCtrlDouble *m_ditherScaleFactor;
     wxCheckBox *m_ditherRaOnly;
     wxChoice *m_pNoiseReduction;
+    wxChoice *m_pSoftwareBinning;
     wxSpinCtrl *m_pTimeLapse;
     wxTextCtrl *m_pFocalLength;
     wxChoice* m_pLanguage;
@@ -127,7 +157,9 @@ class MyFrameConfigDialogCtrlSet : public ConfigDialogCtrlSet
     int m_oldLanguageChoice;
     wxTextCtrl *m_pLogDir;
     wxButton *m_pSelectDir;
+    wxCheckBox *m_pBinaryGuideLog;
     wxCheckBox *m_pAutoLoadCalibration;
+    wxCheckBox *m_pPipelinedCapture;
     wxComboBox *m_autoExpDurationMin;
     wxComboBox *m_autoExpDurationMax;
     wxSpinCtrlDouble *m_autoExpSNR;
@@ -149,6 +181,9 @@ protected:
     NOISE_REDUCTION_METHOD GetNoiseReductionMethod(void);
     bool SetNoiseReductionMethod(int noiseReductionMethod);
 
+    SOFTWARE_BINNING GetSoftwareBinning(void);
+    bool SetSoftwareBinning(int softwareBinning);
+
     bool GetServerMode(void);
     bool SetServerMode(bool val);
 
@@ -161,12 +196,19 @@ protected:
 
     void SetAutoLoadCalibration(bool val);
 
+    bool GetPipelinedCapture(void) const;
+    void SetPipelinedCapture(bool val);
+
+    // for the latency benchmark only, while capture is stopped
+    void SetMoveDispatch(MoveDispatch dispatch);
+
     friend class MyFrameConfigDialogPane;
     friend class MyFrameConfigDialogCtrlSet;
     friend class WorkerThread;
 
 private:
     NOISE_REDUCTION_METHOD m_noiseReductionMethod;
+    SOFTWARE_BINNING m_softwareBinning;
     bool m_image_logging_enabled;
     LOGGED_IMAGE_FORMAT m_logged_image_format;
     DitherMode m_ditherMode;
@@ -178,6 +220,8 @@ private:
     int  m_focalLength;
     double m_sampling;
     bool m_autoLoadCalibration;
+    bool m_pipelinedCapture; // start the next exposure before the guide correction completes
+    MoveDispatch m_moveDispatch;
     int m_instanceNumber;
 
     wxAuiManager m_mgr;
@@ -224,6 +268,7 @@ public:
     wxDialog *pCalReviewDlg;
     bool CaptureActive; // Is camera looping captures?
     bool m_exposurePending; // exposure scheduled and not completed
+    bool m_exposureDeferred; // next exposure waits for the guide correction on the mount thread
     double Stretch_gamma;
     wxLocale *m_pLocale;
     unsigned int m_frameCounter;
@@ -354,10 +399,15 @@ public:
     void OnRequestExposure(wxCommandEvent& evt);
     void OnRequestMountMove(wxCommandEvent& evt);
 
-    void ScheduleExposure(void);
+    void ScheduleExposure(bool pipelined = false);
+    bool CanPipelineCapture(void) const;
+    bool SynchronousMountConnected(void) const;
+    WorkerThread *MoveWorkerThread(void) const;
 
-    void SchedulePrimaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, MountMoveType moveType);
-    void ScheduleSecondaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, MountMoveType moveType);
+    void SchedulePrimaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, MountMoveType moveType,
+        const ExposureWindow& exposure = ExposureWindow(), const FrameLatency *latency = NULL);
+    void ScheduleSecondaryMove(Mount *pMount, const PHD_Point& vectorEndpoint, MountMoveType moveType,
+        const ExposureWindow& exposure = ExposureWindow());
     void ScheduleCalibrationMove(Mount *pMount, const GUIDE_DIRECTION direction, int duration);
 
     void StartCapturing(void);
@@ -395,6 +445,9 @@ private:
     wxCriticalSection m_CSpWorkerThread;
     WorkerThread *m_pPrimaryWorkerThread;
     WorkerThread *m_pSecondaryWorkerThread;
+    WorkerThread *m_pCaptureWorkerThread;   // exposures overlapping a guide correction
+    WorkerThread *m_pMountWorkerThread;     // guide pulses, unless a mount guides through the camera
+    WorkerThread *m_pExposureWorkerThread;  // thread running the pending exposure
 
     wxSocketServer *SocketServer;
     wxTimer m_statusbarTimer;
@@ -584,6 +637,7 @@ enum {
     EEGG_STICKY_LOCK,
     EEGG_FLIPRACAL,
     STAR_MASS_ENABLE,
+    MULTI_STAR_ENABLE,
     MENU_BOOKMARKS_SHOW,
     MENU_BOOKMARKS_SET_AT_LOCK,
     MENU_BOOKMARKS_SET_AT_STAR,
@@ -595,6 +649,8 @@ enum {
     SOCK_SERVER_CLIENT_ID,
     EVENT_SERVER_ID,
     EVENT_SERVER_CLIENT_ID,
+    FRAME_SERVER_ID,
+    FRAME_SERVER_CLIENT_ID,
 };
 
 wxDECLARE_EVENT(APPSTATE_NOTIFY_EVENT, wxCommandEvent);
@@ -618,7 +674,7 @@ inline double MyFrame::GetPixelScale(double pixelSizeMicrons, int focalLengthMm,
 
 inline double MyFrame::TimeSinceGuidingStarted(void) const
 {
-    return (wxDateTime::UNow() - m_guidingStarted).GetMilliseconds().ToDouble() / 1000.0;
+    return (ReplayClock::UNow() - m_guidingStarted).GetMilliseconds().ToDouble() / 1000.0;
 }
 
 inline Star::FindMode MyFrame::GetStarFindMode(void) const
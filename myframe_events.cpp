@@ -291,6 +291,11 @@ void MyFrame::FinishStop(void)
 {
     assert(!CaptureActive);
     EvtServer.NotifyLoopingStopped();
+
+    unsigned int poolHits, poolMisses;
+    usImagePool::GetCounters(&poolHits, &poolMisses);
+    Debug.Write(wxString::Format("image pool: hits = %u misses = %u\n", poolHits, poolMisses));
+
     // when looping resumes, start with at least one full frame. This enables applications
     // controlling PHD to auto-select a new star if the star is lost while looping was stopped.
     pGuider->ForceFullFrame();
@@ -339,9 +344,12 @@ void MyFrame::OnExposeComplete(usImage *pNewFrame, bool err)
 
         m_exposurePending = false;
 
+        if (pNewFrame)
+            pNewFrame->Latency.Stamp(LAT_DISPATCHED);
+
         if (pGuider->GetPauseType() == PAUSE_FULL)
         {
-            delete pNewFrame;
+            usImagePool::Release(pNewFrame);
             Debug.Write("guider is paused, ignoring frame, not scheduling exposure\n");
             return;
         }
@@ -350,7 +358,7 @@ void MyFrame::OnExposeComplete(usImage *pNewFrame, bool err)
         {
             Debug.Write("OnExposeComplete: Capture Error reported\n");
 
-            delete pNewFrame;
+            usImagePool::Release(pNewFrame);
 
             bool stopping = !m_continueCapturing;
             StopCapturing();
@@ -386,19 +394,42 @@ void MyFrame::OnExposeComplete(usImage *pNewFrame, bool err)
             CheckDarkFrameGeometry();
         }
 
+        // start the next exposure now so that it overlaps the guide correction for this frame
+        if (m_continueCapturing && CanPipelineCapture())
+        {
+            ScheduleExposure(true);
+        }
+
         pGuider->UpdateGuideState(pNewFrame, !m_continueCapturing);
         pNewFrame = NULL; // the guider owns it now
 
         PhdController::UpdateControllerState();
 
-        Debug.Write(wxString::Format("OnExposeComplete: CaptureActive=%d m_continueCapturing=%d\n",
-            CaptureActive, m_continueCapturing));
+        Debug.Write(wxString::Format("OnExposeComplete: CaptureActive=%d m_continueCapturing=%d exposurePending=%d\n",
+            CaptureActive, m_continueCapturing, m_exposurePending));
+
+        if (m_exposurePending)
+        {
+            // the pipelined exposure is still running; if capture was stopped in the meantime
+            // StopCapturing() interrupted it and its completion will finish the stop
+            return;
+        }
 
         CaptureActive = m_continueCapturing;
 
         if (CaptureActive)
         {
-            ScheduleExposure();
+            if (m_pMountWorkerThread->MovesPending())
+            {
+                // without pipelining, the next exposure must see the whole correction for this
+                // frame, so it starts when the mount thread is done (see OnMoveComplete)
+                Debug.Write("OnExposeComplete: deferring exposure until the mount move completes\n");
+                m_exposureDeferred = true;
+            }
+            else
+            {
+                ScheduleExposure();
+            }
         }
         else
         {
@@ -431,6 +462,19 @@ void MyFrame::OnMoveComplete(wxThreadEvent& event)
 
         mount->LogGuideStepInfo();
 
+        if (LatencyStats::PublishDue())
+            EvtServer.NotifyLatencyStats();
+
+        if (m_exposureDeferred && !m_pMountWorkerThread->MovesPending())
+        {
+            m_exposureDeferred = false;
+            if (CaptureActive && m_continueCapturing && !m_exposurePending)
+            {
+                Debug.Write("OnMoveComplete: scheduling deferred exposure\n");
+                ScheduleExposure();
+            }
+        }
+
         // deliver the outstanding GuidingStopped notification if this is a late-arriving
         // move completion event
         if (!pGuider->IsCalibratingOrGuiding() &&
@@ -0,0 +1,349 @@
+/*
+ *  pec_evaluate.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Replays the RA guide steps of guide logs through the predictive PEC guide
+ * algorithm and a plain proportional controller, and reports the RMS error
+ * of both.
+ *
+ *   phd2_pec_evaluate [-a AGGRESSION] [-g PREDICTION_GAIN] [-m MIN_MOVE] GUIDE_LOG...
+ *
+ * Text and binary guide logs are accepted. For each guiding section, the
+ * uncorrected RA position is reconstructed as the recorded error plus the sum
+ * of the guide distances applied before it; the controllers are then
+ * simulated against that position, assuming the mount moves by the requested
+ * distance. Sections guided with an AO are skipped.
+ */
+
+#include "guidelog_binary.h"
+#include "pec_predictor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct Step
+{
+    double time;
+    double raw;         // RA error, px
+    double applied;     // RA guide distance applied, px
+    bool dither;        // the lock position was moved before this step
+};
+
+struct Section
+{
+    std::vector<Step> steps;
+    unsigned int dithers;
+    Section() : dithers(0) { }
+};
+
+struct Params
+{
+    double aggression;
+    double predictionGain;
+    double minMove;
+};
+
+struct Result
+{
+    double sumRecorded;
+    double sumReactive;
+    double sumPredictive;
+    unsigned int count;
+};
+
+static bool ReadFile(const char *fileName, std::string *text)
+{
+    char magic[8];
+    FILE *fp = fopen(fileName, "rb");
+    if (!fp)
+        return true;
+    size_t const n = fread(magic, 1, sizeof(magic), fp);
+
+    if (n == sizeof(magic) && memcmp(magic, "PHD2GLOG", sizeof(magic)) == 0)
+    {
+        fclose(fp);
+
+        GuideLogReader reader;
+        std::string err;
+        if (reader.Open(fileName, &err))
+        {
+            fprintf(stderr, "%s: %s\n", fileName, err.c_str());
+            return true;
+        }
+        for (size_t idx = 0; idx < reader.RecordCount(); )
+            idx = reader.Format(idx, text);
+        return false;
+    }
+
+    text->assign(magic, n);
+    char buf[64 * 1024];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        text->append(buf, len);
+    fclose(fp);
+    return false;
+}
+
+static void ParseLog(const std::string& text, std::vector<Section> *sections)
+{
+    bool inSection = false;
+    bool ao = false;
+    bool dither = false;
+
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = text.size();
+        std::string line(text, pos, eol - pos);
+        pos = eol + 1;
+
+        if (line.compare(0, 14, "Guiding Begins") == 0)
+        {
+            sections->push_back(Section());
+            inSection = true;
+            ao = false;
+            dither = false;
+            continue;
+        }
+        if (line.compare(0, 12, "Guiding Ends") == 0)
+        {
+            inSection = false;
+            continue;
+        }
+        if (!inSection)
+            continue;
+
+        if (line.compare(0, 12, "INFO: DITHER") == 0)
+        {
+            dither = true;
+            continue;
+        }
+
+        int frame, duration;
+        double time, dx, dy, raRaw, decRaw, raGuide, decGuide;
+        char mount[16];
+        int const n = sscanf(line.c_str(), "%d,%lf,\"%15[^\"]\",%lf,%lf,%lf,%lf,%lf,%lf,%d",
+                             &frame, &time, mount, &dx, &dy, &raRaw, &decRaw, &raGuide, &decGuide, &duration);
+        if (n < 3)
+            continue;
+
+        if (strcmp(mount, "AO") == 0)
+            ao = true;
+        if (ao || n != 10 || strcmp(mount, "Mount") != 0)
+            continue;
+
+        Section& section = sections->back();
+        if (!section.steps.empty() && time <= section.steps.back().time)
+            continue;
+
+        Step step;
+        step.time = time;
+        step.raw = raRaw;
+        step.applied = duration > 0 ? raGuide : 0.0;
+        step.dither = dither;
+        section.steps.push_back(step);
+
+        if (dither)
+            ++section.dithers;
+        dither = false;
+    }
+}
+
+static void Evaluate(const Section& section, const Params& params, Result *result, PecPredictor *predictor)
+{
+    const std::vector<Step>& steps = section.steps;
+
+    result->sumRecorded = result->sumReactive = result->sumPredictive = 0.0;
+    result->count = (unsigned int) steps.size();
+    predictor->Reset();
+
+    double drift = 0.0;         // applied guide distance in the log
+    double reactive = 0.0;      // simulated applied distances
+    double predictive = 0.0;
+
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        const Step& s = steps[i];
+
+        // position the mount would have reached without guiding
+        double const position = s.raw + drift;
+        drift += s.applied;
+
+        result->sumRecorded += s.raw * s.raw;
+
+        // proportional controller
+        double err = position - reactive;
+        result->sumReactive += err * err;
+        if (fabs(err) >= params.minMove)
+            reactive += params.aggression * err;
+
+        // the same controller with the predicted periodic error fed forward,
+        // as in GuideAlgorithmPredictivePec::result()
+        err = position - predictive;
+        result->sumPredictive += err * err;
+
+        if (s.dither)
+            predictor->Discontinuity();
+        predictor->AddSample(s.time, err + predictive);
+
+        double move = fabs(err) >= params.minMove ? params.aggression * err : 0.0;
+        if (predictor->IsValid() && i > 0)
+        {
+            double const interval = s.time - steps[i - 1].time;
+            move += params.predictionGain * (predictor->Predict(s.time + interval) - predictor->Predict(s.time));
+        }
+        predictive += move;
+    }
+}
+
+static double Rms(double sum, unsigned int count)
+{
+    return count ? sqrt(sum / count) : 0.0;
+}
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-a AGGRESSION] [-g PREDICTION_GAIN] [-m MIN_MOVE] GUIDE_LOG...\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    Params params;
+    params.aggression = 0.7;
+    params.predictionGain = 0.8;
+    params.minMove = 0.2;
+
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++)
+    {
+        if (argi + 1 >= argc)
+        {
+            Usage(argv[0]);
+            return 2;
+        }
+        double const val = atof(argv[argi + 1]);
+        if (strcmp(argv[argi], "-a") == 0)
+            params.aggression = val;
+        else if (strcmp(argv[argi], "-g") == 0)
+            params.predictionGain = val;
+        else if (strcmp(argv[argi], "-m") == 0)
+            params.minMove = val;
+        else
+        {
+            Usage(argv[0]);
+            return 2;
+        }
+        ++argi;
+    }
+
+    if (argi >= argc)
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    printf("aggression %.2f, prediction gain %.2f, min move %.2f px\n",
+           params.aggression, params.predictionGain, params.minMove);
+
+    Result total;
+    total.sumRecorded = total.sumReactive = total.sumPredictive = 0.0;
+    total.count = 0;
+
+    PecPredictor *predictor = new PecPredictor();
+    int ret = 0;
+
+    for (; argi < argc; argi++)
+    {
+        std::string text;
+        if (ReadFile(argv[argi], &text))
+        {
+            fprintf(stderr, "cannot read %s\n", argv[argi]);
+            ret = 1;
+            continue;
+        }
+
+        std::vector<Section> sections;
+        ParseLog(text, &sections);
+
+        for (size_t i = 0; i < sections.size(); i++)
+        {
+            const Section& section = sections[i];
+            if (section.steps.size() < PecPredictor::MIN_SAMPLES)
+                continue;
+
+            Result r;
+            Evaluate(section, params, &r, predictor);
+
+            double const reactive = Rms(r.sumReactive, r.count);
+            double const predictive = Rms(r.sumPredictive, r.count);
+
+            printf("\n%s, section %u: %u steps, %.1f min, %u dithers\n", argv[argi], (unsigned int) i + 1, r.count,
+                   (section.steps.back().time - section.steps.front().time) / 60.0, section.dithers);
+            printf("  recorded RMS    %.3f px\n", Rms(r.sumRecorded, r.count));
+            printf("  reactive RMS    %.3f px\n", reactive);
+            printf("  predictive RMS  %.3f px (%+.1f%%)\n", predictive,
+                   reactive > 0.0 ? 100.0 * (predictive - reactive) / reactive : 0.0);
+            for (unsigned int c = 0; c < predictor->ComponentCount(); c++)
+            {
+                const PecPredictor::Component& comp = predictor->GetComponent(c);
+                printf("  periodic error  %.1f s, %.3f px\n", comp.period, comp.amplitude);
+            }
+
+            total.sumRecorded += r.sumRecorded;
+            total.sumReactive += r.sumReactive;
+            total.sumPredictive += r.sumPredictive;
+            total.count += r.count;
+        }
+    }
+
+    delete predictor;
+
+    if (total.count)
+    {
+        double const reactive = Rms(total.sumReactive, total.count);
+        double const predictive = Rms(total.sumPredictive, total.count);
+        printf("\ntotal: %u steps, recorded RMS %.3f px, reactive RMS %.3f px, predictive RMS %.3f px (%+.1f%%)\n",
+               total.count, Rms(total.sumRecorded, total.count), reactive, predictive,
+               reactive > 0.0 ? 100.0 * (predictive - reactive) / reactive : 0.0);
+    }
+    else
+        printf("no mount guiding sections long enough to evaluate\n");
+
+    return ret;
+}
@@ -0,0 +1,257 @@
+/*
+ *  pec_predictor.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "pec_predictor.h"
+
+#include <algorithm>
+#include <math.h>
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+// a spectral peak is taken as a periodic error component when it stands this
+// many times above the median peak, which is mostly noise
+static const double NoiseRatio = 4.0;
+
+// shorter periods cannot be followed at the guiding rate
+static const double MinPeriodSamples = 8.0;
+
+// solves the n x n system a x = b in place by Gaussian elimination with
+// partial pivoting, returns true if the system is singular
+static bool Solve(double a[][2 + 2 * PecPredictor::MAX_COMPONENTS], double *b, unsigned int n)
+{
+    for (unsigned int col = 0; col < n; col++)
+    {
+        unsigned int pivot = col;
+        for (unsigned int r = col + 1; r < n; r++)
+            if (fabs(a[r][col]) > fabs(a[pivot][col]))
+                pivot = r;
+
+        if (fabs(a[pivot][col]) < 1e-12)
+            return true;
+
+        if (pivot != col)
+        {
+            for (unsigned int c = 0; c < n; c++)
+                std::swap(a[col][c], a[pivot][c]);
+            std::swap(b[col], b[pivot]);
+        }
+
+        for (unsigned int r = col + 1; r < n; r++)
+        {
+            double const f = a[r][col] / a[col][col];
+            for (unsigned int c = col; c < n; c++)
+                a[r][c] -= f * a[col][c];
+            b[r] -= f * b[col];
+        }
+    }
+
+    for (int r = n - 1; r >= 0; r--)
+    {
+        double v = b[r];
+        for (unsigned int c = r + 1; c < n; c++)
+            v -= a[r][c] * b[c];
+        b[r] = v / a[r][r];
+    }
+
+    return false;
+}
+
+PecPredictor::PecPredictor(void)
+{
+    Reset();
+}
+
+void PecPredictor::Reset(void)
+{
+    m_head = 0;
+    m_count = 0;
+    m_sinceRefit = 0;
+    m_t0 = 0.0;
+    m_offset = 0.0;
+    m_rebase = false;
+    m_componentCount = 0;
+}
+
+void PecPredictor::AddSample(double time, double position)
+{
+    if (m_count == 0)
+        m_t0 = time;
+
+    double const t = time - m_t0;
+
+    unsigned int const last = (m_head + m_count - 1) % MAX_SAMPLES;
+
+    if (m_count > 0 && t <= m_time[last])
+        return;
+
+    if (m_rebase)
+    {
+        m_rebase = false;
+        if (m_count > 0)
+        {
+            double const expected = m_pos[last] + Predict(time) - Predict(m_t0 + m_time[last]);
+            m_offset = expected - position;
+        }
+    }
+
+    position += m_offset;
+
+    if (m_count < MAX_SAMPLES)
+    {
+        unsigned int const idx = (m_head + m_count) % MAX_SAMPLES;
+        m_time[idx] = t;
+        m_pos[idx] = position;
+        ++m_count;
+    }
+    else
+    {
+        m_time[m_head] = t;
+        m_pos[m_head] = position;
+        m_head = (m_head + 1) % MAX_SAMPLES;
+    }
+
+    if (++m_sinceRefit >= REFIT_INTERVAL && m_count >= MIN_SAMPLES)
+    {
+        m_sinceRefit = 0;
+        Refit();
+    }
+}
+
+double PecPredictor::Predict(double time) const
+{
+    double const t = time - m_t0;
+    double val = 0.0;
+
+    for (unsigned int i = 0; i < m_componentCount; i++)
+    {
+        const Component& c = m_components[i];
+        double const w = 2.0 * M_PI / c.period;
+        val += c.c * cos(w * t) + c.s * sin(w * t);
+    }
+
+    return val;
+}
+
+void PecPredictor::Refit(void)
+{
+    unsigned int const n = m_count;
+
+    m_t.resize(n);
+    m_x.resize(n);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        unsigned int const idx = (m_head + i) % MAX_SAMPLES;
+        m_t[i] = m_time[idx];
+        m_x[i] = m_pos[idx];
+    }
+
+    double const span = m_t[n - 1] - m_t[0];
+    double const dt = span / (double) (n - 1);
+
+    FindSpectralPeaks(&m_t[0], &m_x[0], n, span / 2.0, &m_peaks);
+
+    // the peaks are sorted by decreasing amplitude, the median is the noise level
+    double const noise = m_peaks.empty() ? 0.0 : m_peaks[m_peaks.size() / 2].amplitude;
+
+    double periods[MAX_COMPONENTS];
+    unsigned int nc = 0;
+    for (size_t i = 0; i < m_peaks.size() && nc < MAX_COMPONENTS; i++)
+    {
+        const SpectralPeak& p = m_peaks[i];
+        if (p.amplitude < NoiseRatio * noise)
+            break;
+        if (p.period >= MinPeriodSamples * dt)
+            periods[nc++] = p.period;
+    }
+
+    if (nc == 0)
+    {
+        m_componentCount = 0;
+        return;
+    }
+
+    // least squares fit of a line plus the sinusoids at the detected periods;
+    // the line is expressed on [-1, 1] over the window to keep the normal
+    // equations well conditioned
+    enum { MAXN = 2 + 2 * MAX_COMPONENTS };
+    unsigned int const k = 2 + 2 * nc;
+    double a[MAXN][MAXN] = { { 0.0 } };
+    double b[MAXN] = { 0.0 };
+    double w[MAX_COMPONENTS];
+    for (unsigned int j = 0; j < nc; j++)
+        w[j] = 2.0 * M_PI / periods[j];
+
+    double const tmid = 0.5 * (m_t[0] + m_t[n - 1]);
+    double const tscale = span > 0.0 ? 2.0 / span : 1.0;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        double f[MAXN];
+        f[0] = 1.0;
+        f[1] = (m_t[i] - tmid) * tscale;
+        for (unsigned int j = 0; j < nc; j++)
+        {
+            f[2 + 2 * j] = cos(w[j] * m_t[i]);
+            f[3 + 2 * j] = sin(w[j] * m_t[i]);
+        }
+
+        for (unsigned int r = 0; r < k; r++)
+        {
+            for (unsigned int c = r; c < k; c++)
+                a[r][c] += f[r] * f[c];
+            b[r] += f[r] * m_x[i];
+        }
+    }
+
+    for (unsigned int r = 1; r < k; r++)
+        for (unsigned int c = 0; c < r; c++)
+            a[r][c] = a[c][r];
+
+    if (Solve(a, b, k))
+    {
+        m_componentCount = 0;
+        return;
+    }
+
+    for (unsigned int j = 0; j < nc; j++)
+    {
+        Component& c = m_components[j];
+        c.period = periods[j];
+        c.c = b[2 + 2 * j];
+        c.s = b[3 + 2 * j];
+        c.amplitude = sqrt(c.c * c.c + c.s * c.s);
+    }
+    m_componentCount = nc;
+}
@@ -0,0 +1,117 @@
+/*
+ *  pec_predictor.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PEC_PREDICTOR_H_INCLUDED
+#define PEC_PREDICTOR_H_INCLUDED
+
+#include "spectrum.h"
+
+#include <vector>
+
+/*
+ * Online estimate of the periodic error of a mount axis.
+ *
+ * The input is the position the axis would have reached without guiding:
+ * the measured guide error plus all the corrections applied so far. The most
+ * recent MAX_SAMPLES positions are kept in a ring buffer. Every REFIT_INTERVAL
+ * samples, the dominant periodic components are located with
+ * FindSpectralPeaks() and their amplitudes and phases are refined by a least
+ * squares fit (together with a linear drift) over the whole window.
+ *
+ * Adding a sample is O(1); a refit is O(N log N) in the fixed window size, so
+ * the cost per guide step is bounded however long guiding runs.
+ *
+ * This header and pec_predictor.cpp do not depend on wxWidgets, so that the
+ * guide log evaluation tool can use them directly.
+ */
+class PecPredictor
+{
+public:
+    enum
+    {
+        MAX_SAMPLES = 1024,
+        MIN_SAMPLES = 64,
+        REFIT_INTERVAL = 16,
+        MAX_COMPONENTS = 2,
+    };
+
+    struct Component
+    {
+        double period;          // seconds
+        double amplitude;       // same unit as the positions
+        double c;               // cosine and sine coefficients, phase origin
+        double s;               // at the time of the first sample
+    };
+
+    PecPredictor(void);
+
+    void Reset(void);
+
+    // time in seconds, increasing
+    void AddSample(double time, double position);
+
+    // the reference of the positions jumps (the lock position was moved by a
+    // dither): the next sample is shifted to continue the history
+    void Discontinuity(void) { m_rebase = true; }
+
+    unsigned int Count(void) const { return m_count; }
+    bool IsValid(void) const { return m_componentCount > 0; }
+    unsigned int ComponentCount(void) const { return m_componentCount; }
+    const Component& GetComponent(unsigned int idx) const { return m_components[idx]; }
+
+    // the periodic part of the position at the given time, 0 until a
+    // periodic component has been found
+    double Predict(double time) const;
+
+private:
+    double m_time[MAX_SAMPLES];     // seconds since m_t0
+    double m_pos[MAX_SAMPLES];
+    unsigned int m_head;            // index of the oldest sample
+    unsigned int m_count;
+    unsigned int m_sinceRefit;
+    double m_t0;
+    double m_offset;                // added to the positions since the last discontinuity
+    bool m_rebase;
+
+    Component m_components[MAX_COMPONENTS];
+    unsigned int m_componentCount;
+
+    // scratch space for the refits, kept to avoid reallocating
+    std::vector<double> m_t;
+    std::vector<double> m_x;
+    std::vector<SpectralPeak> m_peaks;
+
+    void Refit(void);
+};
+
+#endif // PEC_PREDICTOR_H_INCLUDED
@@ -62,6 +62,9 @@ static const wxCmdLineEntryDesc cmdLineDesc[] =
 {
     { wxCMD_LINE_OPTION, "i", "instanceNumber", "sets the PHD2 instance number (default = 1)", wxCMD_LINE_VAL_NUMBER, wxCMD_LINE_PARAM_OPTIONAL},
     { wxCMD_LINE_SWITCH, "R", "Reset", "Reset all PHD2 settings to default values"},
+    { wxCMD_LINE_OPTION, "", "replay", "replay the FITS frames in DIR through the guide loop without a window, then exit", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL},
+    { wxCMD_LINE_OPTION, "", "replay-out", "replay results file (default = DIR/replay.csv)", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL},
+    { wxCMD_LINE_OPTION, "", "latency-benchmark", "guide with the simulator of the profile without a window, write the guide pulse latency of each move dispatch mode to FILE, then exit", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL},
     { wxCMD_LINE_NONE }
 };
 
@@ -91,6 +94,7 @@ PhdApp::PhdApp(void)
 {
     m_resetConfig = false;
     m_instanceNumber = 1;
+    m_exitCode = 0;
 #ifdef  __linux__
     XInitThreads();
 #endif // __linux__
@@ -130,6 +134,11 @@ bool PhdApp::OnInit()
 
     Debug.Init("debug", true);
 
+#if wxUSE_ON_FATAL_EXCEPTION
+    // so that the debug log messages still in memory are written if we crash
+    wxHandleFatalExceptions();
+#endif
+
     Debug.AddLine(wxString::Format("PHD2 version %s begins execution with:", FULLVER));
     Debug.AddLine(wxString::Format("   %s", wxVERSION_STRING));
     float dummy;
@@ -180,6 +189,20 @@ bool PhdApp::OnInit()
 
     pFrame = new MyFrame(m_instanceNumber, &m_locale);
 
+    if (!m_replayDir.IsEmpty())
+    {
+        // headless replay: the frame provides the guider but is never shown
+        CallAfter(&PhdApp::RunReplay);
+        return true;
+    }
+
+    if (!m_latencyBenchmarkOut.IsEmpty())
+    {
+        // headless like the replay, the benchmark runs from the event loop
+        CallAfter(&PhdApp::RunLatencyBenchmark);
+        return true;
+    }
+
     pFrame->Show(true);
 
     if (pConfig->IsNewInstance() || (pConfig->NumProfiles() == 1 && pFrame->pGearDialog->IsEmptyProfile()))
@@ -204,9 +227,65 @@ int PhdApp::OnExit(void)
     delete m_instanceChecker; // OnExit() won't be called if we return false
     m_instanceChecker = 0;
 
+    Debug.StopWriter();
+
     return wxApp::OnExit();
 }
 
+void PhdApp::RunReplay(void)
+{
+    wxString outFile = m_replayOut;
+    if (outFile.IsEmpty())
+    {
+        outFile = m_replayDir + PATHSEPSTR "replay.csv";
+    }
+
+    // Run() returns true on error
+    if (ReplayDriver::Run(m_replayDir, outFile))
+    {
+        Debug.AddLine("replay failed");
+        m_exitCode = 1;
+    }
+
+    pFrame->Close(true);
+}
+
+void PhdApp::RunLatencyBenchmark(void)
+{
+    // Start() returns true on error
+    if (LatencyBenchmark::Start(m_latencyBenchmarkOut))
+    {
+        LatencyBenchmarkDone(true);
+    }
+}
+
+void PhdApp::LatencyBenchmarkDone(bool error)
+{
+    if (error)
+    {
+        Debug.AddLine("latency benchmark failed");
+        m_exitCode = 1;
+    }
+
+    pFrame->Close(true);
+}
+
+int PhdApp::OnRun(void)
+{
+    int ret = wxApp::OnRun();
+
+    // the main loop exit code does not reflect a failed replay or benchmark
+    return m_exitCode ? m_exitCode : ret;
+}
+
+#if wxUSE_ON_FATAL_EXCEPTION
+void PhdApp::OnFatalException(void)
+{
+    Debug.AddLine("fatal exception");
+    Debug.EmergencyFlush();
+}
+#endif
+
 void PhdApp::OnInitCmdLine(wxCmdLineParser& parser)
 {
     parser.SetDesc(cmdLineDesc);
@@ -221,6 +300,10 @@ bool PhdApp::OnCmdLineParsed(wxCmdLineParser & parser)
 
     m_resetConfig = parser.Found("R");
 
+    (void)parser.Found("replay", &m_replayDir);
+    (void)parser.Found("replay-out", &m_replayOut);
+    (void)parser.Found("latency-benchmark", &m_latencyBenchmarkOut);
+
     return bReturn;
 }
 
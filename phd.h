@@ -43,6 +43,7 @@
 #include <wx/dcbuffer.h>
 #include <wx/display.h>
 #include <wx/ffile.h>
+#include <wx/file.h>
 #include <wx/fileconf.h>
 #include <wx/graphics.h>
 #include <wx/grid.h>
@@ -66,6 +67,7 @@
 #include <map>
 #include <math.h>
 #include <stdarg.h>
+#include <string>
 
 #define APPNAME _T("PHD2 Guiding")
 #define PHDVERSION _T("2.6.1")
@@ -145,6 +147,7 @@ WX_DEFINE_ARRAY_DOUBLE(double, ArrayOfDbl);
 #include "phdconfig.h"
 #include "configdialog.h"
 #include "optionsbutton.h"
+#include "latency_stats.h"
 #include "usImage.h"
 #include "point.h"
 #include "star.h"
@@ -167,14 +170,19 @@ WX_DEFINE_ARRAY_DOUBLE(double, ArrayOfDbl);
 #include "scopes.h"
 #include "stepguiders.h"
 #include "rotators.h"
+#include "row_band.h"
 #include "image_math.h"
+#include "darklib_cache.h"
+#include "replay.h"
 #include "testguide.h"
 #include "advanced_dialog.h"
 #include "gear_dialog.h"
 #include "myframe.h"
+#include "latency_benchmark.h"
 #include "debuglog.h"
 #include "worker_thread.h"
 #include "event_server.h"
+#include "frame_server.h"
 #include "confirm_dialog.h"
 #include "phdcontrol.h"
 #include "runinbg.h"
@@ -206,6 +214,10 @@ class PhdApp : public wxApp
     wxSingleInstanceChecker *m_instanceChecker;
     long m_instanceNumber;
     bool m_resetConfig;
+    wxString m_replayDir;
+    wxString m_replayOut;
+    wxString m_latencyBenchmarkOut;
+    int m_exitCode;
     wxString m_localeDir;
 
 protected:
@@ -216,9 +228,16 @@ public:
 
     PhdApp(void);
     bool OnInit(void);
+    int OnRun(void);
     int OnExit(void);
+#if wxUSE_ON_FATAL_EXCEPTION
+    void OnFatalException(void);
+#endif
     void OnInitCmdLine(wxCmdLineParser& parser);
     bool OnCmdLineParsed(wxCmdLineParser & parser);
+    void RunReplay(void);
+    void RunLatencyBenchmark(void);
+    void LatencyBenchmarkDone(bool error);
     virtual bool Yield(bool onlyIfNeeded=false);
     wxString GetLocaleDir() const { return m_localeDir; }
 };
@@ -0,0 +1,376 @@
+/*
+ *  replay.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "phd.h"
+
+#include <wx/dir.h>
+
+#include <algorithm>
+#include <vector>
+
+bool ReplayClock::s_virtual = false;
+wxLongLong ReplayClock::s_now;
+
+void ReplayClock::Start(const wxLongLong& now)
+{
+    s_now = now;
+    s_virtual = true;
+}
+
+void ReplayClock::Advance(int ms)
+{
+    if (s_virtual)
+        s_now += ms;
+}
+
+void ReplayClock::Stop(void)
+{
+    s_virtual = false;
+}
+
+// exposure assumed for frames without an EXPOSURE keyword
+static const int DefaultReplayExposure = 1000;
+
+/*
+ * The mount the replayed guide steps are sent to. The recorded frames do not
+ * respond to the corrections, so a pulse only advances the virtual clock by
+ * its duration.
+ *
+ * The class name is the one of all the scopes so that the guide algorithm
+ * settings and the calibration of the profile are used.
+ */
+class ReplayScope : public Scope
+{
+public:
+    ReplayScope(void)
+    {
+        m_Name = _("Replay");
+    }
+
+    virtual bool HasNonGuiMove(void)
+    {
+        return true;
+    }
+
+    const GuideStepInfo& LastStep(void) const
+    {
+        return m_lastStep;
+    }
+
+private:
+    virtual MOVE_RESULT Guide(GUIDE_DIRECTION direction, int durationMs)
+    {
+        ReplayClock::Advance(durationMs);
+        return MOVE_OK;
+    }
+};
+
+struct StageStats
+{
+    std::vector<double> samples;    // microseconds
+
+    void Add(double us) { samples.push_back(us); }
+    wxString Summary(const char *name) const;
+};
+
+wxString StageStats::Summary(const char *name) const
+{
+    if (samples.empty())
+        return wxString::Format("# %s: no samples\n", name);
+
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (size_t i = 0; i < sorted.size(); i++)
+        sum += sorted[i];
+
+    size_t n = sorted.size();
+    return wxString::Format("# %s: n=%u mean=%.1f median=%.1f p99=%.1f max=%.1f us\n", name, (unsigned int) n,
+        sum / n, sorted[n / 2], sorted[std::min(n - 1, (size_t)(n * 0.99))], sorted[n - 1]);
+}
+
+static bool s_active;
+static ReplayScope *s_scope;
+static double s_moveUs;
+static bool s_stepValid;
+static GuideStepInfo s_step;
+
+bool ReplayDriver::IsActive(void)
+{
+    return s_active;
+}
+
+void ReplayDriver::Move(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure)
+{
+    assert(mount == s_scope);
+
+    mount->IncrementRequestCount();
+
+    wxStopWatch swatch;
+    Mount::MOVE_RESULT result = mount->Move(vectorEndpoint, moveType, exposure);
+    s_moveUs += swatch.TimeInMicro().ToDouble();
+
+    s_step = s_scope->LastStep();
+    s_stepValid = s_step.frameNumber >= 0;
+
+    // what MyFrame::OnMoveComplete() does when the worker thread is done
+    mount->DecrementRequestCount();
+    mount->LogGuideStepInfo();
+
+    if (result != Mount::MOVE_OK)
+    {
+        mount->IncrementErrorCount();
+
+        if (result == Mount::MOVE_STOP_GUIDING)
+        {
+            Debug.Write("Replay: mount move error indicates guiding should stop\n");
+            pGuider->StopGuiding();
+        }
+    }
+}
+
+static void load_replay_calibration(ReplayScope *scope)
+{
+    wxString group = "/" + scope->GetMountClassName() + "/calibration";
+
+    Calibration cal;
+    scope->GetLastCalibration(&cal);
+    bool haveCalibration = cal.isValid;
+
+    if (!haveCalibration)
+    {
+        Debug.AddLine("Replay: no calibration in the profile, using a default calibration");
+
+        cal.xRate = 0.005;
+        cal.yRate = 0.005;
+        cal.xAngle = 0.0;
+        cal.yAngle = M_PI / 2.0;
+        cal.declination = 0.0;
+        cal.rotatorAngle = Rotator::POSITION_UNKNOWN;
+        cal.binning = 1;
+        cal.pierSide = PIER_SIDE_UNKNOWN;
+        cal.raGuideParity = GUIDE_PARITY_UNKNOWN;
+        cal.decGuideParity = GUIDE_PARITY_UNKNOWN;
+        cal.isValid = true;
+    }
+
+    scope->SetCalibration(cal);
+
+    // SetCalibration() stores the calibration in the profile; a replay must
+    // leave the profile as it was
+    if (haveCalibration)
+        pConfig->Profile.SetString(group + "/timestamp", cal.timestamp);
+    else
+        pConfig->Profile.DeleteGroup(group);
+}
+
+bool ReplayDriver::Run(const wxString& dir, const wxString& outFile)
+{
+    bool bError = false;
+
+    Mount *prevMount = pMount;
+    Mount *prevSecondaryMount = pSecondaryMount;
+    Scope *prevPointingSource = pPointingSource;
+
+    try
+    {
+        Debug.AddLine(wxString::Format("Replay: begin replay of %s", dir));
+
+        if (!wxDirExists(dir))
+        {
+            throw ERROR_INFO("Replay directory does not exist");
+        }
+
+        wxArrayString files;
+        wxDir::GetAllFiles(dir, &files, "*.fit*", wxDIR_FILES);
+        files.Sort();
+
+        if (files.IsEmpty())
+        {
+            throw ERROR_INFO("No FITS files to replay");
+        }
+
+        wxFFile out(outFile, "w");
+        if (!out.IsOpened())
+        {
+            throw ERROR_INFO("Cannot open replay output file");
+        }
+
+        s_scope = new ReplayScope();
+        s_scope->Connect();
+        load_replay_calibration(s_scope);
+
+        pMount = s_scope;
+        pSecondaryMount = NULL;
+        pPointingSource = s_scope;
+
+        out.Write(wxString::Format("# PHD2 version %s replay of %u frames from %s\n", FULLVER, (unsigned int) files.GetCount(), dir));
+        out.Write("Frame,File,Time,Load,Find,Move,Total,State,StarX,StarY,dx,dy,RADistance,DECDistance,"
+            "RADuration,RADirection,DECDuration,DECDirection,StarMass,SNR,ErrorCode\n");
+
+        StageStats loadStats;
+        StageStats findStats;
+        StageStats moveStats;
+        StageStats totalStats;
+
+        pGuider->Reset(true);
+        pFrame->m_frameCounter = 0;
+
+        wxLongLong start = ::wxGetUTCTimeMillis();
+        ReplayClock::Start(start);
+        s_active = true;
+
+        wxStopWatch wall;
+
+        for (size_t i = 0; i < files.GetCount(); i++)
+        {
+            usImage *img = usImagePool::Acquire();
+            img->ImgExpDur = 0;
+
+            wxStopWatch swatch;
+            if (img->Load(files[i]))
+            {
+                Debug.AddLine(wxString::Format("Replay: skipping %s, cannot load it", files[i]));
+                usImagePool::Release(img);
+                continue;
+            }
+            double loadUs = swatch.TimeInMicro().ToDouble();
+
+            if (img->ImgExpDur <= 0)
+                img->ImgExpDur = DefaultReplayExposure;
+            img->ImgExposureStart = ReplayClock::Now();
+            ReplayClock::Advance(img->ImgExpDur);
+
+            ++pFrame->m_frameCounter;
+
+            s_moveUs = 0.0;
+            s_stepValid = false;
+
+            swatch.Start();
+            pGuider->UpdateGuideState(img, false);
+            double totalUs = swatch.TimeInMicro().ToDouble();
+            double findUs = totalUs - s_moveUs;
+
+            loadStats.Add(loadUs);
+            findStats.Add(findUs);
+            totalStats.Add(totalUs);
+            if (s_stepValid)
+                moveStats.Add(s_moveUs);
+
+            const PHD_Point& pos = pGuider->CurrentPosition();
+
+            wxString row = wxString::Format("%d,%s,%.3f,%.0f,%.0f,%.0f,%.0f,%d,", pFrame->m_frameCounter,
+                wxFileName(files[i]).GetFullName(), (ReplayClock::Now() - start).ToDouble() / 1000.0,
+                loadUs, findUs, s_moveUs, totalUs, pGuider->GetState());
+
+            if (pos.IsValid())
+                row += wxString::Format("%.3f,%.3f,", pos.X, pos.Y);
+            else
+                row += ",,";
+
+            if (s_stepValid)
+            {
+                row += wxString::Format("%.3f,%.3f,%.3f,%.3f,%d,%s,%d,%s,%.f,%.2f,%d\n",
+                    s_step.cameraOffset.X, s_step.cameraOffset.Y,
+                    s_step.guideDistanceRA, s_step.guideDistanceDec,
+                    s_step.durationRA, s_step.durationRA > 0 ? s_scope->DirectionChar((GUIDE_DIRECTION) s_step.directionRA) : "",
+                    s_step.durationDec, s_step.durationDec > 0 ? s_scope->DirectionChar((GUIDE_DIRECTION) s_step.directionDec) : "",
+                    s_step.starMass, s_step.starSNR, s_step.starError);
+            }
+            else
+            {
+                row += ",,,,,,,,,,\n";
+            }
+
+            out.Write(row);
+
+            // select the star on the first frame where one can be found, and
+            // start guiding right away
+            if (pGuider->GetState() == STATE_SELECTING)
+            {
+                pGuider->AutoSelect();
+            }
+            if (pGuider->GetState() == STATE_SELECTED)
+            {
+                pGuider->StartGuiding();
+            }
+        }
+
+        double wallMs = wall.Time();
+        double virtualMs = (ReplayClock::Now() - start).ToDouble();
+
+        s_active = false;
+
+        if (pGuider->IsCalibratingOrGuiding())
+        {
+            pGuider->StopGuiding();
+        }
+        pGuider->Reset(false);
+
+        wxString summary;
+        summary += loadStats.Summary("load");
+        summary += findStats.Summary("find");
+        summary += moveStats.Summary("move");
+        summary += totalStats.Summary("total");
+        summary += wxString::Format("# %u frames, %u guide steps in %.0f ms for %.0f ms of guiding (%.1fx real time)\n",
+            (unsigned int) totalStats.samples.size(), (unsigned int) moveStats.samples.size(),
+            wallMs, virtualMs, wallMs > 0.0 ? virtualMs / wallMs : 0.0);
+
+        out.Write(summary);
+        Debug.Write(summary);
+    }
+    catch (const wxString& Msg)
+    {
+        POSSIBLY_UNUSED(Msg);
+        bError = true;
+    }
+
+    s_active = false;
+    ReplayClock::Stop();
+
+    pMount = prevMount;
+    pSecondaryMount = prevSecondaryMount;
+    pPointingSource = prevPointingSource;
+
+    if (s_scope)
+    {
+        s_scope->Disconnect();
+        delete s_scope;
+        s_scope = NULL;
+    }
+
+    Debug.AddLine(wxString::Format("Replay: end replay, error=%d", bError));
+
+    return bError;
+}
@@ -0,0 +1,102 @@
+/*
+ *  replay.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED
+
+/*
+ * The clock used by the guide loop for pulse timing, star mass history and
+ * the guide step timestamps.
+ *
+ * It follows the system clock, except while a recorded sequence is being
+ * replayed: the clock is then virtual and only moves forward by the exposure
+ * and guide pulse durations, so that a replay gives the same results however
+ * fast the frames are processed.
+ */
+class ReplayClock
+{
+    static bool s_virtual;
+    static wxLongLong s_now;
+
+public:
+    static wxLongLong Now(void);         // milliseconds since the epoch, like wxGetUTCTimeMillis()
+    static wxDateTime UNow(void);
+    static time_t GetTimeNow(void);
+    static bool IsVirtual(void) { return s_virtual; }
+
+    static void Start(const wxLongLong& now);
+    static void Advance(int ms);
+    static void Stop(void);
+};
+
+inline wxLongLong ReplayClock::Now(void)
+{
+    return s_virtual ? s_now : ::wxGetUTCTimeMillis();
+}
+
+inline wxDateTime ReplayClock::UNow(void)
+{
+    return s_virtual ? wxDateTime(s_now) : wxDateTime::UNow();
+}
+
+inline time_t ReplayClock::GetTimeNow(void)
+{
+    return s_virtual ? (time_t)(s_now / 1000).GetValue() : wxDateTime::GetTimeNow();
+}
+
+/*
+ * Headless replay of a recorded frame sequence through the guide loop.
+ *
+ * The FITS files of a directory are fed in name order to
+ * Guider::UpdateGuideState() without waiting for the exposures. The first
+ * frame selects the guide star, then guiding starts with the calibration of
+ * the profile, and each guide step goes through Mount::Move() and the guide
+ * algorithms of the profile synchronously. The guide pulses are sent to a
+ * simulated mount that only advances the virtual clock.
+ *
+ * The time spent loading each frame, finding the star and computing the
+ * correction is written along with the resulting guide steps to a CSV file,
+ * so that runs before and after a change can be compared.
+ */
+class ReplayDriver
+{
+public:
+    // returns true on error
+    static bool Run(const wxString& dir, const wxString& outFile);
+    static bool IsActive(void);
+
+    // called by MyFrame::SchedulePrimaryMove() during a replay
+    static void Move(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure);
+};
+
+#endif // REPLAY_H_INCLUDED
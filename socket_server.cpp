@@ -118,6 +118,9 @@ bool MyFrame::StartServer(bool state)
             return true;
         }
 
+        // the frame stream is optional, the server is usable without it
+        FrameSrv.FrameServerStart(m_instanceNumber);
+
         Debug.AddLine(wxString::Format("Server started, listening on port %u", port));
         StatusMsg(_("Server started"));
     }
@@ -132,6 +135,7 @@ bool MyFrame::StartServer(bool state)
         std::for_each(s_clients.begin(), s_clients.end(), std::mem_fun(&wxSocketBase::Destroy));
         s_clients.empty();
         EvtServer.EventServerStop();
+        FrameSrv.FrameServerStop();
         delete SocketServer;
         SocketServer = NULL;
         StatusMsg(_("Server stopped"));
@@ -0,0 +1,156 @@
+/*
+ *  spectrum.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "spectrum.h"
+
+#include <algorithm>
+#include <math.h>
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+void FFT(std::vector<std::complex<double> >& a)
+{
+    size_t const n = a.size();
+
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(a[i], a[j]);
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        double const ang = -2.0 * M_PI / (double) len;
+        std::complex<double> const wlen(cos(ang), sin(ang));
+        for (size_t i = 0; i < n; i += len)
+        {
+            std::complex<double> w(1.0);
+            for (size_t k = 0; k < len / 2; k++)
+            {
+                std::complex<double> const u = a[i + k];
+                std::complex<double> const v = a[i + k + len / 2] * w;
+                a[i + k] = u + v;
+                a[i + k + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+}
+
+static bool CompareAmplitude(const SpectralPeak& a, const SpectralPeak& b)
+{
+    return a.amplitude > b.amplitude;
+}
+
+void FindSpectralPeaks(const double *t, const double *x, size_t n, double maxPeriod,
+                       std::vector<SpectralPeak> *peaks)
+{
+    peaks->clear();
+
+    if (n < 16 || t[n - 1] <= t[0])
+        return;
+
+    double const t0 = t[0];
+    double const dt = (t[n - 1] - t0) / (double) (n - 1);
+
+    // least squares line
+    double st = 0.0, stt = 0.0, sx = 0.0, stx = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double const ti = t[i] - t0;
+        st += ti;
+        stt += ti * ti;
+        sx += x[i];
+        stx += ti * x[i];
+    }
+    double const nn = (double) n;
+    double const denom = nn * stt - st * st;
+    double const slope = denom > 0.0 ? (nn * stx - st * sx) / denom : 0.0;
+    double const intercept = (sx - slope * st) / nn;
+
+    size_t m = 1;
+    while (m < n)
+        m <<= 1;
+
+    std::vector<std::complex<double> > buf(m);
+    double sumw = 0.0;
+    size_t j = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        double const ti = i * dt;
+        while (j + 2 < n && t[j + 1] - t0 < ti)
+            ++j;
+        double const ta = t[j] - t0, tb = t[j + 1] - t0;
+        double f = tb > ta ? (ti - ta) / (tb - ta) : 0.0;
+        f = f < 0.0 ? 0.0 : f > 1.0 ? 1.0 : f;
+        double const xi = x[j] + f * (x[j + 1] - x[j]);
+
+        double const w = 0.5 * (1.0 - cos(2.0 * M_PI * i / (double) (n - 1)));
+        buf[i] = (xi - (intercept + slope * ti)) * w;
+        sumw += w;
+    }
+
+    FFT(buf);
+
+    // amplitudes, corrected for the coherent gain of the window
+    std::vector<double> a(m / 2 + 1);
+    for (size_t k = 0; k <= m / 2; k++)
+        a[k] = 2.0 * std::abs(buf[k]) / sumw;
+
+    double const binPeriod = (double) m * dt;     // period of bin 1
+
+    for (size_t k = 1; k + 1 < a.size(); k++)
+    {
+        if (a[k] <= a[k - 1] || a[k] < a[k + 1])
+            continue;
+
+        double const d = a[k - 1] - 2.0 * a[k] + a[k + 1];
+        double const offset = d != 0.0 ? 0.5 * (a[k - 1] - a[k + 1]) / d : 0.0;
+
+        SpectralPeak p;
+        p.period = binPeriod / ((double) k + offset);
+        p.amplitude = a[k];
+
+        if (p.period <= maxPeriod)
+            peaks->push_back(p);
+    }
+
+    std::sort(peaks->begin(), peaks->end(), CompareAmplitude);
+}
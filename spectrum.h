@@ -0,0 +1,71 @@
+/*
+ *  spectrum.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SPECTRUM_H_INCLUDED
+#define SPECTRUM_H_INCLUDED
+
+#include <complex>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Spectral analysis of guiding errors, shared by the Guiding Assistant
+ * statistics and the predictive PEC guide algorithm.
+ *
+ * This header and spectrum.cpp do not depend on wxWidgets, so that analysis
+ * tools can use them directly.
+ */
+
+struct SpectralPeak
+{
+    double period;      // same unit as the sample times
+    double amplitude;   // same unit as the sample values
+};
+
+// in-place iterative radix-2 FFT, the size must be a power of 2
+extern void FFT(std::vector<std::complex<double> >& a);
+
+/*
+ * Finds the periodic components of a series of n samples (t[i], x[i]), t
+ * increasing. The samples need not be evenly spaced: they are resampled on a
+ * uniform grid over the same span. The least squares line through the samples
+ * is removed and a Hann window is applied before the FFT; the amplitude of a
+ * sinusoid is then recovered from its spectral peak, with the period
+ * interpolated between the bins.
+ *
+ * Only periods up to maxPeriod are returned, strongest first.
+ */
+extern void FindSpectralPeaks(const double *t, const double *x, size_t n, double maxPeriod,
+                              std::vector<SpectralPeak> *peaks);
+
+#endif // SPECTRUM_H_INCLUDED
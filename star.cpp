@@ -36,6 +36,7 @@
  */
 
 #include "phd.h"
+#include "star_detect.h"
 #include <algorithm>
 
 Star::Star(void)
@@ -151,6 +152,16 @@ bool Star::Find(const usImage *pImg, int searchRegion, int base_x, int base_y, F
             throw ERROR_INFO("coordinates are invalid");
         }
 
+        // positions and the search region are in sensor pixels, a frame binned
+        // in software is searched in its own pixels
+        int const bin = pImg->BinFactor;
+        if (bin > 1)
+        {
+            base_x = ROUND(pImg->FrameCoord(base_x));
+            base_y = ROUND(pImg->FrameCoord(base_y));
+            searchRegion = (searchRegion + bin - 1) / bin;
+        }
+
         int minx, miny, maxx, maxy;
 
         if (pImg->Subframe.IsEmpty())
@@ -375,6 +386,13 @@ bool Star::Find(const usImage *pImg, int searchRegion, int base_x, int base_y, F
 
             HFD = 2.0 * hfr(hfrvec, newX, newY, mass);
 
+            if (bin > 1)
+            {
+                newX = pImg->SensorCoord(newX);
+                newY = pImg->SensorCoord(newY);
+                HFD *= bin;
+            }
+
             // even at saturation, the max values may vary a bit due to noise
             // Call it saturated if the the top three values are within 32 parts per 65535 of max for 16-bit cameras,
             // or within 1 part per 191 for 8-bit cameras
@@ -433,54 +451,9 @@ bool Star::Find(const usImage *pImg, int searchRegion, FindMode mode)
     return Find(pImg, searchRegion, X, Y, mode);
 }
 
-struct FloatImg
-{
-    float *px;
-    wxSize Size;
-    int NPixels;
-
-    FloatImg() : px(0) { }
-    FloatImg(const wxSize& size) : px(0) { Init(size); }
-    FloatImg(const usImage& img) : px(0) {
-        Init(img.Size);
-        for (int i = 0; i < NPixels; i++)
-            px[i] = (float) img.ImageData[i];
-    }
-    ~FloatImg() { delete[] px; }
-    void Init(const wxSize& sz) { delete[] px;  Size = sz; NPixels = Size.GetWidth() * Size.GetHeight(); px = new float[NPixels]; }
-    void Swap(FloatImg& other) { std::swap(px, other.px); std::swap(Size, other.Size); std::swap(NPixels, other.NPixels); }
-};
-
-static void GetStats(double *mean, double *stdev, const FloatImg& img, const wxRect& win)
-{
-    // Determine the mean and standard deviation
-    double sum = 0.0;
-    double a = 0.0;
-    double q = 0.0;
-    double k = 1.0;
-    double km1 = 0.0;
-
-    const int width = img.Size.GetWidth();
-    const float *p0 = &img.px[win.GetTop() * width + win.GetLeft()];
-    for (int y = 0; y < win.GetHeight(); y++)
-    {
-        const float *end = p0 + win.GetWidth();
-        for (const float *p = p0; p < end; p++)
-        {
-            double const x = (double) *p;
-            sum += x;
-            double const a0 = a;
-            a += (x - a) / k;
-            q += (x - a0) * (x - a);
-            km1 = k;
-            k += 1.0;
-        }
-        p0 += width;
-    }
-
-    *mean = sum / km1;
-    *stdev = sqrt(q / km1);
-}
+// the detector keeps its scratch images from one call of AutoFind to the next
+static wxCriticalSection s_detectorLock;
+static StarDetector s_detector;
 
 // un-comment to save the intermediate autofind image
 //#define SAVE_AUTOFIND_IMG
@@ -500,7 +473,7 @@ static void SaveImage(const FloatImg& img, const char *name)
     }
 
     usImage tmp;
-    tmp.Init(img.Size);
+    tmp.Init(img.Width, img.Height);
     for (int i = 0; i < tmp.NPixels; i++)
     {
         tmp.ImageData[i] = (unsigned short)(((double) img.px[i] - minv) * 65535.0 / (maxv - minv));
@@ -510,122 +483,6 @@ static void SaveImage(const FloatImg& img, const char *name)
 #endif // SAVE_AUTOFIND_IMG
 }
 
-static void psf_conv(FloatImg& dst, const FloatImg& src)
-{
-    dst.Init(src.Size);
-
-    //                       A      B1     B2    C1     C2    C3     D1     D2     D3
-    const double PSF[] = { 0.906, 0.584, 0.365, .117, .049, -0.05, -.064, -.074, -.094 };
-
-    int const width = src.Size.GetWidth();
-    int const height = src.Size.GetHeight();
-
-    memset(dst.px, 0, src.NPixels * sizeof(float));
-
-    /* PSF Grid is:
-    D3 D3 D3 D3 D3 D3 D3 D3 D3
-    D3 D3 D3 D2 D1 D2 D3 D3 D3
-    D3 D3 C3 C2 C1 C2 C3 D3 D3
-    D3 D2 C2 B2 B1 B2 C2 D2 D3
-    D3 D1 C1 B1 A  B1 C1 D1 D3
-    D3 D2 C2 B2 B1 B2 C2 D2 D3
-    D3 D3 C3 C2 C1 C2 C3 D3 D3
-    D3 D3 D3 D2 D1 D2 D3 D3 D3
-    D3 D3 D3 D3 D3 D3 D3 D3 D3
-
-    1@A
-    4@B1, B2, C1, C3, D1
-    8@C2, D2
-    44 * D3
-    */
-
-    int psf_size = 4;
-
-    for (int y = psf_size; y < height - psf_size; y++)
-    {
-        for (int x = psf_size; x < width - psf_size; x++)
-        {
-            float A, B1, B2, C1, C2, C3, D1, D2, D3;
-
-#define PX(dx, dy) *(src.px + width * (y + (dy)) + x + (dx))
-            A =  PX(+0, +0);
-            B1 = PX(+0, -1) + PX(+0, +1) + PX(+1, +0) + PX(-1, +0);
-            B2 = PX(-1, -1) + PX(+1, -1) + PX(-1, +1) + PX(+1, +1);
-            C1 = PX(+0, -2) + PX(-2, +0) + PX(+2, +0) + PX(+0, +2);
-            C2 = PX(-1, -2) + PX(+1, -2) + PX(-2, -1) + PX(+2, -1) + PX(-2, +1) + PX(+2, +1) + PX(-1, +2) + PX(+1, +2);
-            C3 = PX(-2, -2) + PX(+2, -2) + PX(-2, +2) + PX(+2, +2);
-            D1 = PX(+0, -3) + PX(-3, +0) + PX(+3, +0) + PX(+0, +3);
-            D2 = PX(-1, -3) + PX(+1, -3) + PX(-3, -1) + PX(+3, -1) + PX(-3, +1) + PX(+3, +1) + PX(-1, +3) + PX(+1, +3);
-            D3 = PX(-4, -2) + PX(-3, -2) + PX(+3, -2) + PX(+4, -2) + PX(-4, -1) + PX(+4, -1) + PX(-4, +0) + PX(+4, +0) + PX(-4, +1) + PX(+4, +1) + PX(-4, +2) + PX(-3, +2) + PX(+3, +2) + PX(+4, +2);
-#undef PX
-            int i;
-            const float *uptr;
-
-            uptr = src.px + width * (y - 4) + (x - 4);
-            for (i = 0; i < 9; i++)
-                D3 += *uptr++;
-
-            uptr = src.px + width * (y - 3) + (x - 4);
-            for (i = 0; i < 3; i++)
-                D3 += *uptr++;
-            uptr += 3;
-            for (i = 0; i < 3; i++)
-                D3 += *uptr++;
-
-            uptr = src.px + width * (y + 3) + (x - 4);
-            for (i = 0; i < 3; i++)
-                D3 += *uptr++;
-            uptr += 3;
-            for (i = 0; i < 3; i++)
-                D3 += *uptr++;
-
-            uptr = src.px + width * (y + 4) + (x - 4);
-            for (i = 0; i < 9; i++)
-                D3 += *uptr++;
-
-            double mean = (A + B1 + B2 + C1 + C2 + C3 + D1 + D2 + D3) / 81.0;
-            double PSF_fit = PSF[0] * (A - mean) + PSF[1] * (B1 - 4.0 * mean) + PSF[2] * (B2 - 4.0 * mean) +
-                PSF[3] * (C1 - 4.0 * mean) + PSF[4] * (C2 - 8.0 * mean) + PSF[5] * (C3 - 4.0 * mean) +
-                PSF[6] * (D1 - 4.0 * mean) + PSF[7] * (D2 - 8.0 * mean) + PSF[8] * (D3 - 44.0 * mean);
-
-            dst.px[width * y + x] = (float) PSF_fit;
-        }
-    }
-}
-
-static void Downsample(FloatImg& dst, const FloatImg& src, int downsample)
-{
-    int width = src.Size.GetWidth();
-    int dw = src.Size.GetWidth() / downsample;
-    int dh = src.Size.GetHeight() / downsample;
-
-    dst.Init(wxSize(dw, dh));
-
-    for (int yy = 0; yy < dh; yy++)
-    {
-        for (int xx = 0; xx < dw; xx++)
-        {
-            float sum = 0.0;
-            for (int j = 0; j < downsample; j++)
-                for (int i = 0; i < downsample; i++)
-                    sum += src.px[(yy * downsample + j) * width + xx * downsample + i];
-            float val = sum / (downsample * downsample);
-            dst.px[yy * dw + xx] = val;
-        }
-    }
-}
-
-struct Peak
-{
-    int x;
-    int y;
-    float val;
-
-    Peak() { }
-    Peak(int x_, int y_, float val_) : x(x_), y(y_), val(val_) { }
-    bool operator<(const Peak& rhs) const { return val < rhs.val; }
-};
-
 static void RemoveItems(std::set<Peak>& stars, const std::set<int>& to_erase)
 {
     int n = 0;
@@ -643,7 +500,35 @@ static void RemoveItems(std::set<Peak>& stars, const std::set<int>& to_erase)
     }
 }
 
-bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegion)
+// Star::Find takes sensor pixels, AutoFind works in frame pixels
+static int SensorPos(const usImage& image, int framePos)
+{
+    return ROUND(image.SensorCoord(framePos));
+}
+
+// The accepted star, followed by the other survivors that would pass the
+// first selection pass (not saturated and SNR >= 6), brightest first
+static void GetCandidates(std::vector<Star> *candidates, const Star& accepted, const std::set<Peak>& stars,
+    const usImage& image, int searchRegion, unsigned short sat_thresh)
+{
+    candidates->clear();
+    candidates->push_back(accepted);
+
+    for (std::set<Peak>::const_reverse_iterator it = stars.rbegin(); it != stars.rend(); ++it)
+    {
+        Star tmp;
+        tmp.Find(&image, searchRegion, SensorPos(image, it->x), SensorPos(image, it->y), Star::FIND_CENTROID);
+        if (!tmp.WasFound() || tmp.GetError() == Star::STAR_SATURATED || tmp.PeakVal > sat_thresh || tmp.SNR < 6.0)
+            continue;
+        if (tmp.Distance(accepted) < 1.0)
+            continue;
+        candidates->push_back(tmp);
+    }
+
+    Debug.Write(wxString::Format("AutoFind: %u candidate stars\n", (unsigned int) candidates->size()));
+}
+
+bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegion, std::vector<Star> *candidates)
 {
     if (!image.Subframe.IsEmpty())
     {
@@ -652,105 +537,42 @@ bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegi
     }
 
     wxBusyCursor busy;
+    wxStopWatch swatch;
 
     Debug.Write(wxString::Format("Star::AutoFind called with edgeAllowance = %d searchRegion = %d\n", extraEdgeAllowance, searchRegion));
 
-    // run a 3x3 median first to eliminate hot pixels
-    usImage smoothed;
-    smoothed.CopyFrom(image);
-    Median3(smoothed);
-
-    // convert to floating point
-    FloatImg conv(smoothed);
-
-    // downsample the source image
-    const int downsample = 1;
-    if (downsample > 1)
-    {
-        FloatImg tmp;
-        Downsample(tmp, conv, downsample);
-        conv.Swap(tmp);
-    }
-
-    // run the PSF convolution
-    {
-        FloatImg tmp;
-        psf_conv(tmp, conv);
-        conv.Swap(tmp);
-    }
-
-    enum { CONV_RADIUS = 4 };
-    int dw = conv.Size.GetWidth();      // width of the downsampled image
-    int dh = conv.Size.GetHeight();     // height of the downsampled image
-    wxRect convRect(CONV_RADIUS, CONV_RADIUS, dw - 2 * CONV_RADIUS, dh - 2 * CONV_RADIUS);  // region containing valid data
-
-    SaveImage(conv, "PHD2_AutoFind.fit");
+    int const nbands = RowBandCount(image.Size.GetHeight());
 
     enum { TOP_N = 100 };  // keep track of the brightest stars
     std::set<Peak> stars;  // sorted by ascending intensity
 
-    double global_mean, global_stdev;
-    GetStats(&global_mean, &global_stdev, conv, convRect);
-
-    Debug.Write(wxString::Format("AutoFind: global mean = %.1f, stdev %.1f\n", global_mean, global_stdev));
-
     const double threshold = 0.1;
-    Debug.Write(wxString::Format("AutoFind: using threshold = %.1f\n", threshold));
 
-    // find each local maximum
-    int srch = 4;
-    for (int y = convRect.GetTop() + srch; y <= convRect.GetBottom() - srch; y++)
     {
-        for (int x = convRect.GetLeft() + srch; x <= convRect.GetRight() - srch; x++)
-        {
-            float val = conv.px[dw * y + x];
-            bool ismax = false;
-            if (val > 0.0)
-            {
-                ismax = true;
-                for (int j = -srch; j <= srch; j++)
-                {
-                    for (int i = -srch; i <= srch; i++)
-                    {
-                        if (i == 0 && j == 0)
-                            continue;
-                        if (conv.px[dw * (y + j) + (x + i)] > val)
-                        {
-                            ismax = false;
-                            break;
-                        }
-                    }
-                }
-            }
-            if (!ismax)
-                continue;
+        wxCriticalSectionLocker lock(s_detectorLock);
 
-            // compare local maximum to mean value of surrounding pixels
-            const int local = 7;
-            double local_mean, local_stdev;
-            wxRect localRect(x - local, y - local, 2 * local + 1, 2 * local + 1);
-            localRect.Intersect(convRect);
-            GetStats(&local_mean, &local_stdev, conv, localRect);
+        std::vector<Peak> peaks;
+        double global_mean, global_stdev;
+        s_detector.Detect(image.ImageData, image.Size.GetWidth(), image.Size.GetHeight(), threshold, nbands, RunRowBands,
+            &peaks, &global_mean, &global_stdev);
 
-            // this is our measure of star intensity
-            double h = (val - local_mean) / global_stdev;
-
-            if (h < threshold)
-            {
-                //  Debug.Write(wxString::Format("AG: local max REJECT [%d, %d] PSF %.1f SNR %.1f\n", imgx, imgy, val, SNR));
-                continue;
-            }
+        Debug.Write(wxString::Format("AutoFind: global mean = %.1f, stdev %.1f\n", global_mean, global_stdev));
+        Debug.Write(wxString::Format("AutoFind: using threshold = %.1f\n", threshold));
 
-            // coordinates on the original image
-            int imgx = x * downsample + downsample / 2;
-            int imgy = y * downsample + downsample / 2;
+        SaveImage(s_detector.Filtered(), "PHD2_AutoFind.fit");
 
-            stars.insert(Peak(imgx, imgy, h));
+        // keep the brightest, inserting in raster order so that ties resolve
+        // as they would in a single pass over the image
+        for (std::vector<Peak>::const_iterator it = peaks.begin(); it != peaks.end(); ++it)
+        {
+            stars.insert(*it);
             if (stars.size() > TOP_N)
                 stars.erase(stars.begin());
         }
     }
 
+    Debug.Write(wxString::Format("AutoFind: %d local max found in %ld ms (%d bands)\n", (int) stars.size(), swatch.Time(), nbands));
+
     for (std::set<Peak>::const_reverse_iterator it = stars.rbegin(); it != stars.rend(); ++it)
         Debug.Write(wxString::Format("AutoFind: local max [%d, %d] %.1f\n", it->x, it->y, it->val));
 
@@ -784,7 +606,7 @@ bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegi
         // build a list of stars to be excluded
         std::set<int> to_erase;
         const int extra = 5; // extra safety margin
-        const int fullw = searchRegion + extra;
+        const int fullw = (searchRegion + image.BinFactor - 1) / image.BinFactor + extra;
         for (std::set<Peak>::const_iterator a = stars.begin(); a != stars.end(); ++a)
         {
             std::set<Peak>::const_iterator b = a;
@@ -816,7 +638,7 @@ bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegi
     // exclude stars too close to the edge
     {
         enum { MIN_EDGE_DIST = 40 };
-        int edgeDist = MIN_EDGE_DIST + extraEdgeAllowance;
+        int edgeDist = MIN_EDGE_DIST + (extraEdgeAllowance + image.BinFactor - 1) / image.BinFactor;
 
         std::set<Peak>::iterator it = stars.begin();
         while (it != stars.end())
@@ -850,7 +672,7 @@ bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegi
     for (std::set<Peak>::reverse_iterator it = stars.rbegin(); it != stars.rend(); ++it)
     {
         Star tmp;
-        tmp.Find(&image, searchRegion, it->x, it->y, FIND_CENTROID);
+        tmp.Find(&image, searchRegion, SensorPos(image, it->x), SensorPos(image, it->y), FIND_CENTROID);
         if (tmp.WasFound() && tmp.GetError() == STAR_SATURATED)
         {
             if ((maxVal - tmp.PeakVal) * 255U > maxVal)
@@ -905,7 +727,7 @@ bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegi
         for (std::set<Peak>::reverse_iterator it = stars.rbegin(); it != stars.rend(); ++it)
         {
             Star tmp;
-            tmp.Find(&image, searchRegion, it->x, it->y, FIND_CENTROID);
+            tmp.Find(&image, searchRegion, SensorPos(image, it->x), SensorPos(image, it->y), FIND_CENTROID);
             if (tmp.WasFound())
             {
                 if (pass == 1)
@@ -928,8 +750,12 @@ bool Star::AutoFind(const usImage& image, int extraEdgeAllowance, int searchRegi
                 }
 
                 // star accepted
-                SetXY(it->x, it->y);
+                SetXY(image.SensorCoord(it->x), image.SensorCoord(it->y));
                 Debug.Write(wxString::Format("Autofind returns star at [%d, %d] %.1f Mass %.f SNR %.1f\n", it->x, it->y, it->val, tmp.Mass, tmp.SNR));
+
+                if (candidates)
+                    GetCandidates(candidates, tmp, stars, image, searchRegion, sat_thresh);
+
                 return true;
             }
         }
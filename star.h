@@ -75,7 +75,7 @@ public:
      */
     bool Find(const usImage *pImg, int searchRegion, FindMode mode);
     bool Find(const usImage *pImg, int searchRegion, int X, int Y, FindMode mode);
-    bool AutoFind(const usImage& image, int edgeAllowance, int searchRegion);
+    bool AutoFind(const usImage& image, int edgeAllowance, int searchRegion, std::vector<Star> *candidates = NULL);
 
     bool WasFound(FindResult result);
     bool WasFound(void);
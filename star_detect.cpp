@@ -0,0 +1,413 @@
+/*
+ *  star_detect.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "star_detect.h"
+#include "image_kernels.h"
+
+#include <math.h>
+#include <string.h>
+
+static double GetMean(const FloatImg& img, int left, int top, int width, int height)
+{
+    double sum = 0.0;
+
+    const float *p0 = &img.px[top * img.Width + left];
+    for (int y = 0; y < height; y++)
+    {
+        const float *end = p0 + width;
+        for (const float *p = p0; p < end; p++)
+            sum += (double) *p;
+        p0 += img.Width;
+    }
+
+    return sum / ((double) width * height);
+}
+
+struct ToFloatJob : public RowBandJob
+{
+    FloatImg& dst;
+    const unsigned short *src;
+
+    ToFloatJob(FloatImg& dst_, const unsigned short *src_) : dst(dst_), src(src_) { }
+
+    void Run(int, int y0, int y1)
+    {
+        int const width = dst.Width;
+        const unsigned short *s = src + y0 * width;
+        const unsigned short *end = src + y1 * width;
+        float *d = dst.px + y0 * width;
+        while (s < end)
+            *d++ = (float) *s++;
+    }
+};
+
+/* PSF Grid is:
+D3 D3 D3 D3 D3 D3 D3 D3 D3
+D3 D3 D3 D2 D1 D2 D3 D3 D3
+D3 D3 C3 C2 C1 C2 C3 D3 D3
+D3 D2 C2 B2 B1 B2 C2 D2 D3
+D3 D1 C1 B1 A  B1 C1 D1 D3
+D3 D2 C2 B2 B1 B2 C2 D2 D3
+D3 D3 C3 C2 C1 C2 C3 D3 D3
+D3 D3 D3 D2 D1 D2 D3 D3 D3
+D3 D3 D3 D3 D3 D3 D3 D3 D3
+
+1@A
+4@B1, B2, C1, C3, D1
+8@C2, D2
+44 * D3
+
+The kernel is applied with its mean over the 81 pixels subtracted. The D3
+weight then applies to every pixel of the 9x9 box, plus the difference to
+the other weights on the 37 inner pixels:
+
+  fit = sum_k (w_k - w_D3) * S_k + (w_D3 - sum_k n_k w_k / 81) * S_box
+
+The kernel is symmetric, so the class sums are built from the sums of the
+pixel pairs symmetric about the center row, V1..V4 (V0 being the center
+row itself), and the 9x9 box sum from 9-row column sums.
+*/
+struct PsfConvJob : public RowBandJob
+{
+    enum { PSF_SIZE = 4 };
+
+    FloatImg& dst;
+    const FloatImg& src;
+    std::vector<StarDetectorBand>& bands;
+    double K[9]; // A, B1, B2, C1, C2, C3, D1, D2 and box weights
+
+    PsfConvJob(FloatImg& dst_, const FloatImg& src_, std::vector<StarDetectorBand>& bands_)
+        : dst(dst_), src(src_), bands(bands_)
+    {
+        //                       A      B1     B2    C1     C2    C3     D1     D2     D3
+        const double PSF[] = { 0.906, 0.584, 0.365, .117, .049, -0.05, -.064, -.074, -.094 };
+        const double N[] = { 1.0, 4.0, 4.0, 4.0, 8.0, 4.0, 4.0, 8.0, 44.0 };
+
+        double sum = 0.0;
+        for (int k = 0; k < 9; k++)
+            sum += PSF[k] * N[k];
+        for (int k = 0; k < 8; k++)
+            K[k] = PSF[k] - PSF[8];
+        K[8] = PSF[8] - sum / 81.0;
+    }
+
+    void Run(int band, int y0, int y1)
+    {
+        int const width = src.Width;
+        int const height = src.Height;
+
+        std::vector<float>& buf = bands[band].sums;
+        buf.resize(4 * width);
+        float *V1 = &buf[0];
+        float *V2 = V1 + width;
+        float *V3 = V2 + width;
+        float *box = V3 + width;
+
+        for (int y = y0; y < y1; y++)
+        {
+            float *d = dst.px + width * y;
+
+            if (y < PSF_SIZE || y >= height - PSF_SIZE || width <= 2 * PSF_SIZE)
+            {
+                memset(d, 0, width * sizeof(float));
+                continue;
+            }
+
+            const float *V0 = src.px + width * y;
+            for (int x = 0; x < width; x++)
+            {
+                V1[x] = V0[x - width] + V0[x + width];
+                V2[x] = V0[x - 2 * width] + V0[x + 2 * width];
+                V3[x] = V0[x - 3 * width] + V0[x + 3 * width];
+                box[x] = V0[x] + V1[x] + V2[x] + V3[x] + V0[x - 4 * width] + V0[x + 4 * width];
+            }
+
+            for (int x = 0; x < PSF_SIZE; x++)
+                d[x] = d[width - 1 - x] = 0.f;
+
+            for (int x = PSF_SIZE; x < width - PSF_SIZE; x++)
+            {
+                float A =  V0[x];
+                float B1 = V1[x] + V0[x - 1] + V0[x + 1];
+                float B2 = V1[x - 1] + V1[x + 1];
+                float C1 = V2[x] + V0[x - 2] + V0[x + 2];
+                float C2 = V2[x - 1] + V2[x + 1] + V1[x - 2] + V1[x + 2];
+                float C3 = V2[x - 2] + V2[x + 2];
+                float D1 = V3[x] + V0[x - 3] + V0[x + 3];
+                float D2 = V3[x - 1] + V3[x + 1] + V1[x - 3] + V1[x + 3];
+                float S = box[x - 4] + box[x - 3] + box[x - 2] + box[x - 1] + box[x] + box[x + 1] + box[x + 2] + box[x + 3] + box[x + 4];
+
+                double PSF_fit = K[0] * A + K[1] * B1 + K[2] * B2 + K[3] * C1 + K[4] * C2 + K[5] * C3 +
+                    K[6] * D1 + K[7] * D2 + K[8] * S;
+
+                d[x] = (float) PSF_fit;
+            }
+        }
+    }
+};
+
+static void Downsample(FloatImg& dst, const FloatImg& src, int downsample)
+{
+    int width = src.Width;
+    int dw = src.Width / downsample;
+    int dh = src.Height / downsample;
+
+    dst.Init(dw, dh);
+
+    for (int yy = 0; yy < dh; yy++)
+    {
+        for (int xx = 0; xx < dw; xx++)
+        {
+            float sum = 0.0;
+            for (int j = 0; j < downsample; j++)
+                for (int i = 0; i < downsample; i++)
+                    sum += src.px[(yy * downsample + j) * width + xx * downsample + i];
+            float val = sum / (downsample * downsample);
+            dst.px[yy * dw + xx] = val;
+        }
+    }
+}
+
+// mean and standard deviation over columns x0..x1, accumulated per band and combined
+struct StatsJob : public RowBandJob
+{
+    struct Sums
+    {
+        double sum;
+        double sumsq;
+    };
+
+    const FloatImg& img;
+    int x0;
+    int x1;
+    std::vector<Sums> bands;
+
+    StatsJob(const FloatImg& img_, int x0_, int x1_, int nbands) : img(img_), x0(x0_), x1(x1_), bands(nbands) { }
+
+    void Run(int band, int y0, int y1)
+    {
+        // the PSF output has a mean close to zero, so plain sums of squares
+        // do not lose precision
+        double sum = 0.0;
+        double sumsq = 0.0;
+        for (int y = y0; y < y1; y++)
+        {
+            const float *p = img.px + y * img.Width + x0;
+            const float *end = p + (x1 - x0 + 1);
+            for (; p < end; p++)
+            {
+                double const x = (double) *p;
+                sum += x;
+                sumsq += x * x;
+            }
+        }
+        bands[band].sum = sum;
+        bands[band].sumsq = sumsq;
+    }
+
+    void Get(int rows, double *mean, double *stdev) const
+    {
+        double sum = 0.0;
+        double sumsq = 0.0;
+        for (std::vector<Sums>::const_iterator it = bands.begin(); it != bands.end(); ++it)
+        {
+            sum += it->sum;
+            sumsq += it->sumsq;
+        }
+        double n = (double) (x1 - x0 + 1) * rows;
+        *mean = sum / n;
+        *stdev = sqrt(std::max(sumsq / n - *mean * *mean, 0.0));
+    }
+};
+
+/*
+ * Non-maximum suppression over the PSF output. A pixel is a local maximum
+ * when no pixel in the surrounding (2*srch+1)^2 box is greater, i.e. when it
+ * is equal to the max-filtered image at that location. The max filter is
+ * separable: each band streams the row maxima through a ring of 2*srch+1 rows
+ * and takes the column max of the ring. Candidates are collected per band in
+ * raster order.
+ */
+struct PeakJob : public RowBandJob
+{
+    enum { SRCH = StarDetector::SRCH };
+
+    const FloatImg& conv;
+    int left, top, right, bottom; // region containing valid data
+    double global_stdev;
+    double threshold;
+    std::vector<StarDetectorBand>& bands;
+
+    PeakJob(const FloatImg& conv_, int border, double global_stdev_, double threshold_, std::vector<StarDetectorBand>& bands_)
+        : conv(conv_), left(border), top(border), right(conv_.Width - 1 - border), bottom(conv_.Height - 1 - border),
+        global_stdev(global_stdev_), threshold(threshold_), bands(bands_) { }
+
+    void RowMax(float *dst, int y, int x0, int x1) const
+    {
+        const float *p = conv.px + conv.Width * y;
+        for (int x = x0; x <= x1; x++)
+        {
+            float m = p[x - SRCH];
+            for (int i = -SRCH + 1; i <= SRCH; i++)
+                m = std::max(m, p[x + i]);
+            dst[x - x0] = m;
+        }
+    }
+
+    void Run(int band, int y0, int y1)
+    {
+        enum { WIN = 2 * SRCH + 1 };
+
+        int const dw = conv.Width;
+        int const x0 = left + SRCH;
+        int const x1 = right - SRCH;
+        int const n = x1 - x0 + 1;
+        if (n <= 0 || y1 <= y0)
+            return;
+
+        std::vector<float>& ring = bands[band].ring;
+        std::vector<float>& winmax = bands[band].winmax;
+        ring.resize(WIN * n);
+        winmax.resize(n);
+
+        for (int y = y0 - SRCH; y < y0 + SRCH; y++)
+            RowMax(&ring[((y - y0 + WIN) % WIN) * n], y, x0, x1);
+
+        std::vector<Peak>& peaks = bands[band].peaks;
+
+        for (int y = y0; y < y1; y++)
+        {
+            RowMax(&ring[((y + SRCH - y0) % WIN) * n], y + SRCH, x0, x1);
+
+            memcpy(&winmax[0], &ring[0], n * sizeof(float));
+            for (int j = 1; j < WIN; j++)
+            {
+                const float *r = &ring[j * n];
+                for (int i = 0; i < n; i++)
+                    winmax[i] = std::max(winmax[i], r[i]);
+            }
+
+            const float *row = conv.px + dw * y;
+            for (int i = 0; i < n; i++)
+            {
+                int x = x0 + i;
+                float val = row[x];
+                if (val <= 0.0 || val < winmax[i])
+                    continue;
+
+                // compare local maximum to mean value of surrounding pixels,
+                // within the valid region
+                const int local = 7;
+                int lx0 = std::max(x - local, left);
+                int lx1 = std::min(x + local, right);
+                int ly0 = std::max(y - local, top);
+                int ly1 = std::min(y + local, bottom);
+                double local_mean = GetMean(conv, lx0, ly0, lx1 - lx0 + 1, ly1 - ly0 + 1);
+
+                // this is our measure of star intensity
+                double h = (val - local_mean) / global_stdev;
+
+                if (h < threshold)
+                    continue;
+
+                peaks.push_back(Peak(x, y, h));
+            }
+        }
+    }
+};
+
+void StarDetector::Detect(const unsigned short *px, int width, int height, double threshold, int nbands, RowBandRunner run,
+    std::vector<Peak> *peaks, double *globalMean, double *globalStdev)
+{
+    if ((int) m_bands.size() < nbands)
+        m_bands.resize(nbands);
+    for (int i = 0; i < nbands; i++)
+        m_bands[i].peaks.clear();
+
+    // run a 3x3 median first to eliminate hot pixels
+    m_smoothed.resize(width * height);
+    Median3Rect(&m_smoothed[0], px, width, 0, 0, width, height, BestKernels());
+
+    // convert to floating point
+    m_conv.Init(width, height);
+    {
+        ToFloatJob job(m_conv, &m_smoothed[0]);
+        run(job, nbands, 0, height);
+    }
+
+    // downsample the source image
+    const int downsample = 1;
+    if (downsample > 1)
+    {
+        Downsample(m_tmp, m_conv, downsample);
+        m_conv.Swap(m_tmp);
+    }
+
+    // run the PSF convolution
+    {
+        m_tmp.Init(m_conv.Width, m_conv.Height);
+        PsfConvJob job(m_tmp, m_conv, m_bands);
+        run(job, nbands, 0, m_conv.Height);
+        m_conv.Swap(m_tmp);
+    }
+
+    // the region containing valid data
+    int const top = CONV_RADIUS;
+    int const bottom = m_conv.Height - 1 - CONV_RADIUS;
+
+    {
+        StatsJob job(m_conv, CONV_RADIUS, m_conv.Width - 1 - CONV_RADIUS, nbands);
+        run(job, nbands, top, bottom + 1);
+        job.Get(bottom - top + 1, globalMean, globalStdev);
+    }
+
+    // find each local maximum
+    peaks->clear();
+    {
+        PeakJob job(m_conv, CONV_RADIUS, *globalStdev, threshold, m_bands);
+        run(job, nbands, top + SRCH, std::max(bottom - SRCH + 1, top + SRCH));
+
+        for (int band = 0; band < nbands; band++)
+        {
+            const std::vector<Peak>& bandPeaks = m_bands[band].peaks;
+            for (std::vector<Peak>::const_iterator it = bandPeaks.begin(); it != bandPeaks.end(); ++it)
+            {
+                // coordinates on the original image
+                int imgx = it->x * downsample + downsample / 2;
+                int imgy = it->y * downsample + downsample / 2;
+
+                peaks->push_back(Peak(imgx, imgy, it->val));
+            }
+        }
+    }
+}
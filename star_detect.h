@@ -0,0 +1,121 @@
+/*
+ *  star_detect.h
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef STAR_DETECT_INCLUDED
+#define STAR_DETECT_INCLUDED
+
+#include "row_band.h"
+
+#include <algorithm>
+#include <vector>
+
+/*
+ * The detection stage of Star::AutoFind: the frame is filtered with a 3x3
+ * median and a PSF fit, and the local maxima of the filter output are the
+ * star candidates.
+ *
+ * This header and star_detect.cpp do not depend on wxWidgets, so that the
+ * detection can be benchmarked on its own.
+ */
+
+struct FloatImg
+{
+    float *px;
+    int Width;
+    int Height;
+    int NPixels;
+
+    FloatImg() : px(0), Width(0), Height(0), NPixels(0) { }
+    ~FloatImg() { delete[] px; }
+    void Init(int width, int height)
+    {
+        if (px && width == Width && height == Height)
+            return;
+        delete[] px;  Width = width; Height = height; NPixels = Width * Height; px = new float[NPixels];
+    }
+    void Swap(FloatImg& other)
+    {
+        std::swap(px, other.px); std::swap(Width, other.Width); std::swap(Height, other.Height); std::swap(NPixels, other.NPixels);
+    }
+
+private:
+    FloatImg(const FloatImg&);
+    FloatImg& operator=(const FloatImg&);
+};
+
+struct Peak
+{
+    int x;
+    int y;
+    float val;
+
+    Peak() { }
+    Peak(int x_, int y_, float val_) : x(x_), y(y_), val(val_) { }
+    bool operator<(const Peak& rhs) const { return val < rhs.val; }
+};
+
+// row buffers of one band of the filters
+struct StarDetectorBand
+{
+    std::vector<float> sums;    // pixel pair and box sums of the PSF filter
+    std::vector<float> ring;    // row maxima of the peak search
+    std::vector<float> winmax;  // column maxima of the ring
+    std::vector<Peak> peaks;
+};
+
+class StarDetector
+{
+    // scratch images and row buffers, kept from one frame to the next so
+    // that they are only reallocated when the frame size changes
+    std::vector<unsigned short> m_smoothed;
+    FloatImg m_conv;
+    FloatImg m_tmp;
+    std::vector<StarDetectorBand> m_bands;
+
+public:
+    enum { CONV_RADIUS = 4 };  // the filter output is not valid within this distance of the edges
+    enum { SRCH = 4 };         // a peak is the maximum of the (2*SRCH+1)^2 box around it
+
+    // Collects, in raster order, the local maxima of the filter output that
+    // stand out from the mean of their surroundings by at least threshold
+    // times the global standard deviation of the output. The bands of the
+    // filters are run with run(). Returns the global mean and standard
+    // deviation of the filter output.
+    void Detect(const unsigned short *px, int width, int height, double threshold, int nbands, RowBandRunner run,
+        std::vector<Peak> *peaks, double *globalMean, double *globalStdev);
+
+    // the filter output of the last frame
+    const FloatImg& Filtered(void) const { return m_conv; }
+};
+
+#endif // STAR_DETECT_INCLUDED
@@ -53,6 +53,7 @@ ProfileWindow::ProfileWindow(wxWindow *parent) :
 
     this->visible = false;
     this->mode = 0; // 2D profile
+    this->binFactor = 1;
     this->SetBackgroundStyle(wxBG_STYLE_CUSTOM);
     this->data = new unsigned short[FULLW * FULLW];  // 21x21 subframe
 }
@@ -79,8 +80,9 @@ void ProfileWindow::SetState(bool is_active)
 void ProfileWindow::UpdateData(usImage *pImg, float xpos, float ypos)
 {
     if (this->data == NULL) return;
-    int xstart = ROUNDF(xpos) - HALFW;
-    int ystart = ROUNDF(ypos) - HALFW;
+    this->binFactor = pImg->BinFactor;
+    int xstart = ROUND(pImg->FrameCoord(xpos)) - HALFW;
+    int ystart = ROUND(pImg->FrameCoord(ypos)) - HALFW;
     if (xstart < 0) xstart = 0;
     else if (xstart > (pImg->Size.GetWidth() - (FULLW + 1)))
         xstart = pImg->Size.GetWidth() - (FULLW + 1);
@@ -215,7 +217,7 @@ void ProfileWindow::OnPaint(wxPaintEvent& WXUNUSED(evt))
         profval = *(profptr + x2);
         profvalprec = *(profptr + x2 - 1);
         float f2 = (float)x2 - (float)(profvalprec - Prof_Mid) / (float)(profvalprec - profval);
-        fwhm = f2 - f1;
+        fwhm = (f2 - f1) * binFactor;
 
         // Draw it
         dc.SetPen(RedPen);
@@ -48,6 +48,7 @@ private:
     int mode; // 0= 2D profile of mid-row, 1=2D of avg_row, 2=2D of avg_col
     bool visible;
     unsigned short *data;
+    int binFactor; // sensor pixels per profile pixel
     int horiz_profile[21], vert_profile[21], midrow_profile[21];
     DECLARE_EVENT_TABLE()
 };
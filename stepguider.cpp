@@ -937,13 +937,13 @@ static void SuppressSlowBumpWarning(long)
     pConfig->Global.SetBoolean(SlowBumpWarningEnabledKey(), false);
 }
 
-Mount::MOVE_RESULT StepGuider::Move(const PHD_Point& cameraVectorEndpoint, MountMoveType moveType)
+Mount::MOVE_RESULT StepGuider::Move(const PHD_Point& cameraVectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure)
 {
     MOVE_RESULT result = MOVE_OK;
 
     try
     {
-        MOVE_RESULT mountResult = Mount::Move(cameraVectorEndpoint, moveType);
+        MOVE_RESULT mountResult = Mount::Move(cameraVectorEndpoint, moveType, exposure);
         if (mountResult != MOVE_OK)
             Debug.Write("StepGuider::Move: Mount::Move failed!\n");
 
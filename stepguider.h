@@ -194,7 +194,7 @@ public:
     // functions with an implemenation in StepGuider that cannot be over-ridden
     // by a subclass
 private:
-    virtual MOVE_RESULT Move(const PHD_Point& vectorEndpoint, MountMoveType moveType);
+    virtual MOVE_RESULT Move(const PHD_Point& vectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure);
     MOVE_RESULT Move(GUIDE_DIRECTION direction, int amount, MountMoveType moveType, MoveResultInfo *moveResultInfo);
     MOVE_RESULT CalibrationMove(GUIDE_DIRECTION direction, int steps);
     int CalibrationMoveSize(void);
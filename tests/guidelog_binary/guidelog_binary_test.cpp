@@ -0,0 +1,261 @@
+/*
+ *  guidelog_binary_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <gtest/gtest.h>
+#include "guidelog_binary.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+ * A binary guide log converted back to text must match, byte for byte, the
+ * text log GuidingLog writes for the same entries. The expected text uses the
+ * formats of GuidingLog::GuideStep and GuidingLog::FrameDropped.
+ */
+
+static const char *TestFile = "guidelog_binary_test.bin";
+
+static void AppendFormat(std::string *out, const char *fmt, ...)
+{
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    out->append(buf);
+}
+
+static double RandomValue(double range)
+{
+    return range * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+// a text of any length up to a few records, including the lengths at the
+// record boundaries, with quotes, commas and UTF-8 characters
+static std::string RandomText(void)
+{
+    static const char *pieces[] = { "INFO: ", "Guiding", ", ", "\"", "\xc2\xb0", "\xe2\x80\x9d", " ", "x", "\n" };
+    enum { RECORD_TEXT = sizeof(((GuideLogTextRecord *) 0)->text) };
+
+    size_t len;
+    switch (rand() % 4)
+    {
+    case 0: len = rand() % 3; break;
+    case 1: len = RECORD_TEXT * (1 + rand() % 3) - 1 + rand() % 3; break;
+    default: len = rand() % (4 * RECORD_TEXT); break;
+    }
+
+    std::string text;
+    while (text.size() < len)
+        text += pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+    return text;
+}
+
+struct LogPair
+{
+    std::vector<char> bin;
+    std::string text;
+
+    LogPair()
+    {
+        GuideLogBinHeader hdr;
+        InitGuideLogBinHeader(&hdr, "2.6.0test");
+        const char *p = (const char *) &hdr;
+        bin.insert(bin.end(), p, p + sizeof(hdr));
+    }
+
+    void AddText(const std::string& str)
+    {
+        AppendGuideLogText(&bin, str.data(), str.size());
+        text += str;
+    }
+
+    void AddStep(int frame, bool ao)
+    {
+        GuideLogRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        GuideLogStepRecord& r = rec.step;
+        r.type = GUIDELOG_REC_STEP;
+        r.isStepGuider = ao;
+        r.frameNumber = frame;
+        r.time = frame * 2.5 + RandomValue(0.5);
+        r.cameraOffsetX = RandomValue(10.0);
+        r.cameraOffsetY = RandomValue(10.0);
+        r.mountOffsetX = RandomValue(10.0);
+        r.mountOffsetY = RandomValue(10.0);
+        r.guideDistanceRA = RandomValue(5.0);
+        r.guideDistanceDec = RandomValue(5.0);
+        r.starMass = rand() % 100000 + RandomValue(0.5);
+        r.starSNR = 1.0 + rand() % 10000 / 100.0;
+        r.starError = rand() % 4;
+
+        AppendFormat(&text, "%d,%.3f,\"%s\",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,",
+            r.frameNumber, r.time, ao ? "AO" : "Mount",
+            r.cameraOffsetX, r.cameraOffsetY, r.mountOffsetX, r.mountOffsetY,
+            r.guideDistanceRA, r.guideDistanceDec);
+
+        if (ao)
+        {
+            r.durationRA = rand() % 21 - 10;
+            r.durationDec = rand() % 21 - 10;
+            AppendFormat(&text, ",,,,%d,%d,", r.durationRA, r.durationDec);
+        }
+        else
+        {
+            r.durationRA = rand() % 3 == 0 ? 0 : rand() % 2000;
+            r.durationDec = rand() % 3 == 0 ? 0 : rand() % 2000;
+            const char *ra = r.durationRA > 0 ? (rand() % 2 ? "E" : "W") : "";
+            const char *dec = r.durationDec > 0 ? (rand() % 2 ? "N" : "S") : "";
+            r.directionRA = ra[0];
+            r.directionDec = dec[0];
+            AppendFormat(&text, "%d,%s,%d,%s,,,", r.durationRA, ra, r.durationDec, dec);
+        }
+
+        AppendFormat(&text, "%.f,%.2f,%d\n", r.starMass, r.starSNR, r.starError);
+
+        AppendGuideLogRecord(&bin, rec);
+    }
+
+    void AddDrop(int frame)
+    {
+        GuideLogRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        GuideLogDropRecord& r = rec.drop;
+        r.type = GUIDELOG_REC_DROP;
+        r.frameNumber = frame;
+        r.time = frame * 2.5;
+        r.starMass = rand() % 1000;
+        r.starSNR = rand() % 1000 / 100.0;
+        r.starError = 1 + rand() % 5;
+        std::string status = RandomText();
+
+        AppendFormat(&text, "%d,%.3f,\"DROP\",,,,,,,,,,,,,%.f,%.2f,%d,\"",
+            r.frameNumber, r.time, r.starMass, r.starSNR, r.starError);
+        text += status;
+        text += "\"\n";
+
+        AppendGuideLogRecord(&bin, rec);
+        AppendGuideLogText(&bin, status.data(), status.size());
+    }
+
+    bool Save(size_t len) const
+    {
+        FILE *fp = fopen(TestFile, "wb");
+        if (!fp)
+            return false;
+        bool ok = fwrite(&bin[0], 1, len, fp) == len;
+        return fclose(fp) == 0 && ok;
+    }
+    bool Save(void) const { return Save(bin.size()); }
+};
+
+// the text log rebuilt the way phd2_guidelog_convert does it
+static std::string Convert(const GuideLogReader& rdr)
+{
+    std::string out;
+    for (size_t i = 0; i < rdr.RecordCount(); )
+        i = rdr.Format(i, &out);
+    return out;
+}
+
+class GuideLogBinaryTest : public ::testing::Test
+{
+protected:
+    virtual void TearDown() { remove(TestFile); }
+};
+
+TEST_F(GuideLogBinaryTest, convertedLogMatchesTextLog)
+{
+    srand(1);
+
+    LogPair log;
+    log.AddText("Guiding Begins at 2016-05-01 20:15:00\n");
+    for (int frame = 1; frame <= 20000; frame++)
+    {
+        int const kind = rand() % 20;
+        if (kind == 0)
+            log.AddDrop(frame);
+        else if (kind == 1)
+            log.AddText(RandomText());
+        else
+            log.AddStep(frame, kind == 2);
+    }
+    ASSERT_TRUE(log.Save());
+
+    GuideLogReader rdr;
+    std::string err;
+    ASSERT_FALSE(rdr.Open(TestFile, &err)) << err;
+    EXPECT_STREQ("2.6.0test", rdr.Header().phdVersion);
+    EXPECT_EQ((log.bin.size() - sizeof(GuideLogBinHeader)) / GUIDELOG_BIN_RECORD_SIZE, rdr.RecordCount());
+    EXPECT_TRUE(Convert(rdr) == log.text);
+}
+
+TEST_F(GuideLogBinaryTest, truncatedLastRecordIsIgnored)
+{
+    LogPair log;
+    log.AddStep(1, false);
+    std::string const first = log.text;
+    log.AddStep(2, true);
+    ASSERT_TRUE(log.Save(log.bin.size() - 10));
+
+    GuideLogReader rdr;
+    ASSERT_FALSE(rdr.Open(TestFile, 0));
+    EXPECT_EQ(1u, rdr.RecordCount());
+    EXPECT_EQ(first, Convert(rdr));
+}
+
+TEST_F(GuideLogBinaryTest, textLogIsRejected)
+{
+    FILE *fp = fopen(TestFile, "wb");
+    ASSERT_TRUE(fp != 0);
+    for (int i = 0; i < 10; i++)
+        fputs("PHD2 version 2.6.0, Log version 2.5. Log enabled at 2016-05-01 20:15:00\n", fp);
+    fclose(fp);
+
+    GuideLogReader rdr;
+    std::string err;
+    EXPECT_TRUE(rdr.Open(TestFile, &err));
+    EXPECT_EQ("not a binary guide log", err);
+    EXPECT_EQ(0u, rdr.RecordCount());
+}
+
+int main(int argc, char ** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
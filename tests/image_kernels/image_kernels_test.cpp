@@ -0,0 +1,343 @@
+/*
+ *  image_kernels_test.cpp
+ *  PHD Guiding
+ *
+ *  Copyright (c) 2016 openphdguiding.org
+ *  All rights reserved.
+ *
+ *  This source code is distributed under the following "BSD" license
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *    Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *    Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *    Neither the name of openphdguiding.org nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <gtest/gtest.h>
+#include "image_kernels.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+
+/*
+ * The SSE2 and AVX2 kernels must give the same results as the scalar ones,
+ * including on the pixels left over at the end of a row, and on pixels at the
+ * ends of the value range where signed comparisons and saturating arithmetic
+ * would go wrong.
+ */
+
+enum { MAX_LEN = 100, PAD = 1, ROUNDS = 20 };
+
+static std::vector<const ImageKernels *> FastKernels()
+{
+    std::vector<const ImageKernels *> ret;
+    if (SSE2Kernels())
+        ret.push_back(SSE2Kernels());
+    if (AVX2Kernels())
+        ret.push_back(AVX2Kernels());
+    return ret;
+}
+
+// random pixels, or with saturated set, pixels mostly at or near the limits
+static void Fill(std::vector<unsigned short>& v, bool saturated)
+{
+    static const unsigned short extremes[] = { 0, 1, 2, 3, 32767, 32768, 65532, 65533, 65534, 65535 };
+    for (size_t i = 0; i < v.size(); i++)
+    {
+        if (saturated && rand() % 4 != 0)
+            v[i] = extremes[rand() % (sizeof(extremes) / sizeof(extremes[0]))];
+        else
+            v[i] = (unsigned short)((rand() << 8) ^ rand());
+    }
+}
+
+class ImageKernelsTest : public ::testing::TestWithParam<bool>
+{
+protected:
+    void SetUp() { srand(1234); }
+};
+
+TEST_P(ImageKernelsTest, median9Row)
+{
+    const ImageKernels *ref = ScalarKernels();
+    std::vector<unsigned short> r0(MAX_LEN + 2 * PAD), r1(MAX_LEN + 2 * PAD), r2(MAX_LEN + 2 * PAD);
+    std::vector<unsigned short> expected(MAX_LEN), actual(MAX_LEN);
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        Fill(r0, GetParam());
+        Fill(r1, GetParam());
+        Fill(r2, GetParam());
+
+        for (int n = 0; n <= MAX_LEN; n++)
+        {
+            ref->median9Row(&expected[0], &r0[PAD], &r1[PAD], &r2[PAD], n);
+            for (size_t k = 0; k < FastKernels().size(); k++)
+            {
+                SCOPED_TRACE(FastKernels()[k]->name);
+                actual.assign(MAX_LEN, 0);
+                FastKernels()[k]->median9Row(&actual[0], &r0[PAD], &r1[PAD], &r2[PAD], n);
+                ASSERT_TRUE(std::equal(expected.begin(), expected.begin() + n, actual.begin())) << "n = " << n;
+            }
+        }
+    }
+}
+
+TEST_P(ImageKernelsTest, avg4Row)
+{
+    const ImageKernels *ref = ScalarKernels();
+    std::vector<unsigned short> r0(MAX_LEN + PAD), r1(MAX_LEN + PAD);
+    std::vector<unsigned short> expected(MAX_LEN), actual(MAX_LEN);
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        Fill(r0, GetParam());
+        Fill(r1, GetParam());
+
+        for (int n = 0; n <= MAX_LEN; n++)
+        {
+            ref->avg4Row(&expected[0], &r0[0], &r1[0], n);
+            for (size_t k = 0; k < FastKernels().size(); k++)
+            {
+                SCOPED_TRACE(FastKernels()[k]->name);
+                actual.assign(MAX_LEN, 0);
+                FastKernels()[k]->avg4Row(&actual[0], &r0[0], &r1[0], n);
+                ASSERT_TRUE(std::equal(expected.begin(), expected.begin() + n, actual.begin())) << "n = " << n;
+            }
+        }
+    }
+}
+
+TEST_P(ImageKernelsTest, maxDeficitAndSubtractRow)
+{
+    const ImageKernels *ref = ScalarKernels();
+    std::vector<unsigned short> light(MAX_LEN), dark(MAX_LEN);
+    std::vector<unsigned short> expected, actual;
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        Fill(light, GetParam());
+        Fill(dark, GetParam());
+
+        for (int n = 0; n <= MAX_LEN; n++)
+        {
+            unsigned short cur = (unsigned short)(round % 2 ? 0 : rand() % 65536);
+            unsigned short deficit = ref->maxDeficit(&light[0], &dark[0], n, cur);
+
+            // the offset covers the deficit, and for the saturated data is
+            // large enough for the sums to clip
+            unsigned short offset = GetParam() ? 65535 : deficit;
+
+            expected = light;
+            ref->subtractRow(&expected[0], &dark[0], n, offset);
+
+            for (size_t k = 0; k < FastKernels().size(); k++)
+            {
+                SCOPED_TRACE(FastKernels()[k]->name);
+                ASSERT_EQ(deficit, FastKernels()[k]->maxDeficit(&light[0], &dark[0], n, cur)) << "n = " << n;
+
+                actual = light;
+                FastKernels()[k]->subtractRow(&actual[0], &dark[0], n, offset);
+                ASSERT_TRUE(expected == actual) << "n = " << n;
+            }
+        }
+    }
+}
+
+TEST_P(ImageKernelsTest, minMax)
+{
+    const ImageKernels *ref = ScalarKernels();
+    std::vector<unsigned short> p(MAX_LEN);
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        Fill(p, GetParam());
+
+        for (int n = 0; n <= MAX_LEN; n++)
+        {
+            unsigned short mn0 = (unsigned short)(round % 2 ? 65535 : rand() % 65536);
+            unsigned short mx0 = (unsigned short)(round % 2 ? 0 : rand() % 65536);
+
+            unsigned short expmin = mn0, expmax = mx0;
+            ref->minMax(&p[0], n, &expmin, &expmax);
+
+            for (size_t k = 0; k < FastKernels().size(); k++)
+            {
+                SCOPED_TRACE(FastKernels()[k]->name);
+                unsigned short mn = mn0, mx = mx0;
+                FastKernels()[k]->minMax(&p[0], n, &mn, &mx);
+                ASSERT_EQ(expmin, mn) << "n = " << n;
+                ASSERT_EQ(expmax, mx) << "n = " << n;
+            }
+        }
+    }
+}
+
+TEST_P(ImageKernelsTest, scaledDarkRow)
+{
+    const ImageKernels *ref = ScalarKernels();
+    std::vector<unsigned short> bias(MAX_LEN);
+    std::vector<float> rate(MAX_LEN);
+    std::vector<unsigned short> expected(MAX_LEN), actual(MAX_LEN);
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        Fill(bias, GetParam());
+        for (int i = 0; i < MAX_LEN; i++)
+        {
+            // saturated data has rates that push the result beyond both ends
+            float scale = GetParam() ? 100000.f : 100.f;
+            rate[i] = ((float) rand() / RAND_MAX - 0.5f) * scale;
+        }
+        float t = (float)(rand() % 30000) / 1000.f;
+
+        for (int n = 0; n <= MAX_LEN; n++)
+        {
+            ref->scaledDarkRow(&expected[0], &bias[0], &rate[0], n, t);
+            for (size_t k = 0; k < FastKernels().size(); k++)
+            {
+                SCOPED_TRACE(FastKernels()[k]->name);
+                actual.assign(MAX_LEN, 0);
+                FastKernels()[k]->scaledDarkRow(&actual[0], &bias[0], &rate[0], n, t);
+                ASSERT_TRUE(std::equal(expected.begin(), expected.begin() + n, actual.begin())) << "n = " << n;
+            }
+        }
+    }
+}
+
+// false: random pixels, true: saturated pixels
+INSTANTIATE_TEST_CASE_P(Pixels, ImageKernelsTest, ::testing::Bool());
+
+// A frame with a guard area after it, and defect rows that hold columns of a
+// wider frame
+class DefectFixerTest : public ::testing::Test
+{
+protected:
+    enum { W = 16, H = 8, GUARD = 64 };
+    enum { BACKGROUND = 100, DEFECT = 60000, CANARY = 0xabcd };
+
+    std::vector<unsigned short> buf;
+    std::vector<int> cols;
+
+    void SetUp()
+    {
+        buf.assign(W * H, BACKGROUND);
+        buf.resize(W * H + GUARD, CANARY);
+
+        // 16 is the first column past the right edge: fixing it would write
+        // the first pixel of the next row, or past the frame on the last row
+        static const int c[] = { 0, 3, 15, 16, 17, 40, 1000 };
+        cols.assign(c, c + sizeof(c) / sizeof(c[0]));
+
+        for (int y = 0; y < H; y++)
+            for (size_t i = 0; i < cols.size(); i++)
+                if (cols[i] < W)
+                    buf[y * W + cols[i]] = DEFECT;
+    }
+
+    unsigned short At(int x, int y) const { return buf[y * W + x]; }
+
+    bool GuardIntact() const
+    {
+        for (int i = W * H; i < W * H + GUARD; i++)
+            if (buf[i] != CANARY)
+                return false;
+        return true;
+    }
+};
+
+TEST_F(DefectFixerTest, fullFrameIgnoresOutOfFrameDefects)
+{
+    DefectFixer fixer(&buf[0], W, H);
+    ASSERT_TRUE(fixer.CanFix());
+
+    for (int y = 0; y < H; y++)
+        fixer.FixRow(y, &cols[0], &cols[0] + cols.size(), 0, W - 1);
+
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++)
+            EXPECT_EQ(BACKGROUND, At(x, y)) << "x = " << x << " y = " << y;
+    EXPECT_TRUE(GuardIntact());
+}
+
+TEST_F(DefectFixerTest, areaWiderThanFrame)
+{
+    DefectFixer fixer(&buf[0], W, H);
+
+    for (int y = -2; y < H + 2; y++)
+        fixer.FixRow(y, &cols[0], &cols[0] + cols.size(), -5, 100000);
+
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++)
+            EXPECT_EQ(BACKGROUND, At(x, y)) << "x = " << x << " y = " << y;
+    EXPECT_TRUE(GuardIntact());
+}
+
+TEST_F(DefectFixerTest, subframeOnlyFixesItsColumns)
+{
+    DefectFixer fixer(&buf[0], W, H);
+
+    for (int y = 2; y <= 5; y++)
+        fixer.FixRow(y, &cols[0], &cols[0] + cols.size(), 2, 14);
+
+    for (int y = 0; y < H; y++)
+    {
+        bool const inside = y >= 2 && y <= 5;
+        EXPECT_EQ(DEFECT, At(0, y));
+        EXPECT_EQ(inside ? BACKGROUND : DEFECT, At(3, y));
+        EXPECT_EQ(DEFECT, At(15, y));
+    }
+    EXPECT_TRUE(GuardIntact());
+}
+
+TEST_F(DefectFixerTest, edgePixelsUseTheirNeighbors)
+{
+    // a defect in each corner, with distinct neighbor values
+    buf.assign(W * H, 0);
+    buf.resize(W * H + GUARD, CANARY);
+    for (int i = 0; i < W * H; i++)
+        buf[i] = (unsigned short)(i * 10);
+
+    DefectFixer fixer(&buf[0], W, H);
+    fixer.Fix(0, 0);
+    fixer.Fix(W - 1, H - 1);
+
+    // median of the right, below and below-right neighbors
+    EXPECT_EQ(W * 10, At(0, 0));
+    // median of the left, above and above-left neighbors
+    EXPECT_EQ((W * (H - 1) - 1) * 10, At(W - 1, H - 1));
+    EXPECT_TRUE(GuardIntact());
+}
+
+int main(int argc, char ** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+
+    for (size_t k = 0; k < FastKernels().size(); k++)
+        std::cout << "testing " << FastKernels()[k]->name << " kernels against the scalar kernels" << std::endl;
+    if (FastKernels().empty())
+        std::cout << "no SSE2 or AVX2 kernels on this platform" << std::endl;
+
+    return RUN_ALL_TESTS();
+}
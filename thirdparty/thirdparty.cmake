@@ -563,6 +563,9 @@ if(WIN32)
 
   # Video for Windows, directshow and windows media
   set(PHD_LINK_EXTERNAL     ${PHD_LINK_EXTERNAL} vfw32.lib Strmiids.lib Quartz.lib winmm.lib)
+
+  # process memory statistics
+  set(PHD_LINK_EXTERNAL     ${PHD_LINK_EXTERNAL} psapi.lib)
   
   
   # gpusb
@@ -35,16 +35,39 @@
 #include "phd.h"
 #include "image_math.h"
 
+#include <algorithm>
+
 bool usImage::Init(const wxSize& size)
 {
     // Allocates space for image and sets params up
     // returns true on error
 
     int prev = NPixels;
+    wxSize prevSize = Size;
+
+    if (!m_ownsData)
+    {
+        // never write to or free borrowed pixels, start over with our own buffer
+        ImageData = NULL;
+        prev = 0;
+        m_ownsData = true;
+    }
+
+    // a frame with a subframe has zeros outside of it
+    m_area = Subframe.IsEmpty() ? wxRect(prevSize) : Subframe;
+
     NPixels = size.GetWidth() * size.GetHeight();
     Size = size;
     Subframe = wxRect(0, 0, 0, 0);
     Min = Max = 0;
+    BinFactor = 1;
+    Rendering.valid = false;
+
+    if (size != prevSize)
+    {
+        m_area = wxRect(size);
+        m_scratchArea = wxRect(size);
+    }
 
     if (NPixels != prev)
     {
@@ -71,6 +94,99 @@ void usImage::SwapImageData(usImage& other)
     unsigned short *t = ImageData;
     ImageData = other.ImageData;
     other.ImageData = t;
+    bool o = m_ownsData;
+    m_ownsData = other.m_ownsData;
+    other.m_ownsData = o;
+}
+
+// Makes the image a view of pixels owned elsewhere. The pixels are not freed
+// when the image is destroyed and must outlive it; Init() gives the image its
+// own buffer again.
+void usImage::AttachData(unsigned short *data, const wxSize& size)
+{
+    if (m_ownsData)
+        delete[] ImageData;
+    ImageData = data;
+    m_ownsData = false;
+    Size = size;
+    NPixels = size.GetWidth() * size.GetHeight();
+    Subframe = wxRect(0, 0, 0, 0);
+    m_area = wxRect(size);
+    m_scratchArea = wxRect(size);
+    Min = Max = 0;
+}
+
+static void ZeroArea(unsigned short *buf, const wxSize& size, const wxRect& area)
+{
+    wxRect r = area.Intersect(wxRect(size));
+    for (int y = r.GetTop(); y <= r.GetBottom(); y++)
+        memset(buf + y * size.GetWidth() + r.GetLeft(), 0, r.GetWidth() * sizeof(unsigned short));
+}
+
+// Sets the subframe of a frame the camera is about to fill, zeroing the pixels
+// outside of it. Only the area written by the previous frame is cleared, so
+// capturing the same subframe over and over does not touch the rest of the
+// sensor buffer.
+void usImage::InitSubframe(const wxRect& subframe)
+{
+    Subframe = subframe;
+    if (!subframe.Contains(m_area))
+        ZeroArea(ImageData, Size, m_area);
+    m_area = subframe;
+}
+
+// Returns a work buffer of NPixels pixels. The buffer is only reallocated when
+// the frame geometry changes.
+unsigned short *usImage::ScratchData(void)
+{
+    if (m_scratchPixels != NPixels)
+    {
+        delete[] m_scratch;
+        m_scratch = NPixels ? new unsigned short[NPixels] : NULL;
+        m_scratchPixels = NPixels;
+    }
+    m_scratchArea = wxRect(Size); // the caller may write anywhere
+    return m_scratch;
+}
+
+// Returns the work buffer with the pixels outside the subframe set to zero, for
+// filters that only write the subframe
+unsigned short *usImage::ScratchData(const wxRect& subframe)
+{
+    wxRect prevArea = m_scratchPixels == NPixels ? m_scratchArea : wxRect(Size);
+    unsigned short *scratch = ScratchData();
+    if (scratch && !subframe.Contains(prevArea))
+        ZeroArea(scratch, Size, prevArea);
+    m_scratchArea = subframe;
+    return scratch;
+}
+
+// Makes the scratch buffer the image data, for filters that write their output
+// to ScratchData()
+void usImage::SwapScratchData(void)
+{
+    assert(m_scratchPixels == NPixels);
+    assert(m_ownsData);
+    unsigned short *t = ImageData;
+    ImageData = m_scratch;
+    m_scratch = t;
+    m_scratchArea = Subframe.IsEmpty() ? wxRect(Size) : Subframe;
+}
+
+// Subframe is left alone: it tells the next Init() which part of the pixel
+// buffer holds data
+void usImage::ResetMetadata(void)
+{
+    Min = Max = FiltMin = FiltMax = 0;
+    ImgStartTime = 0;
+    ImgExposureStart = 0;
+    ImgExpDur = 0;
+    ImgStackCnt = 1;
+    BitsPerPixel = 0;
+    Pedestal = 0;
+    BinFactor = 1;
+    Latency.Reset();
+    Rendering.valid = false;
 }
 
 void usImage::CalcStats()
@@ -81,196 +197,295 @@ void usImage::CalcStats()
     Min = 65535; Max = 0;
     FiltMin = 65535; FiltMax = 0;
 
+    // the median filter writes to the scratch buffer, at the same offsets as
+    // the source pixels, so the subframe does not need to be copied out first
+
     if (Subframe.IsEmpty())
     {
         // full frame, no subframe
 
-        const unsigned short *src;
-
-        src = ImageData;
-        for (int i = 0; i < NPixels; i++)
-        {
-            int d = (int) *src++;
-            if (d < Min) Min = d;
-            if (d > Max) Max = d;
-        }
-
-        unsigned short *tmpdata = new unsigned short[NPixels];
+        PixelMinMax(ImageData, NPixels, &Min, &Max);
 
-        Median3(tmpdata, ImageData, Size, wxRect(Size));
+        unsigned short *filtered = ScratchData();
+        Median3(filtered, ImageData, Size, wxRect(Size));
 
-        src = tmpdata;
-        for (int i = 0; i < NPixels; i++)
-        {
-            int d = (int) *src++;
-            if (d < FiltMin) FiltMin = d;
-            if (d > FiltMax) FiltMax = d;
-        }
-
-        delete[] tmpdata;
+        PixelMinMax(filtered, NPixels, &FiltMin, &FiltMax);
     }
     else
     {
         // Subframe
 
-        unsigned int pixcnt = Subframe.width * Subframe.height;
-        unsigned short *tmpdata = new unsigned short[pixcnt];
-
-        unsigned short *dst;
-
-        dst = tmpdata;
         for (int y = 0; y < Subframe.height; y++)
         {
             const unsigned short *src = ImageData + Subframe.x + (Subframe.y + y) * Size.GetWidth();
-            for (int x = 0; x < Subframe.width; x++)
-            {
-               int d = (int) *src;
-               if (d < Min) Min = d;
-               if (d > Max) Max = d;
-               *dst++ = *src++;
-            }
+            PixelMinMax(src, Subframe.width, &Min, &Max);
         }
 
-        dst = new unsigned short[pixcnt];
-
-        Median3(dst, tmpdata, Subframe.GetSize(), wxRect(Subframe.GetSize()));
+        unsigned short *filtered = ScratchData(Subframe);
+        Median3(filtered, ImageData, Size, Subframe);
 
-        const unsigned short *src = dst;
-        for (unsigned int i = 0; i < pixcnt; i++)
+        for (int y = 0; y < Subframe.height; y++)
         {
-            int d = (int) *src++;
-            if (d < FiltMin) FiltMin = d;
-            if (d > FiltMax) FiltMax = d;
+            const unsigned short *src = filtered + Subframe.x + (Subframe.y + y) * Size.GetWidth();
+            PixelMinMax(src, Subframe.width, &FiltMin, &FiltMax);
         }
-
-        delete[] dst;
-        delete[] tmpdata;
     }
 }
 
-bool usImage::CopyToImage(wxImage **rawimg, int blevel, int wlevel, double power)
+// Maps 16-bit pixel values to display levels for a given black level, white
+// level and gamma. Consecutive frames are usually displayed with the same
+// stretch, so the table is only rebuilt when the stretch parameters change.
+struct StretchLUT
 {
-    wxImage *img = *rawimg;
+    bool valid;
+    int blevel;
+    int wlevel;
+    double power;
+    unsigned char map[65536];
+
+    StretchLUT() : valid(false) { }
+    const unsigned char *Get(int blevel, int wlevel, double power);
+};
 
-    if (!img || !img->Ok() || (img->GetWidth() != Size.GetWidth()) || (img->GetHeight() != Size.GetHeight()) ) // can't reuse bitmap
-    {
-        delete img;
-        img = new wxImage(Size.GetWidth(), Size.GetHeight(), false);
-    }
+const unsigned char *StretchLUT::Get(int blevel_, int wlevel_, double power_)
+{
+    if (valid && blevel_ == blevel && wlevel_ == wlevel && power_ == power)
+        return map;
 
-    unsigned char *ImgPtr = img->GetData();
-    unsigned short *RawPtr = ImageData;
+    blevel = blevel_;
+    wlevel = wlevel_;
+    power = power_;
+    valid = true;
 
     if (power == 1.0 || blevel >= wlevel)
     {
         float range = (float) wxMax(1, wlevel);  // Go 0-max
-        for (int i = 0; i < NPixels; i++, RawPtr++)
+        int const white = wxMin(wxMax(1, wlevel), 65536);
+        for (int i = 0; i < white; i++)
         {
-            float d;
-            if (*RawPtr >= range)
-                d = 255.0;
-            else
-                d = ((float) (*RawPtr) / range) * 255.0;
-
-            *ImgPtr++ = (unsigned char) d;
-            *ImgPtr++ = (unsigned char) d;
-            *ImgPtr++ = (unsigned char) d;
+            float d = ((float) i / range) * 255.0;
+            map[i] = (unsigned char) d;
         }
+        memset(map + white, 255, 65536 - white);
     }
     else
     {
         float range = (float) (wlevel - blevel);
-        for (int i = 0; i < NPixels; i++, RawPtr++ )
+        int const black = wxMin(wxMax(blevel + 1, 0), 65536);
+        int const white = wxMin(wxMax(wlevel, black), 65536);
+        memset(map, 0, black);
+        for (int i = black; i < white; i++)
+        {
+            float d = ((float) i - (float) blevel) / range;
+            d = pow(d, (float) power) * 255.0;
+            map[i] = (unsigned char) d;
+        }
+        memset(map + white, 255, 65536 - white);
+    }
+
+    return map;
+}
+
+static wxCriticalSection s_stretchLock;
+static StretchLUT s_stretch;
+
+struct StretchJob : public RowBandJob
+{
+    const usImage& src;
+    unsigned char *dst;
+    wxRect area;
+    const unsigned char *lut;
+
+    StretchJob(const usImage& src_, unsigned char *dst_, const wxRect& area_, const unsigned char *lut_)
+        : src(src_), dst(dst_), area(area_), lut(lut_) { }
+
+    void Run(int, int y0, int y1)
+    {
+        int const W = src.Size.GetWidth();
+        for (int y = y0; y < y1; y++)
         {
-            float d;
-            if (*RawPtr <= blevel)
-                d = 0.0;
-            else if (*RawPtr >= wlevel)
-                d = 255.0;
-            else
+            const unsigned short *RawPtr = src.ImageData + y * W + area.GetLeft();
+            unsigned char *ImgPtr = dst + 3 * (y * W + area.GetLeft());
+            for (int x = 0; x < area.GetWidth(); x++)
             {
-                d = ((float) (*RawPtr) - (float) blevel) / range;
-                d = pow(d, (float) power) * 255.0;
+                unsigned char const d = lut[*RawPtr++];
+                *ImgPtr++ = d;
+                *ImgPtr++ = d;
+                *ImgPtr++ = d;
             }
-            *ImgPtr++ = (unsigned char) d;
-            *ImgPtr++ = (unsigned char) d;
-            *ImgPtr++ = (unsigned char) d;
         }
     }
+};
+
+// Converts the image to an RGB wxImage, reusing *rawimg when it has the right size.
+//
+// For a frame with a subframe only the subframe is converted. If drawnArea is
+// given, it holds the area of *rawimg drawn by the previous call, and is
+// updated with the area drawn now; stale pixels from the previous call are
+// blanked only where they fall outside the new subframe.
+bool usImage::CopyToImage(wxImage **rawimg, int blevel, int wlevel, double power, wxRect *drawnArea)
+{
+    wxImage *img = *rawimg;
+    wxRect const area = Subframe.IsEmpty() ? wxRect(Size) : Subframe;
+    wxRect prevArea;
+
+    if (!img || !img->Ok() || (img->GetWidth() != Size.GetWidth()) || (img->GetHeight() != Size.GetHeight()) ) // can't reuse bitmap
+    {
+        delete img;
+        // a new image only needs clearing if part of it is not drawn
+        img = new wxImage(Size.GetWidth(), Size.GetHeight(), !Subframe.IsEmpty());
+    }
+    else
+    {
+        prevArea = drawnArea ? *drawnArea : wxRect(Size);
+    }
+
+    unsigned char *const data = img->GetData();
+    int const W = Size.GetWidth();
+
+    if (!area.Contains(prevArea))
+    {
+        wxRect r = prevArea.Intersect(wxRect(Size));
+        for (int y = r.GetTop(); y <= r.GetBottom(); y++)
+            memset(data + 3 * (y * W + r.GetLeft()), 0, 3 * r.GetWidth());
+    }
+
+    {
+        wxCriticalSectionLocker lock(s_stretchLock);
+        StretchJob job(*this, data, area, s_stretch.Get(blevel, wlevel, power));
+        RunRowBands(job, RowBandCount(area.GetHeight()), area.GetTop(), area.GetBottom() + 1);
+    }
+
+    if (drawnArea)
+        *drawnArea = area;
 
     *rawimg = img;
     return false;
 }
 
-bool usImage::BinnedCopyToImage(wxImage **rawimg, int blevel, int wlevel, double power)
+// Each display pixel gets the mean of the frame pixels it covers. The columns
+// covered by each display column are the same on every row, so they are
+// computed once.
+struct ScaledStretchJob : public RowBandJob
 {
-    wxImage *img;
-    unsigned char *ImgPtr;
-    unsigned short *RawPtr;
-    int x,y;
-    float d;
-    //, s_factor;
-    int full_xsize, full_ysize;
-    int use_xsize, use_ysize;
-
-    full_xsize = Size.GetWidth();
-    full_ysize = Size.GetHeight();
-    use_xsize = full_xsize;
-    use_ysize = full_ysize;
-    if (use_xsize % 2) use_xsize--;
-    if (use_ysize % 2) use_ysize--;
-//  Binsize = 2;
-
-    img = *rawimg;
-    if ((!img->Ok()) || (img->GetWidth() != (full_xsize/2)) || (img->GetHeight() != (full_ysize/2)) ) {  // can't reuse bitmap
-        if (img->Ok()) {
-            delete img;  // Clear out current image if it exists
-            img = (wxImage *) NULL;
-        }
-        img = new wxImage(full_xsize/2, full_ysize/2, false);
-    }
-    ImgPtr = img->GetData();
-    RawPtr = ImageData;
-//  s_factor = (((float) Max - (float) Min) / 255.0);
-    float range = (float) (wlevel - blevel);
-
-    if ((power == 1.0) || (range == 0.0)) {
-        range = wlevel;  // Go 0-max
-        if (range == 0.0) range = 0.001;
-        for (y=0; y<use_ysize; y+=2) {
-            for (x=0; x<use_xsize; x+=2) {
-                RawPtr = ImageData + x + y*full_xsize;
-                d = (float) (*RawPtr + *(RawPtr+1) + *(RawPtr+full_xsize) + *(RawPtr+1+full_xsize)) / 4.0;
-                d = (d / range) * 255.0;
-                if (d < 0.0) d = 0.0;
-                else if (d > 255.0) d = 255.0;
-                *ImgPtr = (unsigned char) d;
-                ImgPtr++;
-                *ImgPtr = (unsigned char) d;
-                ImgPtr++;
-                *ImgPtr = (unsigned char) d;
-                ImgPtr++;
+    const usImage& src;
+    unsigned char *dst;
+    wxSize size;
+    const std::vector<int>& xb;     // display column x covers frame columns [xb[x], xb[x + 1])
+    const unsigned char *lut;
+
+    ScaledStretchJob(const usImage& src_, unsigned char *dst_, const wxSize& size_, const std::vector<int>& xb_,
+                     const unsigned char *lut_)
+        : src(src_), dst(dst_), size(size_), xb(xb_), lut(lut_) { }
+
+    void Run(int, int y0, int y1)
+    {
+        int const W = src.Size.GetWidth();
+        int const H = src.Size.GetHeight();
+        int const DW = size.GetWidth();
+        int const DH = size.GetHeight();
+        std::vector<wxUint64> sum(DW);
+
+        for (int y = y0; y < y1; y++)
+        {
+            int const sy0 = (int)((wxUint64) y * H / DH);
+            int const sy1 = (int)((wxUint64)(y + 1) * H / DH);
+
+            std::fill(sum.begin(), sum.end(), 0);
+            for (int sy = sy0; sy < sy1; sy++)
+            {
+                const unsigned short *row = src.ImageData + sy * W;
+                for (int x = 0; x < DW; x++)
+                {
+                    wxUint64 s = 0;
+                    for (int sx = xb[x]; sx < xb[x + 1]; sx++)
+                        s += row[sx];
+                    sum[x] += s;
+                }
+            }
+
+            unsigned char *ImgPtr = dst + 3 * y * DW;
+            for (int x = 0; x < DW; x++)
+            {
+                unsigned int const n = (xb[x + 1] - xb[x]) * (sy1 - sy0);
+                unsigned char const d = lut[sum[x] / n];
+                *ImgPtr++ = d;
+                *ImgPtr++ = d;
+                *ImgPtr++ = d;
             }
         }
     }
-    else {
-        for (y=0; y<use_ysize; y+=2) {
-            for (x=0; x<use_xsize; x+=2) {
-                RawPtr = ImageData + x + y*full_xsize;
-                d = (float) (*RawPtr + *(RawPtr+1) + *(RawPtr+full_xsize) + *(RawPtr+1+full_xsize)) / 4.0;
-                d = (d - (float) blevel) / range ;
-                if (d < 0.0) d= 0.0;
-                else if (d > 1.0) d = 1.0;
-                d = pow(d, (float) power) * 255.0;
-                *ImgPtr = (unsigned char) d;
-                ImgPtr++;
-                *ImgPtr = (unsigned char) d;
-                ImgPtr++;
-                *ImgPtr = (unsigned char) d;
-                ImgPtr++;
-            }
+};
+
+// Converts the image to an RGB wxImage of the given size, which must not be
+// larger than the image, reusing *rawimg when it has that size. The whole frame
+// is drawn.
+bool usImage::ScaledCopyToImage(wxImage **rawimg, const wxSize& size, int blevel, int wlevel, double power) const
+{
+    wxImage *img = *rawimg;
+
+    if (!img || !img->Ok() || img->GetSize() != size)
+    {
+        delete img;
+        img = new wxImage(size, false);
+    }
+
+    std::vector<int> xb(size.GetWidth() + 1);
+    for (int x = 0; x <= size.GetWidth(); x++)
+        xb[x] = (int)((wxUint64) x * Size.GetWidth() / size.GetWidth());
+
+    {
+        wxCriticalSectionLocker lock(s_stretchLock);
+        ScaledStretchJob job(*this, img->GetData(), size, xb, s_stretch.Get(blevel, wlevel, power));
+        // the work is proportional to the frame rows, but bands are made of display rows
+        int nbands = std::min(RowBandCount(Size.GetHeight()), size.GetHeight());
+        RunRowBands(job, std::max(nbands, 1), 0, size.GetHeight());
+    }
+
+    *rawimg = img;
+    return false;
+}
+
+bool usImage::BinnedCopyToImage(wxImage **rawimg, int blevel, int wlevel, double power)
+{
+    int const full_xsize = Size.GetWidth();
+    int const full_ysize = Size.GetHeight();
+
+    wxImage *img = *rawimg;
+    if (!img || !img->Ok() || (img->GetWidth() != (full_xsize/2)) || (img->GetHeight() != (full_ysize/2)) ) // can't reuse bitmap
+    {
+        delete img;
+        img = new wxImage(full_xsize/2, full_ysize/2, !Subframe.IsEmpty());
+    }
+
+    // only the 2x2 bins that lie entirely within the subframe are drawn
+    wxRect area = Subframe.IsEmpty() ? wxRect(Size) : Subframe;
+    int const x0 = (area.GetLeft() + 1) / 2;
+    int const y0 = (area.GetTop() + 1) / 2;
+    int const x1 = (area.GetRight() + 1) / 2;
+    int const y1 = (area.GetBottom() + 1) / 2;
+    int const bw = full_xsize / 2;
+
+    if (!Subframe.IsEmpty())
+        memset(img->GetData(), 0, 3 * bw * (full_ysize / 2));
+
+    wxCriticalSectionLocker lock(s_stretchLock);
+    const unsigned char *lut = s_stretch.Get(blevel, wlevel, power);
+
+    for (int y = y0; y < y1; y++)
+    {
+        const unsigned short *RawPtr = ImageData + 2 * x0 + 2 * y * full_xsize;
+        unsigned char *ImgPtr = img->GetData() + 3 * (y * bw + x0);
+        for (int x = x0; x < x1; x++, RawPtr += 2)
+        {
+            unsigned int sum = RawPtr[0] + RawPtr[1] + RawPtr[full_xsize] + RawPtr[full_xsize + 1];
+            unsigned char const d = lut[sum >> 2];
+            *ImgPtr++ = d;
+            *ImgPtr++ = d;
+            *ImgPtr++ = d;
         }
     }
+
     *rawimg = img;
     return false;
 }
@@ -278,6 +493,7 @@ bool usImage::BinnedCopyToImage(wxImage **rawimg, int blevel, int wlevel, double
 void usImage::InitImgStartTime()
 {
     ImgStartTime = wxDateTime::GetTimeNow();
+    ImgExposureStart = ::wxGetUTCTimeMillis();
 }
 
 wxString usImage::GetImgStartTime() const
@@ -347,7 +563,7 @@ bool usImage::Save(const wxString& fname, const wxString& hdrNote) const
         if (pCamera)
         {
             hdr.write("INSTRUME", pCamera->Name.c_str(), "Instrument name");
-            unsigned int b = pCamera->Binning;
+            unsigned int b = pCamera->Binning * BinFactor;
             hdr.write("XBINNING", b, "Camera X Bin");
             hdr.write("YBINNING", b, "Camera Y Bin");
             hdr.write("CCDXBIN", b, "Camera X Bin");
@@ -493,6 +709,7 @@ bool usImage::CopyFrom(const usImage& src)
     if (Init(src.Size))
         return true;
     memcpy(ImageData, src.ImageData, NPixels * sizeof(unsigned short));
+    BinFactor = src.BinFactor;
     return false;
 }
 
@@ -535,3 +752,68 @@ bool usImage::CopyFromImage(const wxImage& img)
 
     return false;
 }
+
+static wxCriticalSection s_poolLock;
+static std::vector<usImage *> s_pool;
+static unsigned int s_poolHits;
+static unsigned int s_poolMisses;
+
+usImage *usImagePool::Acquire(void)
+{
+    unsigned int misses;
+
+    {
+        wxCriticalSectionLocker lock(s_poolLock);
+        if (!s_pool.empty())
+        {
+            usImage *img = s_pool.back();
+            s_pool.pop_back();
+            ++s_poolHits;
+            return img;
+        }
+        misses = ++s_poolMisses;
+    }
+
+    Debug.Write(wxString::Format("image pool miss %u, allocating a new frame\n", misses));
+
+    return new usImage();
+}
+
+void usImagePool::Release(usImage *img)
+{
+    if (!img)
+        return;
+
+    img->ResetMetadata();
+
+    {
+        wxCriticalSectionLocker lock(s_poolLock);
+        if (s_pool.size() < POOL_SIZE)
+        {
+            s_pool.push_back(img);
+            return;
+        }
+    }
+
+    delete img;
+}
+
+void usImagePool::Purge(void)
+{
+    std::vector<usImage *> pool;
+
+    {
+        wxCriticalSectionLocker lock(s_poolLock);
+        pool.swap(s_pool);
+    }
+
+    for (std::vector<usImage *>::iterator it = pool.begin(); it != pool.end(); ++it)
+        delete *it;
+}
+
+void usImagePool::GetCounters(unsigned int *hits, unsigned int *misses)
+{
+    wxCriticalSectionLocker lock(s_poolLock);
+    *hits = s_poolHits;
+    *misses = s_poolMisses;
+}
@@ -35,6 +35,43 @@
 #ifndef USIMAGECLASS
 #define USIMAGECLASS
 
+// How frames are shown in the guider window
+struct DisplayOptions
+{
+    wxSize              winSize;
+    bool                scaleImage;     // scale the frame to fit the window
+    double              gamma;
+
+    DisplayOptions() : scaleImage(false), gamma(0.0) { }
+    bool operator==(const DisplayOptions& rhs) const
+    {
+        return winSize == rhs.winSize && scaleImage == rhs.scaleImage && gamma == rhs.gamma;
+    }
+};
+
+// A frame converted to an 8-bit image for the guider window
+struct FrameRendering
+{
+    wxImage            *image;
+    wxRect              area;           // part of image drawn from the frame
+    DisplayOptions      options;        // what the frame was rendered for
+    double              scale;          // display pixels per frame pixel
+    bool                valid;
+
+    FrameRendering() : image(NULL), scale(1.0), valid(false) { }
+    ~FrameRendering() { delete image; }
+    void Swap(FrameRendering& other);
+};
+
+inline void FrameRendering::Swap(FrameRendering& other)
+{
+    std::swap(image, other.image);
+    std::swap(area, other.area);
+    std::swap(options, other.options);
+    std::swap(scale, other.scale);
+    std::swap(valid, other.valid);
+}
+
 class usImage
 {
 public:
@@ -46,31 +83,47 @@ public:
     int                 Max;
     int                 FiltMin, FiltMax;
     time_t              ImgStartTime;
+    wxLongLong          ImgExposureStart; // wxGetUTCTimeMillis() at the start of the exposure
     int                 ImgExpDur;
     int                 ImgStackCnt;
     wxByte              BitsPerPixel;
     unsigned short      Pedestal;
+    int                 BinFactor;      // sensor pixels per frame pixel when the frame was binned in software
+    FrameLatency        Latency;        // stage timestamps while the frame goes through the guide loop
+    FrameRendering      Rendering;      // made by the worker thread so that painting the frame is a blit
 
     usImage() {
         Min = Max = FiltMin = FiltMax = 0;
         NPixels = 0;
         ImageData = NULL;
         ImgStartTime = 0;
+        ImgExposureStart = 0;
         ImgExpDur = 0;
         ImgStackCnt = 1;
         BitsPerPixel = 0;
         Pedestal = 0;
+        BinFactor = 1;
+        m_scratch = NULL;
+        m_scratchPixels = 0;
+        m_ownsData = true;
     }
-    ~usImage() { delete[] ImageData; }
+    ~usImage() { if (m_ownsData) delete[] ImageData; delete[] m_scratch; }
 
     bool                Init(const wxSize& size);
     bool                Init(int width, int height) { return Init(wxSize(width, height)); }
     void                SwapImageData(usImage& other);
+    void                AttachData(unsigned short *data, const wxSize& size);
+    bool                OwnsData(void) const { return m_ownsData; }
+    void                InitSubframe(const wxRect& subframe);
+    unsigned short     *ScratchData(void);
+    unsigned short     *ScratchData(const wxRect& subframe);
+    void                SwapScratchData(void);
     void                CalcStats();
     void                InitImgStartTime();
     wxString            GetImgStartTime() const;
     bool                CopyFrom(const usImage& src);
-    bool                CopyToImage(wxImage **img, int blevel, int wlevel, double power);
+    bool                CopyToImage(wxImage **img, int blevel, int wlevel, double power, wxRect *drawnArea = NULL);
+    bool                ScaledCopyToImage(wxImage **img, const wxSize& size, int blevel, int wlevel, double power) const;
     bool                BinnedCopyToImage(wxImage **img, int blevel, int wlevel, double power); // Does 2x2 bin during copy
     bool                CopyFromImage(const wxImage& img);
     bool                Load(const wxString& fname);
@@ -79,11 +132,56 @@ public:
     unsigned short&     Pixel(int x, int y) { return ImageData[y * Size.x + x]; }
     const unsigned short& Pixel(int x, int y) const { return ImageData[y * Size.x + x]; }
     void                Clear(void);
+
+    // Conversions between frame pixels and the full-resolution sensor pixels
+    // that star positions are reported in. Coordinates refer to pixel centers.
+    double              SensorCoord(double frameCoord) const { return frameCoord * BinFactor + (BinFactor - 1) * 0.5; }
+    double              FrameCoord(double sensorCoord) const { return (sensorCoord - (BinFactor - 1) * 0.5) / BinFactor; }
+    wxSize              SensorSize(void) const { return Size * BinFactor; }
+
+private:
+    friend class usImagePool;
+
+    // frame-sized work buffer for the filters, kept across frames so that
+    // processing a recycled frame does not allocate
+    unsigned short     *m_scratch;
+    int                 m_scratchPixels;
+
+    // the parts of the pixel and scratch buffers that may hold non-zero pixels,
+    // so that subframe captures only need to clear what a previous frame wrote
+    wxRect              m_area;
+    wxRect              m_scratchArea;
+
+    // false when ImageData points into memory owned by someone else, such as
+    // the mapped dark library cache
+    bool                m_ownsData;
+
+    void                ResetMetadata(void);
 };
 
 inline void usImage::Clear(void)
 {
     memset(ImageData, 0, NPixels * sizeof(unsigned short));
+    m_area = wxRect();
 }
 
+/*
+ * A fixed-size pool of frames shared by the capture and guide loop.
+ *
+ * Frames handed back with Release() keep their pixel and scratch buffers, so
+ * once the pool is warm, acquiring a frame of the same geometry as the
+ * previous one does not touch the heap. Frames in excess of the pool size are
+ * deleted on release.
+ */
+class usImagePool
+{
+public:
+    enum { POOL_SIZE = 4 };
+
+    static usImage *Acquire(void);
+    static void Release(usImage *img);
+    static void Purge(void);
+    static void GetCounters(unsigned int *hits, unsigned int *misses);
+};
+
 #endif
@@ -35,11 +35,19 @@
 
 #include "phd.h"
 
+#include <wx/tls.h>
+
+// wxThread::This() may be any kind of thread, so the WorkerThread and the
+// interrupt flags of the running code are kept per thread
+static wxTLS_TYPE(WorkerThread *) s_thisWorker;
+static wxTLS_TYPE(volatile unsigned int *) s_interruptFlags;
+
 WorkerThread::WorkerThread(MyFrame *pFrame)
     : wxThread(wxTHREAD_JOINABLE),
       m_interruptRequested(0),
       m_killable(true),
-      m_skipSendExposeComplete(false)
+      m_skipSendExposeComplete(false),
+      m_pendingMoves(0)
 {
     m_pFrame = pFrame;
     Debug.Write("WorkerThread constructor called\n");
@@ -104,6 +112,22 @@ void WorkerThread::EnqueueWorkerThreadExposeRequest(usImage *pImage, int exposur
     EnqueueMessage(message);
 }
 
+WorkerThread *WorkerThread::This(void)
+{
+    return wxTLS_VALUE(s_thisWorker);
+}
+
+unsigned int WorkerThread::InterruptRequested(void)
+{
+    volatile unsigned int *flags = wxTLS_VALUE(s_interruptFlags);
+    return flags ? *flags : 0;
+}
+
+void WorkerThread::SetInterruptFlags(volatile unsigned int *flags)
+{
+    wxTLS_VALUE(s_interruptFlags) = flags;
+}
+
 unsigned int WorkerThread::MilliSleep(int ms, unsigned int checkInterrupts)
 {
     enum { MAX_SLEEP = 100 };
@@ -115,13 +139,12 @@ unsigned int WorkerThread::MilliSleep(int ms, unsigned int checkInterrupts)
         return WorkerThread::InterruptRequested() & checkInterrupts;
     }
 
-    WorkerThread *thr = WorkerThread::This();
     wxStopWatch swatch;
 
     long elapsed = 0;
     do {
         wxMilliSleep(wxMin((long) ms - elapsed, (long) MAX_SLEEP));
-        unsigned int val = thr ? (thr->m_interruptRequested & checkInterrupts) : 0;
+        unsigned int val = WorkerThread::InterruptRequested() & checkInterrupts;
         if (val)
             return val;
         elapsed = swatch.Time();
@@ -147,37 +170,59 @@ bool WorkerThread::HandleExpose(EXPOSE_REQUEST *req)
             throw ERROR_INFO("Time lapse interrupted");
         }
 
+        // with software binning the camera captures into a full-resolution
+        // buffer so that dark subtraction and defect removal see sensor pixels,
+        // and the binned frame goes into the request's image
+        SOFTWARE_BINNING binning = m_pFrame->GetSoftwareBinning();
+        int binFactor = SoftwareBinFactor(binning);
+        usImage *pCaptured = binFactor > 1 ? &m_binSource : req->pImage;
+
         if (pCamera->HasNonGuiCapture())
         {
             Debug.Write(wxString::Format("Handling exposure in thread, d=%d o=%x r=(%d,%d,%d,%d)\n", req->exposureDuration,
                                          req->options, req->subframe.x, req->subframe.y, req->subframe.width, req->subframe.height));
 
-            if (GuideCamera::Capture(pCamera, req->exposureDuration, *req->pImage, req->options, req->subframe))
+            if (GuideCamera::Capture(pCamera, req->exposureDuration, *pCaptured, req->options, req->subframe))
             {
                 throw ERROR_INFO("Capture failed");
             }
+
+            req->pImage->Latency.Stamp(LAT_CAPTURED);
         }
         else
         {
             Debug.Write(wxString::Format("Handling exposure in myFrame, d=%d o=%x r=(%d,%d,%d,%d)\n", req->exposureDuration,
                                          req->options, req->subframe.x, req->subframe.y, req->subframe.width, req->subframe.height));
 
+            EXPOSE_REQUEST captureReq(*req);
+            captureReq.pImage = pCaptured;
+
             wxSemaphore semaphore;
-            req->pSemaphore = &semaphore;
+            captureReq.pSemaphore = &semaphore;
 
             wxCommandEvent evt(REQUEST_EXPOSURE_EVENT, GetId());
-            evt.SetClientData(req);
+            evt.SetClientData(&captureReq);
             wxQueueEvent(m_pFrame, evt.Clone());
 
             // wait for the request to complete
-            req->pSemaphore->Wait();
+            captureReq.pSemaphore->Wait();
 
-            bError = req->error;
-            req->pSemaphore = NULL;
+            bError = captureReq.error;
+            req->error = bError;
+
+            req->pImage->Latency.Stamp(LAT_CAPTURED);
         }
 
         Debug.Write("Exposure complete\n");
 
+        if (!bError && binFactor > 1)
+        {
+            if (SoftwareBin(*req->pImage, m_binSource, binFactor, SoftwareBinMean(binning)))
+            {
+                throw ERROR_INFO("Software binning failed");
+            }
+        }
+
         if (!bError)
         {
             switch (m_pFrame->GetNoiseReductionMethod())
@@ -193,6 +238,12 @@ bool WorkerThread::HandleExpose(EXPOSE_REQUEST *req)
             }
 
             req->pImage->CalcStats();
+
+            // convert the frame for display here rather than when it is
+            // painted on the main thread
+            Guider::RenderForDisplay(req->pImage);
+
+            req->pImage->Latency.Stamp(LAT_PROCESSED);
         }
     }
     catch (const wxString& Msg)
@@ -214,7 +265,8 @@ void WorkerThread::SendWorkerThreadExposeComplete(usImage *pImage, bool bError)
 
 /*************      Move       **************************/
 
-void WorkerThread::EnqueueWorkerThreadMoveRequest(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType)
+void WorkerThread::EnqueueWorkerThreadMoveRequest(Mount *mount, const PHD_Point& vectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure,
+    const FrameLatency *latency)
 {
     m_interruptRequested &= ~INT_STOP;
 
@@ -228,8 +280,12 @@ void WorkerThread::EnqueueWorkerThreadMoveRequest(Mount *mount, const PHD_Point&
     message.args.move.calibrationMove = false;
     message.args.move.vectorEndpoint  = vectorEndpoint;
     message.args.move.moveType        = moveType;
+    message.args.move.exposure        = exposure;
+    if (latency)
+        message.args.move.latency     = *latency;
     message.args.move.pSemaphore      = NULL;
 
+    wxAtomicInc(m_pendingMoves);
     EnqueueMessage(message);
 }
 
@@ -250,6 +306,7 @@ void WorkerThread::EnqueueWorkerThreadMoveRequest(Mount *mount, const GUIDE_DIRE
     message.args.move.moveType        = MOVETYPE_DIRECT;
     message.args.move.pSemaphore      = NULL;
 
+    wxAtomicInc(m_pendingMoves);
     EnqueueMessage(message);
 }
 
@@ -280,7 +337,18 @@ Mount::MOVE_RESULT WorkerThread::HandleMove(MOVE_REQUEST *pArgs)
                 Debug.Write(wxString::Format("endpoint = (%.2f, %.2f)\n",
                     pArgs->vectorEndpoint.X, pArgs->vectorEndpoint.Y));
 
-                result = pArgs->pMount->Move(pArgs->vectorEndpoint, pArgs->moveType);
+                pArgs->latency.Stamp(LAT_MOVE_STARTED);
+
+                result = pArgs->pMount->Move(pArgs->vectorEndpoint, pArgs->moveType, pArgs->exposure);
+
+                // the move may have ended without a pulse, e.g. with a zero correction
+                long long pulseStart = pArgs->pMount->LastPulse().startTicks;
+                if (pulseStart >= pArgs->latency.t[LAT_MOVE_STARTED])
+                {
+                    pArgs->latency.t[LAT_PULSE_STARTED] = pulseStart;
+                    LatencyStats::Add(pArgs->latency);
+                }
+
                 if (result != Mount::MOVE_OK)
                 {
                     throw ERROR_INFO("Move failed");
@@ -342,6 +410,9 @@ wxThread::ExitCode WorkerThread::Entry()
 
     Debug.Write("WorkerThread::Entry() begins\n");
 
+    wxTLS_VALUE(s_thisWorker) = this;
+    SetInterruptFlags(&m_interruptRequested);
+
 #if defined(__WINDOWS__)
     HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
     Debug.Write(wxString::Format("worker thread CoInitializeEx returns %x\n", hr));
@@ -383,7 +454,7 @@ wxThread::ExitCode WorkerThread::Entry()
                 if (m_skipSendExposeComplete)
                 {
                     Debug.Write("worker thread skipping SendWorkerThreadExposeComplete\n");
-                    delete message.args.expose.pImage; // should be null though
+                    usImagePool::Release(message.args.expose.pImage);
                     message.args.expose.pImage = 0;
                     m_skipSendExposeComplete = false;
                 }
@@ -396,6 +467,7 @@ wxThread::ExitCode WorkerThread::Entry()
                     message.args.move.pMount->GetMountClassName(), message.args.move.direction,
                     message.args.move.vectorEndpoint.X, message.args.move.vectorEndpoint.Y));
                 Mount::MOVE_RESULT moveResult = HandleMove(&message.args.move);
+                wxAtomicDec(m_pendingMoves);
                 SendWorkerThreadMoveComplete(message.args.move.pMount, moveResult);
                 break;
             }
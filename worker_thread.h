@@ -36,6 +36,8 @@
 #ifndef WORKER_THREAD_H_INCLUDED
 #define WORKER_THREAD_H_INCLUDED
 
+#include <wx/atomic.h>
+
 class MyFrame;
 
 /*
@@ -75,6 +77,8 @@ struct MOVE_REQUEST
     MountMoveType      moveType;
     Mount::MOVE_RESULT moveResult;
     PHD_Point          vectorEndpoint;
+    ExposureWindow     exposure;
+    FrameLatency       latency;
     wxSemaphore       *pSemaphore;
 };
 
@@ -110,6 +114,8 @@ class WorkerThread : public wxThread
     wxMessageQueue<WORKER_THREAD_REQUEST> m_highPriorityQueue;
     wxMessageQueue<WORKER_THREAD_REQUEST> m_lowPriorityQueue;
     bool m_skipSendExposeComplete;
+    wxAtomicInt m_pendingMoves;     // move requests queued or in progress
+    usImage m_binSource;            // full-resolution capture buffer when binning in software
 
 public:
 
@@ -126,8 +132,14 @@ public:
     WorkerThread(MyFrame *pFrame);
     ~WorkerThread(void);
 
+    // the WorkerThread running the calling code, NULL on any other thread
     static WorkerThread *This(void);
 
+    // Lets another thread that captures frames, like the dark builder, stop
+    // the capture: the camera code running on the calling thread sees the bits
+    // set in *flags through InterruptRequested(). NULL to unregister.
+    static void SetInterruptFlags(volatile unsigned int *flags);
+
 private:
     wxThread::ExitCode Entry();
 
@@ -180,8 +192,10 @@ protected:
 
     /*************      Guide       **************************/
 public:
-    void EnqueueWorkerThreadMoveRequest(Mount *pMount, const PHD_Point& vectorEndpoint, MountMoveType moveType);
+    void EnqueueWorkerThreadMoveRequest(Mount *pMount, const PHD_Point& vectorEndpoint, MountMoveType moveType, const ExposureWindow& exposure,
+        const FrameLatency *latency = NULL);
     void EnqueueWorkerThreadMoveRequest(Mount *pMount, const GUIDE_DIRECTION direction, int duration);
+    bool MovesPending(void) const;
 protected:
     Mount::MOVE_RESULT HandleMove(MOVE_REQUEST *pArgs);
     void SendWorkerThreadMoveComplete(Mount *pMount, Mount::MOVE_RESULT moveResult);
@@ -195,15 +209,9 @@ inline void WorkerThread::RequestStop(void)
     m_interruptRequested |= INT_STOP;
 }
 
-inline WorkerThread *WorkerThread::This(void)
-{
-    return static_cast<WorkerThread *>(wxThread::This());
-}
-
-inline unsigned int WorkerThread::InterruptRequested(void)
+inline bool WorkerThread::MovesPending(void) const
 {
-    WorkerThread *thr = WorkerThread::This();
-    return thr ? thr->m_interruptRequested : 0;
+    return m_pendingMoves != 0;
 }
 
 inline unsigned int WorkerThread::StopRequested(void)